@@ -0,0 +1,719 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#include "BuildServer.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <Catalog.h>
+#include <DataIO.h>
+#include <Entry.h>
+#include <Locale.h>
+#include <Looper.h>
+#include <Message.h>
+#include <Messenger.h>
+#include <Path.h>
+
+#include "DebugTools.h"
+#include "ErrorParser.h"
+#include "FileUtils.h"
+#include "Globals.h"
+#include "Project.h"
+#include "ProjectBuilder.h"
+#include "SourceFile.h"
+#include "StatCache.h"
+
+// The same strings are printed by the application itself
+#undef B_TRANSLATION_CONTEXT
+#define B_TRANSLATION_CONTEXT "Paladin"
+
+enum
+{
+	M_SERVER_BUILD = 'srvb'
+};
+
+// Requests are small, so anything bigger than this isn't one
+#define MAX_REQUEST_SIZE 65536
+
+// A loaded project and the builder which builds it. The builder's messages
+// are turned into text here and sent to the client which asked for the build.
+class ServerProject : public BLooper
+{
+public:
+						ServerProject(Project *project, time_t modified);
+						~ServerProject(void);
+
+			void		MessageReceived(BMessage *msg);
+
+			int			Build(int output, const BMessage &request);
+
+			Project *	GetProject(void) const { return fProject; }
+			time_t		Modified(void) const { return fModified; }
+
+private:
+			void		Write(const BString &text);
+			void		BuildDone(int status);
+			void		FilesChanged(BMessage *msg);
+
+	Project				*fProject;
+	ProjectBuilder		*fBuilder;
+	time_t				fModified;
+
+	int					fOutput;
+	int					fStatus;
+	sem_id				fDone;
+};
+
+
+static bool
+send_data(int socket, const void *data, size_t size)
+{
+	const char *buffer = (const char*)data;
+	while (size > 0)
+	{
+		ssize_t bytes = send(socket,buffer,size,MSG_NOSIGNAL);
+		if (bytes < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		buffer += bytes;
+		size -= bytes;
+	}
+	return true;
+}
+
+
+static void
+send_result(int socket, int status)
+{
+	char end[2] = { 0, (char)status };
+	send_data(socket,end,sizeof(end));
+}
+
+
+static time_t
+modification_time(const char *path)
+{
+	struct stat s;
+	if (stat(path,&s) != 0)
+		return 0;
+	return s.st_mtime;
+}
+
+
+BString
+DescribeBuildMessage(BMessage *msg)
+{
+	BString text;
+	switch (msg->what)
+	{
+		case M_BUILDING_FILE:
+		{
+			SourceFile *file;
+			if (msg->FindPointer("sourcefile",(void**)&file) == B_OK)
+				text.SetToFormat(B_TRANSLATE("Building %s\n"),
+								file->GetPath().GetFileName());
+			else
+				text = B_TRANSLATE("NULL pointer in M_BUILDING_FILE\n");
+			break;
+		}
+		case M_LINKING_PROJECT:
+		{
+			text = B_TRANSLATE("Linking\n");
+			break;
+		}
+		case M_UPDATING_RESOURCES:
+		{
+			text = B_TRANSLATE("Updating resources\n");
+			break;
+		}
+		case M_BUILD_FAILURE:
+		{
+			BString errstr;
+			if (msg->FindString("errstr",&errstr) == B_OK)
+				text << errstr << "\n";
+			else
+			{
+				ErrorList errors;
+				errors.Unflatten(*msg);
+				text.SetToFormat(B_TRANSLATE("Build failure\n%s"),
+								errors.AsString().String());
+			}
+			break;
+		}
+		case M_BUILD_WARNINGS:
+		{
+			BString errstr;
+			if (msg->FindString("errstr",&errstr) == B_OK)
+				text << errstr << "\n";
+			else
+			{
+				// Messages arrive as each file is done, so they are printed
+				// right away rather than all at the end
+				ErrorList errors;
+				errors.Unflatten(*msg);
+				text = errors.AsString();
+			}
+			break;
+		}
+		case M_BUILD_SUCCESS:
+		{
+			BString reason;
+			if (msg->FindString("linkskipped",&reason) == B_OK)
+				text.SetToFormat(B_TRANSLATE("Link skipped: %s\n"),reason.String());
+
+			int32 hits, misses;
+			if (msg->FindInt32("cachehits",&hits) == B_OK
+				&& msg->FindInt32("cachemisses",&misses) == B_OK)
+			{
+				BString stats;
+				stats.SetToFormat(B_TRANSLATE("Object cache: %ld hits, %ld misses\n"),
+								(long)hits,(long)misses);
+				text << stats;
+			}
+			text << B_TRANSLATE("Success\n");
+			break;
+		}
+		default:
+			break;
+	}
+	return text;
+}
+
+
+ServerProject::ServerProject(Project *project, time_t modified)
+	:	BLooper("build server project"),
+		fProject(project),
+		fBuilder(NULL),
+		fModified(modified),
+		fOutput(-1),
+		fStatus(0)
+{
+	fDone = create_sem(0,"build server build done");
+	fBuilder = new ProjectBuilder(BMessenger(this));
+
+	// Whatever changes between builds is marked right away, so a build after
+	// the first one doesn't have to go looking for it
+	gStatCache.AddListener(BMessenger(this));
+}
+
+
+ServerProject::~ServerProject(void)
+{
+	gStatCache.RemoveListener(BMessenger(this));
+	delete fBuilder;
+	delete fProject;
+	delete_sem(fDone);
+}
+
+
+void
+ServerProject::MessageReceived(BMessage *msg)
+{
+	switch (msg->what)
+	{
+		case M_BUILDING_FILE:
+		case M_LINKING_PROJECT:
+		case M_UPDATING_RESOURCES:
+		case M_BUILD_WARNINGS:
+		{
+			Write(DescribeBuildMessage(msg));
+			break;
+		}
+		case M_BUILD_FAILURE:
+		{
+			Write(DescribeBuildMessage(msg));
+			BuildDone(-1);
+			break;
+		}
+		case M_BUILD_SUCCESS:
+		{
+			Write(DescribeBuildMessage(msg));
+			BuildDone(0);
+			break;
+		}
+		case M_WATCHED_FILES_CHANGED:
+		{
+			FilesChanged(msg);
+			break;
+		}
+		default:
+			BLooper::MessageReceived(msg);
+	}
+}
+
+
+int
+ServerProject::Build(int output, const BMessage &request)
+{
+	// A build which failed may still be winding down
+	while (fBuilder->IsBuilding())
+		snooze(10000);
+
+	if (request.GetBool("clean",false))
+		fProject->ForceRebuild();
+
+	Lock();
+	fOutput = output;
+	fStatus = -1;
+	Unlock();
+
+	// The options only matter while the build is being set up, so they are
+	// put back right away for the builds of the rest of the application
+	bool keepGoing = gKeepGoing;
+	bool singleThreaded = gSingleThreadedBuild;
+	bool traceBuild = gTraceBuild;
+	gKeepGoing = keepGoing || request.GetBool("keepgoing",false);
+	gSingleThreadedBuild = singleThreaded
+		|| request.GetBool("singlethreaded",false);
+	gTraceBuild = traceBuild || request.GetBool("trace",false);
+
+	fBuilder->BuildProject(fProject,POSTBUILD_NOTHING);
+
+	gKeepGoing = keepGoing;
+	gSingleThreadedBuild = singleThreaded;
+	gTraceBuild = traceBuild;
+
+	while (acquire_sem(fDone) == B_INTERRUPTED)
+		;
+
+	// Building may save the project, which doesn't make it one which has to
+	// be loaded again
+	fModified = modification_time(fProject->GetPath().GetFullPath());
+	return fStatus;
+}
+
+
+void
+ServerProject::Write(const BString &text)
+{
+	if (fOutput < 0 || text.Length() == 0)
+		return;
+
+	// A client which went away doesn't stop the build. What it would have
+	// been told is just dropped.
+	if (!send_data(fOutput,text.String(),text.Length()))
+		STRACE(1,("Build server lost its client\n"));
+}
+
+
+void
+ServerProject::BuildDone(int status)
+{
+	// Anything which arrives after the end of a build belongs to nobody
+	if (fOutput < 0)
+		return;
+
+	fOutput = -1;
+	fStatus = status;
+	release_sem(fDone);
+}
+
+
+void
+ServerProject::FilesChanged(BMessage *msg)
+{
+	BObjectList<SourceFile> dirtied(20,false);
+
+	fProject->Lock();
+	if (msg->GetBool("lost",false))
+		fProject->SetChangesTracked(false);
+
+	const char *path;
+	for (int32 i = 0; msg->FindString("path",i,&path) == B_OK; i++)
+		fProject->FileChanged(path,dirtied);
+	fProject->Unlock();
+}
+
+
+BuildServer::BuildServer(void)
+	:	fSocket(-1),
+		fThread(-1),
+		fProjects(20,false)
+{
+}
+
+
+BuildServer::~BuildServer(void)
+{
+	Stop();
+}
+
+
+BString
+BuildServer::SocketPath(void)
+{
+	BString path("/tmp/Paladin-build-server-");
+	path << (int32)getuid();
+	return path;
+}
+
+
+status_t
+BuildServer::Start(void)
+{
+	if (fSocket >= 0)
+		return B_OK;
+
+	BString path = SocketPath();
+	struct sockaddr_un address;
+	if ((size_t)path.Length() >= sizeof(address.sun_path))
+		return B_NAME_TOO_LONG;
+	memset(&address,0,sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path,path.String());
+
+	int server = socket(AF_UNIX,SOCK_STREAM,0);
+	if (server < 0)
+		return errno;
+
+	// A socket which is left over from a server which didn't quit properly is
+	// taken over. One which is still answered belongs to another server.
+	if (connect(server,(struct sockaddr*)&address,sizeof(address)) == 0)
+	{
+		close(server);
+		return B_BUSY;
+	}
+	close(server);
+	unlink(path.String());
+
+	server = socket(AF_UNIX,SOCK_STREAM,0);
+	if (server < 0)
+		return errno;
+
+	if (bind(server,(struct sockaddr*)&address,sizeof(address)) != 0
+		|| chmod(path.String(),0600) != 0
+		|| listen(server,8) != 0)
+	{
+		status_t status = errno;
+		close(server);
+		unlink(path.String());
+		return status;
+	}
+
+	fSocket = server;
+	fThread = spawn_thread(ListenThread,"build server",B_NORMAL_PRIORITY,this);
+	if (fThread < 0)
+	{
+		status_t status = fThread;
+		Stop();
+		return status;
+	}
+	resume_thread(fThread);
+
+	STRACE(1,("Build server listening on %s\n",path.String()));
+	return B_OK;
+}
+
+
+void
+BuildServer::Stop(void)
+{
+	if (fSocket >= 0)
+	{
+		// Waking up the listening thread this way makes it quit
+		int server = fSocket;
+		fSocket = -1;
+		shutdown(server,SHUT_RDWR);
+		close(server);
+		unlink(SocketPath().String());
+	}
+
+	if (fThread >= 0)
+	{
+		status_t result;
+		wait_for_thread(fThread,&result);
+		fThread = -1;
+	}
+
+	for (int32 i = 0; i < fProjects.CountItems(); i++)
+	{
+		ServerProject *project = fProjects.ItemAt(i);
+		project->Lock();
+		project->Quit();
+	}
+	fProjects.MakeEmpty();
+}
+
+
+int32
+BuildServer::ListenThread(void *data)
+{
+	((BuildServer*)data)->Listen();
+	return 0;
+}
+
+
+void
+BuildServer::Listen(void)
+{
+	while (fSocket >= 0)
+	{
+		int client = accept(fSocket,NULL,NULL);
+		if (client < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		// Clients which don't send their request in a reasonable time aren't
+		// allowed to hold up the ones waiting behind them
+		struct timeval timeout;
+		timeout.tv_sec = 10;
+		timeout.tv_usec = 0;
+		setsockopt(client,SOL_SOCKET,SO_RCVTIMEO,&timeout,sizeof(timeout));
+
+		ServeClient(client);
+		close(client);
+	}
+}
+
+
+void
+BuildServer::ServeClient(int client)
+{
+	// The client stops writing once the whole request has been sent
+	BMallocIO data;
+	char buffer[4096];
+	ssize_t bytes;
+	while ((bytes = recv(client,buffer,sizeof(buffer),0)) > 0)
+	{
+		if (data.Position() + bytes > MAX_REQUEST_SIZE)
+			return;
+		data.Write(buffer,bytes);
+	}
+
+	BMessage request;
+	if (bytes < 0 || data.BufferLength() == 0
+		|| request.Unflatten((const char*)data.Buffer()) != B_OK
+		|| request.what != M_SERVER_BUILD)
+		return;
+
+	BString error;
+	ServerProject *project = ProjectFor(request,error);
+	if (!project)
+	{
+		send_data(client,error.String(),error.Length());
+		send_result(client,-1);
+		return;
+	}
+
+	send_result(client,project->Build(client,request));
+}
+
+
+ServerProject *
+BuildServer::ProjectFor(const BMessage &request, BString &error)
+{
+	BString name;
+	if (request.FindString("project",&name) != B_OK)
+		return NULL;
+
+	// Projects are found the same way as when they are given to the
+	// application itself, only relative to the folder of the client
+	if (name.FindLast(".pld") != name.CountChars() - 4)
+		name << ".pld";
+
+	BString path(name);
+	BString folder;
+	if (path.ByteAt(0) != '/' && request.FindString("folder",&folder) == B_OK)
+		path.Prepend("/").Prepend(folder);
+
+	entry_ref ref;
+	BEntry entry(path.String());
+	if (entry.Exists())
+		entry.GetRef(&ref);
+	else
+	{
+		BEntry projfolder(gProjectPath.GetFullPath());
+		entry_ref projref;
+		projfolder.GetRef(&projref);
+		ref = FindProject(projref,name.String());
+		if (!ref.name)
+		{
+			error.SetToFormat(B_TRANSLATE("Can't find file %s\n"),name.String());
+			return NULL;
+		}
+	}
+
+	if (!Project::IsProject(ref))
+	{
+		error.SetToFormat(B_TRANSLATE("%s is not a Paladin project\n"),ref.name);
+		return NULL;
+	}
+
+	BPath projectPath(&ref);
+	time_t modified = modification_time(projectPath.Path());
+	for (int32 i = 0; i < fProjects.CountItems(); i++)
+	{
+		ServerProject *project = fProjects.ItemAt(i);
+		if (strcmp(project->GetProject()->GetPath().GetFullPath(),
+				projectPath.Path()) != 0)
+			continue;
+
+		if (project->Modified() == modified)
+			return project;
+
+		// The project was changed since it was loaded
+		fProjects.RemoveItemAt(i);
+		project->Lock();
+		project->Quit();
+		break;
+	}
+
+	Project *proj = new Project;
+	if (proj->Load(projectPath.Path()) != B_OK)
+	{
+		error.SetToFormat(B_TRANSLATE("Couldn't load %s\n"),projectPath.Path());
+		delete proj;
+		return NULL;
+	}
+
+	if (proj->IsReadOnly())
+	{
+		error = B_TRANSLATE(
+			"%path% is on a read-only disk. Please copy the project to another disk "
+			"or remount the disk with write support to be able to build it.\n");
+		error.ReplaceFirst("%path%",projectPath.Path());
+		delete proj;
+		return NULL;
+	}
+
+	ServerProject *project = new ServerProject(proj,modified);
+	project->Run();
+	fProjects.AddItem(project);
+	return project;
+}
+
+
+static int
+connect_to_server(void)
+{
+	BString path = BuildServer::SocketPath();
+	struct sockaddr_un address;
+	if ((size_t)path.Length() >= sizeof(address.sun_path))
+		return -1;
+	memset(&address,0,sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path,path.String());
+
+	int server = socket(AF_UNIX,SOCK_STREAM,0);
+	if (server < 0)
+		return -1;
+
+	if (connect(server,(struct sockaddr*)&address,sizeof(address)) != 0)
+	{
+		close(server);
+		return -1;
+	}
+	return server;
+}
+
+
+bool
+BuildOnServer(int argc, char **argv, int &status)
+{
+	BMessage request(M_SERVER_BUILD);
+	bool build = false;
+	int i;
+	for (i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		if (strlen(arg) != 2 || arg[0] != '-')
+			break;
+
+		switch (arg[1])
+		{
+			case 'b':
+				build = true;
+				break;
+			case 'r':
+				build = true;
+				request.AddBool("clean",true);
+				break;
+			case 's':
+				request.AddBool("singlethreaded",true);
+				break;
+			case 'k':
+				request.AddBool("keepgoing",true);
+				break;
+			case 't':
+				request.AddBool("trace",true);
+				break;
+			default:
+				// Anything else is left to the application itself
+				return false;
+		}
+	}
+
+	if (!build || i >= argc)
+		return false;
+
+	request.AddString("project",argv[i]);
+	char folder[B_PATH_NAME_LENGTH];
+	if (getcwd(folder,sizeof(folder)))
+		request.AddString("folder",folder);
+
+	int server = connect_to_server();
+	if (server < 0)
+		return false;
+
+	ssize_t size = request.FlattenedSize();
+	char *flattened = new char[size];
+	bool sent = request.Flatten(flattened,size) == B_OK
+		&& send_data(server,flattened,size);
+	delete [] flattened;
+	if (!sent)
+	{
+		close(server);
+		return false;
+	}
+	shutdown(server,SHUT_WR);
+
+	// Everything up to the zero byte is output of the build. The status
+	// comes right after it.
+	status = -1;
+	bool done = false;
+	char buffer[4096];
+	ssize_t bytes;
+	while (!done && (bytes = recv(server,buffer,sizeof(buffer),0)) != 0)
+	{
+		if (bytes < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		char *end = (char*)memchr(buffer,0,bytes);
+		fwrite(buffer,1,end ? end - buffer : bytes,stdout);
+		fflush(stdout);
+		if (!end)
+			continue;
+
+		done = true;
+		char code;
+		if (end + 1 < buffer + bytes)
+			status = (signed char)end[1];
+		else if (recv(server,&code,1,0) == 1)
+			status = (signed char)code;
+		else
+			done = false;
+	}
+	close(server);
+
+	if (!done)
+		printf(B_TRANSLATE("Lost the connection to the build server\n"));
+	return true;
+}
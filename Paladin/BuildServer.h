@@ -0,0 +1,57 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef BUILD_SERVER_H
+#define BUILD_SERVER_H
+
+#include <ObjectList.h>
+#include <OS.h>
+#include <String.h>
+
+class BMessage;
+class ServerProject;
+
+// Builds projects for command line invocations of Paladin, which hand them
+// over through a local socket instead of loading everything themselves.
+//
+// The projects stay loaded between requests, along with their dependencies,
+// and their files are watched through the stat cache. Once a project has been
+// built, later builds only have to compile what changed in the meantime. A
+// project is loaded again when its file has been changed.
+//
+// Requests are handled one at a time, in the order in which they come in.
+// Everything the build prints is sent back to the client, followed by a zero
+// byte and the exit status of the build.
+class BuildServer
+{
+public:
+						BuildServer(void);
+						~BuildServer(void);
+
+	status_t			Start(void);
+	void				Stop(void);
+
+	static	BString		SocketPath(void);
+
+private:
+	static	int32		ListenThread(void *data);
+			void		Listen(void);
+			void		ServeClient(int client);
+			ServerProject *	ProjectFor(const BMessage &request, BString &error);
+
+	int					fSocket;
+	thread_id			fThread;
+	BObjectList<ServerProject>	fProjects;
+};
+
+// Hands a build given on the command line to a running build server and
+// prints what it sends back. Returns false if there is no server or the
+// arguments ask for something other than a build.
+bool	BuildOnServer(int argc, char **argv, int &status);
+
+// The text printed for the messages a ProjectBuilder sends during a command
+// line build
+BString	DescribeBuildMessage(BMessage *msg);
+
+#endif
@@ -1,6 +1,21 @@
 #include "BuildInfo.h"
 
 BuildInfo::BuildInfo(void)
-	:	includeList(20,true)
+	:	includeList(20,true),
+		dependencyStore(NULL)
 {
 }
+
+
+BuildInfo::BuildInfo(const BuildInfo &from)
+	:	projectFolder(from.projectFolder),
+		objectFolder(from.objectFolder),
+		includeList(20,true),
+		includeString(from.includeString),
+		dependencyStore(from.dependencyStore)
+{
+	// The error list is not copied. Copies are made to give each build
+	// thread a list of its own.
+	for (int32 i = 0; i < from.includeList.CountItems(); i++)
+		includeList.AddItem(new ProjectPath(*from.includeList.ItemAt(i)));
+}
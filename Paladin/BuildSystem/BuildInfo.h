@@ -8,10 +8,13 @@
 #include "ObjectList.h"
 #include "ProjectPath.h"
 
+class DependencyStore;
+
 class BuildInfo
 {
 public:
 							BuildInfo(void);
+							BuildInfo(const BuildInfo &from);
 	
 	DPath					projectFolder;
 	DPath					objectFolder;
@@ -20,6 +23,8 @@ public:
 	BString						includeString;
 	
 	ErrorList				errorList;
+	
+	DependencyStore			*dependencyStore;
 };
 
 #endif
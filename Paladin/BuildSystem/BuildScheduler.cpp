@@ -0,0 +1,327 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#include "BuildScheduler.h"
+
+#include <algorithm>
+
+#include <stdlib.h>
+
+#include <Autolock.h>
+#include <File.h>
+
+#include "DebugTools.h"
+#include "SourceFile.h"
+#include "TextFile.h"
+
+static bool
+compare_jobs(const scheduled_job &a, const scheduled_job &b)
+{
+	return a.cost > b.cost;
+}
+
+
+WorkerQueue::WorkerQueue(void)
+	:	lock("worker queue lock")
+{
+}
+
+
+BuildScheduler::BuildScheduler(void)
+	:	fLock("build scheduler lock"),
+		fQueues(20,true),
+		fJobSem(-1),
+		fOpen(false),
+		fJobCount(0),
+		fKnownTime(0),
+		fKnownSize(0),
+		fHistoryChanged(false)
+{
+}
+
+
+BuildScheduler::~BuildScheduler(void)
+{
+	if (fJobSem >= 0)
+		delete_sem(fJobSem);
+}
+
+
+void
+BuildScheduler::LoadHistory(const char *objectFolder)
+{
+	BAutolock lock(fLock);
+
+	fHistory.clear();
+	fHistoryChanged = false;
+
+	fHistoryPath = objectFolder;
+	fHistoryPath << "/buildtimes";
+
+	TextFile file(fHistoryPath.String(),B_READ_ONLY);
+	if (file.InitCheck() != B_OK)
+		return;
+
+	// Each line is the compile time in microseconds followed by the full path
+	// of the source file
+	BString line = file.ReadLine();
+	while (line.CountChars() > 0)
+	{
+		int32 pos = line.FindFirst(" ");
+		if (pos > 0)
+		{
+			BString path = line.String() + pos + 1;
+			line.Truncate(pos);
+			bigtime_t duration = strtoll(line.String(),NULL,10);
+			if (duration > 0 && path.CountChars() > 0)
+				fHistory[path] = duration;
+		}
+		line = file.ReadLine();
+	}
+
+	STRACE(2,("Loaded %ld compile times from %s\n",(long)fHistory.size(),
+			fHistoryPath.String()));
+}
+
+
+void
+BuildScheduler::SaveHistory(void)
+{
+	BAutolock lock(fLock);
+
+	if (!fHistoryChanged || fHistoryPath.CountChars() == 0)
+		return;
+
+	BString data;
+	std::map<BString, bigtime_t>::iterator i;
+	for (i = fHistory.begin(); i != fHistory.end(); i++)
+		data << i->second << " " << i->first << "\n";
+
+	BFile file(fHistoryPath.String(),B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
+	if (file.InitCheck() != B_OK)
+	{
+		STRACE(2,("Couldn't write compile times to %s\n",fHistoryPath.String()));
+		return;
+	}
+	file.Write(data.String(),data.Length());
+	fHistoryChanged = false;
+}
+
+
+void
+BuildScheduler::Open(int32 workerCount)
+{
+	if (workerCount < 1)
+		workerCount = 1;
+
+	BAutolock lock(fLock);
+
+	// None of the build threads are running yet, so any wakeups left over
+	// from the last build can go along with the semaphore
+	if (fJobSem >= 0)
+		delete_sem(fJobSem);
+	fJobSem = create_sem(0,"build scheduler jobs");
+
+	fQueues.MakeEmpty();
+	for (int32 i = 0; i < workerCount; i++)
+		fQueues.AddItem(new WorkerQueue());
+
+	fOpen = true;
+	fJobCount = 0;
+	fKnownTime = 0;
+	fKnownSize = 0;
+}
+
+
+void
+BuildScheduler::AddJob(SourceFile *file)
+{
+	if (!file)
+		return;
+
+	BAutolock lock(fLock);
+	if (!fOpen || fQueues.CountItems() == 0)
+		return;
+
+	scheduled_job job;
+	job.file = file;
+	job.cost = EstimateCost(file);
+
+	// Deal the jobs out like cards so that every thread gets started as soon
+	// as possible. Each queue is kept in order, so the longest of the jobs
+	// still waiting in it is the next one to go.
+	WorkerQueue *queue = fQueues.ItemAt(fJobCount % fQueues.CountItems());
+	fJobCount++;
+
+	queue->lock.Lock();
+	queue->jobs.insert(std::upper_bound(queue->jobs.begin(),queue->jobs.end(),
+										job,compare_jobs),job);
+	queue->lock.Unlock();
+
+	release_sem(fJobSem);
+}
+
+
+void
+BuildScheduler::Close(void)
+{
+	BAutolock lock(fLock);
+	if (!fOpen)
+		return;
+
+	fOpen = false;
+
+	// Wake up every thread waiting for work so it can find out there is none
+	release_sem_etc(fJobSem,fQueues.CountItems(),0);
+
+	STRACE(1,("Scheduled %ld jobs on %ld workers\n",(long)fJobCount,
+			(long)fQueues.CountItems()));
+}
+
+
+SourceFile *
+BuildScheduler::NextJob(int32 worker)
+{
+	// The queue list itself is only changed in Open(), before any of the
+	// build threads are running, so it can be read here without fLock
+	WorkerQueue *queue = fQueues.ItemAt(worker);
+	if (!queue)
+		return NULL;
+
+	while (true)
+	{
+		scheduled_job job;
+		queue->lock.Lock();
+		if (!queue->jobs.empty())
+		{
+			job = queue->jobs.front();
+			queue->jobs.pop_front();
+			queue->lock.Unlock();
+			return job.file;
+		}
+		queue->lock.Unlock();
+
+		if (StealJob(worker,job))
+			return job.file;
+
+		fLock.Lock();
+		bool open = fOpen;
+		fLock.Unlock();
+		if (!open)
+			return NULL;
+
+		// A job added in the meantime has released the semaphore already, so
+		// the timeout is only there in case of trouble
+		acquire_sem_etc(fJobSem,1,B_RELATIVE_TIMEOUT,100000);
+	}
+
+	return NULL;
+}
+
+
+void
+BuildScheduler::JobFinished(SourceFile *file, bigtime_t duration)
+{
+	if (!file || duration <= 0)
+		return;
+
+	BAutolock lock(fLock);
+	fHistory[BString(file->GetPath().GetFullPath())] = duration;
+	fHistoryChanged = true;
+}
+
+
+void
+BuildScheduler::Cancel(void)
+{
+	Close();
+
+	for (int32 i = 0; i < fQueues.CountItems(); i++)
+	{
+		WorkerQueue *queue = fQueues.ItemAt(i);
+		BAutolock lock(queue->lock);
+		queue->jobs.clear();
+	}
+}
+
+
+int32
+BuildScheduler::CountJobs(void)
+{
+	BAutolock lock(fLock);
+	return fJobCount;
+}
+
+
+bigtime_t
+BuildScheduler::EstimateCost(SourceFile *file)
+{
+	// Files which have never been built are estimated from their size, using
+	// the average compile speed of the jobs so far which have been
+	DPath path = file->GetPath();
+	struct stat s;
+	bool hasSize = file->GetStat(path.GetFullPath(),&s) == B_OK;
+
+	std::map<BString, bigtime_t>::iterator entry
+		= fHistory.find(BString(path.GetFullPath()));
+	if (entry != fHistory.end())
+	{
+		if (hasSize)
+		{
+			fKnownTime += entry->second;
+			fKnownSize += s.st_size;
+		}
+		return entry->second;
+	}
+
+	if (!hasSize)
+		return 0;
+
+	double costPerByte = 1.0;
+	if (fKnownTime > 0 && fKnownSize > 0)
+		costPerByte = (double)fKnownTime / (double)fKnownSize;
+
+	return (bigtime_t)(s.st_size * costPerByte);
+}
+
+
+bool
+BuildScheduler::StealJob(int32 thief, scheduled_job &job)
+{
+	int32 count = fQueues.CountItems();
+
+	while (true)
+	{
+		// Take the longest job waiting at the head of any other queue so that
+		// the critical path keeps moving even when the work was dealt unevenly
+		WorkerQueue *victim = NULL;
+		bigtime_t victimCost = -1;
+
+		for (int32 i = 1; i < count; i++)
+		{
+			WorkerQueue *queue = fQueues.ItemAt((thief + i) % count);
+			BAutolock lock(queue->lock);
+			if (!queue->jobs.empty() && queue->jobs.front().cost > victimCost)
+			{
+				victim = queue;
+				victimCost = queue->jobs.front().cost;
+			}
+		}
+
+		if (!victim)
+			return false;
+
+		BAutolock lock(victim->lock);
+		if (!victim->jobs.empty())
+		{
+			job = victim->jobs.front();
+			victim->jobs.pop_front();
+			return true;
+		}
+
+		// Someone else got there first, so look again
+	}
+
+	return false;
+}
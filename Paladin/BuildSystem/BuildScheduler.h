@@ -0,0 +1,79 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef BUILD_SCHEDULER_H
+#define BUILD_SCHEDULER_H
+
+#include <deque>
+#include <map>
+
+#include <Locker.h>
+#include <OS.h>
+#include <String.h>
+
+#include "ObjectList.h"
+
+class SourceFile;
+
+typedef struct
+{
+	SourceFile	*file;
+	bigtime_t	cost;
+} scheduled_job;
+
+// The queue owned by a single build thread. Each one has its own lock so that
+// a thread taking its next job only ever contends with a thread stealing from
+// it, never with the whole pool.
+class WorkerQueue
+{
+public:
+								WorkerQueue(void);
+
+	BLocker						lock;
+	std::deque<scheduled_job>	jobs;
+};
+
+// Hands out the files that need to be compiled to the build threads. Jobs are
+// ordered by their expected compile time, longest first, using the durations
+// recorded during earlier builds of the project. Each thread works through its
+// own queue and steals from the others once it runs dry.
+//
+// Jobs can be added for as long as the scheduler is open, which it is while
+// the project's files are still being examined. Until it is closed, a thread
+// without work waits for more instead of being told that there is none.
+class BuildScheduler
+{
+public:
+						BuildScheduler(void);
+						~BuildScheduler(void);
+
+			void		LoadHistory(const char *objectFolder);
+			void		SaveHistory(void);
+
+			void		Open(int32 workerCount);
+			void		AddJob(SourceFile *file);
+			void		Close(void);
+			SourceFile *NextJob(int32 worker);
+			void		JobFinished(SourceFile *file, bigtime_t duration);
+			void		Cancel(void);
+
+			int32		CountJobs(void);
+
+private:
+			bigtime_t	EstimateCost(SourceFile *file);
+			bool		StealJob(int32 thief, scheduled_job &job);
+
+	BLocker							fLock;
+	BObjectList<WorkerQueue>		fQueues;
+	sem_id							fJobSem;
+	bool							fOpen;
+	int32							fJobCount;
+	bigtime_t						fKnownTime;
+	off_t							fKnownSize;
+	std::map<BString, bigtime_t>	fHistory;
+	BString							fHistoryPath;
+	bool							fHistoryChanged;
+};
+
+#endif
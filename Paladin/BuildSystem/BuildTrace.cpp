@@ -0,0 +1,245 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#include "BuildTrace.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <Autolock.h>
+#include <File.h>
+#include <TLS.h>
+
+#include "DebugTools.h"
+
+static int32 sTraceSlot = tls_allocate();
+
+
+static void
+append_escaped(BString &out, const char *string)
+{
+	for (const char *p = string; *p; p++)
+	{
+		switch (*p)
+		{
+			case '"':
+				out << "\\\"";
+				break;
+			case '\\':
+				out << "\\\\";
+				break;
+			case '\n':
+				out << "\\n";
+				break;
+			case '\t':
+				out << "\\t";
+				break;
+			default:
+			{
+				if ((uint8)*p < 0x20)
+				{
+					char code[8];
+					sprintf(code,"\\u%04x",*p);
+					out << code;
+				}
+				else
+					out.Append(p,1);
+				break;
+			}
+		}
+	}
+}
+
+
+BuildTrace::BuildTrace(void)
+	:	fLock("build trace lock"),
+		fRecording(false),
+		fStartTime(0)
+{
+}
+
+
+BuildTrace::~BuildTrace(void)
+{
+}
+
+
+void
+BuildTrace::Start(void)
+{
+	BAutolock lock(fLock);
+	fEvents.clear();
+	fThreadNames.clear();
+	fStartTime = system_time();
+	fRecording = true;
+}
+
+
+status_t
+BuildTrace::Stop(const char *path)
+{
+	fLock.Lock();
+	if (!fRecording)
+	{
+		fLock.Unlock();
+		return B_OK;
+	}
+	fRecording = false;
+
+	std::vector<trace_event> events;
+	events.swap(fEvents);
+	std::map<thread_id, BString> names;
+	names.swap(fThreadNames);
+	fLock.Unlock();
+
+	BFile file(path,B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
+	status_t status = file.InitCheck();
+	if (status != B_OK)
+		return status;
+
+	// Written a piece at a time because a trace of a big project has a lot
+	// of events in it
+	pid_t pid = getpid();
+	BString data("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+	std::map<thread_id, BString>::iterator i;
+	for (i = names.begin(); i != names.end(); i++)
+	{
+		data << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": " << pid
+			<< ", \"tid\": " << i->first << ", \"args\": {\"name\": \"";
+		append_escaped(data,i->second.String());
+		data << "\"}},\n";
+	}
+
+	for (size_t j = 0; j < events.size(); j++)
+	{
+		trace_event &event = events[j];
+		data << "{\"ph\": \"X\", \"cat\": \"";
+		append_escaped(data,event.category.String());
+		data << "\", \"name\": \"";
+		append_escaped(data,event.name.String());
+		data << "\", \"pid\": " << pid << ", \"tid\": " << event.thread
+			<< ", \"ts\": " << event.start << ", \"dur\": " << event.duration;
+		if (event.args.Length() > 0)
+			data << ", \"args\": {" << event.args << "}";
+		data << "},\n";
+
+		if (data.Length() > 65536)
+		{
+			if (file.Write(data.String(),data.Length()) != data.Length())
+				return B_IO_ERROR;
+			data = "";
+		}
+	}
+
+	// A closing entry means the last real one can end with a comma like all
+	// of the others
+	data << "{\"ph\": \"M\", \"name\": \"process_name\", \"pid\": " << pid
+		<< ", \"args\": {\"name\": \"Paladin\"}}\n]}\n";
+	if (file.Write(data.String(),data.Length()) != data.Length())
+		return B_IO_ERROR;
+
+	STRACE(1,("Wrote %ld trace events to %s\n",(long)events.size(),path));
+	return B_OK;
+}
+
+
+bool
+BuildTrace::IsRecording(void)
+{
+	BAutolock lock(fLock);
+	return fRecording;
+}
+
+
+void
+BuildTrace::Attach(const char *threadName)
+{
+	tls_set(sTraceSlot,this);
+
+	BAutolock lock(fLock);
+	fThreadNames[find_thread(NULL)] = threadName;
+}
+
+
+void
+BuildTrace::Detach(void)
+{
+	tls_set(sTraceSlot,NULL);
+}
+
+
+BuildTrace *
+BuildTrace::Current(void)
+{
+	return (BuildTrace *)tls_get(sTraceSlot);
+}
+
+
+void
+BuildTrace::AddSpan(const char *category, const char *name, bigtime_t start,
+					bigtime_t end, const BString &args)
+{
+	BAutolock lock(fLock);
+	if (!fRecording)
+		return;
+
+	trace_event event;
+	event.category = category;
+	event.name = name;
+	event.args = args;
+	event.start = start - fStartTime;
+	event.duration = end - start;
+	event.thread = find_thread(NULL);
+	fEvents.push_back(event);
+}
+
+
+TraceSpan::TraceSpan(const char *category, const char *name)
+	:	fTrace(BuildTrace::Current()),
+		fCategory(category),
+		fStart(0)
+{
+	if (fTrace && !fTrace->IsRecording())
+		fTrace = NULL;
+
+	if (fTrace)
+	{
+		fName = name;
+		fStart = system_time();
+	}
+}
+
+
+TraceSpan::~TraceSpan(void)
+{
+	if (fTrace)
+		fTrace->AddSpan(fCategory,fName.String(),fStart,system_time(),fArgs);
+}
+
+
+void
+TraceSpan::AddArg(const char *key, const char *value)
+{
+	if (!fTrace)
+		return;
+
+	if (fArgs.Length() > 0)
+		fArgs << ", ";
+	fArgs << "\"" << key << "\": \"";
+	append_escaped(fArgs,value);
+	fArgs << "\"";
+}
+
+
+void
+TraceSpan::AddArg(const char *key, int64 value)
+{
+	if (!fTrace)
+		return;
+
+	if (fArgs.Length() > 0)
+		fArgs << ", ";
+	fArgs << "\"" << key << "\": " << value;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef BUILD_TRACE_H
+#define BUILD_TRACE_H
+
+#include <map>
+#include <vector>
+
+#include <Locker.h>
+#include <OS.h>
+#include <String.h>
+
+// Records what each thread of a build was doing and when, and writes it out
+// in the Chrome trace event format. The file can be loaded into
+// chrome://tracing or ui.perfetto.dev to see where the time went.
+//
+// Each thread which is part of a build attaches itself to the build's trace.
+// Anything it does after that, down to the processes it runs, ends up in that
+// trace without having to be handed the trace first.
+class BuildTrace
+{
+public:
+							BuildTrace(void);
+							~BuildTrace(void);
+
+			void			Start(void);
+			status_t		Stop(const char *path);
+			bool			IsRecording(void);
+
+			void			Attach(const char *threadName);
+	static	void			Detach(void);
+	static	BuildTrace *	Current(void);
+
+			void			AddSpan(const char *category, const char *name,
+									bigtime_t start, bigtime_t end,
+									const BString &args);
+
+private:
+	typedef struct
+	{
+		BString		category;
+		BString		name;
+		BString		args;
+		bigtime_t	start;
+		bigtime_t	duration;
+		thread_id	thread;
+	} trace_event;
+
+	BLocker							fLock;
+	bool							fRecording;
+	bigtime_t						fStartTime;
+	std::vector<trace_event>		fEvents;
+	std::map<thread_id, BString>	fThreadNames;
+};
+
+// Adds a span covering its own lifetime to the trace of the current thread,
+// if there is one
+class TraceSpan
+{
+public:
+							TraceSpan(const char *category, const char *name);
+							~TraceSpan(void);
+
+			void			AddArg(const char *key, const char *value);
+			void			AddArg(const char *key, int64 value);
+
+private:
+	BuildTrace				*fTrace;
+	const char				*fCategory;
+	BString					fName;
+	BString					fArgs;
+	bigtime_t				fStart;
+};
+
+#endif
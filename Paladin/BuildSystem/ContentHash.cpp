@@ -0,0 +1,199 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#include "ContentHash.h"
+
+#include <string.h>
+
+#include <Autolock.h>
+#include <File.h>
+
+static const uint64 kPrime1 = 11400714785074694791ULL;
+static const uint64 kPrime2 = 14029467366897019727ULL;
+static const uint64 kPrime3 = 1609587929392839161ULL;
+static const uint64 kPrime4 = 9650029242287828579ULL;
+static const uint64 kPrime5 = 2870177450012600261ULL;
+
+
+static inline uint64
+rotate_left(uint64 value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+
+static inline uint64
+read64(const uint8 *p)
+{
+	uint64 value;
+	memcpy(&value,p,sizeof(value));
+	return value;
+}
+
+
+static inline uint32
+read32(const uint8 *p)
+{
+	uint32 value;
+	memcpy(&value,p,sizeof(value));
+	return value;
+}
+
+
+static inline uint64
+hash_round(uint64 acc, uint64 input)
+{
+	acc += input * kPrime2;
+	acc = rotate_left(acc,31);
+	return acc * kPrime1;
+}
+
+
+static inline uint64
+hash_merge(uint64 acc, uint64 value)
+{
+	acc ^= hash_round(0,value);
+	return acc * kPrime1 + kPrime4;
+}
+
+
+uint64
+HashBuffer(const void *data, size_t length, uint64 seed)
+{
+	const uint8 *p = (const uint8*)data;
+	const uint8 *end = p + length;
+	uint64 hash;
+
+	if (length >= 32)
+	{
+		uint64 v1 = seed + kPrime1 + kPrime2;
+		uint64 v2 = seed + kPrime2;
+		uint64 v3 = seed;
+		uint64 v4 = seed - kPrime1;
+
+		const uint8 *limit = end - 32;
+		do
+		{
+			v1 = hash_round(v1,read64(p));
+			v2 = hash_round(v2,read64(p + 8));
+			v3 = hash_round(v3,read64(p + 16));
+			v4 = hash_round(v4,read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		hash = rotate_left(v1,1) + rotate_left(v2,7) + rotate_left(v3,12)
+			+ rotate_left(v4,18);
+		hash = hash_merge(hash,v1);
+		hash = hash_merge(hash,v2);
+		hash = hash_merge(hash,v3);
+		hash = hash_merge(hash,v4);
+	}
+	else
+		hash = seed + kPrime5;
+
+	hash += length;
+
+	while (p + 8 <= end)
+	{
+		hash ^= hash_round(0,read64(p));
+		hash = rotate_left(hash,27) * kPrime1 + kPrime4;
+		p += 8;
+	}
+
+	if (p + 4 <= end)
+	{
+		hash ^= (uint64)read32(p) * kPrime1;
+		hash = rotate_left(hash,23) * kPrime2 + kPrime3;
+		p += 4;
+	}
+
+	while (p < end)
+	{
+		hash ^= (*p) * kPrime5;
+		hash = rotate_left(hash,11) * kPrime1;
+		p++;
+	}
+
+	hash ^= hash >> 33;
+	hash *= kPrime2;
+	hash ^= hash >> 29;
+	hash *= kPrime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+
+status_t
+HashFile(const char *path, uint64 *hash)
+{
+	if (!path || !hash)
+		return B_BAD_VALUE;
+
+	BFile file(path,B_READ_ONLY);
+	status_t status = file.InitCheck();
+	if (status != B_OK)
+		return status;
+
+	off_t size;
+	status = file.GetSize(&size);
+	if (status != B_OK)
+		return status;
+
+	char *buffer = new char[size + 1];
+	ssize_t bytesRead = file.Read(buffer,size);
+	if (bytesRead == size)
+		*hash = HashBuffer(buffer,size);
+	else
+		status = (bytesRead < 0) ? bytesRead : B_IO_ERROR;
+
+	delete [] buffer;
+	return status;
+}
+
+
+HashCache::HashCache(void)
+	:	fLock("hash cache lock")
+{
+}
+
+
+HashCache::~HashCache(void)
+{
+}
+
+
+status_t
+HashCache::HashFor(const char *path, uint64 *hash)
+{
+	if (!path || !hash)
+		return B_BAD_VALUE;
+
+	BString key(path);
+
+	fLock.Lock();
+	std::map<BString, uint64>::iterator i = fHashes.find(key);
+	if (i != fHashes.end())
+	{
+		*hash = i->second;
+		fLock.Unlock();
+		return B_OK;
+	}
+	fLock.Unlock();
+
+	status_t status = HashFile(path,hash);
+	if (status != B_OK)
+		return status;
+
+	BAutolock lock(fLock);
+	fHashes[key] = *hash;
+	return B_OK;
+}
+
+
+void
+HashCache::MakeEmpty(void)
+{
+	BAutolock lock(fLock);
+	fHashes.clear();
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <map>
+
+#include <Locker.h>
+#include <String.h>
+
+// 64-bit XXH64 hash of a block of memory. It is not meant to be secure, just
+// fast and good enough to tell when a file's contents have changed.
+uint64		HashBuffer(const void *data, size_t length, uint64 seed = 0);
+status_t	HashFile(const char *path, uint64 *hash);
+
+// Remembers the hashes of the files read during a build so that a header
+// included by many source files is only hashed once
+class HashCache
+{
+public:
+						HashCache(void);
+						~HashCache(void);
+
+			status_t	HashFor(const char *path, uint64 *hash);
+			void		MakeEmpty(void);
+
+private:
+	BLocker						fLock;
+	std::map<BString, uint64>	fHashes;
+};
+
+#endif
@@ -0,0 +1,585 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#include "DependencyStore.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Autolock.h>
+#include <File.h>
+
+#include "DebugTools.h"
+
+#define DEP_STORE_MAGIC 'PDEP'
+#define DEP_STORE_VERSION 2
+
+typedef struct
+{
+	uint32					flags;
+	std::vector<BString>	deps;
+	std::vector<uint32>		dependents;
+	uint32					index;
+} build_node;
+
+
+static uint32
+hash_key(const char *key, uint32 length)
+{
+	// FNV-1a
+	uint32 hash = 2166136261UL;
+	for (uint32 i = 0; i < length; i++)
+	{
+		hash ^= (uint8)key[i];
+		hash *= 16777619UL;
+	}
+	return hash;
+}
+
+
+static build_node &
+node_for(std::map<BString, build_node> &nodes, const BString &key)
+{
+	std::map<BString, build_node>::iterator i = nodes.find(key);
+	if (i != nodes.end())
+		return i->second;
+
+	build_node &node = nodes[key];
+	node.flags = 0;
+	node.index = 0;
+	return node;
+}
+
+
+DependencyStore::DependencyStore(void)
+	:	fLock("dependency store lock"),
+		fFD(-1),
+		fData(NULL),
+		fDataSize(0),
+		fHeader(NULL)
+{
+}
+
+
+DependencyStore::~DependencyStore(void)
+{
+	Close();
+}
+
+
+status_t
+DependencyStore::Open(const char *path, const char *baseFolder)
+{
+	if (!path)
+		return B_BAD_VALUE;
+
+	BAutolock lock(fLock);
+
+	if (fPath.Length() > 0)
+		Close();
+
+	fPath = path;
+	fBase = baseFolder;
+	if (fBase.Length() > 0 && fBase[fBase.Length() - 1] != '/')
+		fBase << "/";
+
+	return Map();
+}
+
+
+void
+DependencyStore::Close(void)
+{
+	BAutolock lock(fLock);
+
+	if (fPath.Length() > 0)
+		Flush();
+
+	Unmap();
+	fChangedDeps.clear();
+	fPath = "";
+}
+
+
+status_t
+DependencyStore::Flush(void)
+{
+	BAutolock lock(fLock);
+
+	if (fPath.Length() == 0)
+		return B_NO_INIT;
+
+	if (fChangedDeps.empty())
+		return B_OK;
+
+	status_t status = WriteStore();
+	if (status != B_OK)
+		return status;
+
+	fChangedDeps.clear();
+
+	Unmap();
+	return Map();
+}
+
+
+bool
+DependencyStore::IsOpen(void) const
+{
+	return fPath.Length() > 0;
+}
+
+
+bool
+DependencyStore::HasDependencies(const char *path)
+{
+	BAutolock lock(fLock);
+
+	BString key = MakeKey(path);
+	if (fChangedDeps.find(key) != fChangedDeps.end())
+		return true;
+
+	int32 index = FindNode(key);
+	if (index < 0)
+		return false;
+
+	dep_store_node *nodes = (dep_store_node*)(fData + fHeader->nodeOffset);
+	return (nodes[index].flags & DEP_NODE_SCANNED) != 0;
+}
+
+
+bool
+DependencyStore::GetDependencies(const char *path, std::vector<BString> &out)
+{
+	BAutolock lock(fLock);
+
+	BString key = MakeKey(path);
+	std::map<BString, std::vector<BString> >::iterator changed
+		= fChangedDeps.find(key);
+	if (changed != fChangedDeps.end())
+	{
+		for (size_t i = 0; i < changed->second.size(); i++)
+		{
+			const BString &dep = changed->second[i];
+			out.push_back(MakePath(dep.String(),dep.Length()));
+		}
+		return true;
+	}
+
+	int32 index = FindNode(key);
+	if (index < 0)
+		return false;
+
+	dep_store_node *nodes = (dep_store_node*)(fData + fHeader->nodeOffset);
+	uint32 *edges = (uint32*)(fData + fHeader->edgeOffset);
+	const char *strings = (const char*)(fData + fHeader->stringOffset);
+
+	dep_store_node &node = nodes[index];
+	if ((node.flags & DEP_NODE_SCANNED) == 0)
+		return false;
+
+	for (uint32 i = 0; i < node.edgeCount; i++)
+	{
+		uint32 target = edges[node.firstEdge + i];
+		if (target >= fHeader->nodeCount || !ValidNode(&nodes[target]))
+			continue;
+		out.push_back(MakePath(strings + nodes[target].name,
+								nodes[target].nameLength));
+	}
+	return true;
+}
+
+
+void
+DependencyStore::SetDependencies(const char *path,
+								const std::vector<BString> &deps)
+{
+	BAutolock lock(fLock);
+
+	BString key = MakeKey(path);
+	std::vector<BString> keys;
+	for (size_t i = 0; i < deps.size(); i++)
+		keys.push_back(MakeKey(deps[i].String()));
+
+	// Don't queue up a rewrite of the store if nothing changed
+	std::vector<BString> current;
+	if (GetDependencies(path,current))
+	{
+		bool same = (current.size() == deps.size());
+		for (size_t i = 0; same && i < current.size(); i++)
+			same = (MakeKey(current[i].String()) == keys[i]);
+		if (same)
+			return;
+	}
+
+	fChangedDeps[key] = keys;
+}
+
+
+void
+DependencyStore::GetDependents(const char *path, std::vector<BString> &out)
+{
+	BAutolock lock(fLock);
+
+	BString key = MakeKey(path);
+
+	int32 index = FindNode(key);
+	if (index >= 0)
+	{
+		dep_store_node *nodes = (dep_store_node*)(fData + fHeader->nodeOffset);
+		uint32 *reverse = (uint32*)(fData + fHeader->reverseOffset);
+		const char *strings = (const char*)(fData + fHeader->stringOffset);
+
+		dep_store_node &node = nodes[index];
+		for (uint32 i = 0; i < node.reverseCount; i++)
+		{
+			uint32 source = reverse[node.firstReverse + i];
+			if (source >= fHeader->nodeCount || !ValidNode(&nodes[source]))
+				continue;
+
+			// Sources with pending changes are handled below
+			BString sourceKey(strings + nodes[source].name,
+							nodes[source].nameLength);
+			if (fChangedDeps.find(sourceKey) != fChangedDeps.end())
+				continue;
+
+			out.push_back(MakePath(sourceKey.String(),sourceKey.Length()));
+		}
+	}
+
+	std::map<BString, std::vector<BString> >::iterator i;
+	for (i = fChangedDeps.begin(); i != fChangedDeps.end(); i++)
+	{
+		for (size_t j = 0; j < i->second.size(); j++)
+		{
+			if (i->second[j] == key)
+			{
+				out.push_back(MakePath(i->first.String(),i->first.Length()));
+				break;
+			}
+		}
+	}
+}
+
+
+BString
+DependencyStore::MakeKey(const char *path) const
+{
+	BString key(path);
+	if (fBase.Length() > 0 && key.StartsWith(fBase.String()))
+		key.Remove(0,fBase.Length());
+	return key;
+}
+
+
+BString
+DependencyStore::MakePath(const char *key, uint32 length) const
+{
+	BString path(key,length);
+	if (path[0] != '/')
+		path.Prepend(fBase);
+	return path;
+}
+
+
+status_t
+DependencyStore::Map(void)
+{
+	fFD = open(fPath.String(),O_RDONLY);
+	if (fFD < 0)
+	{
+		// No store yet. That's fine -- it is created on the first Flush().
+		return B_OK;
+	}
+
+	struct stat s;
+	if (fstat(fFD,&s) != 0 || s.st_size < (off_t)sizeof(dep_store_header))
+	{
+		Unmap();
+		return B_OK;
+	}
+
+	void *data = mmap(NULL,s.st_size,PROT_READ,MAP_SHARED,fFD,0);
+	if (data == MAP_FAILED)
+	{
+		STRACE(1,("Couldn't map dependency store %s\n",fPath.String()));
+		Unmap();
+		return B_ERROR;
+	}
+
+	fData = (uint8*)data;
+	fDataSize = s.st_size;
+	fHeader = (dep_store_header*)fData;
+
+	// Only the header is checked here so that opening stays cheap. Everything
+	// the offsets in the nodes point to is checked when it is used.
+	uint64 nodeEnd = (uint64)fHeader->nodeOffset
+		+ (uint64)fHeader->nodeCount * sizeof(dep_store_node);
+	uint64 edgeEnd = (uint64)fHeader->edgeOffset
+		+ (uint64)fHeader->edgeCount * sizeof(uint32);
+	uint64 reverseEnd = (uint64)fHeader->reverseOffset
+		+ (uint64)fHeader->edgeCount * sizeof(uint32);
+	uint64 hashEnd = (uint64)fHeader->hashOffset
+		+ (uint64)fHeader->hashSlots * sizeof(uint32);
+	uint64 stringEnd = (uint64)fHeader->stringOffset + fHeader->stringSize;
+
+	if (fHeader->magic != DEP_STORE_MAGIC
+		|| fHeader->version != DEP_STORE_VERSION
+		|| fHeader->hashSlots == 0
+		|| (fHeader->hashSlots & (fHeader->hashSlots - 1)) != 0
+		|| (fHeader->nodeOffset % sizeof(uint32)) != 0
+		|| nodeEnd > fDataSize || edgeEnd > fDataSize || reverseEnd > fDataSize
+		|| hashEnd > fDataSize || stringEnd > fDataSize)
+	{
+		STRACE(1,("Ignoring invalid dependency store %s\n",fPath.String()));
+		Unmap();
+		return B_OK;
+	}
+
+	STRACE(2,("Opened dependency store %s: %" B_PRIu32 " nodes, %" B_PRIu32
+			" edges\n",fPath.String(),fHeader->nodeCount,fHeader->edgeCount));
+	return B_OK;
+}
+
+
+void
+DependencyStore::Unmap(void)
+{
+	if (fData)
+		munmap(fData,fDataSize);
+	if (fFD >= 0)
+		close(fFD);
+
+	fFD = -1;
+	fData = NULL;
+	fDataSize = 0;
+	fHeader = NULL;
+}
+
+
+int32
+DependencyStore::FindNode(const BString &key) const
+{
+	if (!fHeader || fHeader->nodeCount == 0)
+		return -1;
+
+	const dep_store_node *nodes
+		= (const dep_store_node*)(fData + fHeader->nodeOffset);
+	const uint32 *slots = (const uint32*)(fData + fHeader->hashOffset);
+	const char *strings = (const char*)(fData + fHeader->stringOffset);
+
+	uint32 hash = hash_key(key.String(),key.Length());
+	uint32 mask = fHeader->hashSlots - 1;
+	uint32 slot = hash & mask;
+
+	for (uint32 probes = 0; probes < fHeader->hashSlots; probes++)
+	{
+		uint32 value = slots[slot];
+		if (value == 0 || value > fHeader->nodeCount)
+			return -1;
+
+		const dep_store_node *node = &nodes[value - 1];
+		if (node->hash == hash && node->nameLength == (uint32)key.Length()
+			&& ValidNode(node)
+			&& memcmp(strings + node->name,key.String(),key.Length()) == 0)
+			return value - 1;
+
+		slot = (slot + 1) & mask;
+	}
+	return -1;
+}
+
+
+bool
+DependencyStore::ValidNode(const dep_store_node *node) const
+{
+	return (uint64)node->name + node->nameLength <= fHeader->stringSize
+		&& (uint64)node->firstEdge + node->edgeCount <= fHeader->edgeCount
+		&& (uint64)node->firstReverse + node->reverseCount <= fHeader->edgeCount;
+}
+
+
+status_t
+DependencyStore::WriteStore(void)
+{
+	std::map<BString, build_node> nodes;
+
+	// Start with what is already in the store
+	if (fHeader)
+	{
+		dep_store_node *stored = (dep_store_node*)(fData + fHeader->nodeOffset);
+		uint32 *edges = (uint32*)(fData + fHeader->edgeOffset);
+		const char *strings = (const char*)(fData + fHeader->stringOffset);
+
+		for (uint32 i = 0; i < fHeader->nodeCount; i++)
+		{
+			if (!ValidNode(&stored[i]))
+				continue;
+
+			BString key(strings + stored[i].name,stored[i].nameLength);
+			build_node &node = node_for(nodes,key);
+			node.flags = stored[i].flags;
+
+			if ((node.flags & DEP_NODE_SCANNED) == 0
+				|| fChangedDeps.find(key) != fChangedDeps.end())
+				continue;
+
+			for (uint32 j = 0; j < stored[i].edgeCount; j++)
+			{
+				uint32 target = edges[stored[i].firstEdge + j];
+				if (target >= fHeader->nodeCount || !ValidNode(&stored[target]))
+					continue;
+				node.deps.push_back(BString(strings + stored[target].name,
+											stored[target].nameLength));
+			}
+		}
+	}
+
+	std::map<BString, std::vector<BString> >::iterator changed;
+	for (changed = fChangedDeps.begin(); changed != fChangedDeps.end(); changed++)
+	{
+		build_node &node = node_for(nodes,changed->first);
+		node.flags |= DEP_NODE_SCANNED;
+		node.deps = changed->second;
+	}
+
+	// Make sure every dependency has a node and drop the ones which nothing
+	// depends on anymore
+	std::map<BString, bool> used;
+	std::map<BString, build_node>::iterator i;
+	for (i = nodes.begin(); i != nodes.end(); i++)
+	{
+		if ((i->second.flags & DEP_NODE_SCANNED) == 0)
+			continue;
+		used[i->first] = true;
+		for (size_t j = 0; j < i->second.deps.size(); j++)
+			used[i->second.deps[j]] = true;
+	}
+
+	std::map<BString, bool>::iterator u;
+	for (u = used.begin(); u != used.end(); u++)
+		node_for(nodes,u->first);
+
+	for (i = nodes.begin(); i != nodes.end(); )
+	{
+		if (used.find(i->first) == used.end())
+			nodes.erase(i++);
+		else
+			i++;
+	}
+
+	uint32 nodeCount = nodes.size();
+	uint32 edgeCount = 0;
+	uint32 stringSize = 0;
+	uint32 index = 0;
+	for (i = nodes.begin(); i != nodes.end(); i++)
+	{
+		i->second.index = index++;
+		edgeCount += i->second.deps.size();
+		stringSize += i->first.Length() + 1;
+	}
+
+	for (i = nodes.begin(); i != nodes.end(); i++)
+	{
+		for (size_t j = 0; j < i->second.deps.size(); j++)
+			nodes[i->second.deps[j]].dependents.push_back(i->second.index);
+	}
+
+	uint32 hashSlots = 16;
+	while (hashSlots < nodeCount * 2)
+		hashSlots *= 2;
+
+	dep_store_header header;
+	memset(&header,0,sizeof(header));
+	header.magic = DEP_STORE_MAGIC;
+	header.version = DEP_STORE_VERSION;
+	header.nodeCount = nodeCount;
+	header.edgeCount = edgeCount;
+	header.hashSlots = hashSlots;
+	header.stringSize = stringSize;
+	header.nodeOffset = sizeof(dep_store_header);
+	header.edgeOffset = header.nodeOffset + nodeCount * sizeof(dep_store_node);
+	header.reverseOffset = header.edgeOffset + edgeCount * sizeof(uint32);
+	header.hashOffset = header.reverseOffset + edgeCount * sizeof(uint32);
+	header.stringOffset = header.hashOffset + hashSlots * sizeof(uint32);
+
+	size_t totalSize = header.stringOffset + stringSize;
+	uint8 *buffer = new uint8[totalSize];
+	memset(buffer,0,totalSize);
+	memcpy(buffer,&header,sizeof(header));
+
+	dep_store_node *outNodes = (dep_store_node*)(buffer + header.nodeOffset);
+	uint32 *outEdges = (uint32*)(buffer + header.edgeOffset);
+	uint32 *outReverse = (uint32*)(buffer + header.reverseOffset);
+	uint32 *outSlots = (uint32*)(buffer + header.hashOffset);
+	char *outStrings = (char*)(buffer + header.stringOffset);
+
+	uint32 edgePos = 0;
+	uint32 reversePos = 0;
+	uint32 stringPos = 0;
+	for (i = nodes.begin(); i != nodes.end(); i++)
+	{
+		build_node &node = i->second;
+		dep_store_node &out = outNodes[node.index];
+
+		out.name = stringPos;
+		out.nameLength = i->first.Length();
+		out.hash = hash_key(i->first.String(),i->first.Length());
+		out.flags = node.flags;
+
+		memcpy(outStrings + stringPos,i->first.String(),i->first.Length());
+		stringPos += i->first.Length() + 1;
+
+		out.firstEdge = edgePos;
+		out.edgeCount = node.deps.size();
+		for (size_t j = 0; j < node.deps.size(); j++)
+			outEdges[edgePos++] = nodes[node.deps[j]].index;
+
+		out.firstReverse = reversePos;
+		out.reverseCount = node.dependents.size();
+		for (size_t j = 0; j < node.dependents.size(); j++)
+			outReverse[reversePos++] = node.dependents[j];
+
+		uint32 slot = out.hash & (hashSlots - 1);
+		while (outSlots[slot] != 0)
+			slot = (slot + 1) & (hashSlots - 1);
+		outSlots[slot] = node.index + 1;
+	}
+
+	// Write to a temporary file and swap it in so that a crash can never leave
+	// a half-written store behind
+	BString tempPath(fPath);
+	tempPath << ".tmp";
+
+	status_t status = B_OK;
+	BFile file(tempPath.String(),B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
+	if (file.InitCheck() != B_OK
+		|| file.Write(buffer,totalSize) != (ssize_t)totalSize)
+	{
+		STRACE(1,("Couldn't write dependency store %s\n",tempPath.String()));
+		status = B_ERROR;
+	}
+	file.Unset();
+	delete [] buffer;
+
+	if (status == B_OK && rename(tempPath.String(),fPath.String()) != 0)
+	{
+		STRACE(1,("Couldn't replace dependency store %s\n",fPath.String()));
+		status = B_ERROR;
+	}
+
+	if (status != B_OK)
+		unlink(tempPath.String());
+	else
+	{
+		STRACE(2,("Wrote dependency store %s: %" B_PRIu32 " nodes, %" B_PRIu32
+				" edges\n",fPath.String(),nodeCount,edgeCount));
+	}
+
+	return status;
+}
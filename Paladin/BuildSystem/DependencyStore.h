@@ -0,0 +1,102 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef DEPENDENCY_STORE_H
+#define DEPENDENCY_STORE_H
+
+#include <map>
+#include <vector>
+
+#include <Locker.h>
+#include <String.h>
+
+// On-disk layout. Everything after the header is addressed by offsets from
+// the start of the file so that the whole thing can be used straight out of
+// a memory mapping.
+typedef struct
+{
+	uint32	magic;
+	uint32	version;
+	uint32	nodeCount;
+	uint32	edgeCount;
+	uint32	hashSlots;
+	uint32	stringSize;
+	uint32	nodeOffset;
+	uint32	edgeOffset;
+	uint32	reverseOffset;
+	uint32	hashOffset;
+	uint32	stringOffset;
+	uint32	reserved;
+} dep_store_header;
+
+typedef struct
+{
+	uint32	name;
+	uint32	nameLength;
+	uint32	hash;
+	uint32	flags;
+	uint32	firstEdge;
+	uint32	edgeCount;
+	uint32	firstReverse;
+	uint32	reverseCount;
+} dep_store_node;
+
+enum
+{
+	// The node is a source file whose dependencies have been recorded, even
+	// if it turned out to have none
+	DEP_NODE_SCANNED = 0x00000001
+};
+
+// Keeps the header dependencies of a project's source files. The data lives
+// in a binary file next to the project's object folder which is mapped into
+// memory when it is opened, so opening costs the same no matter how large the
+// project is. Changes to the dependency lists are kept in memory until Flush()
+// writes out a new file.
+//
+// Paths inside the project folder are stored relative to it so that the
+// project can be moved without losing its dependency information.
+class DependencyStore
+{
+public:
+						DependencyStore(void);
+						~DependencyStore(void);
+
+			status_t	Open(const char *path, const char *baseFolder);
+			void		Close(void);
+			status_t	Flush(void);
+			bool		IsOpen(void) const;
+			const char *GetStorePath(void) const { return fPath.String(); }
+
+			bool		HasDependencies(const char *path);
+			bool		GetDependencies(const char *path,
+										std::vector<BString> &out);
+			void		SetDependencies(const char *path,
+										const std::vector<BString> &deps);
+			void		GetDependents(const char *path,
+									std::vector<BString> &out);
+
+private:
+			BString		MakeKey(const char *path) const;
+			BString		MakePath(const char *key, uint32 length) const;
+			status_t	Map(void);
+			void		Unmap(void);
+			int32		FindNode(const BString &key) const;
+			bool		ValidNode(const dep_store_node *node) const;
+			status_t	WriteStore(void);
+
+	BLocker				fLock;
+	BString				fPath;
+	BString				fBase;
+
+	int					fFD;
+	uint8				*fData;
+	size_t				fDataSize;
+	dep_store_header	*fHeader;
+
+	// Changes which haven't been written out yet, by key
+	std::map<BString, std::vector<BString> >	fChangedDeps;
+};
+
+#endif
@@ -0,0 +1,785 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#include "DiagnosticParser.h"
+
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
+#include "ContentHash.h"
+
+struct json_cursor
+{
+	const char	*pos;
+	const char	*end;
+};
+
+typedef struct
+{
+	const char	*kind;
+	int8		type;
+} diagnostic_kind;
+
+// The kinds of diagnostics GCC puts in its JSON output
+static const diagnostic_kind sDiagnosticKinds[] =
+{
+	{ "error", ERROR_ERROR },
+	{ "fatal error", ERROR_ERROR },
+	{ "internal compiler error", ERROR_ERROR },
+	{ "sorry, unimplemented", ERROR_ERROR },
+	{ "warning", ERROR_WARNING },
+	{ "pedantic warning", ERROR_WARNING },
+	{ "anachronism", ERROR_WARNING },
+	{ "note", ERROR_NOTE },
+	{ NULL, ERROR_UNKNOWN }
+};
+
+
+static bool
+contains_nocase(const char *text, size_t length, const char *word)
+{
+	size_t wordLength = strlen(word);
+	int first = tolower(word[0]);
+	for (size_t i = 0; i + wordLength <= length; i++)
+	{
+		if (tolower(text[i]) == first
+			&& strncasecmp(text + i,word,wordLength) == 0)
+			return true;
+	}
+	return false;
+}
+
+
+static const char *
+read_number(const char *pos, const char *end, int32 &value)
+{
+	value = 0;
+	while (pos < end && isdigit(*pos))
+		value = value * 10 + (*pos++ - '0');
+	return pos;
+}
+
+
+static void
+skip_space(json_cursor &c)
+{
+	while (c.pos < c.end && isspace(*c.pos))
+		c.pos++;
+}
+
+
+static bool
+consume(json_cursor &c, char ch)
+{
+	skip_space(c);
+	if (c.pos < c.end && *c.pos == ch)
+	{
+		c.pos++;
+		return true;
+	}
+	return false;
+}
+
+
+static void
+append_utf8(BString *out, uint32 code)
+{
+	char buffer[4];
+	int32 length;
+	if (code < 0x80)
+	{
+		buffer[0] = code;
+		length = 1;
+	}
+	else if (code < 0x800)
+	{
+		buffer[0] = 0xc0 | (code >> 6);
+		buffer[1] = 0x80 | (code & 0x3f);
+		length = 2;
+	}
+	else if (code < 0x10000)
+	{
+		buffer[0] = 0xe0 | (code >> 12);
+		buffer[1] = 0x80 | ((code >> 6) & 0x3f);
+		buffer[2] = 0x80 | (code & 0x3f);
+		length = 3;
+	}
+	else
+	{
+		buffer[0] = 0xf0 | (code >> 18);
+		buffer[1] = 0x80 | ((code >> 12) & 0x3f);
+		buffer[2] = 0x80 | ((code >> 6) & 0x3f);
+		buffer[3] = 0x80 | (code & 0x3f);
+		length = 4;
+	}
+	out->Append(buffer,length);
+}
+
+
+static bool
+read_hex(json_cursor &c, uint32 &code)
+{
+	if (c.end - c.pos < 4)
+		return false;
+
+	code = 0;
+	for (int32 i = 0; i < 4; i++)
+	{
+		char ch = *c.pos++;
+		code <<= 4;
+		if (ch >= '0' && ch <= '9')
+			code |= ch - '0';
+		else if (ch >= 'a' && ch <= 'f')
+			code |= ch - 'a' + 10;
+		else if (ch >= 'A' && ch <= 'F')
+			code |= ch - 'A' + 10;
+		else
+			return false;
+	}
+	return true;
+}
+
+
+// Reads a string into out, or just skips it if out is NULL. Runs of plain
+// characters are copied in one go.
+static bool
+read_string(json_cursor &c, BString *out)
+{
+	if (!consume(c,'"'))
+		return false;
+
+	const char *start = c.pos;
+	while (c.pos < c.end)
+	{
+		char ch = *c.pos;
+		if (ch == '"')
+		{
+			if (out)
+				out->Append(start,c.pos - start);
+			c.pos++;
+			return true;
+		}
+
+		if (ch != '\\')
+		{
+			c.pos++;
+			continue;
+		}
+
+		if (out)
+			out->Append(start,c.pos - start);
+		if (c.pos + 1 >= c.end)
+			return false;
+
+		char escaped = c.pos[1];
+		c.pos += 2;
+		if (escaped == 'u')
+		{
+			uint32 code;
+			if (!read_hex(c,code))
+				return false;
+
+			// Characters outside of the BMP come as a surrogate pair
+			if (code >= 0xd800 && code < 0xdc00 && c.end - c.pos >= 6
+				&& c.pos[0] == '\\' && c.pos[1] == 'u')
+			{
+				c.pos += 2;
+				uint32 low;
+				if (!read_hex(c,low))
+					return false;
+				code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+			}
+			if (out)
+				append_utf8(out,code);
+		}
+		else if (out)
+		{
+			switch (escaped)
+			{
+				case 'n':
+					escaped = '\n';
+					break;
+				case 't':
+					escaped = '\t';
+					break;
+				case 'r':
+					escaped = '\r';
+					break;
+				case 'b':
+					escaped = '\b';
+					break;
+				case 'f':
+					escaped = '\f';
+					break;
+				default:
+					break;
+			}
+			out->Append(&escaped,1);
+		}
+		start = c.pos;
+	}
+	return false;
+}
+
+
+static bool
+read_integer(json_cursor &c, int32 &value)
+{
+	skip_space(c);
+	bool negative = c.pos < c.end && *c.pos == '-';
+	if (negative)
+		c.pos++;
+
+	const char *start = c.pos;
+	c.pos = read_number(c.pos,c.end,value);
+	if (c.pos == start)
+		return false;
+	if (negative)
+		value = -value;
+
+	// Fractions and exponents don't turn up in the values used here
+	while (c.pos < c.end && (isdigit(*c.pos) || *c.pos == '.' || *c.pos == 'e'
+			|| *c.pos == 'E' || *c.pos == '+' || *c.pos == '-'))
+		c.pos++;
+	return true;
+}
+
+
+static bool
+skip_value(json_cursor &c)
+{
+	skip_space(c);
+	if (c.pos >= c.end)
+		return false;
+
+	if (*c.pos == '"')
+		return read_string(c,NULL);
+
+	if (*c.pos != '{' && *c.pos != '[')
+	{
+		// Numbers, true, false and null
+		const char *start = c.pos;
+		while (c.pos < c.end && !isspace(*c.pos) && *c.pos != ','
+				&& *c.pos != '}' && *c.pos != ']')
+			c.pos++;
+		return c.pos > start;
+	}
+
+	int32 depth = 0;
+	while (c.pos < c.end)
+	{
+		char ch = *c.pos;
+		if (ch == '"')
+		{
+			if (!read_string(c,NULL))
+				return false;
+			continue;
+		}
+
+		c.pos++;
+		if (ch == '{' || ch == '[')
+			depth++;
+		else if ((ch == '}' || ch == ']') && --depth == 0)
+			return true;
+	}
+	return false;
+}
+
+
+static bool
+read_key(json_cursor &c, const char *&key, size_t &length)
+{
+	if (!consume(c,'"'))
+		return false;
+
+	key = c.pos;
+	while (c.pos < c.end && *c.pos != '"')
+		c.pos++;
+	if (c.pos >= c.end)
+		return false;
+
+	length = c.pos - key;
+	c.pos++;
+	return consume(c,':');
+}
+
+
+static bool
+key_is(const char *key, size_t length, const char *name)
+{
+	return strlen(name) == length && memcmp(key,name,length) == 0;
+}
+
+
+// Reads one entry of a diagnostic's "locations". Only the caret matters.
+static bool
+read_location(json_cursor &c, BString &file, int32 &line, int32 &column)
+{
+	if (!consume(c,'{'))
+		return false;
+	if (consume(c,'}'))
+		return true;
+
+	do
+	{
+		const char *key;
+		size_t keyLength;
+		if (!read_key(c,key,keyLength))
+			return false;
+
+		if (!key_is(key,keyLength,"caret"))
+		{
+			if (!skip_value(c))
+				return false;
+			continue;
+		}
+
+		if (!consume(c,'{'))
+			return false;
+		if (consume(c,'}'))
+			continue;
+
+		do
+		{
+			if (!read_key(c,key,keyLength))
+				return false;
+
+			bool ok;
+			if (key_is(key,keyLength,"file"))
+				ok = read_string(c,&file);
+			else if (key_is(key,keyLength,"line"))
+				ok = read_integer(c,line);
+			else if (key_is(key,keyLength,"column"))
+				ok = read_integer(c,column);
+			else
+				ok = skip_value(c);
+
+			if (!ok)
+				return false;
+		} while (consume(c,','));
+
+		if (!consume(c,'}'))
+			return false;
+	} while (consume(c,','));
+
+	return consume(c,'}');
+}
+
+
+static bool
+read_locations(json_cursor &c, BString &file, int32 &line, int32 &column)
+{
+	if (!consume(c,'['))
+		return false;
+	if (consume(c,']'))
+		return true;
+
+	bool first = true;
+	do
+	{
+		bool ok = first ? read_location(c,file,line,column) : skip_value(c);
+		if (!ok)
+			return false;
+		first = false;
+	} while (consume(c,','));
+
+	return consume(c,']');
+}
+
+
+DiagnosticParser::DiagnosticParser(ErrorList &list, int32 format)
+	:	fList(list),
+		fFormat(format),
+		fPrevious(ERROR_UNSET),
+		fInJSON(false),
+		fDepth(0),
+		fInString(false),
+		fEscaped(false),
+		fLastPath(NULL)
+{
+}
+
+
+void
+DiagnosticParser::Feed(const char *data, size_t length)
+{
+	const char *end = data + length;
+	while (data < end)
+	{
+		if (fInJSON)
+		{
+			data = ScanJSON(data,end);
+			continue;
+		}
+
+		// GCC writes its JSON output as one array starting on a line of its own
+		if (fFormat == DIAGNOSTICS_GCC && fPending.empty() && *data == '[')
+		{
+			fInJSON = true;
+			fDepth = 0;
+			fInString = false;
+			fEscaped = false;
+			continue;
+		}
+
+		const char *newline = (const char *)memchr(data,'\n',end - data);
+		if (!newline)
+		{
+			fPending.append(data,end - data);
+			break;
+		}
+
+		if (fPending.empty())
+			ParseLine(data,newline - data);
+		else
+		{
+			fPending.append(data,newline - data);
+			ParseLine(fPending.data(),fPending.size());
+			fPending.clear();
+		}
+		data = newline + 1;
+	}
+}
+
+
+void
+DiagnosticParser::Finish(void)
+{
+	if (fInJSON)
+	{
+		// The output ended in the middle of a diagnostic. It's passed on as
+		// it is so that it isn't lost.
+		if (!fPending.empty())
+		{
+			error_msg *msg = new error_msg;
+			msg->rawdata.SetTo(fPending.data(),fPending.size());
+			msg->type = ERROR_UNKNOWN;
+			fList.msglist.AddItem(msg);
+		}
+		fInJSON = false;
+	}
+	else if (!fPending.empty())
+		ParseLine(fPending.data(),fPending.size());
+
+	fPending.clear();
+}
+
+
+void
+DiagnosticParser::ParseLine(const char *line, size_t length)
+{
+	if (length > 0 && line[length - 1] == '\r')
+		length--;
+	if (length == 0)
+		return;
+
+	if (fFormat == DIAGNOSTICS_LD)
+		ParseLDLine(line,length);
+	else
+		ParseGCCLine(line,length);
+}
+
+
+void
+DiagnosticParser::ParseGCCLine(const char *line, size_t length)
+{
+	error_msg *msg = new error_msg;
+	msg->rawdata.SetTo(line,length);
+	fList.msglist.AddItem(msg);
+
+	const char *end = line + length;
+	const char *colon = (const char *)memchr(line,':',length);
+	if (!colon)
+	{
+		fPrevious = msg->type;
+		return;
+	}
+
+	msg->path = InternPath(line,colon - line);
+
+	// file:line:column: text, where both numbers are optional
+	const char *text = colon + 1;
+	if (text < end && isdigit(*text))
+	{
+		text = read_number(text,end,msg->line);
+
+		colon = (const char *)memchr(text,':',end - text);
+		if (colon)
+		{
+			text = colon + 1;
+			if (text < end && isdigit(*text))
+			{
+				text = read_number(text,end,msg->column);
+				if (text < end && *text == ':')
+					text++;
+			}
+		}
+	}
+	if (text < end && *text == ' ')
+		text++;
+
+	msg->error.SetTo(text,end - text);
+
+	size_t textLength = end - text;
+	if ((msg->line < 0 && !contains_nocase(text,textLength,"error"))
+		|| textLength == 0)
+		msg->type = fPrevious != ERROR_UNSET ? fPrevious : ERROR_NOTE;
+	else if (contains_nocase(line,length,"warning:"))
+		msg->type = ERROR_WARNING;
+	else if (contains_nocase(line,length,"error:"))
+		msg->type = ERROR_ERROR;
+	else if (contains_nocase(line,length,"note:")
+			&& contains_nocase(line,length,"In "))
+		msg->type = fPrevious != ERROR_UNSET ? fPrevious : ERROR_NOTE;
+	else
+		msg->type = fPrevious != ERROR_UNSET ? fPrevious : ERROR_UNKNOWN;
+
+	fPrevious = msg->type;
+}
+
+
+void
+DiagnosticParser::ParseLDLine(const char *line, size_t length)
+{
+	error_msg *msg = new error_msg;
+	msg->rawdata.SetTo(line,length);
+	fList.msglist.AddItem(msg);
+
+	// The linker doesn't use line numbers
+	const char *end = line + length;
+	const char *text = line;
+	const char *colon = (const char *)memchr(line,':',length);
+	if (colon)
+	{
+		if (colon > line)
+			msg->path = InternPath(line,colon - line);
+		text = colon + 1;
+		while (text < end && *text == ' ')
+			text++;
+	}
+	msg->error.SetTo(text,end - text);
+
+	size_t textLength = end - text;
+	if (contains_nocase(text,textLength,"warning:"))
+		msg->type = ERROR_WARNING;
+	else if (contains_nocase(text,textLength,"error:")
+			|| contains_nocase(text,textLength,"undefined"))
+		msg->type = ERROR_ERROR;
+	else
+		msg->type = fPrevious != ERROR_UNSET ? fPrevious : ERROR_NOTE;
+
+	fPrevious = msg->type;
+}
+
+
+const char *
+DiagnosticParser::ScanJSON(const char *data, const char *end)
+{
+	// Only the nesting is followed here. Once a whole diagnostic has come
+	// in, it is taken apart and the text it was made from is let go of.
+	const char *element = fDepth >= 2 ? data : NULL;
+	for (const char *pos = data; pos < end; pos++)
+	{
+		char ch = *pos;
+		if (fInString)
+		{
+			if (fEscaped)
+				fEscaped = false;
+			else if (ch == '\\')
+				fEscaped = true;
+			else if (ch == '"')
+				fInString = false;
+			continue;
+		}
+
+		if (ch == '"')
+			fInString = true;
+		else if (ch == '{' || ch == '[')
+		{
+			if (++fDepth == 2)
+				element = pos;
+		}
+		else if (ch == '}' || ch == ']')
+		{
+			fDepth--;
+			if (fDepth == 1 && element)
+			{
+				if (fPending.empty())
+					ParseJSONDiagnostic(element,pos + 1 - element);
+				else
+				{
+					fPending.append(element,pos + 1 - element);
+					ParseJSONDiagnostic(fPending.data(),fPending.size());
+					fPending.clear();
+				}
+				element = NULL;
+			}
+			else if (fDepth <= 0)
+			{
+				fInJSON = false;
+				return pos + 1;
+			}
+		}
+	}
+
+	if (element)
+		fPending.append(element,end - element);
+	return end;
+}
+
+
+void
+DiagnosticParser::ParseJSONDiagnostic(const char *data, size_t length)
+{
+	json_cursor c;
+	c.pos = data;
+	c.end = data + length;
+
+	int32 count = fList.msglist.CountItems();
+	if (ReadJSONDiagnostic(c))
+		return;
+
+	// Whatever couldn't be made sense of is shown as it is
+	while (fList.msglist.CountItems() > count)
+		delete fList.msglist.RemoveItemAt(count);
+
+	error_msg *msg = new error_msg;
+	msg->rawdata.SetTo(data,length);
+	msg->type = ERROR_UNKNOWN;
+	fList.msglist.AddItem(msg);
+}
+
+
+const BString &
+DiagnosticParser::InternPath(const char *path, size_t length)
+{
+	// Messages about the same file nearly always come one after the other
+	if (fLastPath && (size_t)fLastPath->Length() == length
+		&& memcmp(fLastPath->String(),path,length) == 0)
+		return *fLastPath;
+
+	// Looking names up by their hash means there's nothing to allocate for
+	// the ones which were seen before
+	uint64 hash = HashBuffer(path,length);
+	std::multimap<uint64, BString>::iterator i = fPaths.lower_bound(hash);
+	for (; i != fPaths.end() && i->first == hash; i++)
+	{
+		if ((size_t)i->second.Length() == length
+			&& memcmp(i->second.String(),path,length) == 0)
+		{
+			fLastPath = &i->second;
+			return *fLastPath;
+		}
+	}
+
+	i = fPaths.insert(std::make_pair(hash,BString(path,length)));
+	fLastPath = &i->second;
+	return *fLastPath;
+}
+
+
+bool
+DiagnosticParser::ReadJSONDiagnostic(json_cursor &c)
+{
+	if (!consume(c,'{'))
+		return false;
+
+	// Added right away so that it comes before the notes attached to it
+	error_msg *msg = new error_msg;
+	fList.msglist.AddItem(msg);
+
+	BString kind, file;
+	if (!consume(c,'}'))
+	{
+		do
+		{
+			const char *key;
+			size_t keyLength;
+			if (!read_key(c,key,keyLength))
+				return false;
+
+			bool ok;
+			if (key_is(key,keyLength,"kind"))
+				ok = read_string(c,&kind);
+			else if (key_is(key,keyLength,"message"))
+				ok = read_string(c,&msg->error);
+			else if (key_is(key,keyLength,"locations"))
+				ok = read_locations(c,file,msg->line,msg->column);
+			else if (key_is(key,keyLength,"children"))
+			{
+				ok = consume(c,'[');
+				if (ok && !consume(c,']'))
+				{
+					do
+					{
+						ok = ReadJSONDiagnostic(c);
+					} while (ok && consume(c,','));
+					ok = ok && consume(c,']');
+				}
+			}
+			else
+				ok = skip_value(c);
+
+			if (!ok)
+				return false;
+		} while (consume(c,','));
+
+		if (!consume(c,'}'))
+			return false;
+	}
+
+	msg->type = ERROR_UNKNOWN;
+	for (int32 i = 0; sDiagnosticKinds[i].kind; i++)
+	{
+		if (kind == sDiagnosticKinds[i].kind)
+		{
+			msg->type = sDiagnosticKinds[i].type;
+			break;
+		}
+	}
+
+	// Written the way GCC would have put it as plain text
+	if (file.Length() > 0)
+	{
+		msg->path = InternPath(file.String(),file.Length());
+		msg->rawdata << file << ":";
+		if (msg->line >= 0)
+		{
+			msg->rawdata << msg->line << ":";
+			if (msg->column >= 0)
+				msg->rawdata << msg->column << ":";
+		}
+		msg->rawdata << " ";
+	}
+	msg->rawdata << kind << ": " << msg->error;
+
+	fPrevious = msg->type;
+	return true;
+}
+
+
+DiagnosticListener::DiagnosticListener(DiagnosticParser &parser,
+										BString &output)
+	:	fParser(parser),
+		fOutput(output)
+{
+}
+
+
+void
+DiagnosticListener::OutputReceived(const char *data, size_t length,
+									bool isError)
+{
+	fOutput.Append(data,length);
+	if (isError)
+		fParser.Feed(data,length);
+}
+
+
+void
+DiagnosticListener::ProcessExited(int status, const process_usage &usage)
+{
+	fParser.Finish();
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef DIAGNOSTIC_PARSER_H
+#define DIAGNOSTIC_PARSER_H
+
+#include <map>
+#include <string>
+
+#include <String.h>
+
+#include "ErrorParser.h"
+#include "ProcessExecutor.h"
+
+struct json_cursor;
+
+enum
+{
+	DIAGNOSTICS_GCC = 0,
+	DIAGNOSTICS_LD
+};
+
+// Turns the output of the compiler or the linker into error_msg records in a
+// single pass. The output can be fed in whatever pieces it arrives in; only
+// the end of a line which hasn't been completed yet is held on to.
+//
+// GCC's machine readable output (-fdiagnostics-format=json) is recognized by
+// itself. It is taken apart one diagnostic at a time, so a huge array of them
+// is never kept around as a whole either. The records it gives have the same
+// rawdata as the plain text ones would so they show up the same way.
+//
+// File names are shared between the records which refer to the same file.
+class DiagnosticParser
+{
+public:
+							DiagnosticParser(ErrorList &list,
+											int32 format = DIAGNOSTICS_GCC);
+
+			void			Feed(const char *data, size_t length);
+			void			Finish(void);
+
+private:
+			void			ParseLine(const char *line, size_t length);
+			void			ParseGCCLine(const char *line, size_t length);
+			void			ParseLDLine(const char *line, size_t length);
+
+			const char *	ScanJSON(const char *data, const char *end);
+			void			ParseJSONDiagnostic(const char *data,
+												size_t length);
+			bool			ReadJSONDiagnostic(json_cursor &c);
+
+			const BString &	InternPath(const char *path, size_t length);
+
+	ErrorList				&fList;
+	int32					fFormat;
+	int8					fPrevious;
+
+	std::string				fPending;
+
+	// State of the JSON scanner
+	bool					fInJSON;
+	int32					fDepth;
+	bool					fInString;
+	bool					fEscaped;
+
+	std::multimap<uint64, BString>	fPaths;
+	const BString			*fLastPath;
+};
+
+// Gathers the output of a process while feeding what it writes to stderr to
+// a DiagnosticParser
+class DiagnosticListener : public ProcessListener
+{
+public:
+							DiagnosticListener(DiagnosticParser &parser,
+												BString &output);
+
+			void			OutputReceived(const char *data, size_t length,
+											bool isError);
+			void			ProcessExited(int status,
+											const process_usage &usage);
+
+private:
+	DiagnosticParser		&fParser;
+	BString					&fOutput;
+};
+
+#endif
@@ -5,6 +5,8 @@
 #include <ctype.h>
 #include <OS.h>
 
+#include "DiagnosticParser.h"
+
 error_msg::error_msg(void)
 	:	line(-1),
 		column(-1),
@@ -297,129 +299,12 @@ ErrorList::AsString(void)
 void
 ParseGCCErrors(const char *errstring, ErrorList &masterlist)
 {
-	//list.msglist.MakeEmpty(); // DANGEROUS - shared structure
-	ErrorList list("");
 	if (!errstring)
 		return;
 	
-	int32 length = strlen(errstring);
-	if (length < 1)
-		return;
-	
-	char *data = new char[length + 1];
-	sprintf(data,"%s",errstring);
-	
-	char *item = strtok(data,"\n");
-	while (item)
-	{
-		error_msg *msg = new error_msg;
-		msg->rawdata = item;
-		list.msglist.AddItem(msg);
-		item = strtok(NULL,"\n");
-	}
-	
-	int8 errorPrev = ERROR_UNSET;
-	for (int32 i = 0; i < list.msglist.CountItems(); i++)
-	{
-		error_msg *msg = (error_msg*)list.msglist.ItemAt(i);
-		
-		if (!msg->rawdata || msg->rawdata.CountChars() < 1)
-			continue;
-		
-		int32 startpos = 0;
-		int32 endpos = msg->rawdata.FindFirst(":");
-		if (B_ERROR != endpos) 
-		{
-			msg->rawdata.CopyInto(msg->path, startpos, endpos);
-		
-			// Now we have to do a little fancy guesswork
-			if (isdigit(msg->rawdata[endpos + 1]))
-			{
-				startpos = endpos;
-				
-				BString temp;
-				int32 numberIndex = startpos + 1;
-				while (isdigit(msg->rawdata[numberIndex]))
-				{
-					temp += msg->rawdata[numberIndex];
-					numberIndex++;
-					if (numberIndex >= msg->rawdata.CountChars())
-						break;
-				}
-				msg->line = atol(temp.String());
-				endpos += temp.CountChars();
-				
-				// now check for column number too
-				startpos = endpos;
-				endpos = msg->rawdata.FindFirst(":",startpos);
-				if (B_ERROR != endpos)
-				{
-					// Now we have to do a little fancy guesswork
-					if (isdigit(msg->rawdata[endpos + 1]))
-					{
-						int32 startposcol = endpos;
-				
-						temp = "";
-						numberIndex = startposcol + 1;
-						while (isdigit(msg->rawdata[numberIndex]))
-						{
-							temp += msg->rawdata[numberIndex];
-							numberIndex++;
-							if (numberIndex >= msg->rawdata.CountChars())
-								break;
-						}
-						msg->column = atol(temp.String());
-						endpos += temp.CountChars();
-					}
-					else
-						msg->column = -1;
-				}
-			}
-			else
-				msg->line = -1;
-			
-			// adding 2 instead of one because there is always a space after the final 
-			// colon in the event there is an error message, which is usually
-			if (endpos + 2 < msg->rawdata.CountChars()) {
-				msg->error = msg->rawdata.String() + endpos + 2;
-			}
-		
-			if ((msg->line < 0 && msg->error.IFindFirst("error") < 0) ||
-				(msg->error.CountChars() < 1)) {
-				// first line
-				if (-1 != errorPrev) {
-					msg->type = errorPrev;
-				} else {
-					msg->type = ERROR_NOTE;
-				}
-			} else if (msg->rawdata.IFindFirst("warning:") >= 0) {
-				msg->type = ERROR_WARNING;
-			} else if (msg->rawdata.IFindFirst("error:") >= 0) {
-				msg->type = ERROR_ERROR;
-			} else if (msg->rawdata.IFindFirst("note:") >= 0 &&
-					   msg->rawdata.IFindFirst("In ") >= 0) {
-				if (-1 != errorPrev) {
-					msg->type = errorPrev;
-				} else {
-					msg->type = ERROR_NOTE;
-				}
-			} else {
-				// if not known, mark as previous or unknown
-				if (ERROR_UNSET != errorPrev) {
-					msg->type = errorPrev;
-				} else {
-					msg->type = ERROR_UNKNOWN;
-				}
-			}
-		} // end null endpos if	
-		errorPrev = msg->type;
-		
-		// Add back to master list after processing
-		masterlist.msglist.AddItem(msg);
-	}
-	list.msglist.MakeEmpty(false); // don't delete msg pointers
-	
-	delete [] data;
+	DiagnosticParser parser(masterlist,DIAGNOSTICS_GCC);
+	parser.Feed(errstring,strlen(errstring));
+	parser.Finish();
 }
 
 
@@ -429,60 +314,10 @@ ParseLDErrors(const char *string, ErrorList &list)
 	list.msglist.MakeEmpty();
 	if (!string)
 		return;
-
-	int32 length = strlen(string);
-	if (length < 1)
-		return;
 	
-	char *data = new char[length + 1];
-	sprintf(data,"%s",string);
-	
-	char *item = strtok(data,"\n");
-	while (item)
-	{
-		error_msg *msg = new error_msg;
-		msg->rawdata = item;
-		list.msglist.AddItem(msg);
-		item = strtok(NULL,"\n");
-	}
-	
-	int8 errorPrev = ERROR_UNSET;
-	for (int32 i = 0; i < list.msglist.CountItems(); i++)
-	{
-		error_msg *msg = (error_msg*)list.msglist.ItemAt(i);
-		
-		if (msg->rawdata.CountChars() < 1)
-			continue;
-		
-		int32 startpos = 0;
-		int32 endpos = msg->rawdata.FindFirst(":");
-		if (endpos > startpos)
-			msg->rawdata.CopyInto(msg->path,startpos,endpos);
-		
-		// The linker doesn't use line numbers
-		msg->line = -1;
-		msg->column = -1;
-		
-		// adding 2 instead of one because there is always a space after the final colon
-		msg->error = msg->rawdata.String() + endpos + 2;
-		
-		if (msg->error.IFindFirst("warning:") >= 0) {
-			msg->type = ERROR_WARNING;
-		} else if (msg->error.IFindFirst("error:") >= 0) {
-			msg->type = ERROR_ERROR;
-		} else if (msg->error.IFindFirst("undefined") >= 0) {
-			msg->type = ERROR_ERROR;
-		} else {
-			if (ERROR_UNSET != errorPrev) {
-				msg->type = errorPrev;
-			} else {
-				msg->type = ERROR_NOTE;
-			}
-		}
-			
-		errorPrev = msg->type;
-	}
-	delete [] data;
+	DiagnosticParser parser(list,DIAGNOSTICS_LD);
+	parser.Feed(string,strlen(string));
+	parser.Finish();
 }
 
 
@@ -0,0 +1,595 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#include "IncludeScanner.h"
+
+#include <ctype.h>
+#include <set>
+
+#include <Autolock.h>
+#include <Entry.h>
+#include <File.h>
+
+#include "BuildInfo.h"
+#include "DebugTools.h"
+#include "Globals.h"
+#include "StatCache.h"
+
+static bool
+file_exists(const char *path)
+{
+	// Most of the places a header could be are in folders which the stat
+	// cache has seen already, so it can usually answer without asking the disk
+	if (gUseStatCache)
+		return gStatCache.Exists(path);
+	return BEntry(path).Exists();
+}
+
+
+static const char *
+skip_comment(const char *p, const char *end)
+{
+	// p points to the opening slash of a comment
+	if (p[1] == '/')
+	{
+		while (p < end && *p != '\n')
+			p++;
+		return p;
+	}
+
+	p += 2;
+	while (p + 1 < end && !(p[0] == '*' && p[1] == '/'))
+		p++;
+	return (p + 1 < end) ? p + 2 : end;
+}
+
+
+static bool
+is_comment(const char *p, const char *end)
+{
+	return p[0] == '/' && p + 1 < end && (p[1] == '/' || p[1] == '*');
+}
+
+
+static const char *
+skip_space(const char *p, const char *end)
+{
+	// Skips whitespace and comments within a single logical line
+	while (p < end)
+	{
+		if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\f' || *p == '\v')
+			p++;
+		else if (*p == '\\' && p + 1 < end && p[1] == '\n')
+			p += 2;
+		else if (*p == '\\' && p + 2 < end && p[1] == '\r' && p[2] == '\n')
+			p += 3;
+		else if (is_comment(p,end) && p[1] == '*')
+			p = skip_comment(p,end);
+		else
+			break;
+	}
+	return p;
+}
+
+
+static const char *
+skip_line(const char *p, const char *end)
+{
+	// Moves to the newline which ends the logical line, honoring continuations
+	while (p < end && *p != '\n')
+	{
+		if (*p == '\\' && p + 1 < end && p[1] == '\n')
+			p += 2;
+		else if (is_comment(p,end))
+			p = skip_comment(p,end);
+		else
+			p++;
+	}
+	return p;
+}
+
+
+static const char *
+read_identifier(const char *p, const char *end, BString &out)
+{
+	const char *start = p;
+	while (p < end && (isalnum(*p) || *p == '_'))
+		p++;
+	out.SetTo(start,p - start);
+	return p;
+}
+
+
+static const char *
+skip_literal(const char *p, const char *end)
+{
+	// Raw strings can contain anything, including what looks like comments
+	if (*p == 'R' && p + 1 < end && p[1] == '"')
+	{
+		const char *delim = p + 2;
+		const char *paren = delim;
+		while (paren < end && *paren != '(')
+			paren++;
+		if (paren == end)
+			return end;
+
+		BString closing(")");
+		closing.Append(delim,paren - delim);
+		closing << "\"";
+
+		for (p = paren + 1; p < end; p++)
+		{
+			if (end - p >= closing.Length()
+				&& strncmp(p,closing.String(),closing.Length()) == 0)
+				return p + closing.Length();
+		}
+		return end;
+	}
+
+	char quote = *p++;
+	while (p < end && *p != quote && *p != '\n')
+	{
+		if (*p == '\\' && p + 1 < end)
+			p++;
+		p++;
+	}
+	return (p < end && *p == quote) ? p + 1 : p;
+}
+
+
+IncludeScanner::IncludeScanner(void)
+	:	fLock("include scanner lock")
+{
+}
+
+
+IncludeScanner::~IncludeScanner(void)
+{
+	MakeEmpty();
+}
+
+
+status_t
+IncludeScanner::GetDependencies(BuildInfo &info, const char *path,
+								std::vector<BString> &out)
+{
+	if (!path)
+		return B_BAD_VALUE;
+
+	BString abspath(path);
+	if (abspath[0] != '/')
+	{
+		abspath.Prepend("/");
+		abspath.Prepend(info.projectFolder.GetFullPath());
+	}
+	abspath = NormalizePath(abspath.String());
+
+	if (!file_exists(abspath.String()))
+		return B_ENTRY_NOT_FOUND;
+
+	// Walk the include graph depth-first. Each file only needs to be visited
+	// once no matter how often it is included, which is exactly what an
+	// include guard or #pragma once would do in the preprocessor.
+	std::set<BString> visited;
+	std::vector<BString> stack;
+
+	visited.insert(abspath);
+	stack.push_back(abspath);
+
+	while (!stack.empty())
+	{
+		BString current = stack.back();
+		stack.pop_back();
+
+		include_record *record = RecordFor(info,current.String());
+		if (!record)
+			continue;
+
+		for (int32 i = record->includes.size() - 1; i >= 0; i--)
+		{
+			const BString &include = record->includes[i];
+			if (visited.find(include) != visited.end())
+				continue;
+
+			visited.insert(include);
+
+			// System headers are neither reported nor followed, the same as
+			// the compiler's own dependency output
+			if (include.StartsWith("/boot/system/"))
+				continue;
+
+			if (IsHeader(include.String()))
+				out.push_back(include);
+			stack.push_back(include);
+		}
+	}
+
+	return B_OK;
+}
+
+
+status_t
+IncludeScanner::GetDirectives(BuildInfo &info, const char *path,
+							std::vector<include_directive> &out)
+{
+	if (!path)
+		return B_BAD_VALUE;
+
+	BString abspath(path);
+	if (abspath[0] != '/')
+	{
+		abspath.Prepend("/");
+		abspath.Prepend(info.projectFolder.GetFullPath());
+	}
+	abspath = NormalizePath(abspath.String());
+
+	if (!file_exists(abspath.String()))
+		return B_ENTRY_NOT_FOUND;
+
+	include_record *record = RecordFor(info,abspath.String());
+	if (!record)
+		return B_ERROR;
+
+	out = record->directives;
+	return B_OK;
+}
+
+
+BString
+IncludeScanner::FindHeader(BuildInfo &info, const char *name)
+{
+	if (!name || *name == 0)
+		return BString();
+
+	BString key(name);
+	int32 slash = key.FindLast("/");
+	if (slash >= 0)
+		key.Remove(0,slash + 1);
+
+	fLock.Lock();
+	std::map<BString, BString>::iterator i = fHeaders.find(key);
+	if (i != fHeaders.end())
+	{
+		BString path = i->second;
+		fLock.Unlock();
+		return path;
+	}
+	fLock.Unlock();
+
+	// The project folder is the first entry of the include list, so this is
+	// the same search order the project has always used. Misses are cached,
+	// too, so a header which can't be found costs one search per session.
+	BString path;
+	int32 count = info.includeList.CountItems();
+	for (int32 j = 0; j < count; j++)
+	{
+		BString testpath(info.includeList.ItemAt(j)->Absolute());
+		testpath << "/" << key;
+		if (file_exists(testpath.String()))
+		{
+			path = NormalizePath(testpath.String());
+			break;
+		}
+	}
+
+	BAutolock lock(fLock);
+	fHeaders[key] = path;
+	return path;
+}
+
+
+void
+IncludeScanner::MakeEmpty(void)
+{
+	BAutolock lock(fLock);
+
+	std::map<BString, include_record*>::iterator i;
+	for (i = fRecords.begin(); i != fRecords.end(); i++)
+		delete i->second;
+	fRecords.clear();
+	fHeaders.clear();
+}
+
+
+void
+IncludeScanner::ParseIncludes(const char *data, size_t length,
+							include_record &record)
+{
+	record.directives.clear();
+
+	if (!data)
+		return;
+
+	const char *p = data;
+	const char *end = data + length;
+
+	bool lineStart = true;
+	bool leading = true;
+
+	while (p < end)
+	{
+		char c = *p;
+
+		if (is_comment(p,end))
+		{
+			p = skip_comment(p,end);
+			continue;
+		}
+
+		if (c == '\n')
+		{
+			lineStart = true;
+			p++;
+			continue;
+		}
+
+		if (isspace(c))
+		{
+			p++;
+			continue;
+		}
+
+		if (c != '#' || !lineStart)
+		{
+			leading = false;
+
+			lineStart = false;
+			if (c == '"' || c == '\'' || (c == 'R' && p + 1 < end && p[1] == '"'))
+				p = skip_literal(p,end);
+			else
+				p++;
+			continue;
+		}
+
+		// Preprocessor directive
+		BString keyword;
+		p = skip_space(p + 1,end);
+		p = read_identifier(p,end,keyword);
+		p = skip_space(p,end);
+
+		if (keyword == "include" || keyword == "include_next"
+			|| keyword == "import")
+		{
+			char closing = 0;
+			if (p < end && *p == '"')
+				closing = '"';
+			else if (p < end && *p == '<')
+				closing = '>';
+
+			if (closing)
+			{
+				const char *start = ++p;
+				while (p < end && *p != closing && *p != '\n')
+					p++;
+
+				if (p < end && *p == closing && p > start)
+				{
+					include_directive directive;
+					directive.name.SetTo(start,p - start);
+					directive.quoted = (closing == '"');
+					directive.leading = leading;
+					record.directives.push_back(directive);
+				}
+			}
+			// Anything else is a computed include, which can't be followed
+			// without running the preprocessor
+		}
+		else if (keyword != "pragma")
+			leading = false;
+
+		p = skip_line(p,end);
+		lineStart = true;
+	}
+}
+
+
+BString
+IncludeScanner::NormalizePath(const char *path)
+{
+	BString out;
+	if (!path)
+		return out;
+
+	std::vector<BString> parts;
+	const char *p = path;
+	while (*p)
+	{
+		const char *start = p;
+		while (*p && *p != '/')
+			p++;
+
+		BString part(start,p - start);
+		if (part == "..")
+		{
+			if (!parts.empty() && parts.back() != "..")
+				parts.pop_back();
+			else if (path[0] != '/')
+				parts.push_back(part);
+		}
+		else if (part.Length() > 0 && part != ".")
+			parts.push_back(part);
+
+		if (*p)
+			p++;
+	}
+
+	if (path[0] == '/')
+		out = "/";
+	for (size_t i = 0; i < parts.size(); i++)
+	{
+		if (i > 0)
+			out << "/";
+		out << parts[i];
+	}
+	return out;
+}
+
+
+void
+IncludeScanner::ParseMakeDependencies(const char *data, size_t length,
+									std::vector<BString> &out)
+{
+	const char *p = data;
+	const char *end = data + length;
+	bool inTarget = true;
+	BString word;
+	while (p <= end)
+	{
+		char c = p < end ? *p : '\n';
+		p++;
+
+		if (c == '\\' && p < end)
+		{
+			// Lines are continued with a backslash and spaces in names are
+			// escaped with one
+			if (*p == '\n' || (*p == '\r' && p + 1 < end && p[1] == '\n'))
+			{
+				p += *p == '\r' ? 2 : 1;
+				c = ' ';
+			}
+			else if (*p == ' ' || *p == '#' || *p == '\\')
+			{
+				word << *p++;
+				continue;
+			}
+		}
+		else if (c == '$' && p < end && *p == '$')
+		{
+			word << *p++;
+			continue;
+		}
+
+		// The target ends with a colon which is followed by white space,
+		// which leaves the colons in names alone
+		if (inTarget && c == ':' && (p >= end || isspace(*p)))
+		{
+			inTarget = false;
+			word = "";
+			continue;
+		}
+
+		if (!isspace(c))
+		{
+			word << c;
+			continue;
+		}
+
+		if (!inTarget && word.Length() > 0)
+			out.push_back(word);
+		word = "";
+
+		// Only the first rule counts. Any others, like the empty ones of -MP,
+		// only repeat the headers.
+		if (c == '\n' && !inTarget)
+			break;
+	}
+}
+
+
+bool
+IncludeScanner::IsHeader(const char *path)
+{
+	BString ext(path);
+	int32 dot = ext.FindLast(".");
+	if (dot < 0 || ext.FindFirst("/",dot) >= 0)
+		return false;
+
+	ext.Remove(0,dot + 1);
+	return (ext.ICompare("h") == 0) || (ext.ICompare("hxx") == 0) ||
+			(ext.ICompare("hpp") == 0) || (ext.ICompare("h++") == 0);
+}
+
+
+include_record *
+IncludeScanner::RecordFor(BuildInfo &info, const char *path)
+{
+	BString key(path);
+
+	fLock.Lock();
+	std::map<BString, include_record*>::iterator i = fRecords.find(key);
+	if (i != fRecords.end())
+	{
+		include_record *record = i->second;
+		fLock.Unlock();
+		return record;
+	}
+	fLock.Unlock();
+
+	// Read and parse the file without holding the lock so that the other build
+	// threads can keep working. The worst case is two threads scanning the same
+	// header at the same time, in which case the first one to finish wins.
+	include_record *record = new include_record;
+
+	BFile file(path,B_READ_ONLY);
+	off_t size = 0;
+	if (file.InitCheck() == B_OK && file.GetSize(&size) == B_OK && size > 0)
+	{
+		char *buffer = new char[size];
+		ssize_t bytesRead = file.Read(buffer,size);
+		if (bytesRead > 0)
+			ParseIncludes(buffer,bytesRead,*record);
+		delete [] buffer;
+	}
+
+	BString folder(path);
+	int32 slash = folder.FindLast("/");
+	if (slash >= 0)
+		folder.Truncate(slash);
+
+	for (size_t j = 0; j < record->directives.size(); j++)
+	{
+		BString resolved = Resolve(info,folder.String(),record->directives[j]);
+		if (resolved.Length() > 0)
+			record->includes.push_back(resolved);
+	}
+
+	STRACE(2,("Scanned %s: %ld includes, %ld found\n",path,
+			(long)record->directives.size(),(long)record->includes.size()));
+
+	BAutolock lock(fLock);
+	i = fRecords.find(key);
+	if (i != fRecords.end())
+	{
+		delete record;
+		return i->second;
+	}
+	fRecords[key] = record;
+	return record;
+}
+
+
+BString
+IncludeScanner::Resolve(BuildInfo &info, const char *folder,
+						const include_directive &directive)
+{
+	BString testpath;
+
+	if (directive.name[0] == '/')
+	{
+		testpath = NormalizePath(directive.name.String());
+		return file_exists(testpath.String()) ? testpath : BString();
+	}
+
+	// Quoted includes are looked for next to the including file first
+	if (directive.quoted)
+	{
+		testpath = folder;
+		testpath << "/" << directive.name;
+		testpath = NormalizePath(testpath.String());
+		if (file_exists(testpath.String()))
+			return testpath;
+	}
+
+	int32 count = info.includeList.CountItems();
+	for (int32 i = 0; i < count; i++)
+	{
+		testpath = info.includeList.ItemAt(i)->Absolute();
+		testpath << "/" << directive.name;
+		testpath = NormalizePath(testpath.String());
+		if (file_exists(testpath.String()))
+			return testpath;
+	}
+
+	return BString();
+}
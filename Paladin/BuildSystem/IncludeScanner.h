@@ -0,0 +1,74 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef INCLUDE_SCANNER_H
+#define INCLUDE_SCANNER_H
+
+#include <map>
+#include <vector>
+
+#include <Locker.h>
+#include <String.h>
+
+class BuildInfo;
+
+typedef struct
+{
+	BString	name;
+	bool	quoted;
+
+	// True if nothing but comments, #pragmas and other includes comes before
+	// it in the file
+	bool	leading;
+} include_directive;
+
+// The result of scanning a single file
+typedef struct
+{
+	std::vector<include_directive>	directives;
+
+	// Absolute paths of the directives which could be found in the file's own
+	// folder or the project's include paths
+	std::vector<BString>			includes;
+} include_record;
+
+// Finds the headers a source file depends on without running the compiler.
+// Each file is only read once per session -- headers shared by many source
+// files are scanned the first time they are seen and the results are reused
+// until MakeEmpty() is called. The same goes for looking up a header by name
+// in the project's include paths.
+class IncludeScanner
+{
+public:
+						IncludeScanner(void);
+						~IncludeScanner(void);
+
+			status_t	GetDependencies(BuildInfo &info, const char *path,
+										std::vector<BString> &out);
+			status_t	GetDirectives(BuildInfo &info, const char *path,
+										std::vector<include_directive> &out);
+			BString		FindHeader(BuildInfo &info, const char *name);
+			void		MakeEmpty(void);
+
+	static	void		ParseIncludes(const char *data, size_t length,
+									include_record &record);
+	static	BString		NormalizePath(const char *path);
+
+	// Takes the prerequisites out of a makefile rule like the ones the
+	// compiler writes with -MD. The target itself is left out.
+	static	void		ParseMakeDependencies(const char *data, size_t length,
+									std::vector<BString> &out);
+	static	bool		IsHeader(const char *path);
+
+private:
+			include_record *	RecordFor(BuildInfo &info, const char *path);
+			BString		Resolve(BuildInfo &info, const char *folder,
+								const include_directive &directive);
+
+	BLocker								fLock;
+	std::map<BString, include_record*>	fRecords;
+	std::map<BString, BString>			fHeaders;
+};
+
+#endif
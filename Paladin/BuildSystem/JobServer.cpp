@@ -0,0 +1,337 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#include "JobServer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <Autolock.h>
+#include <String.h>
+
+#include "DebugTools.h"
+
+JobServer::JobServer(void)
+	:	fLock("job server lock"),
+		fReadFD(-1),
+		fWriteFD(-1),
+		fIsClient(false),
+		fOwnsFDs(false),
+		fSlots(0),
+		fImplicitFree(true)
+{
+}
+
+
+JobServer::~JobServer(void)
+{
+	if (!fOwnsFDs)
+		return;
+
+	if (fWriteFD >= 0 && fWriteFD != fReadFD)
+		close(fWriteFD);
+	if (fReadFD >= 0)
+		close(fReadFD);
+}
+
+
+status_t
+JobServer::Init(int32 jobs)
+{
+	BAutolock lock(fLock);
+	if (fReadFD >= 0)
+		return B_OK;
+
+	const char *flags = getenv("MAKEFLAGS");
+	if (flags && ParseMakeFlags(flags))
+	{
+		fIsClient = true;
+		if (fSlots < 1)
+			fSlots = jobs;
+		STRACE(1,("Using the jobserver of make with %" B_PRId32 " slots\n",
+				fSlots));
+		return B_OK;
+	}
+
+	return Serve(jobs);
+}
+
+
+bool
+JobServer::Acquire(int &token, bigtime_t timeout)
+{
+	fLock.Lock();
+	int fd = fReadFD;
+	if (fImplicitFree || fd < 0)
+	{
+		fImplicitFree = false;
+		fLock.Unlock();
+		token = -1;
+		return true;
+	}
+	fLock.Unlock();
+
+	// The pipe is shared with make and the tools the build runs, so it has to
+	// stay blocking for them. If someone else takes the token between poll()
+	// and read(), this waits for the next one like make does, which may take
+	// longer than the timeout. A named pipe is opened by this process alone
+	// and doesn't block, so that can't happen with one.
+	bigtime_t deadline = timeout == B_INFINITE_TIMEOUT
+		? B_INFINITE_TIMEOUT : system_time() + timeout;
+	unsigned char byte;
+	while (true)
+	{
+		int wait = -1;
+		if (deadline != B_INFINITE_TIMEOUT)
+		{
+			bigtime_t left = deadline - system_time();
+			wait = left > 0 ? (int)(left / 1000) : 0;
+		}
+
+		struct pollfd item;
+		item.fd = fd;
+		item.events = POLLIN;
+		item.revents = 0;
+		int result = poll(&item,1,wait);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0)
+			return false;
+
+		ssize_t bytes = read(fd,&byte,1);
+		if (bytes == 1)
+			break;
+		if (bytes < 0 && (errno == EAGAIN || errno == EINTR))
+			continue;
+		return false;
+	}
+
+	token = byte;
+	return true;
+}
+
+
+void
+JobServer::Release(int token)
+{
+	if (token < 0)
+	{
+		BAutolock lock(fLock);
+		fImplicitFree = true;
+		return;
+	}
+
+	unsigned char byte = (unsigned char)token;
+	ssize_t bytes;
+	do
+	{
+		bytes = write(fWriteFD,&byte,1);
+	} while (bytes < 0 && (errno == EINTR || errno == EAGAIN));
+}
+
+
+bool
+JobServer::ParseMakeFlags(const char *flags)
+{
+	// Older versions of make call it --jobserver-fds. The last one counts.
+	BString makeFlags(flags);
+	const char *option = "--jobserver-auth=";
+	int32 start = makeFlags.FindLast(option);
+	if (start < 0)
+	{
+		option = "--jobserver-fds=";
+		start = makeFlags.FindLast(option);
+	}
+	if (start < 0)
+		return false;
+
+	start += strlen(option);
+	int32 end = makeFlags.FindFirst(" ",start);
+	if (end < 0)
+		end = makeFlags.Length();
+
+	BString value;
+	makeFlags.CopyInto(value,start,end - start);
+
+	if (value.FindFirst("fifo:") == 0)
+	{
+		// Newer versions of make use a named pipe, which everyone opens for
+		// themselves
+		value.Remove(0,5);
+		int fd = open(value.String(),O_RDWR | O_CLOEXEC | O_NONBLOCK);
+		if (fd < 0)
+			return false;
+
+		fReadFD = fWriteFD = fd;
+		fOwnsFDs = true;
+	}
+	else
+	{
+		// make only passes the pipe on to commands it knows to be recursive,
+		// so the descriptors aren't necessarily open
+		int readFD, writeFD;
+		if (sscanf(value.String(),"%d,%d",&readFD,&writeFD) != 2
+			|| readFD < 0 || writeFD < 0
+			|| fcntl(readFD,F_GETFD) == -1 || fcntl(writeFD,F_GETFD) == -1)
+			return false;
+
+		fReadFD = readFD;
+		fWriteFD = writeFD;
+		SetCloseOnExec(fReadFD,true);
+		SetCloseOnExec(fWriteFD,true);
+	}
+
+	// The number of jobs is only there for information, but it is still the
+	// best guess for how many threads are worth starting
+	int32 word = 0;
+	while (word < makeFlags.Length())
+	{
+		int32 next = makeFlags.FindFirst(" ",word);
+		if (next < 0)
+			next = makeFlags.Length();
+
+		if (next - word > 2 && makeFlags.ByteAt(word) == '-'
+			&& makeFlags.ByteAt(word + 1) == 'j')
+		{
+			int32 jobs = atol(makeFlags.String() + word + 2);
+			if (jobs > 0)
+				fSlots = jobs;
+		}
+		word = next + 1;
+	}
+	return true;
+}
+
+
+status_t
+JobServer::Serve(int32 jobs)
+{
+	if (jobs < 1)
+		jobs = 1;
+
+	// The descriptors are only handed on to the processes of the build which
+	// take part, see SetInherited()
+	int fds[2];
+	if (pipe(fds) != 0)
+		return errno;
+
+	// Every job but the one which is always allowed needs a token
+	for (int32 i = 1; i < jobs; i++)
+	{
+		if (write(fds[1],"+",1) != 1)
+		{
+			close(fds[0]);
+			close(fds[1]);
+			return B_ERROR;
+		}
+	}
+
+	fReadFD = fds[0];
+	fWriteFD = fds[1];
+	fOwnsFDs = true;
+	SetCloseOnExec(fReadFD,true);
+	SetCloseOnExec(fWriteFD,true);
+	fSlots = jobs;
+
+	BString makeFlags(getenv("MAKEFLAGS"));
+	makeFlags << " -j" << jobs << " --jobserver-auth=" << fReadFD << ","
+		<< fWriteFD;
+	setenv("MAKEFLAGS",makeFlags.String(),1);
+
+	STRACE(1,("Offering a jobserver with %" B_PRId32 " slots\n",jobs));
+	return B_OK;
+}
+
+
+void
+JobServer::SetInherited(bool inherited)
+{
+	BAutolock lock(fLock);
+	if (fReadFD < 0)
+		return;
+
+	SetCloseOnExec(fReadFD,!inherited);
+	if (fWriteFD != fReadFD)
+		SetCloseOnExec(fWriteFD,!inherited);
+}
+
+
+bool
+JobServer::IsUsedBy(const char *command)
+{
+	if (!command)
+		return false;
+
+	if (strstr(command,"-flto=jobserver") != NULL)
+		return true;
+
+	// make, which may be called by its full path or as part of a longer
+	// command line
+	const char *start = command;
+	while ((start = strstr(start,"make")) != NULL)
+	{
+		bool wordStart = start == command || start[-1] == ' '
+			|| start[-1] == '/' || start[-1] == ';' || start[-1] == '&'
+			|| start[-1] == '|' || start[-1] == '(';
+		bool wordEnd = start[4] == '\0' || start[4] == ' ' || start[4] == ';';
+		if (wordStart && wordEnd)
+			return true;
+		start += 4;
+	}
+	return false;
+}
+
+
+void
+JobServer::SetCloseOnExec(int fd, bool closeOnExec)
+{
+	int flags = fcntl(fd,F_GETFD);
+	if (flags == -1)
+		return;
+
+	if (closeOnExec)
+		flags |= FD_CLOEXEC;
+	else
+		flags &= ~FD_CLOEXEC;
+	fcntl(fd,F_SETFD,flags);
+}
+
+
+JobToken::JobToken(JobServer &server)
+	:	fServer(server),
+		fToken(-1),
+		fHeld(false)
+{
+}
+
+
+JobToken::~JobToken(void)
+{
+	Release();
+}
+
+
+bool
+JobToken::Acquire(bigtime_t timeout)
+{
+	if (!fHeld)
+		fHeld = fServer.Acquire(fToken,timeout);
+	return fHeld;
+}
+
+
+void
+JobToken::Release(void)
+{
+	if (!fHeld)
+		return;
+
+	fServer.Release(fToken);
+	fHeld = false;
+}
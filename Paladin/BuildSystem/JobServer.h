@@ -0,0 +1,83 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef JOB_SERVER_H
+#define JOB_SERVER_H
+
+#include <Locker.h>
+#include <OS.h>
+
+// Limits how many jobs run at once, together with make and anything else
+// which uses GNU make's jobserver protocol.
+//
+// The protocol is a pipe holding one byte for each job which may run in
+// addition to the one every process may always run. A job takes a byte out
+// before it starts and puts it back once it is done.
+//
+// When Paladin is run by make with a jobserver, which make announces in
+// MAKEFLAGS, the builds use make's pipe, so they don't run more jobs than
+// make was told to. Otherwise Paladin sets up a pipe of its own and puts it
+// into MAKEFLAGS. The tools the build runs, like make or gcc with
+// -flto=jobserver, then stay within the same limit as Paladin's own jobs.
+// Only those get the pipe, though. Everything else has it closed.
+//
+// Until Init() has been called, there is no limit at all.
+class JobServer
+{
+public:
+						JobServer(void);
+						~JobServer(void);
+
+	// Uses the jobserver in MAKEFLAGS if there is one, or else offers one
+	// for the given number of jobs
+	status_t			Init(int32 jobs);
+
+	bool				IsClient(void) const { return fIsClient; }
+
+	// The most jobs which may run at once, as far as it is known
+	int32				CountSlots(void) const { return fSlots; }
+
+	// Waits up to the timeout for a job slot. Returns false if none was free
+	// in time. The token is what has to be handed back to Release().
+	bool				Acquire(int &token, bigtime_t timeout);
+	void				Release(int token);
+
+	// The pipe is closed in the processes the build starts unless it is
+	// asked for here. Only those which take part in the protocol get it.
+	void				SetInherited(bool inherited);
+	static	bool		IsUsedBy(const char *command);
+
+private:
+	bool				ParseMakeFlags(const char *flags);
+	status_t			Serve(int32 jobs);
+	static	void		SetCloseOnExec(int fd, bool closeOnExec);
+
+	BLocker				fLock;
+	int					fReadFD;
+	int					fWriteFD;
+	bool				fIsClient;
+	bool				fOwnsFDs;
+	int32				fSlots;
+
+	// The slot which doesn't need a token is marked by this instead
+	bool				fImplicitFree;
+};
+
+// Holds a job slot for as long as it exists
+class JobToken
+{
+public:
+						JobToken(JobServer &server);
+						~JobToken(void);
+
+	bool				Acquire(bigtime_t timeout);
+	void				Release(void);
+
+private:
+	JobServer			&fServer;
+	int					fToken;
+	bool				fHeld;
+};
+
+#endif
@@ -0,0 +1,417 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#include "ObjectCache.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <Autolock.h>
+#include <Directory.h>
+#include <Entry.h>
+#include <File.h>
+#include <Path.h>
+
+#include "BuildInfo.h"
+#include "ContentHash.h"
+#include "DebugTools.h"
+
+typedef struct
+{
+	time_t	mtime;
+	off_t	size;
+	BString	path;
+} cache_entry;
+
+
+static bool
+compare_cache_entries(const cache_entry &a, const cache_entry &b)
+{
+	return a.mtime < b.mtime;
+}
+
+
+static status_t
+copy_file(const char *from, const char *to)
+{
+	BFile in(from,B_READ_ONLY);
+	off_t size;
+	status_t status = in.InitCheck();
+	if (status == B_OK)
+		status = in.GetSize(&size);
+	if (status != B_OK)
+		return status;
+
+	// Other build threads -- or other machines when it's the shared folder --
+	// may be reading the destination, so it is replaced in one step
+	BString tempPath(to);
+	tempPath << "." << find_thread(NULL) << ".tmp";
+
+	BFile out(tempPath.String(),B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
+	status = out.InitCheck();
+	if (status != B_OK)
+		return status;
+
+	char buffer[32768];
+	off_t remaining = size;
+	while (remaining > 0 && status == B_OK)
+	{
+		ssize_t bytesRead = in.Read(buffer,sizeof(buffer));
+		if (bytesRead <= 0 || out.Write(buffer,bytesRead) != bytesRead)
+			status = B_IO_ERROR;
+		remaining -= bytesRead;
+	}
+	out.Unset();
+
+	if (status == B_OK && rename(tempPath.String(),to) != 0)
+		status = B_ERROR;
+	if (status != B_OK)
+		BEntry(tempPath.String()).Remove();
+
+	return status;
+}
+
+
+static void
+read_text(const char *path, BString &out)
+{
+	out = "";
+
+	BFile file(path,B_READ_ONLY);
+	off_t size;
+	if (file.InitCheck() != B_OK || file.GetSize(&size) != B_OK || size < 1)
+		return;
+
+	char *buffer = out.LockBuffer(size);
+	ssize_t bytesRead = file.Read(buffer,size);
+	out.UnlockBuffer(bytesRead > 0 ? bytesRead : 0);
+}
+
+
+ObjectCache::ObjectCache(void)
+	:	fLock("object cache lock"),
+		fSizeLimit(1024LL * 1024 * 1024),
+		fSize(0),
+		fSizeKnown(false),
+		fHits(0),
+		fMisses(0)
+{
+}
+
+
+ObjectCache::~ObjectCache(void)
+{
+}
+
+
+void
+ObjectCache::SetFolder(const char *path)
+{
+	BAutolock lock(fLock);
+	fFolder = path;
+	fSizeKnown = false;
+}
+
+
+void
+ObjectCache::SetSharedFolder(const char *path)
+{
+	BAutolock lock(fLock);
+	fSharedFolder = path;
+}
+
+
+void
+ObjectCache::SetSizeLimit(off_t bytes)
+{
+	BAutolock lock(fLock);
+	fSizeLimit = bytes;
+}
+
+
+BString
+ObjectCache::MakeKey(BuildInfo &info, const char *command,
+					const std::vector<BString> &files,
+					const std::vector<uint64> &hashes)
+{
+	// The paths stay as they are. Objects have the paths of their sources
+	// built into them, in debugging information and __FILE__, so one from
+	// another copy of a project would point into the wrong folder.
+	BString normalized(command);
+	if (normalized.StartsWith("ccache "))
+		normalized.Remove(0,7);
+
+	BString data(normalized);
+	data << "\n" << CompilerIdentity(normalized.String()) << "\n"
+		<< SystemIdentity();
+
+	for (size_t i = 0; i < files.size() && i < hashes.size(); i++)
+	{
+		char hashString[32];
+		sprintf(hashString," %016" B_PRIx64 "\n",hashes[i]);
+		data << files[i] << hashString;
+	}
+
+	// Two differently seeded hashes make for a 128-bit key
+	uint64 first = HashBuffer(data.String(),data.Length());
+	uint64 second = HashBuffer(data.String(),data.Length(),first);
+
+	char key[40];
+	sprintf(key,"%016" B_PRIx64 "%016" B_PRIx64,first,second);
+	return BString(key);
+}
+
+
+bool
+ObjectCache::Fetch(const char *key, const char *objectPath, BString &output)
+{
+	fLock.Lock();
+	BString localPath = PathFor(fFolder.String(),key,".o");
+	BString sharedPath = PathFor(fSharedFolder.String(),key,".o");
+	fLock.Unlock();
+
+	if (localPath.Length() > 0 && copy_file(localPath.String(),objectPath) == B_OK)
+	{
+		read_text(PathFor(fFolder.String(),key,".out").String(),output);
+
+		// Keep recently used objects from being trimmed
+		BEntry(localPath.String()).SetModificationTime(real_time_clock());
+
+		atomic_add(&fHits,1);
+		STRACE(2,("Object cache hit for %s\n",objectPath));
+		return true;
+	}
+
+	if (sharedPath.Length() > 0 && copy_file(sharedPath.String(),objectPath) == B_OK)
+	{
+		read_text(PathFor(fSharedFolder.String(),key,".out").String(),output);
+
+		// Keep a local copy so the next hit doesn't need the shared folder
+		Store(key,objectPath,output.String());
+
+		atomic_add(&fHits,1);
+		STRACE(2,("Shared object cache hit for %s\n",objectPath));
+		return true;
+	}
+
+	atomic_add(&fMisses,1);
+	return false;
+}
+
+
+status_t
+ObjectCache::Store(const char *key, const char *objectPath, const char *output)
+{
+	fLock.Lock();
+	BString folder(fFolder);
+	BString sharedFolder(fSharedFolder);
+	fLock.Unlock();
+
+	if (folder.Length() == 0)
+		return B_NO_INIT;
+
+	BString localPath = PathFor(folder.String(),key,".o");
+	BString subfolder(localPath);
+	subfolder.Truncate(subfolder.FindLast("/"));
+	create_directory(subfolder.String(),0777);
+
+	// The compiler output goes in first so that whoever finds the object also
+	// finds its warnings
+	if (output && *output)
+	{
+		BString outputPath = PathFor(folder.String(),key,".out");
+		BFile file(outputPath.String(),B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
+		if (file.InitCheck() == B_OK)
+			file.Write(output,strlen(output));
+	}
+
+	status_t status = copy_file(objectPath,localPath.String());
+	if (status != B_OK)
+	{
+		STRACE(1,("Couldn't add %s to the object cache\n",objectPath));
+		return status;
+	}
+
+	if (sharedFolder.Length() > 0
+		&& !BEntry(PathFor(sharedFolder.String(),key,".o").String()).Exists())
+	{
+		BString sharedPath = PathFor(sharedFolder.String(),key,".o");
+		BString sharedSub(sharedPath);
+		sharedSub.Truncate(sharedSub.FindLast("/"));
+		create_directory(sharedSub.String(),0777);
+
+		if (output && *output)
+		{
+			BFile file(PathFor(sharedFolder.String(),key,".out").String(),
+						B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
+			if (file.InitCheck() == B_OK)
+				file.Write(output,strlen(output));
+		}
+		copy_file(objectPath,sharedPath.String());
+	}
+
+	struct stat s;
+	BAutolock lock(fLock);
+	if (fSizeKnown && stat(localPath.String(),&s) == 0)
+		fSize += s.st_size;
+	if (!fSizeKnown || fSize > fSizeLimit)
+		Trim();
+
+	return B_OK;
+}
+
+
+void
+ObjectCache::ResetStats(void)
+{
+	fHits = 0;
+	fMisses = 0;
+}
+
+
+BString
+ObjectCache::PathFor(const char *folder, const char *key,
+					const char *extension) const
+{
+	BString path;
+	if (!folder || *folder == 0 || !key || strlen(key) < 2)
+		return path;
+
+	// Objects are spread over subfolders named after the first two digits of
+	// their key to keep the folders small
+	path << folder << "/";
+	path.Append(key,2);
+	path << "/" << key << extension;
+	return path;
+}
+
+
+BString
+ObjectCache::CompilerIdentity(const char *command)
+{
+	BString compiler(command);
+	int32 space = compiler.FindFirst(" ");
+	if (space >= 0)
+		compiler.Truncate(space);
+
+	BAutolock lock(fLock);
+
+	std::map<BString, BString>::iterator i = fCompilers.find(compiler);
+	if (i != fCompilers.end())
+		return i->second;
+
+	// A compiler is identified by where it is, its size and its modification
+	// time, so an update of the development tools starts over with a clean
+	// slate instead of reusing objects from the old compiler
+	BString path(compiler);
+	if (path.FindFirst("/") < 0 && getenv("PATH"))
+	{
+		BString searchPath(getenv("PATH"));
+		int32 start = 0;
+		while (start <= searchPath.Length())
+		{
+			int32 end = searchPath.FindFirst(":",start);
+			if (end < 0)
+				end = searchPath.Length();
+
+			BString test(searchPath.String() + start,end - start);
+			test << "/" << compiler;
+			if (BEntry(test.String()).Exists())
+			{
+				path = test;
+				break;
+			}
+			start = end + 1;
+		}
+	}
+
+	BString identity(path);
+	struct stat s;
+	if (stat(path.String(),&s) == 0)
+		identity << " " << (int64)s.st_size << " " << (int64)s.st_mtime;
+
+	fCompilers[compiler] = identity;
+	return identity;
+}
+
+
+BString
+ObjectCache::SystemIdentity(void)
+{
+	// The headers in the system folders aren't among the files which are
+	// hashed for each source. They only change along with the packages they
+	// come from, so the state of the installed packages stands in for them.
+	static const char *kFolders[] =
+	{
+		"/boot/system/packages",
+		"/boot/system/develop/headers",
+		NULL
+	};
+
+	BString identity;
+	for (int32 i = 0; kFolders[i] != NULL; i++)
+	{
+		struct stat s;
+		if (stat(kFolders[i],&s) != 0)
+			continue;
+		identity << kFolders[i] << " " << (int64)s.st_mtime << " "
+			<< (int64)s.st_ctime << "\n";
+	}
+	return identity;
+}
+
+
+void
+ObjectCache::Trim(void)
+{
+	// Called with the lock held
+	std::vector<cache_entry> entries;
+	off_t total = 0;
+
+	BDirectory folder(fFolder.String());
+	BEntry subEntry;
+	while (folder.GetNextEntry(&subEntry) == B_OK)
+	{
+		if (!subEntry.IsDirectory())
+			continue;
+
+		BDirectory subfolder(&subEntry);
+		BEntry entry;
+		while (subfolder.GetNextEntry(&entry) == B_OK)
+		{
+			struct stat s;
+			BPath path;
+			if (entry.GetStat(&s) != B_OK || entry.GetPath(&path) != B_OK)
+				continue;
+
+			cache_entry item;
+			item.mtime = s.st_mtime;
+			item.size = s.st_size;
+			item.path = path.Path();
+			entries.push_back(item);
+			total += s.st_size;
+		}
+	}
+
+	fSize = total;
+	fSizeKnown = true;
+	if (fSize <= fSizeLimit)
+		return;
+
+	// Throw out the least recently used objects until there is some room
+	// to spare so that this doesn't have to happen on every store
+	std::sort(entries.begin(),entries.end(),compare_cache_entries);
+
+	off_t target = fSizeLimit - fSizeLimit / 10;
+	for (size_t i = 0; i < entries.size() && fSize > target; i++)
+	{
+		if (BEntry(entries[i].path.String()).Remove() == B_OK)
+			fSize -= entries[i].size;
+	}
+
+	STRACE(1,("Trimmed object cache to %" B_PRId64 " bytes\n",(int64)fSize));
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef OBJECT_CACHE_H
+#define OBJECT_CACHE_H
+
+#include <map>
+#include <vector>
+
+#include <Locker.h>
+#include <String.h>
+
+class BuildInfo;
+
+// A content-addressed store of compiled objects. An object is filed under a
+// hash of everything which goes into it: the compile command, the compiler,
+// the installed system packages and the contents of the source and all of
+// its headers. Rebuilding the same code -- after a clean or after switching
+// branches back and forth -- gets the object straight out of the cache.
+//
+// The cache lives in a local folder and can optionally also look in a shared
+// one, for example on a network drive used by several machines. Objects
+// found in the shared folder are copied into the local one.
+class ObjectCache
+{
+public:
+						ObjectCache(void);
+						~ObjectCache(void);
+
+			void		SetFolder(const char *path);
+			void		SetSharedFolder(const char *path);
+			void		SetSizeLimit(off_t bytes);
+
+			BString		MakeKey(BuildInfo &info, const char *command,
+								const std::vector<BString> &files,
+								const std::vector<uint64> &hashes);
+
+			bool		Fetch(const char *key, const char *objectPath,
+								BString &output);
+			status_t	Store(const char *key, const char *objectPath,
+								const char *output);
+
+			void		ResetStats(void);
+			int32		CountHits(void) const { return fHits; }
+			int32		CountMisses(void) const { return fMisses; }
+
+private:
+			BString		PathFor(const char *folder, const char *key,
+								const char *extension) const;
+			BString		CompilerIdentity(const char *command);
+			BString		SystemIdentity(void);
+			void		Trim(void);
+
+	BLocker						fLock;
+	BString						fFolder;
+	BString						fSharedFolder;
+	off_t						fSizeLimit;
+	off_t						fSize;
+	bool						fSizeKnown;
+
+	std::map<BString, BString>	fCompilers;
+
+	int32						fHits;
+	int32						fMisses;
+};
+
+#endif
@@ -0,0 +1,257 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#include "ObjectHash.h"
+
+#include <string.h>
+
+#include <File.h>
+#include <String.h>
+
+#include "ContentHash.h"
+
+// Only the few parts of the ELF format needed here are described, so there
+// is no dependency on a system elf.h which differs between the platforms
+#define ELF_CLASS_32		1
+#define ELF_CLASS_64		2
+#define ELF_DATA_LSB		1
+#define ELF_DATA_MSB		2
+#define ELF_TYPE_REL		1
+
+#define SECTION_SYMTAB		2
+#define SECTION_STRTAB		3
+#define SECTION_RELA		4
+#define SECTION_NOBITS		8
+#define SECTION_REL			9
+
+typedef struct
+{
+	uint32	name;
+	uint32	type;
+	uint64	flags;
+	uint64	offset;
+	uint64	size;
+	uint32	link;
+	uint32	info;
+	uint64	entsize;
+} section_info;
+
+
+static inline uint16
+read16(const uint8 *p)
+{
+	uint16 value;
+	memcpy(&value,p,sizeof(value));
+	return value;
+}
+
+
+static inline uint32
+read32(const uint8 *p)
+{
+	uint32 value;
+	memcpy(&value,p,sizeof(value));
+	return value;
+}
+
+
+static inline uint64
+read64(const uint8 *p)
+{
+	uint64 value;
+	memcpy(&value,p,sizeof(value));
+	return value;
+}
+
+
+static bool
+is_skipped_section(const char *name, bool withDebugInfo)
+{
+	// Line numbers and file names end up in these, which is exactly what
+	// changes when nothing else does. A debugger needs them to be right,
+	// though, so they only go when there is no debugging to be done.
+	if (!withDebugInfo
+		&& (strncmp(name,".debug",6) == 0 || strncmp(name,".zdebug",7) == 0))
+		return true;
+
+	return strcmp(name,".comment") == 0 || strcmp(name,".gnu_debuglink") == 0
+		|| strcmp(name,".note.gnu.build-id") == 0;
+}
+
+
+static uint64
+hash_value(uint64 value, uint64 hash)
+{
+	return HashBuffer(&value,sizeof(value),hash);
+}
+
+
+status_t
+HashObjectCode(const void *buffer, size_t length, uint64 *hash,
+				bool withDebugInfo)
+{
+	const uint8 *data = (const uint8 *)buffer;
+	if (!data || !hash || length < 64 || memcmp(data,"\x7f" "ELF",4) != 0)
+		return B_BAD_DATA;
+
+	uint16 endianTest = 1;
+	bool littleEndian = *(uint8 *)&endianTest == 1;
+	if (data[5] != (littleEndian ? ELF_DATA_LSB : ELF_DATA_MSB))
+		return B_BAD_DATA;
+
+	bool is64 = data[4] == ELF_CLASS_64;
+	if (!is64 && data[4] != ELF_CLASS_32)
+		return B_BAD_DATA;
+
+	if (read16(data + 16) != ELF_TYPE_REL)
+		return B_BAD_DATA;
+
+	uint64 sectionOffset = is64 ? read64(data + 40) : read32(data + 32);
+	uint16 sectionSize = read16(data + (is64 ? 58 : 46));
+	uint16 sectionCount = read16(data + (is64 ? 60 : 48));
+	uint16 namesIndex = read16(data + (is64 ? 62 : 50));
+
+	if (sectionSize < (is64 ? 64 : 40) || namesIndex >= sectionCount
+		|| sectionOffset > length
+		|| (uint64)sectionCount * sectionSize > length - sectionOffset)
+		return B_BAD_DATA;
+
+	section_info *sections = new section_info[sectionCount];
+	for (uint16 i = 0; i < sectionCount; i++)
+	{
+		const uint8 *p = data + sectionOffset + (uint64)i * sectionSize;
+		section_info &section = sections[i];
+		section.name = read32(p);
+		section.type = read32(p + 4);
+		if (is64)
+		{
+			section.flags = read64(p + 8);
+			section.offset = read64(p + 24);
+			section.size = read64(p + 32);
+			section.link = read32(p + 40);
+			section.info = read32(p + 44);
+			section.entsize = read64(p + 56);
+		}
+		else
+		{
+			section.flags = read32(p + 8);
+			section.offset = read32(p + 16);
+			section.size = read32(p + 20);
+			section.link = read32(p + 24);
+			section.info = read32(p + 28);
+			section.entsize = read32(p + 36);
+		}
+
+		if (section.type != SECTION_NOBITS && (section.offset > length
+			|| section.size > length - section.offset))
+		{
+			delete [] sections;
+			return B_BAD_DATA;
+		}
+	}
+
+	const section_info &names = sections[namesIndex];
+	const char *nameTable = (const char *)data + names.offset;
+
+	// Names are looked up through here so that a broken object can't make
+	// this read past the end of a string table
+	#define SECTION_NAME(index) (sections[index].name < names.size \
+		&& memchr(nameTable + sections[index].name,0, \
+				names.size - sections[index].name) \
+		? nameTable + sections[index].name : "")
+
+	uint64 result = 0;
+	for (uint16 i = 0; i < sectionCount; i++)
+	{
+		const section_info &section = sections[i];
+		const char *name = SECTION_NAME(i);
+
+		if (section.type == SECTION_STRTAB || is_skipped_section(name,withDebugInfo))
+			continue;
+
+		// Relocations for the debugging information go along with it
+		if ((section.type == SECTION_RELA || section.type == SECTION_REL)
+			&& section.info < sectionCount
+			&& is_skipped_section(SECTION_NAME(section.info),withDebugInfo))
+			continue;
+
+		result = HashBuffer(name,strlen(name) + 1,result);
+		result = hash_value(section.type,result);
+		result = hash_value(section.flags,result);
+		result = hash_value(section.size,result);
+
+		if (section.type == SECTION_NOBITS)
+			continue;
+
+		if (section.type != SECTION_SYMTAB)
+		{
+			result = HashBuffer(data + section.offset,section.size,result);
+			continue;
+		}
+
+		// Symbols are hashed by name rather than by their place in the
+		// string table
+		uint64 entrySize = is64 ? 24 : 16;
+		if (section.entsize < entrySize || section.link >= sectionCount)
+		{
+			delete [] sections;
+			return B_BAD_DATA;
+		}
+
+		const section_info &strings = sections[section.link];
+		const char *stringTable = (const char *)data + strings.offset;
+		for (uint64 offset = 0; offset + entrySize <= section.size;
+				offset += section.entsize)
+		{
+			const uint8 *p = data + section.offset + offset;
+			uint32 nameOffset = read32(p);
+			uint16 index = read16(p + (is64 ? 6 : 14));
+
+			if (index < sectionCount && index != 0
+				&& is_skipped_section(SECTION_NAME(index),withDebugInfo))
+				continue;
+
+			const char *symbolName = "";
+			if (nameOffset < strings.size
+				&& memchr(stringTable + nameOffset,0,strings.size - nameOffset))
+				symbolName = stringTable + nameOffset;
+
+			result = HashBuffer(symbolName,strlen(symbolName) + 1,result);
+			if (is64)
+			{
+				result = HashBuffer(p + 4,4,result);
+				result = HashBuffer(p + 8,16,result);
+			}
+			else
+				result = HashBuffer(p + 4,12,result);
+		}
+	}
+	#undef SECTION_NAME
+
+	delete [] sections;
+	*hash = result;
+	return B_OK;
+}
+
+
+status_t
+HashObjectCode(const char *path, uint64 *hash, bool withDebugInfo)
+{
+	BFile file(path,B_READ_ONLY);
+	off_t size;
+	status_t status = file.InitCheck();
+	if (status == B_OK)
+		status = file.GetSize(&size);
+	if (status != B_OK)
+		return status;
+
+	uint8 *buffer = new uint8[size];
+	if (file.Read(buffer,size) != size)
+		status = B_IO_ERROR;
+	else
+		status = HashObjectCode(buffer,size,hash,withDebugInfo);
+
+	delete [] buffer;
+	return status;
+}
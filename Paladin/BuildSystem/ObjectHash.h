@@ -0,0 +1,26 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef OBJECT_HASH_H
+#define OBJECT_HASH_H
+
+#include <SupportDefs.h>
+
+// Hashes what an ELF object contributes to the linked target: its code, data,
+// relocations and symbols. Debugging information and comments are left out,
+// so recompiling a file after a change which didn't affect the generated code
+// -- editing a comment, say, or a header declaration the file doesn't use --
+// gives the same hash even though the object itself is different.
+//
+// With withDebugInfo, the debugging information counts, too, since moving
+// code to other lines changes what a debugger shows.
+//
+// Returns B_BAD_DATA for anything which isn't a relocatable ELF object in
+// the host's byte order.
+status_t	HashObjectCode(const char *path, uint64 *hash,
+						bool withDebugInfo = false);
+status_t	HashObjectCode(const void *data, size_t length, uint64 *hash,
+						bool withDebugInfo = false);
+
+#endif
@@ -0,0 +1,230 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#include "PrecompiledHeader.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sys/stat.h>
+
+#include <Entry.h>
+#include <File.h>
+
+#include "BuildInfo.h"
+#include "DebugTools.h"
+#include "Globals.h"
+#include "IncludeScanner.h"
+#include "ProcessExecutor.h"
+
+// A header has to be included by at least this many source files -- and by
+// at least half of them -- to be worth precompiling
+#define PCH_MINIMUM_USERS 2
+
+typedef std::pair<BString, int32> header_count;
+
+
+static bool
+compare_header_counts(const header_count &a, const header_count &b)
+{
+	if (a.second != b.second)
+		return a.second > b.second;
+	return a.first < b.first;
+}
+
+
+static void
+read_file(const char *path, BString &out)
+{
+	out = "";
+
+	BFile file(path,B_READ_ONLY);
+	off_t size;
+	if (file.InitCheck() != B_OK || file.GetSize(&size) != B_OK || size < 1)
+		return;
+
+	char *buffer = out.LockBuffer(size);
+	ssize_t bytesRead = file.Read(buffer,size);
+	out.UnlockBuffer(bytesRead > 0 ? bytesRead : 0);
+}
+
+
+PrecompiledHeader::PrecompiledHeader(void)
+	:	fReady(false)
+{
+}
+
+
+status_t
+PrecompiledHeader::Update(BuildInfo &info, const std::vector<BString> &sources,
+						const char *options)
+{
+	fReady = false;
+	fHeaders.clear();
+
+	// Only system headers are considered. Those hardly ever change, while
+	// the project's own headers often depend on what comes before them --
+	// even when they are included with angle brackets.
+	std::map<BString, int32> counts;
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		std::vector<include_directive> directives;
+		if (gIncludeScanner.GetDirectives(info,sources[i].String(),
+				directives) != B_OK)
+			continue;
+
+		std::set<BString> seen;
+		for (size_t j = 0; j < directives.size(); j++)
+		{
+			if (directives[j].quoted
+				|| !seen.insert(directives[j].name).second
+				|| gIncludeScanner.FindHeader(info,
+						directives[j].name.String()).Length() > 0)
+				continue;
+			counts[directives[j].name]++;
+		}
+	}
+
+	int32 threshold = MAX(PCH_MINIMUM_USERS,((int32)sources.size() + 1) / 2);
+	std::vector<header_count> selected;
+	std::map<BString, int32>::iterator i;
+	for (i = counts.begin(); i != counts.end(); i++)
+	{
+		if (i->second >= threshold)
+			selected.push_back(*i);
+	}
+
+	if (selected.empty())
+	{
+		STRACE(1,("No headers are common enough to be precompiled\n"));
+		return B_OK;
+	}
+
+	std::sort(selected.begin(),selected.end(),compare_header_counts);
+	for (size_t j = 0; j < selected.size(); j++)
+		fHeaders.insert(selected[j].first);
+
+	BString content;
+	content << "// Generated by Paladin from the headers most source files in "
+			"the project include.\n"
+			<< "// Compiled with: " << options << "\n";
+	for (size_t j = 0; j < selected.size(); j++)
+		content << "#include <" << selected[j].first << ">\n";
+
+	DPath headerPath(info.objectFolder);
+	headerPath.Append("(Precompiled).h");
+	fHeaderPath = headerPath.GetFullPath();
+
+	BString gchPath(fHeaderPath);
+	gchPath << ".gch";
+	BString depPath(fHeaderPath);
+	depPath << ".d";
+
+	BString oldContent;
+	read_file(fHeaderPath.String(),oldContent);
+	if (oldContent != content)
+	{
+		BFile file(fHeaderPath.String(),B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
+		if (file.InitCheck() != B_OK
+			|| file.Write(content.String(),content.Length()) != content.Length())
+		{
+			STRACE(1,("Couldn't write %s\n",fHeaderPath.String()));
+			return B_ERROR;
+		}
+		BEntry(gchPath.String()).Remove();
+	}
+	else if (IsCurrent(gchPath.String(),depPath.String()))
+	{
+		fReady = true;
+		return B_OK;
+	}
+
+	BString command("g++ -x c++-header -Wall -Wno-multichar -Wno-unknown-pragmas ");
+	if (gPlatform == PLATFORM_ZETA)
+		command << "-D_ZETA_TS_FIND_DIR_ ";
+	command << options << "'" << fHeaderPath << "' -o '" << gchPath
+			<< "' -MD -MF '" << depPath << "'";
+
+	STRACE(1,("Precompiling %" B_PRId32 " headers: %s\n",(int32)selected.size(),
+			command.String()));
+
+	// Run like the compiles, so that the header is stopped along with the
+	// build and shows up in its trace
+	BString output;
+	int status;
+	if (gProcessExecutor.Run(command.String(),output,&status) != B_OK
+		|| status != 0 || !BEntry(gchPath.String()).Exists())
+	{
+		// Not being able to precompile isn't an error. The build just goes
+		// on without it.
+		STRACE(1,("Couldn't precompile headers:\n%s\n",output.String()));
+		BEntry(gchPath.String()).Remove();
+		return B_ERROR;
+	}
+
+	fReady = true;
+	return B_OK;
+}
+
+
+void
+PrecompiledHeader::Clear(void)
+{
+	fReady = false;
+	fHeaders.clear();
+}
+
+
+bool
+PrecompiledHeader::Suits(BuildInfo &info, const char *source)
+{
+	if (!fReady || fHeaders.empty())
+		return false;
+
+	// A source which defines something like _GNU_SOURCE first, or which
+	// doesn't include all of the headers, would see different code
+	std::vector<include_directive> directives;
+	if (gIncludeScanner.GetDirectives(info,source,directives) != B_OK
+		|| directives.size() < fHeaders.size())
+		return false;
+
+	std::set<BString> first;
+	for (size_t i = 0; i < fHeaders.size(); i++)
+	{
+		if (directives[i].quoted || !directives[i].leading)
+			return false;
+		first.insert(directives[i].name);
+	}
+	return first == fHeaders;
+}
+
+
+bool
+PrecompiledHeader::IsCurrent(const char *gchPath, const char *depPath)
+{
+	struct stat gchStat;
+	if (stat(gchPath,&gchStat) != 0)
+		return false;
+
+	BString data;
+	read_file(depPath,data);
+	if (data.Length() == 0)
+		return false;
+
+	std::vector<BString> inputs;
+	IncludeScanner::ParseMakeDependencies(data.String(),data.Length(),inputs);
+
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		struct stat inputStat;
+		if (stat(inputs[i].String(),&inputStat) != 0
+			|| inputStat.st_mtime > gchStat.st_mtime)
+		{
+			STRACE(1,("Precompiled header is out of date because of %s\n",
+					inputs[i].String()));
+			return false;
+		}
+	}
+	return true;
+}
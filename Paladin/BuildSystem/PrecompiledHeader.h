@@ -0,0 +1,47 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef PRECOMPILED_HEADER_H
+#define PRECOMPILED_HEADER_H
+
+#include <set>
+#include <vector>
+
+#include <String.h>
+
+class BuildInfo;
+
+// Builds a precompiled header out of the system headers which most of a
+// project's source files include -- things like Application.h and Window.h
+// -- so that the compiler only has to parse them once per build instead of
+// once per file. The header and its .gch live in the object folder and are
+// only rebuilt when the selection, the compile options or one of the headers
+// themselves change.
+class PrecompiledHeader
+{
+public:
+						PrecompiledHeader(void);
+
+			status_t	Update(BuildInfo &info,
+								const std::vector<BString> &sources,
+								const char *options);
+			void		Clear(void);
+
+			bool		IsReady(void) const { return fReady; }
+			const char *GetHeaderPath(void) const { return fHeaderPath.String(); }
+
+			// Whether the header can go ahead of the source without changing
+			// what it means. The source's first includes have to be the
+			// precompiled ones, with nothing which isn't an include before.
+			bool		Suits(BuildInfo &info, const char *source);
+
+private:
+			bool		IsCurrent(const char *gchPath, const char *depPath);
+
+	BString				fHeaderPath;
+	std::set<BString>	fHeaders;
+	bool				fReady;
+};
+
+#endif
@@ -0,0 +1,575 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#include "ProcessExecutor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <Autolock.h>
+
+#include "BuildTrace.h"
+#include "DebugTools.h"
+#include "Globals.h"
+#include "JobServer.h"
+
+extern char **environ;
+
+// Collects the output of a process for ProcessExecutor::Run(), or hands it
+// on to another listener as it arrives
+class SyncListener : public ProcessListener
+{
+public:
+						SyncListener(BString *output, ProcessListener *target)
+							:	fOutput(output),
+								fTarget(target),
+								fStatus(-1),
+								fSemaphore(create_sem(0,"process exit"))
+						{
+							fUsage.userTime = fUsage.kernelTime = 0;
+							fUsage.peakMemory = -1;
+						}
+						~SyncListener(void)
+						{
+							delete_sem(fSemaphore);
+						}
+
+			void		OutputReceived(const char *data, size_t length,
+										bool isError)
+						{
+							if (fOutput)
+								fOutput->Append(data,length);
+							if (fTarget)
+								fTarget->OutputReceived(data,length,isError);
+						}
+			void		ProcessExited(int status,
+										const process_usage &usage)
+						{
+							if (fTarget)
+								fTarget->ProcessExited(status,usage);
+							fStatus = status;
+							fUsage = usage;
+							release_sem(fSemaphore);
+						}
+
+			int			Wait(void)
+						{
+							while (acquire_sem(fSemaphore) == B_INTERRUPTED)
+								;
+							return fStatus;
+						}
+
+			const process_usage &Usage(void) const
+						{
+							return fUsage;
+						}
+
+private:
+	BString				*fOutput;
+	ProcessListener		*fTarget;
+	int					fStatus;
+	process_usage		fUsage;
+	sem_id				fSemaphore;
+};
+
+
+static inline bigtime_t
+timeval_to_bigtime(const struct timeval &time)
+{
+	return (bigtime_t)time.tv_sec * 1000000 + time.tv_usec;
+}
+
+
+static void
+set_descriptor_flags(int fd, bool nonBlocking)
+{
+	fcntl(fd,F_SETFD,fcntl(fd,F_GETFD) | FD_CLOEXEC);
+	if (nonBlocking)
+		fcntl(fd,F_SETFL,fcntl(fd,F_GETFL) | O_NONBLOCK);
+}
+
+
+// The end of a process which has already closed its output is only told by
+// SIGCHLD, which wakes the executor's thread up through its pipe
+static int sChildWakeFD = -1;
+static struct sigaction sOldChildAction;
+
+
+static void
+child_exited(int signal, siginfo_t *info, void *context)
+{
+	int savedErrno = errno;
+	if (sChildWakeFD >= 0)
+	{
+		char byte = 0;
+		write(sChildWakeFD,&byte,1);
+	}
+	errno = savedErrno;
+
+	if ((sOldChildAction.sa_flags & SA_SIGINFO) != 0)
+	{
+		if (sOldChildAction.sa_sigaction)
+			sOldChildAction.sa_sigaction(signal,info,context);
+	}
+	else if (sOldChildAction.sa_handler != SIG_DFL
+		&& sOldChildAction.sa_handler != SIG_IGN)
+		sOldChildAction.sa_handler(signal);
+}
+
+
+ProcessListener::~ProcessListener(void)
+{
+}
+
+
+ProcessExecutor::ProcessExecutor(void)
+	:	fLock("process executor lock"),
+		fThread(-1),
+		fQuitting(false)
+{
+	if (pipe(fWakePipe) == 0)
+	{
+		set_descriptor_flags(fWakePipe[0],true);
+		set_descriptor_flags(fWakePipe[1],true);
+	}
+	else
+		fWakePipe[0] = fWakePipe[1] = -1;
+
+	if (fWakePipe[1] >= 0 && sChildWakeFD < 0)
+	{
+		sChildWakeFD = fWakePipe[1];
+
+		struct sigaction action;
+		memset(&action,0,sizeof(action));
+		action.sa_sigaction = child_exited;
+		action.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGCHLD,&action,&sOldChildAction);
+	}
+}
+
+
+ProcessExecutor::~ProcessExecutor(void)
+{
+	fLock.Lock();
+	fQuitting = true;
+	thread_id thread = fThread;
+	fLock.Unlock();
+
+	if (thread >= 0)
+	{
+		Wake();
+		status_t result;
+		wait_for_thread(thread,&result);
+	}
+
+	if (fWakePipe[1] >= 0 && sChildWakeFD == fWakePipe[1])
+	{
+		sigaction(SIGCHLD,&sOldChildAction,NULL);
+		sChildWakeFD = -1;
+	}
+
+	if (fWakePipe[0] >= 0)
+	{
+		close(fWakePipe[0]);
+		close(fWakePipe[1]);
+	}
+}
+
+
+pid_t
+ProcessExecutor::Start(const char *command, ProcessListener *listener,
+						const char *folder)
+{
+	if (!command || !listener || fWakePipe[0] < 0)
+		return -1;
+
+	// The command is run by the shell just like before, so redirections and
+	// quoting in project settings keep working
+	BString shellCommand;
+	if (folder && *folder)
+	{
+		BString quoted(folder);
+		quoted.ReplaceAll("'","'\\''");
+		shellCommand << "cd '" << quoted << "' && ";
+	}
+	shellCommand << command;
+
+	const char *argv[] = { "/bin/sh", "-c", shellCommand.String(), NULL };
+
+	// Spawning is serialized so that no other child started here can inherit
+	// the write end of these pipes before it is marked close-on-exec. One
+	// that did would keep them open and the end of the output would only be
+	// seen once it quits, too.
+	BAutolock lock(fLock);
+
+	int out[2], err[2];
+	if (pipe(out) != 0)
+		return -1;
+	if (pipe(err) != 0)
+	{
+		close(out[0]);
+		close(out[1]);
+		return -1;
+	}
+	set_descriptor_flags(out[0],true);
+	set_descriptor_flags(out[1],false);
+	set_descriptor_flags(err[0],true);
+	set_descriptor_flags(err[1],false);
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions,0,"/dev/null",O_RDONLY,0);
+	posix_spawn_file_actions_adddup2(&actions,out[1],1);
+	posix_spawn_file_actions_adddup2(&actions,err[1],2);
+
+	// Each command gets a process group of its own so that everything it
+	// starts can be signalled at once
+	posix_spawnattr_t attributes;
+	posix_spawnattr_init(&attributes);
+	posix_spawnattr_setflags(&attributes,POSIX_SPAWN_SETPGROUP);
+	posix_spawnattr_setpgroup(&attributes,0);
+
+	// The jobserver's pipe is only left open for the commands which use it.
+	// Spawning is serialized, so no other one gets it in the meantime.
+	bool useJobServer = JobServer::IsUsedBy(command);
+	if (useJobServer)
+		gJobServer.SetInherited(true);
+	
+	pid_t pid;
+	int result = posix_spawn(&pid,argv[0],&actions,&attributes,
+							(char * const *)argv,environ);
+	
+	if (useJobServer)
+		gJobServer.SetInherited(false);
+
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attributes);
+	close(out[1]);
+	close(err[1]);
+
+	if (result != 0)
+	{
+		STRACE(1,("Couldn't start %s: %s\n",command,strerror(result)));
+		close(out[0]);
+		close(err[0]);
+		return -1;
+	}
+
+	// A command started by a build which runs in the background stays in the
+	// background. On Haiku the process ID is that of its main thread.
+	thread_info threadInfo;
+	if (get_thread_info(find_thread(NULL),&threadInfo) == B_OK
+		&& threadInfo.priority < B_NORMAL_PRIORITY)
+		set_thread_priority(pid,threadInfo.priority);
+
+	process_info process;
+	process.pid = pid;
+	process.starter = find_thread(NULL);
+	process.out = out[0];
+	process.err = err[0];
+	process.listener = listener;
+	fProcesses.push_back(process);
+
+	if (fThread < 0)
+	{
+		fThread = spawn_thread(ExecutorThread,"process executor",
+								B_NORMAL_PRIORITY,this);
+		resume_thread(fThread);
+	}
+	else
+		Wake();
+
+	return pid;
+}
+
+
+status_t
+ProcessExecutor::Run(const char *command, BString &output, int *exitStatus,
+					const char *folder)
+{
+	output = "";
+
+	SyncListener listener(&output,NULL);
+	return RunAndWait(command,listener,exitStatus,folder);
+}
+
+
+status_t
+ProcessExecutor::Run(const char *command, ProcessListener *listener,
+					int *exitStatus, const char *folder)
+{
+	if (!listener)
+		return B_BAD_VALUE;
+
+	SyncListener syncListener(NULL,listener);
+	return RunAndWait(command,syncListener,exitStatus,folder);
+}
+
+
+status_t
+ProcessExecutor::Signal(pid_t process, int signal)
+{
+	if (process <= 0)
+		return B_BAD_VALUE;
+
+	return kill(-process,signal) == 0 ? B_OK : errno;
+}
+
+
+void
+ProcessExecutor::SignalStartedBy(thread_id thread, int signal)
+{
+	// Processes are added with the lock held from before they are spawned,
+	// so one which isn't here yet will only be started afterwards
+	BAutolock lock(fLock);
+	for (size_t i = 0; i < fProcesses.size(); i++)
+	{
+		if (fProcesses[i].starter == thread)
+			kill(-fProcesses[i].pid,signal);
+	}
+}
+
+
+status_t
+ProcessExecutor::RunAndWait(const char *command, SyncListener &listener,
+							int *exitStatus, const char *folder)
+{
+	// The process gets its own span in the trace of the build, if there is
+	// one, with what it cost
+	BString program(command);
+	int32 end = program.FindFirst(" ");
+	if (end > 0)
+		program.Truncate(end);
+	TraceSpan span("process",program.String());
+
+	if (Start(command,&listener,folder) < 0)
+		return B_ERROR;
+
+	int status = listener.Wait();
+	if (exitStatus)
+		*exitStatus = status;
+
+	const process_usage &usage = listener.Usage();
+	span.AddArg("command",command);
+	span.AddArg("exit_status",(int64)status);
+	span.AddArg("user_cpu_us",(int64)usage.userTime);
+	span.AddArg("system_cpu_us",(int64)usage.kernelTime);
+	if (usage.peakMemory >= 0)
+		span.AddArg("peak_rss_kb",(int64)(usage.peakMemory / 1024));
+	return B_OK;
+}
+
+
+int32
+ProcessExecutor::ExecutorThread(void *data)
+{
+	((ProcessExecutor *)data)->Loop();
+	return 0;
+}
+
+
+void
+ProcessExecutor::Loop(void)
+{
+	std::vector<struct pollfd> fds;
+	std::vector<int32> owners;
+
+	while (true)
+	{
+		fds.clear();
+		owners.clear();
+
+		struct pollfd wake;
+		wake.fd = fWakePipe[0];
+		wake.events = POLLIN;
+		wake.revents = 0;
+		fds.push_back(wake);
+		owners.push_back(-1);
+
+		// A process which closed its output is reaped once SIGCHLD says it
+		// quit. Should the signal be missed, it is still looked at now and
+		// then.
+		bool reaping = false;
+
+		fLock.Lock();
+		if (fQuitting)
+		{
+			fLock.Unlock();
+			break;
+		}
+
+		for (size_t i = 0; i < fProcesses.size(); i++)
+		{
+			struct pollfd entry;
+			entry.events = POLLIN;
+			entry.revents = 0;
+			if (fProcesses[i].out >= 0)
+			{
+				entry.fd = fProcesses[i].out;
+				fds.push_back(entry);
+				owners.push_back(i * 2);
+			}
+			if (fProcesses[i].err >= 0)
+			{
+				entry.fd = fProcesses[i].err;
+				fds.push_back(entry);
+				owners.push_back(i * 2 + 1);
+			}
+			if (fProcesses[i].out < 0 && fProcesses[i].err < 0)
+				reaping = true;
+		}
+		fLock.Unlock();
+
+		int result = poll(&fds[0],fds.size(),reaping ? 100 : -1);
+		if (result < 0 && errno != EINTR)
+		{
+			STRACE(1,("ProcessExecutor: poll() failed: %s\n",strerror(errno)));
+			snooze(10000);
+			continue;
+		}
+
+		if (fds[0].revents != 0)
+		{
+			char buffer[64];
+			while (read(fWakePipe[0],buffer,sizeof(buffer)) > 0)
+				;
+		}
+
+		// Processes are only ever removed by this thread, so the indices
+		// taken above are still good. The listeners are only called once
+		// the lock is released again, so that taking the output apart
+		// doesn't hold up starting and stopping other processes.
+		std::vector<received_output> received;
+		std::vector<exited_process> exited;
+
+		fLock.Lock();
+		for (size_t i = 1; i < fds.size(); i++)
+		{
+			if (fds[i].revents == 0)
+				continue;
+
+			process_info &process = fProcesses[owners[i] / 2];
+			if (owners[i] % 2 == 0)
+				ReadFrom(process,process.out,false,received);
+			else
+				ReadFrom(process,process.err,true,received);
+		}
+
+		for (int32 i = fProcesses.size() - 1; i >= 0; i--)
+		{
+			process_info &process = fProcesses[i];
+			if (process.out >= 0 || process.err >= 0)
+				continue;
+
+			int status;
+			process_usage usage;
+			pid_t pid = Reap(process.pid,&status,usage);
+			if (pid == 0 || (pid < 0 && errno == EINTR))
+				continue;
+
+			int code = -1;
+			if (pid == process.pid)
+			{
+				if (WIFEXITED(status))
+					code = WEXITSTATUS(status);
+				else if (WIFSIGNALED(status))
+					code = 128 + WTERMSIG(status);
+			}
+
+			exited_process done;
+			done.listener = process.listener;
+			done.status = code;
+			done.usage = usage;
+			exited.push_back(done);
+			fProcesses.erase(fProcesses.begin() + i);
+		}
+		fLock.Unlock();
+
+		// A process' output always comes before its end
+		for (size_t i = 0; i < received.size(); i++)
+		{
+			received[i].listener->OutputReceived(received[i].data.String(),
+				received[i].data.Length(),received[i].isError);
+		}
+
+		for (size_t i = 0; i < exited.size(); i++)
+			exited[i].listener->ProcessExited(exited[i].status,exited[i].usage);
+	}
+}
+
+
+pid_t
+ProcessExecutor::Reap(pid_t process, int *status, process_usage &usage)
+{
+	usage.userTime = usage.kernelTime = 0;
+	usage.peakMemory = -1;
+
+#ifdef __HAIKU__
+	// There's no wait4() to ask about a single child. Only this thread waits
+	// for the processes started here, so what all children used grows by
+	// just what this one did.
+	struct rusage before, after;
+	getrusage(RUSAGE_CHILDREN,&before);
+	pid_t pid = waitpid(process,status,WNOHANG);
+	if (pid != process)
+		return pid;
+	getrusage(RUSAGE_CHILDREN,&after);
+
+	usage.userTime = timeval_to_bigtime(after.ru_utime)
+		- timeval_to_bigtime(before.ru_utime);
+	usage.kernelTime = timeval_to_bigtime(after.ru_stime)
+		- timeval_to_bigtime(before.ru_stime);
+#else
+	struct rusage used;
+	pid_t pid = wait4(process,status,WNOHANG,&used);
+	if (pid != process)
+		return pid;
+
+	usage.userTime = timeval_to_bigtime(used.ru_utime);
+	usage.kernelTime = timeval_to_bigtime(used.ru_stime);
+	usage.peakMemory = (off_t)used.ru_maxrss * 1024;
+#endif
+	return pid;
+}
+
+
+void
+ProcessExecutor::Wake(void)
+{
+	char byte = 0;
+	write(fWakePipe[1],&byte,1);
+}
+
+
+bool
+ProcessExecutor::ReadFrom(process_info &process, int &fd, bool isError,
+							std::vector<received_output> &received)
+{
+	char buffer[16384];
+	ssize_t bytesRead = read(fd,buffer,sizeof(buffer));
+	if (bytesRead > 0)
+	{
+		received_output output;
+		output.listener = process.listener;
+		output.data.SetTo(buffer,bytesRead);
+		output.isError = isError;
+		received.push_back(output);
+		return true;
+	}
+
+	if (bytesRead < 0 && (errno == EAGAIN || errno == EINTR))
+		return false;
+
+	close(fd);
+	fd = -1;
+	return false;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef PROCESS_EXECUTOR_H
+#define PROCESS_EXECUTOR_H
+
+#include <sys/types.h>
+#include <vector>
+
+#include <Locker.h>
+#include <OS.h>
+#include <String.h>
+
+typedef struct
+{
+	bigtime_t	userTime;
+	bigtime_t	kernelTime;
+
+	// The most memory the process used at once, or -1 if that isn't known
+	off_t		peakMemory;
+} process_usage;
+
+class SyncListener;
+
+// Gets told about a process started through a ProcessExecutor. The calls are
+// made from the executor's thread, so they should be quick.
+class ProcessListener
+{
+public:
+	virtual				~ProcessListener(void);
+
+	virtual	void		OutputReceived(const char *data, size_t length,
+										bool isError) = 0;
+
+	// The status is the process' exit code or, if it was killed by a
+	// signal, 128 plus the number of the signal -- the same as the shell's $?
+	// The usage counts everything the process started, too.
+	virtual	void		ProcessExited(int status,
+									const process_usage &usage) = 0;
+};
+
+// Runs the commands of a build. Each is started with posix_spawn() with its
+// output going to plain pipes, and a single thread watches all of the pipes
+// with poll(). Output is handed over as soon as it arrives and the end of a
+// process is noticed right away, so there is no polling interval for short
+// jobs to wait out.
+class ProcessExecutor
+{
+public:
+						ProcessExecutor(void);
+						~ProcessExecutor(void);
+
+			pid_t		Start(const char *command, ProcessListener *listener,
+							const char *folder = NULL);
+			status_t	Run(const char *command, BString &output,
+							int *exitStatus = NULL, const char *folder = NULL);
+			status_t	Run(const char *command, ProcessListener *listener,
+							int *exitStatus = NULL, const char *folder = NULL);
+			status_t	Signal(pid_t process, int signal);
+			
+			// Signals everything the given thread has started which is still
+			// running, along with whatever those processes started in turn
+			void		SignalStartedBy(thread_id thread, int signal);
+
+private:
+			status_t	RunAndWait(const char *command, SyncListener &listener,
+								int *exitStatus, const char *folder);
+	typedef struct
+	{
+		pid_t				pid;
+		thread_id			starter;
+		int					out;
+		int					err;
+		ProcessListener		*listener;
+	} process_info;
+
+	typedef struct
+	{
+		ProcessListener		*listener;
+		int					status;
+		process_usage		usage;
+	} exited_process;
+
+	typedef struct
+	{
+		ProcessListener		*listener;
+		BString				data;
+		bool				isError;
+	} received_output;
+
+	static	int32		ExecutorThread(void *data);
+			void		Loop(void);
+			pid_t		Reap(pid_t process, int *status,
+								process_usage &usage);
+			void		Wake(void);
+			bool		ReadFrom(process_info &process, int &fd,
+								bool isError,
+								std::vector<received_output> &received);
+
+	BLocker						fLock;
+	std::vector<process_info>	fProcesses;
+	thread_id					fThread;
+	int							fWakePipe[2];
+	bool						fQuitting;
+};
+
+#endif
@@ -8,8 +8,11 @@
  */
 #include "ProjectBuilder.h"
 
+#include <signal.h>
 #include <unistd.h>
 #include <fstream>
+#include <map>
+#include <set>
 #include <string>
 
 #include <Alert.h>
@@ -23,10 +26,15 @@
 
 #include "CompileCommand.h"
 #include "CompileCommandWriter.h"
+#include "ContentHash.h"
 #include "DebugTools.h"
 #include "ErrorParser.h"
 #include "Globals.h"
+#include "IncludeScanner.h"
+#include "JobServer.h"
 #include "LaunchHelper.h"
+#include "ObjectCache.h"
+#include "ProcessExecutor.h"
 #include "Project.h"
 #include "SourceFile.h"
 #include "StatCache.h"
@@ -47,7 +55,21 @@ ProjectBuilder::ProjectBuilder(void)
 		fIsBuilding(false),
 		fTotalFilesToBuild(0L),
 		fTotalFilesBuilt(0L),
-		fManager(gCPUCount),
+		fCompileOnly(false),
+		fManager(),
+		fNextWorker(0),
+		fWorkerCount(0),
+		fMaxWorkers(1),
+		fWorkerPriority(B_NORMAL_PRIORITY),
+		fQueueDirectly(false),
+		fExamineLock("examine lock"),
+		fNextExamined(0),
+		fAllWatched(false),
+		fDependencyThreads(0),
+		fKeepGoing(false),
+		fFailedCount(0),
+		fStopped(false),
+		fHeaderSem(-1),
 		fCommands(),
 		fFilesToUpdate()
 {
@@ -60,7 +82,21 @@ ProjectBuilder::ProjectBuilder(const BMessenger &target)
 		fIsBuilding(false),
 		fTotalFilesToBuild(0L),
 		fTotalFilesBuilt(0L),
-		fManager(gCPUCount),
+		fCompileOnly(false),
+		fManager(),
+		fNextWorker(0),
+		fWorkerCount(0),
+		fMaxWorkers(1),
+		fWorkerPriority(B_NORMAL_PRIORITY),
+		fQueueDirectly(false),
+		fExamineLock("examine lock"),
+		fNextExamined(0),
+		fAllWatched(false),
+		fDependencyThreads(0),
+		fKeepGoing(false),
+		fFailedCount(0),
+		fStopped(false),
+		fHeaderSem(-1),
 		fCommands(),
 		fFilesToUpdate()
 {
@@ -71,6 +107,8 @@ ProjectBuilder::~ProjectBuilder(void)
 {
 	if (IsBuilding())
 		QuitBuild();
+	if (fHeaderSem >= 0)
+		delete_sem(fHeaderSem);
 }
 
 void ProjectBuilder::UpdateDependencies(Project *proj)
@@ -80,7 +118,13 @@ void ProjectBuilder::UpdateDependencies(Project *proj)
 	
 	fProject = proj;
 	
+	// The threads of the last run may not have let go of their slots yet
+	fManager.WaitForAllThreads();
 	fFilesToUpdate.clear();
+	
+	// Headers may have changed since the last scan
+	gStatCache.Refresh();
+	gIncludeScanner.MakeEmpty();
 
 	if ((gPlatform == PLATFORM_HAIKU || gPlatform == PLATFORM_HAIKU_GCC4) &&
 		fProject->IsLocked() && fProject->LockingThread() == find_thread(NULL))
@@ -110,6 +154,7 @@ void ProjectBuilder::UpdateDependencies(Project *proj)
 		threadcount = MIN(gCPUCount,fTotalFilesToBuild);
 	}
 	
+	fDependencyThreads = threadcount;
 	for (int32 i = 0; i < threadcount; i++)
 	{
 		fManager.SpawnThread(UpdateDependenciesThread,this);
@@ -119,6 +164,20 @@ void ProjectBuilder::UpdateDependencies(Project *proj)
 
 void
 ProjectBuilder::BuildProject(Project *proj, int32 postbuild)
+{
+	StartBuild(proj,postbuild,false);
+}
+
+
+void
+ProjectBuilder::CompileProject(Project *proj)
+{
+	StartBuild(proj,POSTBUILD_NOTHING,true);
+}
+
+
+void
+ProjectBuilder::StartBuild(Project *proj, int32 postbuild, bool compileOnly)
 {
 //	Build sequence:
 //	Check to see if file needs built:
@@ -135,6 +194,11 @@ ProjectBuilder::BuildProject(Project *proj, int32 postbuild)
 	
 	fProject = proj;
 	fPostBuildAction = postbuild;
+	fCompileOnly = compileOnly;
+	
+	// A build started right after the last one finished could otherwise be
+	// short of threads
+	fManager.WaitForAllThreads();
 
 // This will work around a bug in Haiku's locking mechanism until such time that I
 // can find and fix it
@@ -157,65 +221,383 @@ ProjectBuilder::BuildProject(Project *proj, int32 postbuild)
 	
 	STRACE(1,("Building Project %s\n",proj->GetName()));
 	
-	bool saveproj = false;
+	// The timeline of the build goes into the object folder once it is done
+	if (gTraceBuild)
+	{
+		fTrace.Start();
+		fTrace.Attach("main");
+	}
+	
+	// Always start the caches fresh on a new build. What the stat cache knows
+	// about watched folders is kept up to date by the node monitor, so only
+	// the rest of it has to go.
+	gStatCache.Refresh();
+	gIncludeScanner.MakeEmpty();
+	gHashCache.MakeEmpty();
+	gObjectCache.ResetStats();
+	
+	// Everything the build threads go by has to be reset before the first of
+	// them is started, which happens before the files are examined
+	BuildInfo &info = *proj->GetBuildInfo();
+	fTotalFilesToBuild = 0;
+	fTotalFilesBuilt = 0;
+	fNextWorker = 0;
+	fKeepGoing = gKeepGoing || proj->KeepGoing();
+	fFailedCount = 0;
+	fStopped = false;
+	fLinkSkipReason = "";
+	fCommands.clear();
+	info.errorList.msglist.MakeEmpty(); // clears previous, once
+	fErrors.msglist.MakeEmpty();
+	fQueued.clear();
 	
-	// Always start the cache fresh on a new build
-	gStatCache.MakeEmpty();
+	// How many of the threads actually compile at once is up to the job
+	// server
+	fMaxWorkers = 1;
+	if (!gSingleThreadedBuild)
+	{
+		fMaxWorkers = gJobServer.CountSlots();
+		if (fMaxWorkers < 1)
+			fMaxWorkers = gCPUCount;
+	}
+	fWorkerPriority = compileOnly ? B_LOW_PRIORITY : B_NORMAL_PRIORITY;
 	
+	// Files which were compiled as part of a unity build batch are up to
+	// date for as long as their batch is. Batches with changes are dropped
+	// here, which leaves their files to be compiled one by one below.
+	proj->CheckUnityBatches();
+	fQueueDirectly = !proj->UsesUnityBuild();
 	
+	// The precompiled header is made by the first build thread while the
+	// files are examined here. The others wait for it before they compile
+	// anything, so that every file in this build gets the same one.
+	if (fHeaderSem >= 0)
+		delete_sem(fHeaderSem);
+	fHeaderSem = create_sem(0,"precompiled header");
 	
-	// Check any files not already marked as needing built
-	for (int32 i = 0; i < fProject->CountGroups(); i++)
+	// The build threads get their work from the scheduler and never need the
+	// project lock to do so. The first one is there from the start because it
+	// also links the project when nothing needs to be compiled. The others
+	// are started as the jobs come in.
+	fScheduler.LoadHistory(proj->GetObjectPath().GetFullPath());
+	fScheduler.Open(fMaxWorkers);
+	
+	Lock();
+	fIsBuilding = true;
+	fWorkerCount = 1;
+	fManager.SpawnThread(BuildThread,this,fWorkerPriority);
+	Unlock();
+	
+	// Files which are known to have changed, like the ones saved since the
+	// last build, are compiled while the others are examined
+	if (fQueueDirectly)
+		QueueDirtyFiles();
+	
+	// While all of the project's files are watched, whatever changed since
+	// the last build has been marked already, and examining them would only
+	// confirm that. Otherwise this finds out whether they can be watched from
+	// here on.
+	bool tracked = proj->ChangesTracked();
+	if (tracked)
+		STRACE(1,("All files are watched, skipping the examination\n"));
+	
+	// Check any files not already marked as needing built. The checks which
+	// only involve the file itself come first and are shared out among
+	// several threads. Headers are handled afterwards through the dependency
+	// store's reverse edges so that each header is looked up and stat'ed once
+	// instead of once for every file which includes it.
+	fExamineList.clear();
+	fNextExamined = 0;
+	fHeaders.clear();
+	fExamined.clear();
+	fAllWatched = true;
+	
+	for (int32 i = 0; !tracked && i < fProject->CountGroups(); i++)
 	{
 		SourceGroup *group = fProject->GroupAt(i);
 		
 		for (int32 j = 0; j < group->filelist.CountItems(); j++)
 		{
 			SourceFile *file = group->filelist.ItemAt(j);
+			if (!proj->IsInUnityBatch(file))
+				fExamineList.push_back(file);
+		}
+	}
+	
+	// This thread is one of the examiners, too
+	std::vector<thread_id> examiners;
+	int32 examinerCount = MIN(fMaxWorkers,(int32)fExamineList.size());
+	for (int32 i = 1; i < examinerCount; i++)
+	{
+		thread_id thread = spawn_thread(ExamineThread,"examine thread",
+										fWorkerPriority,this);
+		if (thread >= 0 && resume_thread(thread) == B_OK)
+			examiners.push_back(thread);
+	}
+	ExamineFiles();
+	for (size_t i = 0; i < examiners.size(); i++)
+	{
+		status_t result;
+		wait_for_thread(examiners[i],&result);
+	}
+	
+	if (IsBuilding())
+	{
+		TraceSpan headerSpan("examine","headers");
+		DependencyStore *store = proj->GetDependencyStore();
+		std::set<SourceFile*> checked;
+		std::set<BString>::iterator header;
+		for (header = fHeaders.begin(); header != fHeaders.end(); header++)
+		{
+			struct stat depstat;
+			bool exists = gStatCache.StatFor(header->String(),&depstat);
+			fAllWatched = fAllWatched && gStatCache.IsWatched(header->String());
+			if (!exists)
+				continue;
+			time_t depTime = depstat.st_mtime;
 			
-			BMessage exmsg(M_EXAMINING_FILE);
-			exmsg.AddPointer("file",file);
-			fMsgr.SendMessage(&exmsg);
-			
-			BString dep = file->GetDependencies();
-			if (proj->CheckNeedsBuild(file))
+			std::vector<BString> dependents;
+			store->GetDependents(header->String(),dependents);
+			for (size_t k = 0; k < dependents.size(); k++)
 			{
-				file->SetBuildFlag(BUILD_YES);
-				BMessage drawmsg(M_FILE_NEEDS_BUILD);
-				drawmsg.AddPointer("file",file);
-				fMsgr.SendMessage(&drawmsg);
-				fProject->MakeFileDirty(file);
-				STRACE(1,("%s needs to be built\n",file->GetPath().GetFullPath()));
-			}
-			else
-			{
-				STRACE(1,("%s does not need to be built\n",file->GetPath().GetFullPath()));
+				std::map<BString, examined_file>::iterator examined
+					= fExamined.find(dependents[k]);
+				if (examined == fExamined.end())
+					continue;
+				
+				SourceFile *file = examined->second.file;
+				if (file->BuildFlag() == BUILD_YES
+					|| depTime <= examined->second.objectTime
+					|| checked.find(file) != checked.end())
+					continue;
+				
+				// The full check makes the final call because it knows about
+				// things like unchanged contents
+				STRACE(2,("%s: dependency %s was updated\n",
+						file->GetPath().GetFullPath(),header->String()));
+				checked.insert(file);
+				if (proj->CheckNeedsBuild(file))
+					MarkForBuild(file);
 			}
-			if (!gBuildMode && !saveproj && dep.Compare(file->GetDependencies()) != 0)
-				saveproj = true;
 		}
 	}
 	
-	if (saveproj)
-		fProject->Save();
+	// Any dependencies found while examining go to the dependency store, so
+	// there is no need to rewrite the project file for them
+	fProject->GetDependencyStore()->Flush();
 	
-	fIsBuilding = true;
+	if (!tracked && fAllWatched && IsBuilding())
+	{
+		STRACE(1,("All files are watched, changes are tracked from now on\n"));
+		proj->SetChangesTracked(true);
+	}
 	
-	int32 threadcount = 1;
-	if (fProject->CountDirtyFiles() > 1 && !gSingleThreadedBuild)
+	// Files to be batched for a unity build have only been marked so far
+	fProject->Lock();
+	fProject->PrepareUnityBuild();
+	fProject->Unlock();
+	QueueDirtyFiles();
+	
+	// Any older batch without an object was dropped above, so this only
+	// picks up the ones PrepareUnityBuild() just made
+	std::vector<SourceFile*> units;
+	fProject->Lock();
+	for (int32 i = 0; i < fProject->CountUnityUnits(); i++)
 	{
-		// It's kind of silly spawning 4 threads on a quad core system to
-		// build 2 files, so limit spawned threads to whichever is less
-		threadcount = MIN(gCPUCount,fProject->CountDirtyFiles());
+		SourceFile *unit = fProject->UnityUnitAt(i);
+		if (!BEntry(unit->GetObjectPath(info).GetFullPath()).Exists())
+			units.push_back(unit);
 	}
-	//threadcount = 2;
+	fProject->Unlock();
+	for (size_t i = 0; i < units.size(); i++)
+		QueueJob(units[i]);
 	
-	fTotalFilesToBuild = proj->CountDirtyFiles();
-	fTotalFilesBuilt = 0;
-	fCommands.clear();
-	proj->GetBuildInfo()->errorList.msglist.MakeEmpty(); // clears previous, once
-	for (int32 i = 0; i < threadcount; i++)
-		fManager.SpawnThread(BuildThread,this);
+	// The build threads are done once they run out of work from here on
+	fScheduler.Close();
+	
+	BuildTrace::Detach();
+}
+
+
+void
+ProjectBuilder::SendBuildSuccess(void)
+{
+	BMessage msg(M_BUILD_SUCCESS);
+	if (fCompileOnly)
+		msg.AddBool("compileonly",true);
+	if (fLinkSkipReason.Length() > 0)
+		msg.AddString("linkskipped",fLinkSkipReason);
+	if (gUseObjectCache)
+	{
+		msg.AddInt32("cachehits",gObjectCache.CountHits());
+		msg.AddInt32("cachemisses",gObjectCache.CountMisses());
+		STRACE(1,("Object cache: %" B_PRId32 " hits, %" B_PRId32 " misses\n",
+				gObjectCache.CountHits(),gObjectCache.CountMisses()));
+	}
+	fMsgr.SendMessage(&msg);
+}
+
+
+void
+ProjectBuilder::SendBuildFailure(ErrorList &list)
+{
+	// Unlike SendErrorMessage(), this always ends the build, even when a tool
+	// failed without printing anything that could be parsed as an error.
+	// Files which weren't built are no longer marked, so the next build has
+	// to look for them again.
+	fProject->SetChangesTracked(false);
+	PublishErrors(list,M_BUILD_FAILURE);
+}
+
+
+void
+ProjectBuilder::MarkForBuild(SourceFile *file)
+{
+	file->SetBuildFlag(BUILD_YES);
+	BMessage drawmsg(M_FILE_NEEDS_BUILD);
+	drawmsg.AddPointer("file",file);
+	fMsgr.SendMessage(&drawmsg);
+	
+	// The files are examined by several threads at once
+	fProject->Lock();
+	fProject->MakeFileDirty(file);
+	fProject->Unlock();
+	STRACE(1,("%s needs to be built\n",file->GetPath().GetFullPath()));
+	
+	if (fQueueDirectly)
+		QueueDirtyFiles();
+}
+
+
+void
+ProjectBuilder::QueueDirtyFiles(void)
+{
+	if (!IsBuilding())
+		return;
+	
+	// The jobs are only queued once the project is unlocked again, because
+	// the build threads lock the builder before the project
+	std::vector<SourceFile*> jobs;
+	
+	fProject->Lock();
+	SourceFile *dirtyFile = fProject->GetNextDirtyFile();
+	while (dirtyFile)
+	{
+		fProject->MakeFileClean(dirtyFile);
+		dirtyFile->UpdateModTime();
+		
+		// Batched files are built by their unit instead
+		if (fProject->IsInUnityBatch(dirtyFile))
+		{
+			dirtyFile->SetBuildFlag(BUILD_NO);
+			
+			BMessage donemsg(M_BUILDING_DONE);
+			donemsg.AddPointer("sourcefile",dirtyFile);
+			fMsgr.SendMessage(&donemsg);
+		}
+		else
+			jobs.push_back(dirtyFile);
+		dirtyFile = fProject->GetNextDirtyFile();
+	}
+	fProject->Unlock();
+	
+	for (size_t i = 0; i < jobs.size(); i++)
+		QueueJob(jobs[i]);
+}
+
+
+void
+ProjectBuilder::QueueJob(SourceFile *file)
+{
+	BAutolock lock(this);
+	
+	// A file may be found again after it was queued, by the header check or
+	// because it was marked before the build
+	if (!fIsBuilding || !fQueued.insert(file).second)
+		return;
+	
+	fScheduler.AddJob(file);
+	fTotalFilesToBuild++;
+	
+	// It's kind of silly spawning 4 threads on a quad core system to build
+	// 2 files, so threads are only added while there are more jobs than them
+	if (fWorkerCount < fMaxWorkers && fWorkerCount < fTotalFilesToBuild)
+	{
+		fWorkerCount++;
+		fManager.SpawnThread(BuildThread,this,fWorkerPriority);
+	}
+}
+
+
+void
+ProjectBuilder::ExamineFiles(void)
+{
+	BuildInfo &info = *fProject->GetBuildInfo();
+	
+	// Each file is taken by whichever thread gets to it first. A failed
+	// build stops the examination, too.
+	while (IsBuilding())
+	{
+		int32 index = atomic_add(&fNextExamined,1);
+		if (index >= (int32)fExamineList.size())
+			break;
+		
+		SourceFile *file = fExamineList[index];
+		TraceSpan span("examine",file->GetPath().GetFileName());
+		
+		BMessage exmsg(M_EXAMINING_FILE);
+		exmsg.AddPointer("file",file);
+		fMsgr.SendMessage(&exmsg);
+		
+		// Files without objects, like resources, only have themselves
+		// to be watched
+		BString objectPath = file->GetObjectPath(info).GetFullPath();
+		if (!gStatCache.IsWatched(file->GetPath().GetFullPath())
+			|| (objectPath.Length() > 0
+				&& !gStatCache.IsWatched(objectPath.String())))
+		{
+			BAutolock lock(fExamineLock);
+			fAllWatched = false;
+		}
+		
+		if (fProject->CheckNeedsBuild(file,false))
+		{
+			MarkForBuild(file);
+			continue;
+		}
+		
+		// Compiling records what a file includes, so only files which
+		// were never compiled that way need to be scanned
+		if (!file->DependenciesKnown(info))
+			fProject->UpdateFileDependencies(file);
+		
+		const std::vector<BString> &deps = file->GetDependencyList();
+		if (deps.empty())
+		{
+			STRACE(1,("%s does not need to be built\n",file->GetPath().GetFullPath()));
+			continue;
+		}
+		
+		struct stat objstat;
+		if (!gStatCache.StatFor(objectPath.String(),&objstat))
+			continue;
+		
+		std::vector<BString> depPaths;
+		for (size_t k = 0; k < deps.size(); k++)
+		{
+			BString depPath(deps[k]);
+			if (depPath[0] != '/')
+				depPath = file->FindDependency(info,depPath.String()).GetFullPath();
+			if (depPath.Length() > 0 && depPath != file->GetPath().GetFullPath())
+				depPaths.push_back(depPath);
+		}
+		
+		BAutolock lock(fExamineLock);
+		examined_file &examined = fExamined[file->GetPath().GetFullPath()];
+		examined.file = file;
+		examined.objectTime = objstat.st_mtime;
+		fHeaders.insert(depPaths.begin(),depPaths.end());
+	}
 }
 
 
@@ -223,7 +605,19 @@ void
 ProjectBuilder::QuitBuild(void)
 {
 	if (IsBuilding())
-		fManager.QuitAllThreads();
+	{
+		// The compiles which are running are stopped instead of waited for.
+		// Each of them only ever writes a temporary file, which is removed
+		// again once the compiler is gone.
+		Lock();
+		fStopped = true;
+		Unlock();
+		
+		fScheduler.Cancel();
+		fManager.QuitAllThreads(true);
+		fProject->SetChangesTracked(false);
+		SaveTrace();
+	}
 }
 
 
@@ -240,6 +634,8 @@ ProjectBuilder::IsBuilding(void)
 void
 ProjectBuilder::DoPostBuild(void)
 {
+	TraceSpan span("post-build",fProject->GetTargetName());
+	
 	// Write out compile commands JSON file first
 	std::string jsonFile(fProject->GetBuildInfo()->projectFolder.GetFullPath());
 	jsonFile += std::string("/compile_commands.json");
@@ -361,17 +757,108 @@ ProjectBuilder::DoPostBuild(void)
 void
 ProjectBuilder::SendErrorMessage(ErrorList &list)
 {
-
-	BMessage errmsg;
+	uint32 what;
 	if (list.CountErrors() > 0)
-		errmsg.what = M_BUILD_FAILURE;
+		what = M_BUILD_FAILURE;
 	else if (list.msglist.CountItems() > 0)
-		errmsg.what = M_BUILD_WARNINGS;
+		what = M_BUILD_WARNINGS;
 	else
-		errmsg.what = M_BUILD_MESSAGES;
+		what = M_BUILD_MESSAGES;
+	PublishErrors(list,what);
+}
+
+
+void
+ProjectBuilder::PublishErrors(ErrorList &list, uint32 what)
+{
+	// Only the messages in the list are sent, and the receivers add them to
+	// what they already have. The list is emptied, so a list which is used
+	// again only ever holds what is new.
+	BMessage errmsg(what);
 	list.Flatten(errmsg);
 	fMsgr.SendMessage(&errmsg);
 	
+	fErrors.Lock();
+	fErrors.msglist.AddList(&list.msglist);
+	fErrors.Unlock();
+	list.msglist.MakeEmpty(false);
+	list.Rewind();
+}
+
+
+void
+ProjectBuilder::MergeErrors(void)
+{
+	// Hands all of the messages of the build over to the project in one go
+	ErrorList &projectList = fProject->GetBuildInfo()->errorList;
+	fErrors.Lock();
+	projectList.msglist.AddList(&fErrors.msglist);
+	fErrors.msglist.MakeEmpty(false);
+	fErrors.Unlock();
+}
+
+
+bool
+ProjectBuilder::JobFailed(SourceFile *file, ErrorList &list)
+{
+	// The list only holds this job's messages
+	bool failed = file->ExitStatus() != 0 || list.CountErrors() > 0;
+	
+	if (failed)
+	{
+		STRACE(1,("%s failed to build, exit status %d\n",
+				file->GetPath().GetFullPath(),file->ExitStatus()));
+		
+		// Make sure that the file is tried again on the next build
+		file->SetBuildFlag(BUILD_YES);
+		if (fKeepGoing)
+			atomic_add(&fFailedCount,1);
+		else
+		{
+			SendBuildFailure(list);
+			return true;
+		}
+	}
+	
+	// Errors are passed along as they come in, but when going on after them
+	// the build only fails once everything else has been compiled
+	if (list.msglist.CountItems() > 0)
+		PublishErrors(list,M_BUILD_WARNINGS);
+	
+	return failed;
+}
+
+
+void
+ProjectBuilder::SaveTrace(void)
+{
+	if (!fTrace.IsRecording())
+		return;
+	
+	DPath path(fProject->GetObjectPath());
+	path.Append("build_trace.json");
+	status_t status = fTrace.Stop(path.GetFullPath());
+	if (status != B_OK)
+		STRACE(1,("Couldn't write %s: %s\n",path.GetFullPath(),strerror(status)));
+}
+
+
+int32
+ProjectBuilder::ExamineThread(void *data)
+{
+	ProjectBuilder *parent = (ProjectBuilder *)data;
+	
+	if (parent->fTrace.IsRecording())
+	{
+		BString threadName("examiner ");
+		threadName << find_thread(NULL);
+		parent->fTrace.Attach(threadName.String());
+	}
+	
+	parent->ExamineFiles();
+	
+	BuildTrace::Detach();
+	return B_OK;
 }
 
 
@@ -382,32 +869,68 @@ ProjectBuilder::BuildThread(void *data)
 	Project *proj = parent->fProject;
 	
 	thread_id thisThread = find_thread(NULL);
+	int32 worker = atomic_add(&parent->fNextWorker,1);
 	
 	BMessage msg;
 	BString errstr;
 	bool link_needed = false;
 	
-	time_t lastMod = 0;
-	
-	proj->Lock();
-	proj->SortDirtyList();
+	// Each thread collects the messages of its jobs in a list of its own
+	BuildInfo jobInfo(*proj->GetBuildInfo());
 	
-	// Reacllocate compile commands vector
-	//((ProjectBuilder*)data)->fCommands = std::vector<CompileCommand>(proj->CountDirtyFiles());
-	//STRACE(1,("Dirty files:", +proj->CountDirtyFiles()));
+	if (parent->fTrace.IsRecording())
+	{
+		BString threadName("worker ");
+		threadName << worker;
+		parent->fTrace.Attach(threadName.String());
+	}
 	
-	SourceFile *file = proj->GetNextDirtyFile();
-	if (file)
+	if (worker == 0)
 	{
-		proj->MakeFileClean(file);
-		lastMod = MAX(lastMod,file->GetModTime());
-		file->UpdateModTime();
+		{
+			JobToken token(gJobServer);
+			token.Acquire(B_INFINITE_TIMEOUT);
+			TraceSpan span("precompiled header",proj->GetName());
+			proj->UpdatePrecompiledHeader();
+		}
+		release_sem(parent->fHeaderSem);
+	}
+	else
+	{
+		// Each thread lets the next one through once it is ready
+		status_t status;
+		while ((status = acquire_sem_etc(parent->fHeaderSem,1,
+				B_RELATIVE_TIMEOUT,100000)) == B_TIMED_OUT
+			|| status == B_INTERRUPTED)
+		{
+			if (parent->fManager.ThreadCheckQuit())
+			{
+				parent->fManager.RemoveThread(thisThread);
+				return B_OK;
+			}
+		}
+		if (status == B_OK)
+			release_sem(parent->fHeaderSem);
 	}
-	proj->Unlock();
+	
+	SourceFile *file = parent->fScheduler.NextJob(worker);
 	
 	while (file)
 	{
+		// Every job runs in a slot of the job server, so the build stays
+		// within the same limit as make and the tools the build runs
+		JobToken token(gJobServer);
+		while (!token.Acquire(100000))
+		{
+			if (parent->fManager.ThreadCheckQuit())
+			{
+				parent->fManager.RemoveThread(thisThread);
+				return B_OK;
+			}
+		}
+		
 		link_needed = true;
+		bigtime_t startTime = system_time();
 		
 		file->SetBuildFlag(BUILD_NO);
 		
@@ -424,39 +947,51 @@ ProjectBuilder::BuildThread(void *data)
 		
 		BTRACE(("Thread %" B_PRId32 " is precompiling file %s\n",thisThread,file->GetPath().GetFileName()));
 		
-		BuildInfo *info = proj->GetBuildInfo();
-		//ErrorList errorList("");
-		//info->errorList.msglist.MakeEmpty();
-		proj->PrecompileFile(file);
+		file->SetExitStatus(0);
+		{
+			TraceSpan span("precompile",file->GetPath().GetFileName());
+			proj->PrecompileFile(file,jobInfo);
+			span.AddArg("exit_status",(int64)file->ExitStatus());
+		}
 		
-		if (info->errorList.msglist.CountItems() > 0)
-		//if (errorList.msglist.CountItems() > 0)
+		// A tool stopped along with the build didn't fail, but the file still
+		// has to be built next time
+		if (file->ExitStatus() != 0 && parent->fManager.ThreadCheckQuit())
 		{
-			parent->SendErrorMessage(info->errorList);
-			//parent->SendErrorMessage(errorList);
+			file->SetBuildFlag(BUILD_YES);
+			parent->fManager.RemoveThread(thisThread);
+			return B_OK;
+		}
+		
+		if (parent->JobFailed(file,jobInfo.errorList))
+		{
+			msg.MakeEmpty();
+			msg.what = M_BUILDING_DONE;
+			msg.AddPointer("sourcefile",file);
+			parent->fMsgr.SendMessage(&msg);
 			
-			if (info->errorList.CountErrors() > 0)
-			//if (errorList.CountErrors() > 0)
+			if (parent->fKeepGoing)
 			{
-				msg.MakeEmpty();
-				msg.what = M_BUILDING_DONE;
-				msg.AddPointer("sourcefile",file);
-				parent->fMsgr.SendMessage(&msg);
-				
-				parent->Lock();
-				parent->fIsBuilding = false;
-				parent->Unlock();
-				
-				parent->fManager.RemoveThread(thisThread);
-				parent->fManager.QuitAllThreads();
-				
-				BTRACE(("Thread %" B_PRId32 " quit on errors after precompile\n",thisThread));
-				
-				return B_ERROR;
+				file = parent->fScheduler.NextJob(worker);
+				continue;
 			}
-			//else
-				//info->errorList.msglist.MakeEmpty();
-				//errorList.msglist.MakeEmpty();
+			
+			parent->Lock();
+			parent->fIsBuilding = false;
+			parent->fStopped = true;
+			parent->Unlock();
+			
+			parent->fScheduler.Cancel();
+			parent->fScheduler.SaveHistory();
+			proj->GetDependencyStore()->Flush();
+			parent->MergeErrors();
+			parent->fManager.RemoveThread(thisThread);
+			parent->fManager.QuitAllThreads();
+			parent->SaveTrace();
+			
+			BTRACE(("Thread %" B_PRId32 " quit on errors after precompile\n",thisThread));
+			
+			return B_ERROR;
 		}
 		
 		if (parent->fManager.ThreadCheckQuit())
@@ -485,39 +1020,59 @@ ProjectBuilder::BuildThread(void *data)
 		*/
 		BTRACE(("Thread %" B_PRId32 " is compiling file %s\n",thisThread,file->GetPath().GetFileName()));
 		//sleep(10 * (thisThread % 10));
-		proj->CompileFile(file);
+		{
+			TraceSpan span("compile",file->GetPath().GetFileName());
+			proj->CompileFile(file,jobInfo);
+			span.AddArg("exit_status",(int64)file->ExitStatus());
+		}
+		
+		// The node monitor will get around to the new object, but the next
+		// build shouldn't depend on it having done so already
+		DPath objectPath(file->GetObjectPath(jobInfo));
+		if (!objectPath.IsEmpty())
+			gStatCache.Update(objectPath.GetFullPath());
 		BTRACE(("Thread %" B_PRId32 " compiling complete for file %s\n",thisThread,file->GetPath().GetFileName()));
 		
-		if (info->errorList.msglist.CountItems() > 0)
-		//if (errorList.msglist.CountItems() > 0)
+		if (file->ExitStatus() != 0 && parent->fManager.ThreadCheckQuit())
 		{
-			//parent->SendErrorMessage(errorList);
-			parent->SendErrorMessage(info->errorList);
+			file->SetBuildFlag(BUILD_YES);
+			parent->fManager.RemoveThread(thisThread);
+			return B_OK;
+		}
+		
+		if (parent->JobFailed(file,jobInfo.errorList))
+		{
+			msg.MakeEmpty();
+			msg.what = M_BUILDING_DONE;
+			msg.AddPointer("sourcefile",file);
+			parent->fMsgr.SendMessage(&msg);
 			
-			if (info->errorList.CountErrors() > 0)
-			//if (errorList.CountErrors() > 0)
+			if (parent->fKeepGoing)
 			{
-				msg.MakeEmpty();
-				msg.what = M_BUILDING_DONE;
-				msg.AddPointer("sourcefile",file);
-				parent->fMsgr.SendMessage(&msg);
-				
-				parent->Lock();
-				parent->fIsBuilding = false;
-				parent->Unlock();
-				
-				parent->fManager.RemoveThread(thisThread);
-				parent->fManager.QuitAllThreads();
-				
-				BTRACE(("Thread %" B_PRId32 " quit after compile\n",thisThread));
-				
-				return B_ERROR;
+				file = parent->fScheduler.NextJob(worker);
+				continue;
 			}
-			//else
-				//errorList.msglist.MakeEmpty();
-				//info->errorList.msglist.MakeEmpty();
+			
+			parent->Lock();
+			parent->fIsBuilding = false;
+			parent->fStopped = true;
+			parent->Unlock();
+			
+			parent->fScheduler.Cancel();
+			parent->fScheduler.SaveHistory();
+			proj->GetDependencyStore()->Flush();
+			parent->MergeErrors();
+			parent->fManager.RemoveThread(thisThread);
+			parent->fManager.QuitAllThreads();
+			parent->SaveTrace();
+			
+			BTRACE(("Thread %" B_PRId32 " quit after compile\n",thisThread));
+			
+			return B_ERROR;
 		}
 		
+		parent->fScheduler.JobFinished(file,system_time() - startTime);
+		
 		msg.MakeEmpty();
 		msg.what = M_BUILDING_DONE;
 		msg.AddPointer("sourcefile",file);
@@ -531,19 +1086,15 @@ ProjectBuilder::BuildThread(void *data)
 			return B_OK;
 		}
 		
-		proj->Lock();
-		file = proj->GetNextDirtyFile();
-		if (file)
-		{
-			proj->MakeFileClean(file);
-			lastMod = MAX(lastMod,file->GetModTime());
-			file->UpdateModTime();
-		}
-		proj->Unlock();
-		
-		// copy over errors in to build info
-		//info->errorList.msglist.AddList(&errorList.msglist);
-		//errorList.msglist.MakeEmpty(false);
+		file = parent->fScheduler.NextJob(worker);
+	}
+	
+	// Nothing is left to do for a build which was stopped while this thread
+	// was waiting for work
+	if (parent->fManager.ThreadCheckQuit())
+	{
+		parent->fManager.RemoveThread(thisThread);
+		return B_OK;
 	}
 	
 	// Now that we've finished building the individual source files, we need to
@@ -553,8 +1104,9 @@ ProjectBuilder::BuildThread(void *data)
 	// all the finishing work.
 	parent->Lock();
 	bool do_postprocess = true;
+	bool up_to_date = false;
 	
-	if (parent->fTotalFilesBuilt > 0)
+	if (parent->fTotalFilesBuilt > 0 || parent->fCompileOnly)
 	{
 		if (parent->fIsLinking)
 			do_postprocess = false;
@@ -573,49 +1125,147 @@ ProjectBuilder::BuildThread(void *data)
 		proj->Unlock();
 		
 		if (BEntry(targetPath.GetFullPath()).Exists())
-			do_postprocess = false;
+		{
+			// Resource files which are used as they are never get built, so
+			// a change to one of them only shows up here
+			BString reason;
+			proj->Lock();
+			do_postprocess = proj->ResourcesChanged(reason);
+			proj->Unlock();
+		}
+		
+		if (do_postprocess)
+		{
+			if (parent->fIsLinking)
+				do_postprocess = false;
+			else
+				parent->fIsLinking = true;
+		}
+		else if (parent->fIsBuilding && !parent->fIsLinking)
+		{
+			// Only one thread finishes a build which had nothing to do
+			parent->fIsBuilding = false;
+			up_to_date = true;
+		}
 	}
 	
 	parent->Unlock();
 	
 	if (do_postprocess)
 	{
-		while (parent->fManager.CountRunningThreads() > 1)
-			snooze(10000);
+		{
+			TraceSpan span("wait","other workers");
+			parent->fManager.WaitForAllThreads();
+		}
+		
+		// A build which failed or was stopped while this thread waited has
+		// been reported as such already and isn't linked
+		parent->Lock();
+		bool stopped = parent->fStopped || parent->fManager.ThreadCheckQuit();
+		if (stopped)
+			parent->fIsLinking = false;
+		parent->Unlock();
+		
+		if (stopped)
+		{
+			BTRACE(("Thread %" B_PRId32 " quit without linking\n",thisThread));
+			parent->fManager.RemoveThread(thisThread);
+			return B_OK;
+		}
+		
+		parent->fScheduler.SaveHistory();
+		
+		// The dependencies of what was compiled were taken in along the way
+		proj->GetDependencyStore()->Flush();
+		
+		// Everything which could be compiled has been, so this is where a
+		// build which went on after errors stops
+		if (parent->fFailedCount > 0)
+		{
+			STRACE(1,("%" B_PRId32 " files failed to build\n",
+					parent->fFailedCount));
+			
+			parent->Lock();
+			parent->fIsLinking = false;
+			parent->fIsBuilding = false;
+			parent->Unlock();
+			
+			// All of the messages have been sent already
+			ErrorList none;
+			parent->SendBuildFailure(none);
+			parent->MergeErrors();
+			parent->SaveTrace();
+			parent->fManager.RemoveThread(thisThread);
+			return B_ERROR;
+		}
+		
+		if (parent->fCompileOnly)
+		{
+			parent->Lock();
+			parent->fIsLinking = false;
+			parent->fIsBuilding = false;
+			parent->Unlock();
+			
+			parent->MergeErrors();
+			parent->SendBuildSuccess();
+			parent->SaveTrace();
+			parent->fManager.RemoveThread(thisThread);
+			return B_OK;
+		}
 		
 		BTRACE(("Thread %" B_PRId32 " is performing postcompile processing\n",thisThread));
 		
-		// Check to see if linking is needed
+		// Check to see if linking is needed. Recompiled objects often
+		// contain the same code as before -- after editing a comment, for
+		// example -- so what counts is whether the code changed.
 		BPath targetPath(proj->GetPath().GetFolder());
 		targetPath.Append(proj->GetTargetName(),true);
 		
-		BEntry targetEntry(targetPath.Path());
-		if (!targetEntry.Exists())
+		BString reason;
+		proj->Lock();
+		link_needed = proj->LinkInputsChanged(reason);
+		proj->Unlock();
+		
+		if (!BEntry(targetPath.Path()).Exists())
+		{
 			link_needed = true;
+			reason = "the target doesn't exist";
+		}
+		
+		if (link_needed)
+		{
+			STRACE(1,("Linking because %s\n",reason.String()));
+		}
 		else
 		{
-			struct stat *s = gStatCache.StatFor(targetPath.Path());
-			if (s || s->st_mtime < lastMod)
-				link_needed = true;
+			parent->fLinkSkipReason = "none of the rebuilt files changed "
+				"the code which goes into the target";
+			STRACE(1,("Skipping the link: %s\n",
+					parent->fLinkSkipReason.String()));
 		}
 		
+		// Only this thread is left, so the project's own list can be used
+		// for the rest. Whatever is sent from it is taken out again.
 		BuildInfo *info = proj->GetBuildInfo();
-		//ErrorList errorList("");
 		if (link_needed)
 		{
 			parent->fMsgr.SendMessage(M_LINKING_PROJECT);
 			
 			proj->Lock();
-			proj->Link();
+			{
+				// The linker may run jobs of its own, like with -flto=jobserver
+				JobToken token(gJobServer);
+				token.Acquire(B_INFINITE_TIMEOUT);
+				TraceSpan span("link",proj->GetTargetName());
+				proj->Link();
+			}
 			
 			if (info->errorList.msglist.CountItems() > 0)
-			//if (errorList.msglist.CountItems() > 0)
 			{
+				bool failed = info->errorList.CountErrors() > 0;
 				parent->SendErrorMessage(info->errorList);
-				//parent->SendErrorMessage(errorList);
 				
-				if (info->errorList.CountErrors() > 0)
-				//if (errorList.CountErrors() > 0)
+				if (failed)
 				{
 					parent->Lock();
 					parent->fIsLinking = false;
@@ -623,6 +1273,8 @@ ProjectBuilder::BuildThread(void *data)
 					parent->Unlock();
 					proj->Unlock();
 					
+					parent->MergeErrors();
+					parent->SaveTrace();
 					parent->fManager.RemoveThread(thisThread);
 					//parent->fManager.QuitAllThreads();
 					
@@ -630,9 +1282,6 @@ ProjectBuilder::BuildThread(void *data)
 					
 					return B_ERROR;
 				}
-				//else
-					//errorList.msglist.MakeEmpty();
-					//info->errorList.msglist.MakeEmpty();
 			}
 			
 			if (parent->fManager.ThreadCheckQuit())
@@ -643,37 +1292,54 @@ ProjectBuilder::BuildThread(void *data)
 				return B_OK;
 			}
 			
+			proj->SaveLinkState();
 			proj->Unlock();
 		}
 		//sleep(10);
 		
-		// Now that the linking is done, we should add any resource files
-		parent->fMsgr.SendMessage(M_UPDATING_RESOURCES);
-		
+		// Now that the linking is done, we should add any resource files.
+		// A target which wasn't linked still has them unless they changed.
 		proj->Lock();
-		proj->UpdateResources();
-		if (info->errorList.msglist.CountItems() > 0)
-		//if (errorList.msglist.CountItems() > 0)
+		bool resourcesNeeded = proj->ResourcesChanged(reason);
+		proj->Unlock();
+		
+		if (resourcesNeeded)
 		{
-			parent->SendErrorMessage(info->errorList);
-			//parent->SendErrorMessage(errorList);
-			
-			if (info->errorList.CountErrors() > 0)
-			//if (errorList.CountErrors() > 0)
+			STRACE(1,("Updating resources because %s\n",reason.String()));
+			parent->fMsgr.SendMessage(M_UPDATING_RESOURCES);
+		
+			proj->Lock();
 			{
-				parent->Lock();
-				parent->fIsLinking = false;
-				parent->fIsBuilding = false;
-				parent->Unlock();
-				proj->Unlock();
+				TraceSpan span("resources",proj->GetTargetName());
+				proj->UpdateResources();
+			}
+			if (info->errorList.msglist.CountItems() > 0)
+			{
+				bool failed = info->errorList.CountErrors() > 0;
+				parent->SendErrorMessage(info->errorList);
+			
+				if (failed)
+				{
+					parent->Lock();
+					parent->fIsLinking = false;
+					parent->fIsBuilding = false;
+					parent->Unlock();
+					proj->Unlock();
 				
-				parent->fManager.RemoveThread(thisThread);
-				//parent->fManager.QuitAllThreads();
-				return B_ERROR;
+					parent->MergeErrors();
+					parent->SaveTrace();
+					parent->fManager.RemoveThread(thisThread);
+					//parent->fManager.QuitAllThreads();
+					return B_ERROR;
+				}
+			}
+			{
+				TraceSpan span("attributes",proj->GetTargetName());
+				proj->UpdateAttributes();
 			}
+			proj->SaveResourceState();
+			proj->Unlock();
 		}
-		proj->UpdateAttributes();
-		proj->Unlock();
 		
 		// Now that the linking is done, we should add any resource files
 		parent->fMsgr.SendMessage(M_DOING_POSTBUILD);
@@ -682,6 +1348,7 @@ ProjectBuilder::BuildThread(void *data)
 		int32 groupcount = proj->CountGroups();
 		proj->Unlock();
 		
+		TraceSpan postBuildSpan("post-build","files");
 		for (int32 j = 0; j < groupcount; j++)
 		{
 			// Locking isn't necessary here -- it reduces contention for the lock
@@ -697,13 +1364,7 @@ ProjectBuilder::BuildThread(void *data)
 				proj->Unlock();
 				
 				if (info->errorList.msglist.CountItems() > 0)
-				//if (errorList.msglist.CountItems() > 0)
-				{
 					parent->SendErrorMessage(info->errorList);
-					//info->errorList.msglist.MakeEmpty();
-					//parent->SendErrorMessage(errorList);
-					//errorList.msglist.MakeEmpty();
-				}
 			}
 		}
 		
@@ -711,23 +1372,21 @@ ProjectBuilder::BuildThread(void *data)
 		parent->fIsLinking = false;
 		parent->fIsBuilding = false;
 		parent->Unlock();
-		parent->fMsgr.SendMessage(M_BUILD_SUCCESS);
-		
-		//sleep(10);
-		
-		// copy over errors in to build info
-		//info->errorList.msglist.AddList(&errorList.msglist);
-		//errorList.msglist.MakeEmpty(false);
+		parent->MergeErrors();
+		parent->SendBuildSuccess();
 		
 		parent->DoPostBuild();
 	}
 	
-	if (parent->fTotalFilesBuilt == 0)
+	// A target which was linked or had its resources updated has been
+	// finished above already
+	if (up_to_date)
 	{
-		parent->fMsgr.SendMessage(M_BUILD_SUCCESS);
+		parent->SendBuildSuccess();
 		parent->DoPostBuild();
 	}
 	
+	parent->SaveTrace();
 	parent->fManager.RemoveThread(thisThread);
 	return B_OK;
 }
@@ -766,9 +1425,12 @@ ProjectBuilder::UpdateDependenciesThread(void* data)
 	
 	
 	
-	if (parent->fManager.CountRunningThreads() == 1)
+	// Two threads finishing at the same time would both see the other one
+	// still running, so the last one is found by counting down instead
+	if (atomic_add(&parent->fDependencyThreads,-1) == 1)
 	{
 		// raise update dependencies complete message
+		proj->GetDependencyStore()->Flush();
 		parent->fMsgr.SendMessage(M_DEPENDENCIES_UPDATED);
 	}
 	parent->fManager.RemoveThread(thisThread);
@@ -776,51 +1438,33 @@ ProjectBuilder::UpdateDependenciesThread(void* data)
 }
 
 
-ThreadManager::ThreadManager(uint8 max)
+ThreadManager::ThreadManager(int32 max)
 	:	fMaxThreads(max),
-		fThreadCount(0),
 		fQuitFlag(false)
 {
-	if (max < 1)
-		fMaxThreads = 1;
-	
-	fThreadArray = new thread_id[max];
-	
-	memset(fThreadArray, -1, sizeof(thread_id) * fMaxThreads);
 }
 
 
 ThreadManager::~ThreadManager(void)
 {
 	QuitAllThreads();
-	delete [] fThreadArray;
 }
 
 
 thread_id
-ThreadManager::SpawnThread(thread_func func, void *data)
+ThreadManager::SpawnThread(thread_func func, void *data, int32 priority)
 {
 	BAutolock lock(fLock);
 	
-	if (fThreadCount == fMaxThreads)
+	if (fMaxThreads > 0 && (int32)fThreads.size() >= fMaxThreads)
 		return B_ERROR;
 	
-	thread_id t = spawn_thread(func,"build thread", B_NORMAL_PRIORITY, data);
+	thread_id t = spawn_thread(func,"build thread", priority, data);
 	if (t >= 0)
 	{
-		int8 slot = FindFreeSlot();
-		if (slot >= 0)
-		{
-			BTRACE(("Spawning build thread %" B_PRId32 "\n",t));
-			resume_thread(t);
-			fThreadArray[slot] = t;
-			fThreadCount++;
-		}
-		else
-		{
-			BTRACE(("No free slot so killing thread %" B_PRId32 "\n",t));
-			kill_thread(t);
-		}
+		BTRACE(("Spawning build thread %" B_PRId32 "\n",t));
+		fThreads.insert(t);
+		resume_thread(t);
 	}
 	
 	return t;	
@@ -831,54 +1475,90 @@ void
 ThreadManager::RemoveThread(thread_id tid)
 {
 	BAutolock lock(fLock);
-	
-	for (int32 i = 0; i < fMaxThreads; i++)
-	{
-		if (fThreadArray[i] == tid)
-		{
-			fThreadArray[i] = -1;
-			fThreadCount--;
-			return;
-		}
-	}
+	fThreads.erase(tid);
 }
 
 
-uint8
+int32
 ThreadManager::CountRunningThreads(void)
 {
 	BAutolock lock(fLock);
-	uint8 count = fThreadCount;
+	int32 count = fThreads.size();
 	
 	return count;
 }
 
 
 void
-ThreadManager::QuitAllThreads(void)
+ThreadManager::QuitAllThreads(bool stopProcesses)
 {
 	fLock.Lock();
 	fQuitFlag = true;
 	fLock.Unlock();
 	
-	while (true)
+	// Anything which ignores being asked to quit is killed a little later.
+	// Each round takes care of processes started since the last one, too.
+	bigtime_t start = system_time();
+	while (stopProcesses)
 	{
-		bool done = false;
+		int signal = system_time() - start < 2000000 ? SIGTERM : SIGKILL;
 		
 		fLock.Lock();
-		if (fThreadCount <= 0)
-			done = true;
+		std::set<thread_id> threads(fThreads);
 		fLock.Unlock();
 		
-		if (done)
-			break;
+		std::set<thread_id>::iterator i;
+		for (i = threads.begin(); i != threads.end(); i++)
+			gProcessExecutor.SignalStartedBy(*i,signal);
 		
-		snooze(10000);
+		if (WaitForAllThreads(100000))
+			break;
 	}
+	
+	WaitForAllThreads();
 	fQuitFlag = false;
 }
 
 
+bool
+ThreadManager::WaitForAllThreads(bigtime_t timeout)
+{
+	uint32 flags = 0;
+	if (timeout != B_INFINITE_TIMEOUT)
+	{
+		flags = B_ABSOLUTE_TIMEOUT;
+		timeout += system_time();
+	}
+	
+	while (true)
+	{
+		fLock.Lock();
+		std::set<thread_id> threads(fThreads);
+		fLock.Unlock();
+		
+		// A worker waiting for the rest can't wait for itself
+		threads.erase(find_thread(NULL));
+		if (threads.empty())
+			return true;
+		
+		// Each thread takes itself off the list just before it quits, so
+		// waiting for its end is as good as waiting for that
+		std::set<thread_id>::iterator i;
+		for (i = threads.begin(); i != threads.end(); i++)
+		{
+			status_t result;
+			status_t status = wait_for_thread_etc(*i,flags,timeout,&result);
+			if (status == B_TIMED_OUT || status == B_WOULD_BLOCK)
+				return false;
+			
+			// One which is gone without saying so won't ever do it
+			if (status == B_BAD_THREAD_ID)
+				RemoveThread(*i);
+		}
+	}
+}
+
+
 void
 ThreadManager::KillAllThreads(bigtime_t quit_timeout)
 {
@@ -888,16 +1568,10 @@ ThreadManager::KillAllThreads(bigtime_t quit_timeout)
 	if (quit_timeout > 0)
 		snooze(quit_timeout);
 	
-	for (int32 i = 0; i < fMaxThreads; i++)
-	{
-		thread_id tid = fThreadArray[i];
-		if (tid >= 0)
-		{
-			kill_thread(tid);
-			fThreadArray[i] = -1;
-		}
-	}
-	fThreadCount = 0;
+	std::set<thread_id>::iterator i;
+	for (i = fThreads.begin(); i != fThreads.end(); i++)
+		kill_thread(*i);
+	fThreads.clear();
 }
 
 
@@ -908,17 +1582,3 @@ ThreadManager::ThreadCheckQuit(void)
 	bool value = fQuitFlag;
 	return value;
 }
-
-
-int8
-ThreadManager::FindFreeSlot(void)
-{
-	for (int8 i = 0; i < fMaxThreads; i++)
-	{
-		thread_id tid = fThreadArray[i];
-		if (tid < 0)
-			return i;
-	}
-	return -1;
-}
-
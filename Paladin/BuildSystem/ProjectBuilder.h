@@ -1,12 +1,16 @@
 #ifndef PROJECT_BUILDER_H
 #define PROJECT_BUILDER_H
 
+#include <map>
+#include <set>
 #include <vector>
 
 #include <Locker.h>
 #include <Messenger.h>
 #include <String.h>
 
+#include "BuildScheduler.h"
+#include "BuildTrace.h"
 #include "CompileCommand.h"
 #include "ErrorParser.h"
 
@@ -40,29 +44,44 @@ enum
 
 class Project;
 
+// What the header check needs to know about a file which was examined
+typedef struct
+{
+	SourceFile	*file;
+	time_t		objectTime;
+} examined_file;
+
+// Keeps track of the threads of a build. There is no limit on how many there
+// may be unless one is given -- how many jobs run at once is up to the job
+// server.
 class ThreadManager
 {
 public:
-						ThreadManager(uint8 max = 32);
+						ThreadManager(int32 max = 0);
 						~ThreadManager(void);
 						
-	thread_id			SpawnThread(thread_func func, void *data);
+	thread_id			SpawnThread(thread_func func, void *data,
+									int32 priority = B_NORMAL_PRIORITY);
 	void				RemoveThread(thread_id tid);
 	
-	uint8				CountRunningThreads(void);
-	void				QuitAllThreads(void);
+	int32				CountRunningThreads(void);
+	
+	// Asks the threads to quit and waits for them. Stopping their processes
+	// ends whatever they are running right away instead of letting it finish.
+	void				QuitAllThreads(bool stopProcesses = false);
+	
+	// Returns false if the threads weren't all gone before the timeout. A
+	// thread on the list which calls it waits only for the others.
+	bool				WaitForAllThreads(bigtime_t timeout = B_INFINITE_TIMEOUT);
 	void				KillAllThreads(bigtime_t quit_timeout = 0);
 	
 	bool				ThreadCheckQuit(void);
 	
 private:
-	int8				FindFreeSlot(void);
-	
 	BLocker				fLock;
-	uint8				fMaxThreads;
-	uint8				fThreadCount;
+	int32				fMaxThreads;
 	bool				fQuitFlag;
-	thread_id			*fThreadArray;
+	std::set<thread_id>	fThreads;
 };
 
 class ProjectBuilder : public BLocker
@@ -73,15 +92,32 @@ public:
 						~ProjectBuilder(void);
 						
 			void		BuildProject(Project *proj, int32 postbuild);
+			
+			// Compiles whatever needs it at a low priority without linking.
+			// The build success message has "compileonly" set.
+			void		CompileProject(Project *proj);
 			void		UpdateDependencies(Project* proj);
 			void		QuitBuild(void);
 			bool		IsBuilding(void);
 			
 private:
+			void		StartBuild(Project *proj, int32 postbuild,
+									bool compileOnly);
 			void		DoBuild(void);
 			void		DoPostBuild(void);
+			void		MarkForBuild(SourceFile *file);
+			void		QueueDirtyFiles(void);
+			void		QueueJob(SourceFile *file);
+			void		ExamineFiles(void);
+			void		SendBuildSuccess(void);
+			void		SendBuildFailure(ErrorList &list);
 			void		SendErrorMessage(ErrorList &list);
+			void		PublishErrors(ErrorList &list, uint32 what);
+			void		MergeErrors(void);
+			bool		JobFailed(SourceFile *file, ErrorList &list);
+			void		SaveTrace(void);
 	static	int32		BuildThread(void *data);
+	static	int32		ExamineThread(void *data);
 	static	int32		UpdateDependenciesThread(void *data);
 	
 	BMessenger			fMsgr;
@@ -92,8 +128,41 @@ private:
 	int32				fTotalFilesBuilt;
 	
 	int32				fPostBuildAction;
+	bool				fCompileOnly;
 	
 	ThreadManager		fManager;
+	BuildScheduler		fScheduler;
+	int32				fNextWorker;
+	int32				fWorkerCount;
+	int32				fMaxWorkers;
+	int32				fWorkerPriority;
+	
+	// Unless the files are going to be batched for a unity build, each one is
+	// handed to the build threads as soon as it is found to need building
+	bool				fQueueDirectly;
+	std::set<SourceFile*>	fQueued;
+	
+	// What the threads examining the files have found so far
+	BLocker				fExamineLock;
+	std::vector<SourceFile*>	fExamineList;
+	int32				fNextExamined;
+	std::set<BString>	fHeaders;
+	std::map<BString, examined_file>	fExamined;
+	bool				fAllWatched;
+	
+	int32				fDependencyThreads;
+	bool				fKeepGoing;
+	int32				fFailedCount;
+	
+	// Set when a build ends early, after an error or by being stopped, so
+	// that the thread waiting to link it doesn't go on
+	bool				fStopped;
+	
+	// Released once the precompiled header of the build is ready
+	sem_id				fHeaderSem;
+	BString				fLinkSkipReason;
+	ErrorList			fErrors;
+	BuildTrace			fTrace;
 	
 	std::vector<CompileCommand>	fCommands;
 	std::vector<SourceFile*>	fFilesToUpdate;
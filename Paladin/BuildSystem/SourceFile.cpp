@@ -1,16 +1,23 @@
 #include "SourceFile.h"
 
 #include <Path.h>
+#include <errno.h>
 #include <sys/stat.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "BuildInfo.h"
 #include "Globals.h"
+#include "IncludeScanner.h"
 #include "StatCache.h"
 #include "CompileCommand.h"
+#include "DebugTools.h"
+#include "DependencyStore.h"
 
 SourceFile::SourceFile(const char *path)
 	:	fNeedsBuild(BUILD_YES),
+		fExitStatus(0),
 		fType(TYPE_UNKNOWN),
 		fModTime(0)
 {
@@ -20,6 +27,7 @@ SourceFile::SourceFile(const char *path)
 
 SourceFile::SourceFile(const entry_ref &ref)
 	:	fNeedsBuild(BUILD_YES),
+		fExitStatus(0),
 		fType(TYPE_UNKNOWN),
 		fModTime(0)
 {
@@ -95,17 +103,19 @@ SourceFile::UpdateModTime(void)
 		return;
 */
 	struct stat data;
-	GetStat(fPath.GetFullPath(),&data);
-	fModTime = data.st_mtime;
+	if (GetStat(fPath.GetFullPath(),&data) == B_OK)
+		fModTime = data.st_mtime;
 }
 
 
 time_t
 SourceFile::GetModTime(void) const
 {
-//	return fModTime;
+	// The stat cache knows when the file changes, so asking it is no more
+	// work than keeping the time around ourselves
 	struct stat data;
-	GetStat(fPath.GetFullPath(),&data);
+	if (GetStat(fPath.GetFullPath(),&data) != B_OK)
+		return fModTime;
 	return data.st_mtime;
 }
 
@@ -128,51 +138,69 @@ SourceFile::UpdateDependencies(BuildInfo &info)
 }
 
 
+void
+SourceFile::SetDependencies(const char *deps)
+{
+	fDependencies = deps;
+	
+	// Keep the split version around so that checking dependencies doesn't
+	// have to parse the string every time
+	fDependencyList.clear();
+	const char *start = fDependencies.String();
+	while (*start)
+	{
+		const char *end = strchr(start,'|');
+		if (!end)
+			end = start + strlen(start);
+		
+		if (end > start)
+			fDependencyList.push_back(BString(start,end - start));
+		
+		start = *end ? end + 1 : end;
+	}
+}
+
+
+bool
+SourceFile::DependenciesKnown(BuildInfo &info)
+{
+	if (!fDependencyList.empty())
+		return true;
+	
+	return info.dependencyStore
+		&& info.dependencyStore->HasDependencies(GetPath().GetFullPath());
+}
+
+
 bool
 SourceFile::DependsOn(const char *path) const
 {
-	if (!path || fDependencies.CountChars() < 1)
+	if (!path || fDependencyList.empty())
 		return false;
 	
 	// strip absolute paths down to their filenames
-	BString pathstr(path);
-	int32 pos = pathstr.FindLast("/");
-	if (pos >= 0)
-		pathstr = path + pos + 1;
+	const char *name = strrchr(path,'/');
+	name = name ? name + 1 : path;
 	
-	return (fDependencies.FindFirst(pathstr) != B_ERROR) ? true : false;
+	for (size_t i = 0; i < fDependencyList.size(); i++)
+	{
+		const char *depname = strrchr(fDependencyList[i].String(),'/');
+		depname = depname ? depname + 1 : fDependencyList[i].String();
+		if (strcmp(name,depname) == 0)
+			return true;
+	}
+	return false;
 }
 
 
 DPath
 SourceFile::FindDependency(BuildInfo &info, const char *name)
 {
-	DPath testpath;
-	
 	if (!name || strlen(name) < 1)
-		return testpath;
-	
-	DPath file(name);
-	
-	// First check the project folder -- typically many includes kept there. :)
-	testpath = info.projectFolder.GetFullPath();
-	testpath.Append(file.GetFileName());
+		return DPath();
 	
-	if (BEntry(testpath.GetFullPath()).Exists())
-		return testpath;
-	
-	int32 count = info.includeList.CountItems();
-	for (int32 i = 0; i < count; i++)
-	{
-		testpath = info.includeList.ItemAt(i)->Absolute().String();
-		testpath.Append(file.GetFileName());
-		
-		BEntry entry(testpath.GetFullPath());
-		if (entry.Exists())
-			return testpath;
-	}
-	
-	return DPath();
+	BString path = gIncludeScanner.FindHeader(info,name);
+	return (path.Length() > 0) ? DPath(path.String()) : DPath();
 }
 
 
@@ -234,6 +262,42 @@ SourceFile::GetResourcePath(BuildInfo &info)
 }
 
 
+DPath
+SourceFile::GetTemporaryObjectPath(BuildInfo &info)
+{
+	// Named after the thread, like the temporary files of the object cache
+	BString path(GetObjectPath(info).GetFullPath());
+	path << "." << find_thread(NULL) << ".tmp";
+	return DPath(path.String());
+}
+
+
+void
+SourceFile::FinishObject(BuildInfo &info, bool inPlace)
+{
+	if (inPlace)
+	{
+		if (ExitStatus() != 0)
+			unlink(GetObjectPath(info).GetFullPath());
+		return;
+	}
+	
+	BString tempPath(GetTemporaryObjectPath(info).GetFullPath());
+	if (ExitStatus() == 0)
+	{
+		if (rename(tempPath.String(),GetObjectPath(info).GetFullPath()) == 0)
+			return;
+		
+		STRACE(1,("Couldn't move %s into place: %s\n",tempPath.String(),
+				strerror(errno)));
+		SetExitStatus(-1);
+	}
+	
+	// The object from before stays until there is a complete new one
+	unlink(tempPath.String());
+}
+
+
 BString
 SourceFile::MakeAbsolutePath(DPath relative, const char *path)
 {
@@ -256,14 +320,7 @@ SourceFile::GetStat(const char *path, struct stat *s, bool use_cache) const
 		return B_BAD_VALUE;
 	
 	if (gUseStatCache && use_cache)
-	{
-		struct stat *info = gStatCache.StatFor(path);
-		if (!info)
-			return B_ERROR;
-		
-		*s = *info;
-		return B_OK;
-	}
+		return gStatCache.StatFor(path,s) ? B_OK : B_ERROR;
 	
 	return stat(path,s);
 }
@@ -1,6 +1,8 @@
 #ifndef SOURCE_FILE_H
 #define SOURCE_FILE_H
 
+#include <vector>
+
 #include <String.h>
 
 #include "DPath.h"
@@ -44,6 +46,11 @@ public:
 			int8		BuildFlag(void) const;
 	virtual	bool		UsesBuild(void) const;
 	
+			// The exit status of the last tool run by Precompile() or
+			// Compile(). Anything but 0 means that the file failed to build.
+			void		SetExitStatus(int status) { fExitStatus = status; }
+			int			ExitStatus(void) const { return fExitStatus; }
+	
 			SourceFileType	GetType(void) const { return fType; }
 			
 			void		UpdateModTime(void);
@@ -55,7 +62,14 @@ public:
 	virtual	void		UpdateDependencies(BuildInfo &info);
 	
 			const char *GetDependencies(void) const { return fDependencies.String(); }
+			void		SetDependencies(const char *deps);
+			const std::vector<BString> &	GetDependencyList(void) const
+											{ return fDependencyList; }
 			bool		DependsOn(const char *path) const;
+			
+			// Whether the dependencies were ever found out, even if there
+			// turned out to be none
+			bool		DependenciesKnown(BuildInfo &info);
 			DPath		FindDependency(BuildInfo &info, const char *name);
 	
 	virtual	bool		CheckNeedsBuild(BuildInfo &info, bool check_deps = true);
@@ -68,13 +82,21 @@ public:
 	virtual	DPath		GetObjectPath(BuildInfo &info);
 	virtual	DPath		GetLibraryPath(BuildInfo &info);
 	virtual	DPath		GetResourcePath(BuildInfo &info);
+			
+			// Compilers write to the temporary object, which only takes the
+			// place of the object once they have succeeded. A stopped or
+			// crashed build can't leave a broken object which looks current.
+			// An object written in place is removed if the compiler failed.
+			DPath		GetTemporaryObjectPath(BuildInfo &info);
+			void		FinishObject(BuildInfo &info, bool inPlace = false);
 	
 			BString		MakeAbsolutePath(DPath relative, const char *path);
 	
 			status_t	GetStat(const char *path, struct stat *s,
 								bool use_cache = true) const;
 protected:
-	BString			fDependencies;
+	BString					fDependencies;
+	std::vector<BString>	fDependencyList;
 	
 private:
 	friend class Project;
@@ -82,6 +104,7 @@ private:
 	DPath			fPath;
 					
 	int8			fNeedsBuild;
+	int				fExitStatus;
 	SourceFileType	fType;
 	time_t			fModTime;
 };
@@ -1,21 +1,27 @@
 #include "SourceTypeC.h"
 
+#include <map>
 #include <string>
 #include <vector>
-#include <algorithm>
 
 #include <Entry.h>
+#include <File.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <Node.h>
-#include <StringList.h>
 #include <Messenger.h>
 
 #include "BuildInfo.h"
+#include "BuildTrace.h"
+#include "ContentHash.h"
 #include "DebugTools.h"
+#include "DependencyStore.h"
+#include "DiagnosticParser.h"
 #include "Globals.h"
-#include "CommandOutputHandler.h"
-#include "CommandThread.h"
 #include "CompileCommand.h"
+#include "IncludeScanner.h"
+#include "ObjectCache.h"
+#include "ProcessExecutor.h"
 
 SourceTypeC::SourceTypeC(void)
 {
@@ -139,176 +145,39 @@ SourceFileC::UsesBuild(void) const
 void
 SourceFileC::UpdateDependencies(BuildInfo &info)
 {
+	STRACE(1,("Updating dependencies for %s\n",GetPath().GetFullPath()));
+	TraceSpan span("dependencies",GetPath().GetFileName());
 	
-	BString abspath = GetPath().GetFullPath();
-	if (abspath[0] != '/')
+	std::vector<BString> dependencies;
+	if (gIncludeScanner.GetDependencies(info,GetPath().GetFullPath(),
+			dependencies) != B_OK)
 	{
-		abspath.Prepend("/");
-		abspath.Prepend(info.projectFolder.GetFullPath());
+		STRACE(1,("Couldn't scan %s for dependencies\n",GetPath().GetFullPath()));
+		return;
 	}
-	BString command;
-	
-	if (gUseFastDep && gFastDepAvailable)
-		command << "fastdep " << info.includeString << " '" << abspath.String() << "'";
-	else
-		command << "g++ -MM " << info.includeString << " '" << abspath.String() << "'";
 	
+	StoreDependencies(info,dependencies);
+}
+
+
+void
+SourceFileC::StoreDependencies(BuildInfo &info,
+							const std::vector<BString> &dependencies)
+{
 	BString depstr;
-	//RunPipedCommand(command.String(), depstr, true);
-	
-	BMessage cmd;
-	cmd.AddString("cmd",command);
-		
-	STRACE(1,("Updating dependencies for %s\n",GetPath().GetFullPath()));
-	
-	CommandOutputHandler handler(true); // enable redirect
-	BLooper* looper = new BLooper();
-	looper->AddHandler(&handler);
-	BMessenger msgr(&handler,looper);
-	looper->Run();
-	CommandThread thread(&cmd,&msgr);
-	status_t startStatus = thread.Start();
-	
-	std::string errmsg;	
-	
-	if (B_BUSTED_PIPE == startStatus)
+	for (size_t i = 0; i < dependencies.size(); i++)
 	{
-		errmsg = "CommandThread was unable to allocate a thread\n";
-	} else {
-		status_t okReturn = B_OK;
-		thread.WaitForThread(&okReturn);
-	
-		handler.WaitForExit(); // REQUIRED so as not to miss output/errors
-	
-		depstr = BString(handler.GetOut().c_str());
+		if (i > 0)
+			depstr << "|";
+		depstr << dependencies[i];
 	}
 	
-	
-	
-	
-	STRACE(1,("Updated Dependencies for %s\nCommand:%s\nOutput:%s\n",
-			GetPath().GetFullPath(),command.String(),depstr.String()));
-	
-	if (gUseFastDep && gFastDepAvailable)
-	{
-		if (depstr.FindFirst("error ") == 0)
-		{
-			int32 index, startpos = 0;
-			index = depstr.FindFirst("error ", startpos);
-			while (index >= 0)
-			{
-				startpos = index + 6;
-				index = depstr.FindFirst("error ", startpos);
-			}
-			
-			index = depstr.FindFirst("\n") + 1;
-			depstr = depstr.String() + index;
-		}
-		
-		// The first part of the dependency string should be FileName.o:
-		int32 secondlinepos = depstr.FindFirst("\n") + 1;
-		
-		BString tempstr = depstr;
-		depstr = tempstr.String() + secondlinepos;
-		
-		depstr.ReplaceAll(" \\\n\t","|");
-		
-		if (depstr.FindLast("\n") == depstr.CountChars() - 1)
-			depstr.RemoveLast("\n");
-		
-		if (depstr.FindFirst(" ") == 0)
-			depstr.RemoveFirst(" ");
-		
-		fDependencies = depstr;
-	}
-	else
-	{
-		// The reason that all of this works is because the absolute paths force
-		// each file to be on a separate line. Going with relative paths is FAR more
-		// of a headache than I want to mess with. Bleah.
-		
-		if (depstr.FindFirst(" warning: ") >= 0)
-		{
-			int32 index, startpos = 0;
-			index = depstr.FindFirst(" warning: ", startpos);
-			while (index >= 0)
-			{
-				startpos = index + 10;
-				index = depstr.FindFirst(" warning: ", startpos);
-			}
-			
-			index = depstr.FindFirst("\n") + 1;
-			depstr = depstr.String() + index;
-		}
-		
-		// The first part of the dependency string should be FileName.o:
-		BString objfilename = GetPath().GetBaseName();
-		objfilename << ".o: ";
-		
-		int32 filenamepos = depstr.FindFirst(objfilename.String());
-		if (filenamepos == 0)
-		{
-			int32 lineend = depstr.FindFirst("\n",filenamepos);
-			if (lineend >= 0)
-				fDependencies = depstr.String() + lineend + 2;
-		}
-		else
-			fDependencies = depstr.String();
-		
-		fDependencies.RemoveSet("\\\n");
-		fDependencies.ReplaceAll("  ","|");
-		fDependencies.ReplaceAll("| ","|");
-		if (fDependencies[0] == ' ')
-			fDependencies.RemoveFirst(" ");
-	}
-	// now we have a pipe delimited string, split and filter for this source type (headers only left)
-	BStringList components;
-	fDependencies.Split("|",true,components);
-	std::vector<BString> included;
-	for (int32 si = components.CountStrings() - 1;si >=0;si--) {
-		if (!components.StringAt(si).EndsWith(".h") || 
-			 components.StringAt(si).StartsWith("/boot/system/"))
-		{
-			components.Remove(si);
-		} else if(std::find(included.begin(), included.end(), 
-				  components.StringAt(si)) != included.end()) {
-			// already included, remove
-			components.Remove(si);
-		} else {
-			included.push_back(components.StringAt(si));
-		}
-	}
-	
-	/*
-	auto it = components.end();
-	while (it > components.begin()) {
-		if (!(*it).EndsWith(".h"))
-			it = components.erase(it);
-	}
-	*/
-	/*
-	for (uint32 si = components.Length();si >= 0;si--)
-	{
-		if (!components.At(si).endsWith(".h")) {
-		components.Remove(si);
-	}
-	*/
-	//fDependencies = "";
-	/*
-	auto it2 = components.begin();
-	bool first = true;
-	while (it2 < components.end()) {
-		if (first) {
-			first = false;
-		} else {
-			fDependencies += "|";
-		}
-		fDependencies += *it;
-		it++;
-	}
-	*/
-	fDependencies = components.Join("|");
+	SetDependencies(depstr.String());
 	STRACE(2,("fDependencies now: %s\n",fDependencies.String()));
+	
+	if (info.dependencyStore)
+		info.dependencyStore->SetDependencies(GetPath().GetFullPath(),
+												dependencies);
 }
 
 
@@ -341,23 +210,19 @@ SourceFileC::CheckNeedsBuild(BuildInfo &info, bool check_deps)
 	
 	DPath objpath(info.objectFolder);
 	objpath.Append(objname);
-	if (!BEntry(objpath.GetFullPath()).Exists())
+	struct stat objstat;
+	if (GetStat(objpath.GetFullPath(),&objstat) != B_OK)
 	{
 		STRACE(2,("%s::CheckNeedsBuild: object doesn't exist\n",GetPath().GetFullPath()));
 		return true;
 	}
 	
 	// source vs object mod time
-	struct stat objstat;
-	if (GetStat(objpath.GetFullPath(),&objstat) != B_OK)
-	{
-		STRACE(2,("%s::CheckNeedsBuild: couldn't stat object\n",GetPath().GetFullPath()));
-		return false;
-	}
 	
-	// Fix mod times set into the future
+	// Fix mod times set into the future. Comparing contents copes with them
+	// without having to touch the source.
 	time_t now = real_time_clock();
-	if (GetModTime() > now)
+	if (!gUseContentHash && GetModTime() > now)
 	{
 		BNode node(GetPath().GetFullPath());
 		node.SetModificationTime(now);
@@ -367,7 +232,7 @@ SourceFileC::CheckNeedsBuild(BuildInfo &info, bool check_deps)
 	{
 		STRACE(2,("%s::CheckNeedsBuild: file time more recent than object time\n",
 				GetPath().GetFullPath()));
-		return true;
+		return !ContentUnchanged(info);
 	}
 	
 	if (!check_deps)
@@ -377,42 +242,34 @@ SourceFileC::CheckNeedsBuild(BuildInfo &info, bool check_deps)
 		return false;
 	}
 	
-	// Dependency check
-	BString str(GetDependencies());
-	if (str.CountChars() < 1)
+	// Dependency check. Compiling records the dependencies, so they only
+	// have to be looked for in files which were never compiled that way.
+	if (!DependenciesKnown(info))
 	{
 		STRACE(2,("%s::CheckNeedsBuild: initial dependency update\n",
 				GetPath().GetFullPath()));
 		UpdateDependencies(info);
-		str = GetDependencies();
 	}
 	
-	if (str.CountChars() > 0)
+	const std::vector<BString> &deps = GetDependencyList();
+	for (size_t i = 0; i < deps.size(); i++)
 	{
-		char *pathstr;
-		char depString[str.Length() + 1];
-		sprintf(depString,"%s",str.String());
-
-		pathstr = strtok(depString,"|");
-		while (pathstr)
+		// Dependencies found by the include scanner are absolute paths. Only
+		// ones carried over from older projects need to be looked up.
+		BString depPath(deps[i]);
+		if (depPath[0] != '/')
+			depPath = FindDependency(info,depPath.String()).GetFullPath();
+		
+		if (depPath.Length() == 0 || depPath == GetPath().GetFullPath())
+			continue;
+		
+		struct stat depstat;
+		if (GetStat(depPath.String(),&depstat) == B_OK &&
+			depstat.st_mtime > objstat.st_mtime)
 		{
-			BString filename(DPath(pathstr).GetFileName());
-			if (filename.Compare(GetPath().GetFileName()) != 0)
-			{
-				DPath depPath(FindDependency(info,filename.String()));
-				if (!depPath.IsEmpty())
-				{
-					struct stat depstat;
-					if (GetStat(depPath.GetFullPath(),&depstat) == B_OK &&
-						depstat.st_mtime > objstat.st_mtime)
-					{
-						STRACE(2,("%s::CheckNeedsBuild: dependency %s was updated\n",
-								GetPath().GetFullPath(),depPath.GetFullPath()));
-						return true;
-					}
-				}
-			}
-			pathstr = strtok(NULL,"|");
+			STRACE(2,("%s::CheckNeedsBuild: dependency %s was updated\n",
+					GetPath().GetFullPath(),depPath.String()));
+			return !ContentUnchanged(info);
 		}
 	}
 	
@@ -476,44 +333,115 @@ SourceFileC::Compile(BuildInfo &info, const CompileCommand& cc)
 	BString compileString(cc.command.c_str());
 	//compileString << " 2>&1";
 	
-	//BString errmsg;
-	
-	BMessage cmd;
-	cmd.AddString("cmd",compileString);
-	cmd.AddString("pwd",abspath);
-		
-	
-	CommandOutputHandler handler(true); // enable redirect
-	BLooper* looper = new BLooper();
-	looper->AddHandler(&handler);
-	BMessenger msgr(&handler,looper);
-	looper->Run();
-	CommandThread thread(&cmd,&msgr);
-	status_t startStatus = thread.Start();
+	// Structured diagnostics can be taken in without any guesswork. The option
+	// isn't part of the command itself so that other tools reading the
+	// compile commands aren't bothered with it.
+	if (JSONDiagnosticsAvailable())
+		compileString << " -fdiagnostics-format=json";
+	
+	// The hashes are taken before compiling so that they describe what the
+	// compiler actually read even if a file is saved in the meantime
+	std::vector<BString> hashedFiles;
+	std::vector<uint64> hashes;
+	time_t startTime = real_time_clock();
+	
+	// With split DWARF, the debugging information is in a .dwo file next to
+	// the object, which the cache doesn't keep
+	bool splitDebug = compileString.FindFirst("-gsplit-dwarf") >= 0;
+	
+	// A cached object has to match every header the source reads now. The
+	// list from the last compile may lack the ones added since and a file
+	// which was never compiled has none, so the headers are looked for
+	// first. Without them, the cache is left alone.
+	bool dependenciesFound = false;
+	if (gUseObjectCache && !splitDebug)
+	{
+		std::vector<BString> dependencies;
+		if (gIncludeScanner.GetDependencies(info,GetPath().GetFullPath(),
+				dependencies) == B_OK)
+		{
+			StoreDependencies(info,dependencies);
+			dependenciesFound = true;
+		}
+	}
 	
-	std::string errmsg;	
+	if (gUseContentHash || gUseObjectCache)
+		HashContents(info,hashedFiles,hashes);
 	
-	if (B_BUSTED_PIPE == startStatus)
+	BString cacheKey;
+	if (dependenciesFound && !hashedFiles.empty())
 	{
-		errmsg = "CommandThread was unable to allocate a thread\n";
-	} else {
-		status_t okReturn = B_OK;
-		thread.WaitForThread(&okReturn);
+		cacheKey = gObjectCache.MakeKey(info,compileString.String(),hashedFiles,
+										hashes);
+		
+		BString output;
+		if (gObjectCache.Fetch(cacheKey.String(),
+								GetObjectPath(info).GetFullPath(),output))
+		{
+			STRACE(1,("Using cached object for %s\n",abspath.String()));
+			
+			// Warnings are kept along with the object so they aren't lost
+			if (output.Length() > 0)
+				ParseGCCErrors(output.String(),info.errorList);
+			if (gUseContentHash)
+				WriteContentHashes(info,hashedFiles,hashes);
+			return;
+		}
+	}
 	
-		handler.WaitForExit(); // REQUIRED so as not to miss output/errors
+	// The compiler writes down which headers it read, which is where the
+	// dependencies come from. That way they always match what was compiled.
+	// Like the diagnostics option, this is left out of the command itself.
+	DPath depFilePath = GetDependencyFilePath(info);
+	compileString << " -MMD -MF '" << depFilePath.GetFullPath() << "'";
+	
+	// The compiler writes a temporary object, which takes the place of the
+	// old one once it is complete. With split DWARF, the object names the
+	// .dwo file next to it, which is named after the object, so that one
+	// is written in place.
+	bool inPlace = splitDebug;
+	if (!inPlace)
+	{
+		BString objectOption, tempOption;
+		objectOption << " -o '" << GetObjectPath(info).GetFullPath() << "'";
+		tempOption << " -o '" << GetTemporaryObjectPath(info).GetFullPath() << "'";
+		compileString.ReplaceLast(objectOption.String(),tempOption.String());
+	}
 	
-		errmsg = handler.GetOut();
+	// The compiler's messages are taken apart while it is still running
+	BString errmsg;
+	int status;
+	DiagnosticParser parser(info.errorList);
+	DiagnosticListener listener(parser,errmsg);
+	if (gProcessExecutor.Run(compileString.String(),&listener,&status) != B_OK)
+	{
+		errmsg = "Unable to start the compiler\n";
+		parser.Feed(errmsg.String(),errmsg.Length());
+		parser.Finish();
+		status = -1;
 	}
+	SetExitStatus(status);
+	FinishObject(info,inPlace);
 	
 	STRACE(1,("Compiling c++ %s\nCommand:%s\nOutput:%s\n",
-			abspath.String(),compileString.String(),errmsg.c_str()));
-		
-	//RunPipedCommand(compileString.String(), errmsg, true);
-	//STRACE(1,("Compiling %s\nCommand:%s\nOutput:%s\n",
-	//		abspath.String(),compileString.String(),errmsg.String()));
+			abspath.String(),compileString.String(),errmsg.String()));
+	
+	if (ExitStatus() == 0 && !ReadDependencyFile(info))
+		STRACE(1,("No dependency file for %s\n",abspath.String()));
 	
-	ParseGCCErrors(errmsg.c_str(),info.errorList);
-	//ParseGCCErrors(errmsg.String(),info.errorList);
+	// Only a fresh object means that the compile worked
+	struct stat objstat;
+	if (hashedFiles.empty()
+		|| GetStat(GetObjectPath(info).GetFullPath(),&objstat,false) != B_OK
+		|| objstat.st_mtime < startTime)
+		return;
+	
+	if (gUseContentHash)
+		WriteContentHashes(info,hashedFiles,hashes);
+	
+	if (cacheKey.Length() > 0)
+		gObjectCache.Store(cacheKey.String(),GetObjectPath(info).GetFullPath(),
+							errmsg.String());
 }
 
 
@@ -534,4 +462,205 @@ SourceFileC::RemoveObjects(BuildInfo &info)
 {
 	BEntry entry(GetObjectPath(info).GetFullPath());
 	entry.Remove();
+	
+	BEntry depEntry(GetDependencyFilePath(info).GetFullPath());
+	depEntry.Remove();
+	
+	BEntry hashEntry(GetHashPath(info).GetFullPath());
+	hashEntry.Remove();
+	
+	// Left by split DWARF
+	BString dwoPath(info.objectFolder.GetFullPath());
+	dwoPath << "/" << GetPath().GetBaseName() << ".dwo";
+	BEntry dwoEntry(dwoPath.String());
+	dwoEntry.Remove();
+}
+
+
+DPath
+SourceFileC::GetHashPath(BuildInfo &info)
+{
+	BString hashname(GetPath().GetBaseName());
+	hashname << ".hash";
+	
+	DPath hashpath(info.objectFolder);
+	hashpath.Append(hashname);
+	return hashpath;
+}
+
+
+DPath
+SourceFileC::GetDependencyFilePath(BuildInfo &info)
+{
+	BString name(GetPath().GetBaseName());
+	name << ".d";
+	
+	DPath path(info.objectFolder);
+	path.Append(name);
+	return path;
+}
+
+
+bool
+SourceFileC::ReadDependencyFile(BuildInfo &info)
+{
+	TraceSpan span("dependencies",GetPath().GetFileName());
+	
+	BFile file(GetDependencyFilePath(info).GetFullPath(),B_READ_ONLY);
+	off_t size;
+	if (file.InitCheck() != B_OK || file.GetSize(&size) != B_OK || size <= 0)
+		return false;
+	
+	BString data;
+	char *buffer = data.LockBuffer(size);
+	ssize_t bytes = file.Read(buffer,size);
+	data.UnlockBuffer(bytes > 0 ? bytes : 0);
+	if (bytes <= 0)
+		return false;
+	
+	std::vector<BString> names;
+	IncludeScanner::ParseMakeDependencies(data.String(),data.Length(),names);
+	
+	// The list holds the source itself, too. The compiler is given absolute
+	// paths for the source and the include folders, so that is what comes
+	// back. Anything else is taken to be relative to the project, like the
+	// paths in the project file.
+	std::vector<BString> dependencies;
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		BString name(names[i]);
+		if (name[0] != '/')
+		{
+			name.Prepend("/");
+			name.Prepend(info.projectFolder.GetFullPath());
+		}
+		name = IncludeScanner::NormalizePath(name.String());
+		if (name != GetPath().GetFullPath())
+			dependencies.push_back(name);
+	}
+	
+	StoreDependencies(info,dependencies);
+	return true;
+}
+
+
+void
+SourceFileC::HashContents(BuildInfo &info, std::vector<BString> &files,
+						std::vector<uint64> &hashes)
+{
+	files.push_back(GetPath().GetFullPath());
+	
+	const std::vector<BString> &deps = GetDependencyList();
+	for (size_t i = 0; i < deps.size(); i++)
+	{
+		BString depPath(deps[i]);
+		if (depPath[0] != '/')
+			depPath = FindDependency(info,depPath.String()).GetFullPath();
+		if (depPath.Length() > 0 && depPath != files[0])
+			files.push_back(depPath);
+	}
+	
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		uint64 hash;
+		if (gHashCache.HashFor(files[i].String(),&hash) != B_OK)
+		{
+			// Without a complete set the object can't be vouched for later
+			files.clear();
+			hashes.clear();
+			return;
+		}
+		hashes.push_back(hash);
+	}
+}
+
+
+void
+SourceFileC::WriteContentHashes(BuildInfo &info,
+								const std::vector<BString> &files,
+								const std::vector<uint64> &hashes)
+{
+	BString data;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		char hashString[32];
+		sprintf(hashString,"%016" B_PRIx64 " ",hashes[i]);
+		data << hashString << files[i] << "\n";
+	}
+	
+	BFile file(GetHashPath(info).GetFullPath(),
+				B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
+	if (file.InitCheck() == B_OK)
+		file.Write(data.String(),data.Length());
+}
+
+
+bool
+SourceFileC::ContentUnchanged(BuildInfo &info)
+{
+	// A file which is newer than its object only needs to be built if its
+	// contents or those of one of its dependencies are different from when
+	// the object was built. Switching branches and the like touch a lot of
+	// files without changing them.
+	if (!gUseContentHash)
+		return false;
+	
+	BFile file(GetHashPath(info).GetFullPath(),B_READ_ONLY);
+	off_t size;
+	if (file.InitCheck() != B_OK || file.GetSize(&size) != B_OK || size < 1)
+		return false;
+	
+	BString data;
+	char *buffer = data.LockBuffer(size);
+	ssize_t bytesRead = file.Read(buffer,size);
+	data.UnlockBuffer(bytesRead > 0 ? bytesRead : 0);
+	
+	std::vector<BString> files;
+	std::vector<uint64> hashes;
+	HashContents(info,files,hashes);
+	if (files.empty())
+		return false;
+	
+	// Every file in the record has to have the same contents as before and
+	// every file the source depends on now has to be in the record
+	std::map<BString, uint64> recorded;
+	int32 start = 0;
+	while (start < data.Length())
+	{
+		int32 end = data.FindFirst("\n",start);
+		if (end < 0)
+			end = data.Length();
+		
+		if (end - start > 17)
+		{
+			BString line(data.String() + start,end - start);
+			recorded[BString(line.String() + 17)]
+				= strtoull(line.String(),NULL,16);
+		}
+		start = end + 1;
+	}
+	
+	std::map<BString, uint64>::iterator entry;
+	for (entry = recorded.begin(); entry != recorded.end(); entry++)
+	{
+		uint64 hash;
+		if (gHashCache.HashFor(entry->first.String(),&hash) != B_OK
+			|| hash != entry->second)
+			return false;
+	}
+	
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		if (recorded.find(files[i]) == recorded.end())
+			return false;
+	}
+	
+	STRACE(2,("%s::CheckNeedsBuild: contents unchanged since last build\n",
+			GetPath().GetFullPath()));
+	
+	// Bring the object up to date so that the next check doesn't need to
+	// look at the contents again
+	BNode node(GetObjectPath(info).GetFullPath());
+	node.SetModificationTime(real_time_clock());
+	return true;
 }
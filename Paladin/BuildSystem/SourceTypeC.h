@@ -1,6 +1,8 @@
 #ifndef SOURCE_TYPE_C_H
 #define SOURCE_TYPE_C_H
 
+#include <vector>
+
 #include "ErrorParser.h"
 #include "SourceFile.h"
 #include "SourceType.h"
@@ -37,6 +39,19 @@ public:
 	
 			DPath		GetObjectPath(BuildInfo &info);
 			void		RemoveObjects(BuildInfo &info);
+
+private:
+			DPath		GetHashPath(BuildInfo &info);
+			DPath		GetDependencyFilePath(BuildInfo &info);
+			bool		ReadDependencyFile(BuildInfo &info);
+			void		StoreDependencies(BuildInfo &info,
+									const std::vector<BString> &dependencies);
+			void		HashContents(BuildInfo &info, std::vector<BString> &files,
+									std::vector<uint64> &hashes);
+			void		WriteContentHashes(BuildInfo &info,
+									const std::vector<BString> &files,
+									const std::vector<uint64> &hashes);
+			bool		ContentUnchanged(BuildInfo &info);
 };
 
 #endif
@@ -7,6 +7,7 @@
 #include "CompileCommand.h"
 #include "DebugTools.h"
 #include "Globals.h"
+#include "ProcessExecutor.h"
 
 SourceTypeLex::SourceTypeLex(void)
 {
@@ -151,7 +152,9 @@ SourceFileLex::Precompile(BuildInfo &info, const char *options)
 	flexString << cppPath << "' '" << abspath << "'";
 	
 	BString errmsg;
-	RunPipedCommand(flexString.String(),errmsg,true);
+	int status = -1;
+	gProcessExecutor.Run(flexString.String(),errmsg,&status);
+	SetExitStatus(status);
 	
 	STRACE(1,("Precompiling %s\nCommand:%s\nOutput:%s\n",
 			abspath.String(),flexString.String(),errmsg.String()));
@@ -181,10 +184,13 @@ SourceFileLex::Compile(BuildInfo &info, const CompileCommand& cc)//const char *o
 	
 	compileString	<< " -Wall -Wno-multichar -Wno-ctor-dtor-privacy -Wno-unknown-pragmas ";
 	compileString	<< "'" << cppPath
-					<< "' -o '" << GetObjectPath(info).GetFullPath() << "'";
+					<< "' -o '" << GetTemporaryObjectPath(info).GetFullPath() << "'";
 	
 	BString errmsg;
-	RunPipedCommand(compileString.String(),errmsg,true);
+	int status = -1;
+	gProcessExecutor.Run(compileString.String(),errmsg,&status);
+	SetExitStatus(status);
+	FinishObject(info);
 
 	STRACE(1,("Compiling %s\nCommand:%s\nOutput:%s\n",
 			abspath.String(),compileString.String(),errmsg.String()));
@@ -1,11 +1,14 @@
 #include "SourceTypeResource.h"
 
+#include <set>
 #include <string>
 //#include <iostream>
 
+#include <ctype.h>
 #include <Entry.h>
 #include <File.h>
 #include <stdio.h>
+#include <string.h>
 #include <Menu.h>
 #include <MenuItem.h>
 #include <Messenger.h>
@@ -14,12 +17,74 @@
 #include <Resources.h>
 
 #include "BuildInfo.h"
+#include "ContentHash.h"
 #include "DebugTools.h"
 #include "FileActions.h"
 #include "Globals.h"
-#include "CommandOutputHandler.h"
-#include "CommandThread.h"
 #include "CompileCommand.h"
+#include "IncludeScanner.h"
+#include "ProcessExecutor.h"
+
+// rc reads more than the file it is given: other rdefs through #include and
+// data files through import. This finds all of them, the file itself first.
+static void
+find_rdef_inputs(const char *path, std::vector<BString> &inputs,
+				std::set<BString> &seen)
+{
+	if (!seen.insert(path).second)
+		return;
+	
+	inputs.push_back(path);
+	
+	BFile file(path,B_READ_ONLY);
+	off_t size;
+	if (file.InitCheck() != B_OK || file.GetSize(&size) != B_OK || size < 1)
+		return;
+	
+	BString text;
+	char *buffer = text.LockBuffer(size);
+	ssize_t bytesRead = file.Read(buffer,size);
+	text.UnlockBuffer(bytesRead > 0 ? bytesRead : 0);
+	
+	std::vector<BString> names;
+	include_record record;
+	IncludeScanner::ParseIncludes(text.String(),text.Length(),record);
+	for (size_t i = 0; i < record.directives.size(); i++)
+		names.push_back(record.directives[i].name);
+	
+	// Something which only looks like an import, in a comment for example,
+	// only costs an extra file in the hash
+	int32 pos = 0;
+	while ((pos = text.FindFirst("import",pos)) >= 0)
+	{
+		int32 start = pos + 6;
+		bool word = (pos == 0 || (!isalnum((uint8)text[pos - 1])
+				&& text[pos - 1] != '_'))
+			&& !isalnum((uint8)text[start]) && text[start] != '_';
+		pos = start;
+		if (!word)
+			continue;
+		
+		while (start < text.Length() && isspace((uint8)text[start]))
+			start++;
+		int32 end = text.FindFirst('"',start + 1);
+		if (text[start] != '"' || end < 0)
+			continue;
+		
+		names.push_back(BString(text.String() + start + 1,end - start - 1));
+	}
+	
+	BString folder(path);
+	folder.Truncate(folder.FindLast('/') + 1);
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		BString name(names[i]);
+		if (name.Length() > 0 && name[0] != '/')
+			name.Prepend(folder);
+		find_rdef_inputs(name.String(),inputs,seen);
+	}
+}
+
 
 SourceTypeResource::SourceTypeResource(void)
 {
@@ -169,6 +234,18 @@ SourceFileResource::CheckNeedsBuild(BuildInfo &info, bool check_deps)
 	if (GetModTime() > objstat.st_mtime)
 		return true;
 	
+	// Whatever the rdef pulls in counts, too
+	std::vector<BString> inputs;
+	std::set<BString> seen;
+	find_rdef_inputs(GetPath().GetFullPath(),inputs,seen);
+	for (size_t i = 1; i < inputs.size(); i++)
+	{
+		struct stat inputstat;
+		if (stat(inputs[i].String(),&inputstat) == 0
+			&& inputstat.st_mtime > objstat.st_mtime)
+			return true;
+	}
+	
 	return false;
 }
 
@@ -195,41 +272,65 @@ SourceFileResource::Compile(BuildInfo &info, const CompileCommand& cc) // const
 	pipestr << GetResourcePath(info).GetFullPath()
 			<< "' '" << abspath << "'";
 	
-	
-	//std::cout << "Resource Compile GOT RC COMMAND" << std::endl;
-	//BString errmsg;
-	//RunPipedCommand(pipestr.String(), errmsg, false);
-	
-	BMessage cmd;
-	cmd.AddString("cmd",pipestr);
-	//cmd.AddString("pwd",abspath);
+	// Saving or checking out an rdef without changing it doesn't need rc
+	// to be run again. The hash covers the command along with everything rc
+	// reads. The paths are in it, too, so adding or removing a file counts.
+	uint64 hash;
+	char hashString[32] = "";
+	if (HashFile(abspath.String(),&hash) == B_OK)
+	{
+		std::vector<BString> inputs;
+		std::set<BString> seen;
+		find_rdef_inputs(abspath.String(),inputs,seen);
+		for (size_t i = 1; i < inputs.size(); i++)
+		{
+			uint64 inputHash = 0;
+			HashFile(inputs[i].String(),&inputHash);
+			hash = HashBuffer(inputs[i].String(),inputs[i].Length(),hash);
+			hash = HashBuffer(&inputHash,sizeof(inputHash),hash);
+		}
+		hash = HashBuffer(pipestr.String(),pipestr.Length(),hash);
+		sprintf(hashString,"%016" B_PRIx64,hash);
 		
-	//std::cout << "Resource Compile GOT CMD PARAMETER" << std::endl;
-	
-	CommandOutputHandler handler(true); // enable redirect
-	BLooper* looper = new BLooper();
-	looper->AddHandler(&handler);
-	BMessenger msgr(&handler,looper);
-	//std::cout << "Resource Compile EXECUTING LOOPER" << std::endl;
-	looper->Run();
-	CommandThread thread(&cmd,&msgr);
-	//std::cout << "Resource Compile STARTING THREAD" << std::endl;
-	thread.Start();
-	status_t okReturn = B_OK;
-	thread.WaitForThread(&okReturn);
-	
-	//std::cout << "Resource Compile THREAD COMPLETE" << std::endl;
-	
-	handler.WaitForExit();
-	
-	//std::cout << "Resource Compile THREAD OUTPUT COMPLETE" << std::endl;
+		char lastHash[32] = "";
+		BFile hashFile(GetHashPath(info).GetFullPath(),B_READ_ONLY);
+		ssize_t bytesRead = hashFile.InitCheck() == B_OK
+			? hashFile.Read(lastHash,sizeof(lastHash) - 1) : -1;
+		if (bytesRead > 0)
+			lastHash[bytesRead] = '\0';
+		
+		if (strcmp(lastHash,hashString) == 0
+			&& BEntry(GetResourcePath(info).GetFullPath()).Exists())
+		{
+			STRACE(1,("Resource %s unchanged since it was compiled\n",
+					abspath.String()));
+			
+			// Brought up to date so that it isn't looked at again
+			BNode node(GetResourcePath(info).GetFullPath());
+			node.SetModificationTime(real_time_clock());
+			SetExitStatus(0);
+			return;
+		}
+	}
 	
-	std::string errmsg = handler.GetOut();
+	BString errmsg;
+	int status;
+	if (gProcessExecutor.Run(pipestr.String(),errmsg,&status) != B_OK)
+	{
+		errmsg = "Unable to start rc\n";
+		status = -1;
+	}
+	SetExitStatus(status);
 	
 	STRACE(1,("Compiling Resource %s\nCommand:%s\nOutput:%s\n",
-			abspath.String(),pipestr.String(),errmsg.c_str()));
+			abspath.String(),pipestr.String(),errmsg.String()));
 	
-	ParseRCErrors(errmsg.c_str(),info.errorList);
+	ParseRCErrors(errmsg.String(),info.errorList);
+	
+	BFile hashFile(GetHashPath(info).GetFullPath(),
+					B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
+	if (status == 0 && hashString[0] != '\0' && hashFile.InitCheck() == B_OK)
+		hashFile.Write(hashString,strlen(hashString));
 	
 	//std::cout << "Resource Compile ENDS" << std::endl;
 }
@@ -277,6 +378,19 @@ SourceFileResource::RemoveObjects(BuildInfo &info)
 	base << "/" << path.GetBaseName() << ".rsrc";
 	
 	BEntry(base.String()).Remove();
+	BEntry(GetHashPath(info).GetFullPath()).Remove();
+}
+
+
+DPath
+SourceFileResource::GetHashPath(BuildInfo &info)
+{
+	BString hashname(GetPath().GetBaseName());
+	hashname << ".rsrc.hash";
+	
+	DPath hashpath(info.objectFolder);
+	hashpath.Append(hashname);
+	return hashpath;
 }
 
 
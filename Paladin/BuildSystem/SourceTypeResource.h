@@ -34,6 +34,7 @@ public:
 			
 			DPath		GetResourcePath(BuildInfo &info);
 			void		RemoveObjects(BuildInfo &info);
+			DPath		GetHashPath(BuildInfo &info);
 
 			void		AddActionsItems(BMenu *menu);
 			int8		CountActions(void) const;
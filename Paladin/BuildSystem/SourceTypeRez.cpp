@@ -5,6 +5,8 @@
 
 #include "BuildInfo.h"
 #include "DebugTools.h"
+#include "Globals.h"
+#include "ProcessExecutor.h"
 
 SourceTypeRez::SourceTypeRez(void)
 {
@@ -134,17 +136,12 @@ SourceFileRez::Precompile(BuildInfo &info, const char *options)
 		pipestr << "'-I" << info.includeList.ItemAt(i)->Absolute() << "' ";
 	
 	pipestr << "-o '" << GetTempFilePath(info).GetFullPath()
-			<< "' '" << abspath << "' 2>&1";
+			<< "' '" << abspath << "'";
 	
-	FILE *fd = popen(pipestr.String(),"r");
-	if (!fd)
-		return;
-	
-	char buffer[1024];
 	BString errmsg;
-	while (fgets(buffer,1024,fd))
-		errmsg += buffer;
-	pclose(fd);
+	int status = -1;
+	gProcessExecutor.Run(pipestr.String(),errmsg,&status);
+	SetExitStatus(status);
 	
 	STRACE(1,("Preprocessing %s\nCommand:%s\nOutput:%s\n",
 			abspath.String(),pipestr.String(),errmsg.String()));
@@ -172,17 +169,12 @@ SourceFileRez::Compile(BuildInfo &info, const CompileCommand& cc)//const char *o
 		pipestr << "'-I" << info.includeList.ItemAt(i)->Absolute() << "' ";
 	
 	pipestr << "-o '" << GetResourcePath(info).GetFullPath()
-			<< "' '" << GetTempFilePath(info).GetFullPath() << "' 2>&1";
-	
-	FILE *fd = popen(pipestr.String(),"r");
-	if (!fd)
-		return;
+			<< "' '" << GetTempFilePath(info).GetFullPath() << "'";
 	
-	char buffer[1024];
 	BString errmsg;
-	while (fgets(buffer,1024,fd))
-		errmsg += buffer;
-	pclose(fd);
+	int status = -1;
+	gProcessExecutor.Run(pipestr.String(),errmsg,&status);
+	SetExitStatus(status);
 	
 	STRACE(1,("Compiling %s\nCommand:%s\nOutput:%s\n",
 			abspath.String(),pipestr.String(),errmsg.String()));
@@ -7,6 +7,7 @@
 #include "CompileCommand.h"
 #include "DebugTools.h"
 #include "Globals.h"
+#include "ProcessExecutor.h"
 
 SourceTypeYacc::SourceTypeYacc(void)
 {
@@ -151,7 +152,9 @@ SourceFileYacc::Precompile(BuildInfo &info, const char *options)
 	bisonString << cppPath << "' '" << abspath << "'";
 	
 	BString errmsg;
-	RunPipedCommand(bisonString.String(), errmsg, true);
+	int status = -1;
+	gProcessExecutor.Run(bisonString.String(),errmsg,&status);
+	SetExitStatus(status);
 	
 	STRACE(1,("Precompiling %s\nCommand:%s\nOutput:%s\n",
 			abspath.String(),bisonString.String(),errmsg.String()));
@@ -180,10 +183,13 @@ SourceFileYacc::Compile(BuildInfo &info, const CompileCommand& cc)//const char *
 	
 	compileString	<< " -Wall -Wno-multichar -Wno-ctor-dtor-privacy -Wno-unknown-pragmas ";
 	compileString	<< "'" << cppPath
-					<< "' -o '" << GetObjectPath(info).GetFullPath() << "'";
+					<< "' -o '" << GetTemporaryObjectPath(info).GetFullPath() << "'";
 	
 	BString errmsg;
-	RunPipedCommand(compileString.String(), errmsg, true);
+	int status = -1;
+	gProcessExecutor.Run(compileString.String(),errmsg,&status);
+	SetExitStatus(status);
+	FinishObject(info);
 	
 	STRACE(1,("Compiling %s\nCommand:%s\nOutput:%s\n",
 			abspath.String(),compileString.String(),errmsg.String()));
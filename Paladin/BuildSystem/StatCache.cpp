@@ -1,15 +1,71 @@
 #include "StatCache.h"
 
-#include <Path.h>
-#include <stdio.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include <Autolock.h>
+#include <Looper.h>
+#include <Message.h>
+#include <NodeMonitor.h>
+
+// Hands the node monitor's messages to the cache they are meant for
+class StatCacheWatcher : public BLooper
+{
+public:
+					StatCacheWatcher(StatCache *cache);
+
+	void			MessageReceived(BMessage *msg);
+
+private:
+	StatCache		*fCache;
+};
+
+
+StatCacheWatcher::StatCacheWatcher(StatCache *cache)
+	:	BLooper("stat cache watcher"),
+		fCache(cache)
+{
+}
+
+
+void
+StatCacheWatcher::MessageReceived(BMessage *msg)
+{
+	if (msg->what == B_NODE_MONITOR)
+		fCache->NodeMonitorReceived(msg);
+	else
+		BLooper::MessageReceived(msg);
+}
+
+
+static std::string
+join_path(const std::string &folder, const char *name)
+{
+	std::string path(folder);
+	if (path.size() == 0 || path[path.size() - 1] != '/')
+		path += "/";
+	path += name;
+	return path;
+}
+
+
+static bool
+split_path(const std::string &path, std::string &folder)
+{
+	size_t slash = path.rfind('/');
+	if (slash == std::string::npos || slash == path.size() - 1)
+		return false;
+
+	folder.assign(path,0,slash > 0 ? slash : 1);
+	return true;
+}
+
 
 StatCache::StatCache(void)
-	:	fList(20,true),
-		fMaxItems(79)
+	:	fLock("stat cache lock"),
+		fWatcher(NULL)
 {
-	// 79 is the approximate number of stat structures that will fit into 4K, which
-	// seems like more than enough for most uses
-	
 }
 
 
@@ -18,76 +74,446 @@ StatCache::~StatCache(void)
 }
 
 
+status_t
+StatCache::StartWatching(void)
+{
+	BAutolock lock(fLock);
+	if (fWatcher)
+		return B_OK;
+
+	// The watcher lives for as long as the application does
+	fWatcher = new StatCacheWatcher(this);
+	fWatcher->Run();
+	fMessenger = BMessenger(fWatcher);
+	return B_OK;
+}
+
+
+bool
+StatCache::StatFor(const char *path, struct stat *out)
+{
+	if (!path || !out)
+		return false;
+
+	std::string key(path);
+	BAutolock lock(fLock);
+
+	std::unordered_map<std::string, statdata>::iterator i = fEntries.find(key);
+	if (i == fEntries.end())
+	{
+		std::string folder;
+		if (!split_path(key,folder))
+			return stat(path,out) == 0;
+
+		// Everything which is in a folder goes into the cache when it is read,
+		// so a file which isn't there after that doesn't exist
+		if (fFolders.find(folder) != fFolders.end())
+			return false;
+		ReadFolder(folder,fFolders[folder]);
+
+		i = fEntries.find(key);
+		if (i == fEntries.end())
+			return false;
+	}
+
+	*out = i->second.statinfo;
+	return true;
+}
+
+
+bool
+StatCache::Exists(const char *path)
+{
+	struct stat s;
+	return StatFor(path,&s);
+}
+
+
+void
+StatCache::Update(const char *path)
+{
+	if (!path)
+		return;
+
+	std::string key(path);
+	std::string folder;
+	if (!split_path(key,folder))
+		return;
+
+	BAutolock lock(fLock);
+
+	// Files in folders which haven't been read yet are read along with them
+	// when they are needed
+	std::unordered_map<std::string, folderdata>::iterator i
+		= fFolders.find(folder);
+	if (i != fFolders.end())
+		UpdateEntry(key,i->second.watched);
+}
+
+
+bool
+StatCache::IsWatched(const char *path)
+{
+	std::string folder;
+	if (!path || !split_path(path,folder))
+		return false;
+
+	BAutolock lock(fLock);
+
+	std::unordered_map<std::string, folderdata>::iterator i
+		= fFolders.find(folder);
+	if (i == fFolders.end())
+	{
+		folderdata &data = fFolders[folder];
+		ReadFolder(folder,data);
+		return data.watched;
+	}
+	return i->second.watched;
+}
+
+
+void
+StatCache::Refresh(void)
+{
+	BAutolock lock(fLock);
+
+	std::unordered_map<std::string, folderdata>::iterator folder
+		= fFolders.begin();
+	while (folder != fFolders.end())
+	{
+		if (folder->second.watched)
+			folder++;
+		else
+			folder = fFolders.erase(folder);
+	}
+
+	std::unordered_map<std::string, statdata>::iterator entry
+		= fEntries.begin();
+	while (entry != fEntries.end())
+	{
+		if (entry->second.watched)
+			entry++;
+		else
+			entry = fEntries.erase(entry);
+	}
+}
+
+
+void
+StatCache::MakeEmpty(void)
+{
+	BAutolock lock(fLock);
+
+	if (fWatcher)
+		stop_watching(fMessenger);
+
+	fEntries.clear();
+	fFolders.clear();
+	fFolderNodes.clear();
+	fFileNodes.clear();
+}
+
+
 void
-StatCache::SetRAMLimit(uint32 size)
+StatCache::AddListener(const BMessenger &target)
 {
-	fMaxItems = size / sizeof(struct stat);
-	while (fList.CountItems() > fMaxItems)
-		delete fList.RemoveItemAt(fList.CountItems() - 1);
+	BAutolock lock(fLock);
+	fListeners.push_back(target);
 }
 
 
-uint32
-StatCache::GetRAMLimit(void) const
+void
+StatCache::RemoveListener(const BMessenger &target)
 {
-	return fMaxItems * sizeof(struct stat);
+	BAutolock lock(fLock);
+	for (size_t i = 0; i < fListeners.size(); i++)
+	{
+		if (fListeners[i] == target)
+		{
+			fListeners.erase(fListeners.begin() + i);
+			return;
+		}
+	}
 }
 
 
-struct stat *
-StatCache::StatFor(entry_ref ref)
+void
+StatCache::NodeMonitorReceived(BMessage *msg)
 {
-	statdata *item = NULL;
-	for (int32 i = 0; i < fList.CountItems(); i++)
+	int32 opcode;
+	int32 device;
+	if (msg->FindInt32("opcode",&opcode) != B_OK
+		|| msg->FindInt32("device",&device) != B_OK)
+		return;
+
+	int64 node;
+	if (msg->FindInt64("node",&node) != B_OK)
+		node = -1;
+
+	// The listeners are only told once the lock is let go. They may well be
+	// waiting for it themselves.
+	std::vector<std::string> changed;
+	bool lost = false;
+	std::vector<BMessenger> listeners;
+
+	fLock.Lock();
+
+	std::map<node_key, std::string>::iterator i;
+	switch (opcode)
 	{
-		item = fList.ItemAt(i);
-		if (item->ref == ref)
+		case B_ENTRY_CREATED:
 		{
-			// we have a cache hit. Move the item to the front of the list
-			// and return it.
-			fList.RemoveItemAt(i);
-			fList.AddItem(item,0);
-			return &item->statinfo;
+			int64 directory;
+			const char *name;
+			if (msg->FindInt64("directory",&directory) != B_OK
+				|| msg->FindString("name",&name) != B_OK)
+				break;
+
+			i = fFolderNodes.find(node_key(device,directory));
+			if (i != fFolderNodes.end())
+			{
+				std::string path = join_path(i->second,name);
+				if (UpdateEntry(path,true))
+					changed.push_back(path);
+			}
+			break;
 		}
+		case B_ENTRY_REMOVED:
+		{
+			i = fFolderNodes.find(node_key(device,node));
+			if (i != fFolderNodes.end())
+			{
+				changed.push_back(i->second);
+				lost = true;
+				RemoveFolder(std::string(i->second));
+				break;
+			}
+
+			i = fFileNodes.find(node_key(device,node));
+			if (i != fFileNodes.end())
+			{
+				std::string path(i->second);
+				if (RemoveEntry(path))
+					changed.push_back(path);
+			}
+			break;
+		}
+		case B_ENTRY_MOVED:
+		{
+			int64 from, to;
+			const char *name;
+			if (msg->FindInt64("from directory",&from) != B_OK
+				|| msg->FindInt64("to directory",&to) != B_OK
+				|| msg->FindString("name",&name) != B_OK)
+				break;
+
+			// Everything which was known under the old name is gone. A
+			// folder keeps its node, but none of the paths in it are right
+			// any more.
+			i = fFolderNodes.find(node_key(device,node));
+			if (i != fFolderNodes.end())
+			{
+				changed.push_back(i->second);
+				lost = true;
+				RemoveFolder(std::string(i->second));
+			}
+
+			std::string path;
+			const char *fromName;
+			i = fFolderNodes.find(node_key(device,from));
+			if (i != fFolderNodes.end()
+				&& msg->FindString("from name",&fromName) == B_OK)
+				path = join_path(i->second,fromName);
+			else
+			{
+				i = fFileNodes.find(node_key(device,node));
+				if (i != fFileNodes.end())
+					path = i->second;
+			}
+			if (path.size() > 0 && RemoveEntry(path))
+				changed.push_back(path);
+
+			i = fFolderNodes.find(node_key(device,to));
+			if (i != fFolderNodes.end())
+			{
+				path = join_path(i->second,name);
+				if (UpdateEntry(path,true))
+					changed.push_back(path);
+			}
+			break;
+		}
+		case B_STAT_CHANGED:
+		{
+			i = fFileNodes.find(node_key(device,node));
+			if (i != fFileNodes.end())
+			{
+				std::string path(i->second);
+				if (UpdateEntry(path,true))
+					changed.push_back(path);
+			}
+			break;
+		}
+		default:
+			break;
 	}
-	
-	// If we got this far, then we have a cache miss. Create a new statdata item and
-	// add it to the list or reuse the last item in the cache if it has the max number
-	// of items
-	if (fList.CountItems() == fMaxItems)
-		item = fList.RemoveItemAt(fList.CountItems() - 1);
-	else
-		item = new statdata;
-	fList.AddItem(item,0);
-	
-	BPath path(&ref);
-	if (stat(path.Path(),&item->statinfo) != 0)
+
+	if (changed.size() > 0)
+		listeners = fListeners;
+
+	fLock.Unlock();
+
+	if (listeners.empty())
+		return;
+
+	BMessage notice(M_WATCHED_FILES_CHANGED);
+	for (size_t j = 0; j < changed.size(); j++)
+		notice.AddString("path",changed[j].c_str());
+	if (lost)
+		notice.AddBool("lost",true);
+
+	for (size_t j = 0; j < listeners.size(); j++)
+		listeners[j].SendMessage(&notice);
+}
+
+
+void
+StatCache::ReadFolder(const std::string &folder, folderdata &data)
+{
+	data.watched = false;
+	data.device = -1;
+	data.node = -1;
+
+	// A folder which can't be read is remembered as empty, but only until
+	// the next Refresh() because it isn't watched
+	DIR *dir = opendir(folder.c_str());
+	if (!dir)
+		return;
+
+	struct stat folderStat;
+	if (fstat(dirfd(dir),&folderStat) == 0)
 	{
-		delete fList.RemoveItemAt(0L);
-		return NULL;
+		data.device = folderStat.st_dev;
+		data.node = folderStat.st_ino;
+
+		// The watch is set up before the folder is read so that nothing which
+		// changes in the meantime is missed
+		if (fWatcher)
+		{
+			node_ref ref;
+			ref.device = data.device;
+			ref.node = data.node;
+			if (watch_node(&ref,B_WATCH_DIRECTORY | B_WATCH_STAT
+					| B_WATCH_CHILDREN,fMessenger) == B_OK)
+			{
+				data.watched = true;
+				fFolderNodes[node_key(data.device,data.node)] = folder;
+			}
+		}
 	}
-	
-	item->ref = ref;
-	return &item->statinfo;
+
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		if (strcmp(entry->d_name,".") == 0 || strcmp(entry->d_name,"..") == 0)
+			continue;
+
+		statdata item;
+		if (fstatat(dirfd(dir),entry->d_name,&item.statinfo,0) != 0)
+			continue;
+		item.watched = data.watched;
+
+		std::string path = join_path(folder,entry->d_name);
+		fEntries[path] = item;
+		if (item.watched)
+			fFileNodes[node_key(item.statinfo.st_dev,item.statinfo.st_ino)]
+				= path;
+	}
+	closedir(dir);
 }
 
 
-struct stat *
-StatCache::StatFor(const char *path)
+bool
+StatCache::UpdateEntry(const std::string &path, bool watched)
 {
-	entry_ref ref;
-	BEntry entry(path);
-	if (entry.InitCheck() != B_OK || !entry.Exists())
-		return NULL;
-	
-	entry.GetRef(&ref);
-	return StatFor(ref);
+	statdata item;
+	if (stat(path.c_str(),&item.statinfo) != 0)
+		return RemoveEntry(path);
+	item.watched = watched;
+
+	// Changes which don't touch what is in the file, like to its attributes
+	// or permissions, don't count as changes
+	bool changed = true;
+	std::unordered_map<std::string, statdata>::iterator i = fEntries.find(path);
+	if (i != fEntries.end())
+	{
+		const struct stat &old = i->second.statinfo;
+		changed = old.st_mtime != item.statinfo.st_mtime
+			|| old.st_size != item.statinfo.st_size
+			|| old.st_ino != item.statinfo.st_ino;
+	}
+
+	fEntries[path] = item;
+	if (watched)
+		fFileNodes[node_key(item.statinfo.st_dev,item.statinfo.st_ino)] = path;
+	return changed;
 }
 
 
-void
-StatCache::MakeEmpty(void)
+bool
+StatCache::RemoveEntry(const std::string &path)
 {
-	fList.MakeEmpty();
+	std::unordered_map<std::string, statdata>::iterator i = fEntries.find(path);
+	if (i == fEntries.end())
+		return false;
+
+	std::map<node_key, std::string>::iterator node = fFileNodes.find(
+		node_key(i->second.statinfo.st_dev,i->second.statinfo.st_ino));
+	if (node != fFileNodes.end() && node->second == path)
+		fFileNodes.erase(node);
+
+	fEntries.erase(i);
+	return true;
 }
 
+
+void
+StatCache::RemoveFolder(const std::string &folder)
+{
+	// Folders inside it go, too, because their paths have changed as well
+	std::string prefix = join_path(folder,"");
+
+	std::unordered_map<std::string, folderdata>::iterator i = fFolders.begin();
+	while (i != fFolders.end())
+	{
+		if (i->first != folder && i->first.compare(0,prefix.size(),prefix) != 0)
+		{
+			i++;
+			continue;
+		}
+
+		if (i->second.watched)
+		{
+			node_ref ref;
+			ref.device = i->second.device;
+			ref.node = i->second.node;
+			watch_node(&ref,B_STOP_WATCHING,fMessenger);
+			fFolderNodes.erase(node_key(i->second.device,i->second.node));
+		}
+		i = fFolders.erase(i);
+	}
+
+	std::unordered_map<std::string, statdata>::iterator entry
+		= fEntries.begin();
+	while (entry != fEntries.end())
+	{
+		if (entry->first.compare(0,prefix.size(),prefix) != 0)
+		{
+			entry++;
+			continue;
+		}
+
+		fFileNodes.erase(node_key(entry->second.statinfo.st_dev,
+									entry->second.statinfo.st_ino));
+		entry = fEntries.erase(entry);
+	}
+}
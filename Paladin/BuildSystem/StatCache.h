@@ -2,33 +2,104 @@
 #define STAT_CACHE_H
 
 #include <sys/stat.h>
-#include <Entry.h>
 
-#include "ObjectList.h"
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <Locker.h>
+#include <Messenger.h>
+
+class BLooper;
+class BMessage;
+
+enum
+{
+	M_WATCHED_FILES_CHANGED = 'wfch'
+};
 
 typedef struct
 {
-	struct stat statinfo;
-	entry_ref	ref;
+	struct stat	statinfo;
+
+	// Set when the folder the file is in is watched, so the entry can be
+	// trusted from one build to the next
+	bool		watched;
 } statdata;
 
+typedef struct
+{
+	bool		watched;
+	dev_t		device;
+	ino_t		node;
+} folderdata;
+
+// Keeps the results of stat() calls around, looked up by path.
+//
+// When a path isn't known yet, the whole folder it is in is read in one go.
+// After that, looking up any other file in the same folder -- including ones
+// which don't exist, like the places a header might be -- doesn't need to go
+// to the disk at all.
+//
+// Once StartWatching() has been called, each folder which is read is also
+// watched with the node monitor and kept up to date from its messages. The
+// entries of watched folders stay valid for as long as the application runs,
+// so the same files aren't looked at again for every build. Refresh() only
+// throws away the entries which couldn't be watched.
+//
+// Listeners are sent an M_WATCHED_FILES_CHANGED message whenever the node
+// monitor reports that files in watched folders were created, removed or
+// changed in size or modification time. It holds the "path" of each of them.
+// When a watched folder itself goes away or is moved, its path is sent with
+// "lost" set, because nothing in it is watched any more.
 class StatCache
 {
 public:
 					StatCache(void);
 					~StatCache(void);
-			
-	void			SetRAMLimit(uint32 size);
-	uint32			GetRAMLimit(void) const;
-	
-	struct stat	*	StatFor(entry_ref ref);
-	struct stat	*	StatFor(const char *path);
-	
+
+	status_t		StartWatching(void);
+
+	bool			StatFor(const char *path, struct stat *out);
+	bool			Exists(const char *path);
+
+	// Makes sure that a file the caller just changed is up to date even if
+	// the node monitor hasn't caught up yet
+	void			Update(const char *path);
+
+	// Whether changes to the file are seen by the node monitor. Its folder is
+	// read and watched if that hasn't happened yet.
+	bool			IsWatched(const char *path);
+
+	void			Refresh(void);
 	void			MakeEmpty(void);
-	
+
+	void			AddListener(const BMessenger &target);
+	void			RemoveListener(const BMessenger &target);
+
+	void			NodeMonitorReceived(BMessage *msg);
+
 private:
-	BObjectList<statdata>	fList;
-	int32					fMaxItems;
+	typedef std::pair<dev_t, ino_t>	node_key;
+
+	void			ReadFolder(const std::string &folder, folderdata &data);
+	bool			UpdateEntry(const std::string &path, bool watched);
+	bool			RemoveEntry(const std::string &path);
+	void			RemoveFolder(const std::string &folder);
+
+	BLocker										fLock;
+	std::unordered_map<std::string, statdata>	fEntries;
+	std::unordered_map<std::string, folderdata>	fFolders;
+
+	// What the node monitor's messages refer to
+	std::map<node_key, std::string>				fFolderNodes;
+	std::map<node_key, std::string>				fFileNodes;
+
+	BLooper			*fWatcher;
+	BMessenger		fMessenger;
+	std::vector<BMessenger>	fListeners;
 };
 
 #endif
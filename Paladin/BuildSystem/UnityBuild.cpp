@@ -0,0 +1,390 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#include "UnityBuild.h"
+
+#include <map>
+#include <sys/stat.h>
+
+#include <Directory.h>
+#include <Entry.h>
+#include <File.h>
+
+#include "BuildInfo.h"
+#include "DebugTools.h"
+#include "Project.h"
+#include "SourceFile.h"
+#include "SourceTypeC.h"
+#include "TextFile.h"
+
+#define UNITY_PREFIX "(Unity) "
+
+
+UnityBuild::UnityBuild(void)
+	:	fProject(NULL),
+		fBatchSize(8),
+		fLoaded(false)
+{
+}
+
+
+UnityBuild::~UnityBuild(void)
+{
+	MakeEmpty();
+}
+
+
+void
+UnityBuild::SetBatchSize(int32 size)
+{
+	fBatchSize = MAX(size,2);
+}
+
+
+void
+UnityBuild::Load(BuildInfo &info, Project *project)
+{
+	fProject = project;
+	if (fLoaded)
+		return;
+
+	MakeEmpty();
+	fLoaded = true;
+
+	TextFile file(GetManifestPath(info).String(),B_READ_ONLY);
+	if (file.InitCheck() != B_OK)
+		return;
+
+	bool dirty = false;
+	bool broken = false;
+	unity_batch batch;
+	batch.unit = NULL;
+
+	BString line = file.ReadLine();
+	while (true)
+	{
+		BString entry(line), value;
+		int32 pos = line.FindFirst("=");
+		if (pos >= 0)
+		{
+			entry.Truncate(pos);
+			value = line.String() + pos + 1;
+		}
+
+		if (line.Length() == 0 || entry == "UNIT")
+		{
+			if (batch.unit)
+			{
+				// A file which was removed from the project is still part of
+				// the object, so the whole batch has to go
+				if (broken || batch.members.size() < 2)
+				{
+					batch.unit->RemoveObjects(info);
+					BEntry(batch.unit->GetPath().GetFullPath()).Remove();
+					delete batch.unit;
+					dirty = true;
+				}
+				else
+				{
+					UpdateUnitDependencies(info,batch);
+					fBatches.push_back(batch);
+					for (size_t i = 0; i < batch.members.size(); i++)
+						fCovered.insert(batch.members[i]);
+				}
+			}
+
+			batch.unit = NULL;
+			batch.members.clear();
+			broken = false;
+
+			if (line.Length() == 0)
+				break;
+
+			batch.unit = new SourceFileC(value.String());
+		}
+		else if (entry == "MEMBER" && batch.unit)
+		{
+			SourceFile *member = project->FindFile(value.String());
+			if (member)
+				batch.members.push_back(member);
+			else
+			{
+				STRACE(1,("Unity build member %s is gone\n",value.String()));
+				broken = true;
+			}
+		}
+
+		line = file.ReadLine();
+	}
+
+	if (dirty)
+		Save(info);
+}
+
+
+status_t
+UnityBuild::Save(BuildInfo &info)
+{
+	BString path = GetManifestPath(info);
+	if (fBatches.empty())
+	{
+		BEntry(path.String()).Remove();
+		return B_OK;
+	}
+
+	BString data;
+	for (size_t i = 0; i < fBatches.size(); i++)
+	{
+		data << "UNIT=" << fBatches[i].unit->GetPath().GetFullPath() << "\n";
+		for (size_t j = 0; j < fBatches[i].members.size(); j++)
+			data << "MEMBER=" << fBatches[i].members[j]->GetPath().GetFullPath() << "\n";
+	}
+
+	BFile file(path.String(),B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
+	status_t status = file.InitCheck();
+	if (status != B_OK)
+		return status;
+
+	if (file.Write(data.String(),data.Length()) != data.Length())
+		return B_IO_ERROR;
+
+	return B_OK;
+}
+
+
+void
+UnityBuild::AddGroup(BuildInfo &info, int32 groupIndex,
+					const std::vector<SourceFile*> &files)
+{
+	// C and C++ files can't be mixed, so each extension gets its own batches
+	std::map<BString, std::vector<SourceFile*> > byExtension;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		if (fCovered.find(files[i]) == fCovered.end())
+			byExtension[files[i]->GetPath().GetExtension()].push_back(files[i]);
+	}
+
+	int32 count = 0;
+	std::map<BString, std::vector<SourceFile*> >::iterator i;
+	for (i = byExtension.begin(); i != byExtension.end(); i++)
+	{
+		std::vector<SourceFile*> &list = i->second;
+		for (size_t start = 0; start < list.size(); start += fBatchSize)
+		{
+			size_t end = MIN(start + fBatchSize,list.size());
+
+			// A batch of one is just the file
+			if (end - start < 2)
+				continue;
+
+			BString name(UNITY_PREFIX);
+			name << groupIndex << "-" << count++ << "." << i->first;
+			DPath unitPath(info.objectFolder);
+			unitPath.Append(name);
+
+			BString content("// Generated by Paladin. Compiles several of the "
+							"project's source files at once.\n");
+			unity_batch batch;
+			for (size_t j = start; j < end; j++)
+			{
+				content << "#include \"" << list[j]->GetPath().GetFullPath() << "\"\n";
+				batch.members.push_back(list[j]);
+			}
+
+			BFile file(unitPath.GetFullPath(),B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
+			if (file.InitCheck() != B_OK
+				|| file.Write(content.String(),content.Length()) != content.Length())
+			{
+				STRACE(1,("Couldn't write %s\n",unitPath.GetFullPath()));
+				continue;
+			}
+
+			batch.unit = new SourceFileC(unitPath.GetFullPath());
+			UpdateUnitDependencies(info,batch);
+			fBatches.push_back(batch);
+			for (size_t j = 0; j < batch.members.size(); j++)
+				fCovered.insert(batch.members[j]);
+
+			STRACE(1,("Batched %ld files into %s\n",(long)batch.members.size(),
+					unitPath.GetFullPath()));
+		}
+	}
+}
+
+
+void
+UnityBuild::CheckBatches(BuildInfo &info)
+{
+	bool changed = false;
+	for (int32 i = fBatches.size() - 1; i >= 0; i--)
+	{
+		unity_batch &batch = fBatches[i];
+
+		const char *reason = NULL;
+		struct stat objstat;
+		if (batch.unit->GetStat(batch.unit->GetObjectPath(info).GetFullPath(),
+								&objstat) != B_OK)
+			reason = "object doesn't exist";
+
+		for (size_t j = 0; !reason && j < batch.members.size(); j++)
+		{
+			if (batch.members[j]->BuildFlag() == BUILD_YES)
+				reason = "file was marked for building";
+		}
+
+		// The unit depends on all of its files and their headers
+		const std::vector<BString> &deps = batch.unit->GetDependencyList();
+		for (size_t j = 0; !reason && j < deps.size(); j++)
+		{
+			struct stat depstat;
+			if (batch.unit->GetStat(deps[j].String(),&depstat) == B_OK
+				&& depstat.st_mtime > objstat.st_mtime)
+				reason = "file was updated";
+		}
+
+		if (reason)
+		{
+			STRACE(1,("Dropping unity build batch %s: %s\n",
+					batch.unit->GetPath().GetFullPath(),reason));
+			RemoveBatch(info,i);
+			changed = true;
+		}
+	}
+
+	if (changed)
+		Save(info);
+}
+
+
+void
+UnityBuild::RemoveFile(BuildInfo &info, SourceFile *file)
+{
+	if (!Covers(file))
+		return;
+
+	for (int32 i = fBatches.size() - 1; i >= 0; i--)
+	{
+		for (size_t j = 0; j < fBatches[i].members.size(); j++)
+		{
+			if (fBatches[i].members[j] == file)
+			{
+				RemoveBatch(info,i);
+				break;
+			}
+		}
+	}
+	Save(info);
+}
+
+
+void
+UnityBuild::RemoveObjects(BuildInfo &info)
+{
+	MakeEmpty();
+
+	// Batches from earlier sessions may not have been loaded, so everything
+	// generated in the object folder goes
+	BDirectory folder(info.objectFolder.GetFullPath());
+	BEntry entry;
+	while (folder.GetNextEntry(&entry) == B_OK)
+	{
+		char name[B_FILE_NAME_LENGTH];
+		if (entry.GetName(name) == B_OK
+			&& BString(name).StartsWith(UNITY_PREFIX))
+			entry.Remove();
+	}
+	BEntry(GetManifestPath(info).String()).Remove();
+
+	fLoaded = true;
+}
+
+
+bool
+UnityBuild::Covers(SourceFile *file) const
+{
+	return fCovered.find(file) != fCovered.end();
+}
+
+
+SourceFile *
+UnityBuild::UnitAt(int32 index) const
+{
+	if (index < 0 || index >= (int32)fBatches.size())
+		return NULL;
+	return fBatches[index].unit;
+}
+
+
+void
+UnityBuild::RemoveBatch(BuildInfo &info, int32 index)
+{
+	unity_batch &batch = fBatches[index];
+
+	batch.unit->RemoveObjects(info);
+	BEntry(batch.unit->GetPath().GetFullPath()).Remove();
+	delete batch.unit;
+
+	// Any object left over from before the batch was made is out of date, so
+	// the files are sure to be compiled on their own from now on. They have
+	// to be marked for it, too, since a project which keeps track of its
+	// changes doesn't look at unchanged files again.
+	for (size_t i = 0; i < batch.members.size(); i++)
+	{
+		SourceFile *member = batch.members[i];
+		member->RemoveObjects(info);
+		member->SetBuildFlag(BUILD_YES);
+		if (fProject)
+			fProject->MakeFileDirty(member);
+		fCovered.erase(member);
+	}
+
+	fBatches.erase(fBatches.begin() + index);
+}
+
+
+void
+UnityBuild::MakeEmpty(void)
+{
+	for (size_t i = 0; i < fBatches.size(); i++)
+		delete fBatches[i].unit;
+	fBatches.clear();
+	fCovered.clear();
+}
+
+
+void
+UnityBuild::UpdateUnitDependencies(BuildInfo &info, unity_batch &batch)
+{
+	// Giving the unit the combined dependencies of its files makes content
+	// hashing and the object cache see everything which goes into it
+	std::set<BString> seen;
+	BString deps;
+	for (size_t i = 0; i < batch.members.size(); i++)
+	{
+		SourceFile *member = batch.members[i];
+		BString path(member->GetPath().GetFullPath());
+		if (seen.insert(path).second)
+			deps << (deps.Length() > 0 ? "|" : "") << path;
+
+		const std::vector<BString> &list = member->GetDependencyList();
+		for (size_t j = 0; j < list.size(); j++)
+		{
+			BString depPath(list[j]);
+			if (depPath[0] != '/')
+				depPath = member->FindDependency(info,depPath.String()).GetFullPath();
+			if (depPath.Length() > 0 && seen.insert(depPath).second)
+				deps << "|" << depPath;
+		}
+	}
+	batch.unit->SetDependencies(deps.String());
+}
+
+
+BString
+UnityBuild::GetManifestPath(BuildInfo &info) const
+{
+	DPath path(info.objectFolder);
+	path.Append("(Unity).manifest");
+	return BString(path.GetFullPath());
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef UNITY_BUILD_H
+#define UNITY_BUILD_H
+
+#include <set>
+#include <vector>
+
+#include <String.h>
+
+class BuildInfo;
+class Project;
+class SourceFile;
+
+typedef struct
+{
+	SourceFile					*unit;
+	std::vector<SourceFile*>	members;
+} unity_batch;
+
+// Compiles a project's source files in batches -- one generated source file
+// in the object folder which #includes several of a group's files -- so that
+// the headers they share are only parsed once per batch. This is only worth
+// it when rebuilding everything. Afterwards, a batch stays in use until one of
+// its files or their headers change. At that point it is dropped and its
+// files go back to being compiled one at a time.
+//
+// Which files were batched together is kept in (Unity).manifest in the
+// object folder so that the batches survive restarting Paladin.
+class UnityBuild
+{
+public:
+						UnityBuild(void);
+						~UnityBuild(void);
+
+			void		SetBatchSize(int32 size);
+			int32		BatchSize(void) const { return fBatchSize; }
+
+			void		Load(BuildInfo &info, Project *project);
+			status_t	Save(BuildInfo &info);
+
+			void		AddGroup(BuildInfo &info, int32 groupIndex,
+								const std::vector<SourceFile*> &files);
+			void		CheckBatches(BuildInfo &info);
+			void		RemoveFile(BuildInfo &info, SourceFile *file);
+			void		RemoveObjects(BuildInfo &info);
+
+			bool		Covers(SourceFile *file) const;
+			int32		CountUnits(void) const { return fBatches.size(); }
+			SourceFile *UnitAt(int32 index) const;
+
+private:
+			void		RemoveBatch(BuildInfo &info, int32 index);
+			void		MakeEmpty(void);
+			void		UpdateUnitDependencies(BuildInfo &info,
+												unity_batch &batch);
+			BString		GetManifestPath(BuildInfo &info) const;
+
+	Project						*fProject;
+	std::vector<unity_batch>	fBatches;
+	std::set<SourceFile*>		fCovered;
+	int32						fBatchSize;
+	bool						fLoaded;
+};
+
+#endif
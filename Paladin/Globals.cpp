@@ -1,6 +1,7 @@
 #include "Globals.h"
 
 #include <Application.h>
+#include <Autolock.h>
 #include <Catalog.h>
 #include <ctype.h>
 #include <Directory.h>
@@ -9,12 +10,19 @@
 #include <Path.h>
 #include <Roster.h>
 #include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "BeIDEProject.h"
+#include "ContentHash.h"
 #include "DebugTools.h"
 #include "DPath.h"
 #include "FileFactory.h"
 #include "Globals.h"
+#include "IncludeScanner.h"
+#include "JobServer.h"
+#include "ObjectCache.h"
+#include "ProcessExecutor.h"
 #include "Project.h"
 #include "Settings.h"
 #include "SourceTypeLib.h"
@@ -36,12 +44,15 @@ bool gBuildMode = false;
 bool gMakeMode = false;
 bool gDontManageHeaders = true;
 bool gSingleThreadedBuild = false;
+bool gKeepGoing = false;
+bool gTraceBuild = false;
+bool gCompileOnSave = false;
 bool gShowFolderOnOpen = false;
 bool gAutoSyncModules = true;
 bool gUseCCache = false;
 bool gCCacheAvailable = false;
-bool gUseFastDep = false;
-bool gFastDepAvailable = false;
+bool gUseContentHash = false;
+bool gUseObjectCache = false;
 bool gHgAvailable = false;
 bool gGitAvailable = false;
 bool gSvnAvailable = false;
@@ -54,10 +65,16 @@ CodeLib gCodeLib;
 scm_t gDefaultSCM = SCM_HG;
 bool gUsePipeHack = false;
 
-uint8 gCPUCount = 1;
+int32 gCPUCount = 1;
 
 StatCache gStatCache;
+JobServer gJobServer;
 bool gUseStatCache = true;
+
+IncludeScanner gIncludeScanner;
+HashCache gHashCache;
+ObjectCache gObjectCache;
+ProcessExecutor gProcessExecutor;
 platform_t gPlatform = PLATFORM_R5;
 
 
@@ -79,7 +96,17 @@ InitGlobals(void)
 	gShowFolderOnOpen = gSettings.GetBool("showfolderonopen",false);
 	gAutoSyncModules = gSettings.GetBool("autosyncmodules",true);
 	gUseCCache = gSettings.GetBool("ccache",false);
-	gUseFastDep = gSettings.GetBool("fastdep",false);
+	gUseContentHash = gSettings.GetBool("contenthash",false);
+	gUseObjectCache = gSettings.GetBool("objectcache",false);
+	gTraceBuild = gSettings.GetBool("buildtrace",false);
+	gCompileOnSave = gSettings.GetBool("compileonsave",false);
+	
+	DPath objectCachePath(B_USER_CACHE_DIRECTORY);
+	objectCachePath << "Paladin" << "objects";
+	gObjectCache.SetFolder(objectCachePath.GetFullPath());
+	gObjectCache.SetSharedFolder(gSettings.GetString("objectcacheshared",""));
+	gObjectCache.SetSizeLimit((off_t)gSettings.GetInt32("objectcachesize",1024)
+								* 1024 * 1024);
 	
 	gDefaultSCM = (scm_t)gSettings.GetInt32("defaultSCM", SCM_HG);
 	
@@ -87,6 +114,14 @@ InitGlobals(void)
 	get_system_info(&sysinfo);
 	gCPUCount = sysinfo.cpu_count;
 	
+	// Builds started from a makefile share the jobs make may run. Otherwise
+	// the tools the builds run get to share Paladin's.
+	gJobServer.Init(gCPUCount);
+	
+	// Files in watched folders only need to be looked at again when they
+	// change, rather than on every build
+	gStatCache.StartWatching();
+	
 	gPlatform = DetectPlatform();
 	
 	// This will make sure that we can still build if ccache is borked and the user
@@ -96,12 +131,9 @@ InitGlobals(void)
 	{
 		gCCacheAvailable = true;
 	}
-		
+	
 	if (gPlatform == PLATFORM_HAIKU || gPlatform == PLATFORM_HAIKU_GCC4)
 	{
-		if (system("fastdep > /dev/null 2>&1") == 0)
-			gFastDepAvailable = true;
-		
 		if (system("hg > /dev/null 2>&1") == 0)
 			gHgAvailable = true;
 		
@@ -761,3 +793,65 @@ GetPartnerRef(entry_ref ref)
 	
 	return entry_ref();
 }
+
+
+bool
+JSONDiagnosticsAvailable(void)
+{
+	// GCC 9 and later can give their messages in a form which doesn't need
+	// to be guessed at. Asking the compiler takes a moment, so it is only
+	// done once a file is compiled, and the answer is kept in the settings
+	// for as long as the same compiler is installed.
+	static BLocker sLock("json diagnostics lock");
+	static int8 sAvailable = -1;
+	
+	BAutolock lock(sLock);
+	if (sAvailable >= 0)
+		return sAvailable == 1;
+	
+	sAvailable = 0;
+	if (gPlatform != PLATFORM_HAIKU && gPlatform != PLATFORM_HAIKU_GCC4)
+		return false;
+	
+	BString compiler;
+	BString paths(getenv("PATH"));
+	int32 start = 0;
+	while (compiler.Length() == 0 && start < paths.Length())
+	{
+		int32 end = paths.FindFirst(":",start);
+		if (end < 0)
+			end = paths.Length();
+		
+		BString path;
+		paths.CopyInto(path,start,end - start);
+		path << "/g++";
+		if (access(path.String(),X_OK) == 0)
+			compiler = path;
+		start = end + 1;
+	}
+	
+	BString identity;
+	struct stat compilerStat;
+	if (compiler.Length() > 0 && stat(compiler.String(),&compilerStat) == 0)
+	{
+		identity << compiler << "|" << (int64)compilerStat.st_mtime << "|";
+		
+		BString known = gSettings.GetString("jsondiagnostics","");
+		if (known.StartsWith(identity))
+		{
+			sAvailable = known.EndsWith("|yes") ? 1 : 0;
+			return sAvailable == 1;
+		}
+	}
+	
+	if (system("g++ -fdiagnostics-format=json -fsyntax-only -x c++ /dev/null "
+			"> /dev/null 2>&1") == 0)
+		sAvailable = 1;
+	
+	if (identity.Length() > 0)
+	{
+		identity << (sAvailable == 1 ? "yes" : "no");
+		gSettings.SetString("jsondiagnostics",identity);
+	}
+	return sAvailable == 1;
+}
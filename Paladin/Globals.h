@@ -12,6 +12,11 @@
 #include "Project.h"
 
 class DPath;
+class HashCache;
+class IncludeScanner;
+class ObjectCache;
+class ProcessExecutor;
+class JobServer;
 class StatCache;
 
 // Define this to enable the code library
@@ -37,6 +42,7 @@ int32		ShowAlert(const char *message, const char *button1 = NULL,
 						const char *button2 = NULL, const char *button3 = NULL,
 						alert_type type = B_INFO_ALERT);
 DPath		GetSystemPath(directory_which which);
+bool		JSONDiagnosticsAvailable(void);
 entry_ref	GetPartnerRef(entry_ref ref);
 
 extern Project *gCurrentProject;
@@ -54,24 +60,33 @@ extern bool	gBuildMode;
 extern bool	gMakeMode;
 extern bool gDontManageHeaders;
 extern bool gSingleThreadedBuild;
+extern bool gKeepGoing;
+extern bool gTraceBuild;
+extern bool gCompileOnSave;
 extern bool gShowFolderOnOpen;
 extern bool gShowTooltips;
 extern bool gAutoSyncModules;
 extern bool gUseCCache;
 extern bool gCCacheAvailable;
-extern bool gUseFastDep;
-extern bool gFastDepAvailable;
+extern bool gUseContentHash;
+extern bool gUseObjectCache;
 extern bool gHgAvailable;
 extern bool gGitAvailable;
 extern bool gSvnAvailable;
 extern bool gLuaAvailable;
 extern BString gDefaultEmail;
 
-extern uint8 gCPUCount;
+extern int32 gCPUCount;
 
 extern StatCache gStatCache;
+extern JobServer gJobServer;
 extern bool	gUseStatCache;
 
+extern IncludeScanner gIncludeScanner;
+extern HashCache gHashCache;
+extern ObjectCache gObjectCache;
+extern ProcessExecutor gProcessExecutor;
+
 extern platform_t gPlatform;
 
 #endif
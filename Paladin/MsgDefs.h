@@ -23,6 +23,7 @@ enum
 	M_OPEN_PARENT_FOLDER = 'oppf',
 	M_REMOVE_FILES = 'rmfl',
 	M_REBUILD_FILE = 'rbfl',
+	M_TOGGLE_UNITY_EXCLUDE = 'tgue',
 	M_NEW_GROUP = 'nwgr',
 	M_SORT_GROUP = 'srgr',
 	M_DELETE_GROUP = 'dlgr',
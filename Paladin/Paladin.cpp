@@ -17,6 +17,7 @@
 #include <Locker.h>
 #include <getopt.h>
 #include <Message.h>
+#include <MessageRunner.h>
 #include <Messenger.h>
 #include <Mime.h>
 #include <Node.h>
@@ -27,6 +28,7 @@
 #include <TranslationUtils.h>
 
 #include "AboutWindow.h"
+#include "BuildServer.h"
 #include "DebugTools.h"
 #include "DPath.h"
 #include "ErrorParser.h"
@@ -43,6 +45,7 @@
 #include "Settings.h"
 #include "SourceFile.h"
 #include "StartWindow.h"
+#include "StatCache.h"
 #include "TemplateWindow.h"
 #include "PaladinFileFilter.h"
 
@@ -52,6 +55,11 @@
 BPoint gProjectWindowPoint;
 static int sReturnCode = 0;
 
+enum
+{
+	M_WATCH_REBUILD = 'wrbl'
+};
+
 static int32 sWindowCount = 0;
 static BLocker sWindowLocker;
 int32 gQuitOnZeroWindows = 1;
@@ -102,19 +110,29 @@ void
 PrintUsage(void)
 {
 	#ifdef USE_TRACE_TOOLS
-	printf(B_TRANSLATE("Usage: Paladin [-b] [-m] [-r] [-s] [-d] [-v] [file1 [file2 ...]]\n"
+	printf(B_TRANSLATE("Usage: Paladin [-b] [-m] [-r] [-s] [-k] [-t] [-w] [-D] [-d] [-v] [file1 [file2 ...]]\n"
 			"-b, Build the specified project. Only one file can be specified with this switch.\n"
 			"-m, Generate a makefile for the specified project.\n"
 			"-r, Completely rebuild the project.\n"
 			"-s, Use only one thread for building.\n"
+			"-k, Keep building the other files when one fails and report all errors at the end.\n"
+			"-t, Write a timeline of the build to build_trace.json in the objects folder.\n"
+			"-w, --watch, Build the specified project again whenever its files change.\n"
+			"-D, --server, Keep running and do the builds of -b and -r for other\n"
+			"    invocations, which reuse the projects this one has loaded.\n"
 			"-d, Print debugging output.\n"
 			"-v, Make debugging mode verbose.\n"));
 	#else
-	printf(B_TRANSLATE("Usage: Paladin [-b] [-m] [-r] [-s] [file1 [file2 ...]]\n"
+	printf(B_TRANSLATE("Usage: Paladin [-b] [-m] [-r] [-s] [-k] [-t] [-w] [-D] [file1 [file2 ...]]\n"
 			"-b, Build the specified project. Only one file can be specified with this switch.\n"
 			"-m, Generate a makefile for the specified project.\n"
 			"-r, Completely rebuild the project.\n"
-			"-s, Use only one thread for building.\n"));
+			"-s, Use only one thread for building.\n"
+			"-k, Keep building the other files when one fails and report all errors at the end.\n"
+			"-t, Write a timeline of the build to build_trace.json in the objects folder.\n"
+			"-w, --watch, Build the specified project again whenever its files change.\n"
+			"-D, --server, Keep running and do the builds of -b and -r for other\n"
+			"    invocations, which reuse the projects this one has loaded.\n"));
 	#endif
 }
 
@@ -123,7 +141,11 @@ App::App(void)
 	:
 	BApplication(APP_SIGNATURE),
 	fBuildCleanMode(false),
-	fBuilder(NULL)
+	fWatchMode(false),
+	fRebuildPending(false),
+	fRebuildRunner(NULL),
+	fBuilder(NULL),
+	fBuildServer(NULL)
 {
 	InitFileTypes();
 	InitGlobals();
@@ -140,6 +162,8 @@ App::~App(void)
 {
 	gSettings.Save();
 	
+	delete fBuildServer;
+	delete fRebuildRunner;
 	if (NULL != fBuilder)
 		delete fBuilder;
 	if (NULL != fOpenPanel)
@@ -160,6 +184,7 @@ App::ArgvReceived(int32 argc,char **argv)
 {
 	bool showUsage = false;
 	bool verbose = false;
+	bool startServer = false;
 	int32 i = 1;
 	for (i = 1; i < argc; i++)
 	{
@@ -169,6 +194,10 @@ App::ArgvReceived(int32 argc,char **argv)
 		char opt;
 		if (arglen == 2 && arg[0] == '-')
 			opt = arg[1];
+		else if (strcmp(arg,"--watch") == 0)
+			opt = 'w';
+		else if (strcmp(arg,"--server") == 0)
+			opt = 'D';
 		else
 			break;
 			
@@ -195,6 +224,27 @@ App::ArgvReceived(int32 argc,char **argv)
 				gSingleThreadedBuild = true;
 				break;
 			}
+			case 'k':
+			{
+				gKeepGoing = true;
+				break;
+			}
+			case 't':
+			{
+				gTraceBuild = true;
+				break;
+			}
+			case 'w':
+			{
+				gBuildMode = true;
+				fWatchMode = true;
+				break;
+			}
+			case 'D':
+			{
+				startServer = true;
+				break;
+			}
 			
 			#ifdef USE_TRACE_TOOLS
 			case 'v':
@@ -239,6 +289,22 @@ App::ArgvReceived(int32 argc,char **argv)
 	
 	if (gSingleThreadedBuild)
 		STRACE(1,("Disabling multithreaded project building\n"));
+	
+	if (startServer && !fBuildServer)
+	{
+		fBuildServer = new BuildServer;
+		status_t status = fBuildServer->Start();
+		if (status == B_OK)
+			printf(B_TRANSLATE("Build server listening on %s\n"),
+					BuildServer::SocketPath().String());
+		else
+		{
+			printf(B_TRANSLATE("Couldn't start the build server: %s\n"),
+					strerror(status));
+			delete fBuildServer;
+			fBuildServer = NULL;
+		}
+	}
 
 		
 	BMessage refmsg;
@@ -325,7 +391,7 @@ App::QuitRequested(void)
 void
 App::ReadyToRun(void)
 {
-	if (CountRegisteredWindows() < 1 && !gBuildMode)
+	if (CountRegisteredWindows() < 1 && !gBuildMode && !fBuildServer)
 	{
 		StartWindow *win = new StartWindow();
 		win->Show();
@@ -448,55 +514,47 @@ App::MessageReceived(BMessage *msg)
 		}
 
 		case M_BUILDING_FILE:
-		{
-			SourceFile *file;
-			if (msg->FindPointer("sourcefile",(void**)&file) == B_OK)
-				printf(B_TRANSLATE("Building %s\n"),file->GetPath().GetFileName());
-			else
-				printf(B_TRANSLATE("NULL pointer in M_BUILDING_FILE\n"));
-			break;
-		}
-
 		case M_LINKING_PROJECT:
+		case M_UPDATING_RESOURCES:
+		case M_BUILD_WARNINGS:
 		{
-			printf(B_TRANSLATE("Linking\n"));
+			printf("%s",DescribeBuildMessage(msg).String());
 			break;
 		}
 
-		case M_UPDATING_RESOURCES:
+		case M_BUILD_FAILURE:
 		{
-			printf(B_TRANSLATE("Updating resources\n"));
+			printf("%s",DescribeBuildMessage(msg).String());
+			sReturnCode = -1;
+			if (fWatchMode)
+				RebuildProject();
+			else
+				PostMessage(B_QUIT_REQUESTED);
 			break;
 		}
 
-		case M_BUILD_FAILURE:
+		case M_BUILD_SUCCESS:
 		{
-			BString errstr;
-			if (msg->FindString("errstr",&errstr) == B_OK)
-				printf("%s\n",errstr.String());
+			printf("%s",DescribeBuildMessage(msg).String());
+			if (fWatchMode)
+				RebuildProject();
 			else
-			{
-				ErrorList errors;
-				errors.Unflatten(*msg);
-				printf(B_TRANSLATE("Build failure\n%s"), errors.AsString().String());
-			}
-			sReturnCode = -1;
-			PostMessage(B_QUIT_REQUESTED);
+				PostMessage(B_QUIT_REQUESTED);
 			break;
 		}
 
-		case M_BUILD_WARNINGS:
+		case M_WATCHED_FILES_CHANGED:
 		{
-			BString errstr;
-			if (msg->FindString("errstr",&errstr) == B_OK)
-				printf("%s\n",errstr.String());
+			WatchedFilesChanged(msg);
 			break;
 		}
 
-		case M_BUILD_SUCCESS:
+		case M_WATCH_REBUILD:
 		{
-			printf(B_TRANSLATE("Success\n"));
-			PostMessage(B_QUIT_REQUESTED);
+			delete fRebuildRunner;
+			fRebuildRunner = NULL;
+			fRebuildPending = true;
+			RebuildProject();
 			break;
 		}
 
@@ -872,9 +930,77 @@ App::BuildProject(const entry_ref &ref)
 	if (fBuildCleanMode)
 		proj->ForceRebuild();
 	
+	// The build reads the folders of the project's files, which is when the
+	// stat cache starts to watch them
+	if (fWatchMode)
+		gStatCache.AddListener(BMessenger(this));
+	
 	fBuilder->BuildProject(proj, POSTBUILD_NOTHING);
 }
 
+
+void
+App::WatchedFilesChanged(BMessage *msg)
+{
+	Project *proj = gCurrentProject;
+	if (!proj)
+		return;
+	
+	BObjectList<SourceFile> dirtied(20,false);
+	bool lost = msg->GetBool("lost",false);
+	
+	proj->Lock();
+	if (lost)
+		proj->SetChangesTracked(false);
+	
+	const char *path;
+	for (int32 i = 0; msg->FindString("path",i,&path) == B_OK; i++)
+		proj->FileChanged(path,dirtied);
+	proj->Unlock();
+	
+	if (dirtied.CountItems() == 0 && !lost)
+		return;
+	
+	// Saving a file often shows up as several changes in a row, so the
+	// build waits for a moment of quiet
+	delete fRebuildRunner;
+	BMessage rebuild(M_WATCH_REBUILD);
+	fRebuildRunner = new BMessageRunner(BMessenger(this),&rebuild,500000,1);
+}
+
+
+void
+App::RebuildProject(void)
+{
+	if (!fBuilder || !gCurrentProject)
+	{
+		// The project couldn't be loaded, so there is nothing to watch
+		PostMessage(B_QUIT_REQUESTED);
+		return;
+	}
+	
+	if (!fRebuildPending)
+	{
+		printf(B_TRANSLATE("Waiting for changes\n"));
+		return;
+	}
+	
+	// Whatever changed during a build is built once it is over. A build which
+	// failed may still be winding down when the failure arrives.
+	if (fBuilder->IsBuilding())
+	{
+		delete fRebuildRunner;
+		BMessage rebuild(M_WATCH_REBUILD);
+		fRebuildRunner = new BMessageRunner(BMessenger(this),&rebuild,100000,1);
+		return;
+	}
+	
+	fRebuildPending = false;
+	sReturnCode = 0;
+	printf(B_TRANSLATE("Building again\n"));
+	fBuilder->BuildProject(gCurrentProject,POSTBUILD_NOTHING);
+}
+
 void
 App::GenerateMakefile(const entry_ref &ref)
 {
@@ -1108,6 +1234,12 @@ main(int argc, char **argv)
 	}
 	else
 	{
+		// Builds are handed to a build server if one is running, which saves
+		// starting up the whole application for them
+		int status;
+		if (BuildOnServer(argc,argv,status))
+			return status;
+		
 		// Initialize localization under Haiku
 //		#ifdef __HAIKU__
 //		BCatalog cat;
@@ -6,6 +6,8 @@
 #include <FilePanel.h>
 
 
+class BMessageRunner;
+class BuildServer;
 class DelayedMessenger;
 class ProjectBuilder;
 class Project;
@@ -29,6 +31,8 @@ public:
 
 private:
 	void	BuildProject(const entry_ref &ref);
+	void	WatchedFilesChanged(BMessage *msg);
+	void	RebuildProject(void);
 	void	GenerateMakefile(const entry_ref &ref);
 	void	LoadProject(const entry_ref &ref);
 	void	UpdateRecentItems(const entry_ref &ref);
@@ -36,7 +40,11 @@ private:
 	void	CheckCreateOpenPanel(void);
 	
 	bool			fBuildCleanMode;
+	bool			fWatchMode;
+	bool			fRebuildPending;
+	BMessageRunner	*fRebuildRunner;
 	ProjectBuilder	*fBuilder;
+	BuildServer		*fBuildServer;
 	BFilePanel		*fOpenPanel;
 };
 
@@ -27,6 +27,7 @@
 
 #include "DPath.h"
 #include "Globals.h"
+#include "ObjectCache.h"
 #include "PathBox.h"
 #include "Settings.h"
 
@@ -44,7 +45,11 @@ enum
 	M_SET_DONT_ADD_HEADERS = 'sdah',
 	M_SET_SLOW_BUILDS = 'ssbl',
 	M_SET_CCACHE = 'scac',
-	M_SET_FASTDEP = 'sfsd',
+	M_SET_CONTENT_HASH = 'scth',
+	M_SET_OBJECT_CACHE = 'soca',
+	M_SET_SHARED_CACHE_FOLDER = 'sscf',
+	M_SET_BUILD_TRACE = 'sbtr',
+	M_SET_COMPILE_ON_SAVE = 'scos',
 	M_SET_AUTOSYNC = 'saus',
 	M_SET_BACKUP_FOLDER = 'sbuf',
 	M_SET_REPO_FOLDER = 'sref'
@@ -60,7 +65,11 @@ PrefsWindow::PrefsWindow(BRect frame)
 	fDontAddHeaders(NULL),
 	fSlowBuilds(NULL),
 	fCCache(NULL),
-	fFastDep(NULL),
+	fContentHash(NULL),
+	fObjectCache(NULL),
+	fBuildTrace(NULL),
+	fCompileOnSave(NULL),
+	fSharedCacheFolder(NULL),
 	fAutoSyncModules(NULL),
 	fBackupFolder(NULL),
 	fSCMChooser(NULL),
@@ -112,24 +121,54 @@ PrefsWindow::PrefsWindow(BRect frame)
 		fCCache->SetEnabled(false);
 	}
 
-	fFastDep = new BCheckBox("fastdep", B_TRANSLATE("Use fastdep dependency checker"),
-		new BMessage(M_SET_FASTDEP));
-	SetToolTip(fFastDep, B_TRANSLATE("Use the fastdep dependency checker instead of gcc"));
-	if (gFastDepAvailable) {
-		if (gUseFastDep)
-			fFastDep->SetValue(B_CONTROL_ON);
-	} else {
-		BString label = fFastDep->Label();
-		label << " -- " << B_TRANSLATE("unavailable");
-		fFastDep->SetLabel(label.String());
-		fFastDep->SetEnabled(false);
-	}
+	fContentHash = new BCheckBox("contenthash",
+		B_TRANSLATE("Don't rebuild files whose contents haven't changed"),
+		new BMessage(M_SET_CONTENT_HASH));
+	SetToolTip(fContentHash, B_TRANSLATE("Compare file contents instead of "
+		"just modification times, for example after switching branches"));
+	if (gUseContentHash)
+		fContentHash->SetValue(B_CONTROL_ON);
+
+	fObjectCache = new BCheckBox("objectcache",
+		B_TRANSLATE("Reuse previously compiled objects"),
+		new BMessage(M_SET_OBJECT_CACHE));
+	SetToolTip(fObjectCache, B_TRANSLATE("Keep compiled objects in a cache and "
+		"use them again whenever the same code is built with the same options"));
+	if (gUseObjectCache)
+		fObjectCache->SetValue(B_CONTROL_ON);
+
+	fBuildTrace = new BCheckBox("buildtrace",
+		B_TRANSLATE("Record a timeline of each build"),
+		new BMessage(M_SET_BUILD_TRACE));
+	SetToolTip(fBuildTrace, B_TRANSLATE("Writes build_trace.json to the objects "
+		"folder, which shows what each build thread did and for how long when "
+		"opened in chrome://tracing or ui.perfetto.dev"));
+	if (gTraceBuild)
+		fBuildTrace->SetValue(B_CONTROL_ON);
+
+	fCompileOnSave = new BCheckBox("compileonsave",
+		B_TRANSLATE("Compile files in the background when they are saved"),
+		new BMessage(M_SET_COMPILE_ON_SAVE));
+	SetToolTip(fCompileOnSave, B_TRANSLATE("Changed files and the files which "
+		"include them are compiled at a low priority right away, so building "
+		"only has to link"));
+	if (gCompileOnSave)
+		fCompileOnSave->SetValue(B_CONTROL_ON);
+
+	fSharedCacheFolder = new PathBox("sharedcachefolder",
+		gSettings.GetString("objectcacheshared", "").String(),
+		new BMessage(M_SET_SHARED_CACHE_FOLDER));
+	SetToolTip(fSharedCacheFolder, B_TRANSLATE("An optional folder, for example "
+		"on a network drive, where compiled objects are shared with others"));
 
 	BBox* buildBox = new BBox(B_FANCY_BORDER,
 		BLayoutBuilder::Group<>(B_VERTICAL, 0)
 			.Add(fSlowBuilds)
 			.Add(fCCache)
-			.Add(fFastDep)
+			.Add(fContentHash)
+			.Add(fObjectCache)
+			.Add(fBuildTrace)
+			.Add(fCompileOnSave)
 			.SetInsets(B_USE_DEFAULT_SPACING, B_USE_SMALL_SPACING,
 				B_USE_DEFAULT_SPACING, B_USE_SMALL_SPACING)
 			.View());
@@ -164,6 +203,10 @@ PrefsWindow::PrefsWindow(BRect frame)
 		.Add(new BStringView("backups folder label", B_TRANSLATE("Backups folder:")), 0, 4)
 		.Add(fBackupFolder, 1, 4)
 
+		.Add(new BStringView("shared cache folder label",
+			B_TRANSLATE("Shared object cache:")), 0, 5)
+		.Add(fSharedCacheFolder, 1, 5)
+
 		.SetInsets(B_USE_DEFAULT_SPACING)
 		.View();
 	fTabs[0]->SetName(B_TRANSLATE("General"));
@@ -312,10 +355,38 @@ PrefsWindow::MessageReceived(BMessage* message)
 			gSettings.Save();
 			break;
 		}
-		case M_SET_FASTDEP:
+		case M_SET_CONTENT_HASH:
+		{
+			gUseContentHash = (fContentHash->Value() == B_CONTROL_ON);
+			gSettings.SetBool("contenthash", gUseContentHash);
+			gSettings.Save();
+			break;
+		}
+		case M_SET_OBJECT_CACHE:
+		{
+			gUseObjectCache = (fObjectCache->Value() == B_CONTROL_ON);
+			gSettings.SetBool("objectcache", gUseObjectCache);
+			gSettings.Save();
+			break;
+		}
+		case M_SET_BUILD_TRACE:
+		{
+			gTraceBuild = (fBuildTrace->Value() == B_CONTROL_ON);
+			gSettings.SetBool("buildtrace", gTraceBuild);
+			gSettings.Save();
+			break;
+		}
+		case M_SET_COMPILE_ON_SAVE:
+		{
+			gCompileOnSave = (fCompileOnSave->Value() == B_CONTROL_ON);
+			gSettings.SetBool("compileonsave", gCompileOnSave);
+			gSettings.Save();
+			break;
+		}
+		case M_SET_SHARED_CACHE_FOLDER:
 		{
-			gUseFastDep = (fFastDep->Value() == B_CONTROL_ON);
-			gSettings.SetBool("fastdep", gUseFastDep);
+			gObjectCache.SetSharedFolder(fSharedCacheFolder->Path());
+			gSettings.SetString("objectcacheshared", fSharedCacheFolder->Path());
 			gSettings.Save();
 			break;
 		}
@@ -37,11 +37,15 @@ private:
 
 			BCheckBox*			fSlowBuilds;
 			BCheckBox*			fCCache;
-			BCheckBox*			fFastDep;
+			BCheckBox*			fContentHash;
+			BCheckBox*			fObjectCache;
+			BCheckBox*			fBuildTrace;
+			BCheckBox*			fCompileOnSave;
 
 			BCheckBox*			fAutoSyncModules;
 
 			PathBox*			fBackupFolder;
+			PathBox*			fSharedCacheFolder;
 
 			BMenuField*			fSCMChooser;
 			PathBox*			fSVNRepoFolder;
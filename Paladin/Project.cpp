@@ -13,10 +13,15 @@
 
 #include "Project.h"
 
+#include <map>
+#include <set>
 #include <string>
+#include <vector>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <fs_attr.h>
 
@@ -34,17 +39,19 @@
 #include <Path.h>
 #include <Volume.h>
 
+#include "ContentHash.h"
 #include "DebugTools.h"
 #include "DPath.h"
 #include "FileFactory.h"
 #include "Globals.h"
 #include "LaunchHelper.h"
+#include "ObjectHash.h"
 #include "SCMManager.h"
 #include "SourceFile.h"
+#include "StatCache.h"
 #include "TextFile.h"
-#include "CommandOutputHandler.h"
-#include "CommandThread.h"
 #include "CompileCommand.h"
+#include "ProcessExecutor.h"
 
 #undef B_TRANSLATION_CONTEXT
 #define B_TRANSLATION_CONTEXT "Project"
@@ -70,11 +77,20 @@ Project::Project(const char *name, const char *targetname)
 	fLocalIncludeList(20,true),
 	fSystemIncludeList(20,true),
 	fAccessList(20,true),
+	fUnityExcludeList(20,true),
 	fGroupList(20,true),
 	fReadOnly(false),
 	fDebug(false),
 	fProfile(false),
 	fOpSize(false),
+	fAutoPCH(false),
+	fUnityBuild(false),
+	fUnityPending(false),
+	fKeepGoing(false),
+	fSplitDebug(false),
+	fThinArchive(false),
+	fRebuildArchive(true),
+	fChangesTracked(false),
 	fOpLevel(0),
 	fTargetType(TARGET_APP),
 	fSCMType(gDefaultSCM)
@@ -103,6 +119,7 @@ Project::Project(const char *name, const char *targetname)
 
 Project::~Project(void)
 {
+	fDependencyStore.Close();
 	delete fErrorList;
 }
 
@@ -167,7 +184,7 @@ Project::Load(const char* path)
 				AddFile(srcfile, srcgroup);
 			} else if (entry == "DEPENDENCY") {
 				if (srcfile)
-					srcfile->fDependencies = value;
+					srcfile->SetDependencies(value.String());
 			} else if (entry == "LOCALINCLUDE") {
 				if (value.FindFirst("B_FIND_PATH_DEVELOP_HEADERS_DIRECTORY") == 0)
 					value.ReplaceFirst("B_FIND_PATH_DEVELOP_HEADERS_DIRECTORY",
@@ -220,6 +237,20 @@ Project::Load(const char* path)
 				fProfile = value == "yes" ? true : false;
 			} else if (entry == "CCOPSIZE") {
 				fOpSize = value == "yes" ? true : false;
+			} else if (entry == "CCAUTOPCH") {
+				fAutoPCH = value == "yes" ? true : false;
+			} else if (entry == "CCUNITY") {
+				fUnityBuild = value == "yes" ? true : false;
+			} else if (entry == "CCUNITYSIZE") {
+				fUnity.SetBatchSize(atoi(value.String()));
+			} else if (entry == "UNITYEXCLUDE") {
+				fUnityExcludeList.AddItem(new BString(value));
+			} else if (entry == "KEEPGOING") {
+				fKeepGoing = value == "yes" ? true : false;
+			} else if (entry == "SPLITDEBUG") {
+				fSplitDebug = value == "yes" ? true : false;
+			} else if (entry == "THINARCHIVE") {
+				fThinArchive = value == "yes" ? true : false;
 			} else if (entry == "CCOPLEVEL") {
 				fOpLevel = atoi(value.String());
 			} else if (entry == "CCTARGETTYPE") {
@@ -228,6 +259,8 @@ Project::Load(const char* path)
 				fExtraCompilerOptions = value;
 			} else if (entry == "LDEXTRA") {
 				fExtraLinkerOptions = value;
+			} else if (entry == "LINKER") {
+				fLinker = value;
 			} else if (entry == "RUNARGS") {
 				fRunArgs = value;
 			} else if (entry == "SCM") {
@@ -271,6 +304,7 @@ Project::Load(const char* path)
 	fObjectPath.Append(objfolder.String());
 
 	UpdateBuildInfo();
+	OpenDependencyStore();
 
 	// We now set the platform to whatever we're building on. fPlatform is only used
 	// in the project loading code to be able to help cover over issues with changing platforms.
@@ -336,11 +370,6 @@ Project::Save(const char* path)
 			temppath.ReplaceAll(projectPath, "");
 
 			data << "SOURCEFILE=" << temppath << "\n";
-			if (file->GetDependencies() && strlen(file->GetDependencies()) > 0) {
-				BString deps = file->GetDependencies();
-				deps.ReplaceAll(projectPath, "");
-				data << "DEPENDENCY=" << deps << "\n";
-			}
 		}
 	}
 
@@ -432,10 +461,20 @@ Project::Save(const char* path)
 	data << "CCDEBUG=" << (fDebug ? "yes" : "no") << "\n";
 	data << "CCPROFILE=" << (fProfile ? "yes" : "no") << "\n";
 	data << "CCOPSIZE=" << (fOpSize ? "yes" : "no") << "\n";
+	data << "CCAUTOPCH=" << (fAutoPCH ? "yes" : "no") << "\n";
+	data << "CCUNITY=" << (fUnityBuild ? "yes" : "no") << "\n";
+	data << "CCUNITYSIZE=" << fUnity.BatchSize() << "\n";
+	for (int32 i = 0; i < fUnityExcludeList.CountItems(); i++)
+		data << "UNITYEXCLUDE=" << *fUnityExcludeList.ItemAt(i) << "\n";
+	data << "KEEPGOING=" << (fKeepGoing ? "yes" : "no") << "\n";
+	data << "SPLITDEBUG=" << (fSplitDebug ? "yes" : "no") << "\n";
+	data << "THINARCHIVE=" << (fThinArchive ? "yes" : "no") << "\n";
 	data << "CCOPLEVEL=" << (int)fOpLevel << "\n";
 	data << "CCTARGETTYPE=" << fTargetType << "\n";
 	data << "CCEXTRA=" << fExtraCompilerOptions << "\n";
 	data << "LDEXTRA=" << fExtraLinkerOptions << "\n";
+	if (fLinker.Length() > 0)
+		data << "LINKER=" << fLinker << "\n";
 
 	BFile file(path,B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
 	if (file.InitCheck() != B_OK) {
@@ -458,6 +497,15 @@ Project::Save(const char* path)
 	nodeInfo.SetType(PROJECT_MIME_TYPE);
 
 	UpdateBuildInfo();
+
+	// Dependencies are kept in their own file. It only needs to be opened
+	// again if the project was saved under a new name or in a new place.
+	BString storePath(fPath.GetFolder());
+	storePath << "/(Dependencies." << GetName() << ")";
+	if (storePath != fDependencyStore.GetStorePath())
+		OpenDependencyStore();
+	else
+		fDependencyStore.Flush();
 }
 
 
@@ -543,6 +591,7 @@ Project::AddFile(SourceFile *file, SourceGroup *group, int32 index)
 		group->filelist.AddItem(file);
 	else
 		group->filelist.AddItem(file,index);
+	fChangesTracked = false;
 
 	BString path = file->GetPath().GetFolder();
 	if (path != fPath.GetFolder()) {
@@ -570,8 +619,11 @@ Project::RemoveFile(SourceFile* file)
 		SourceGroup* group = GroupAt(i);
 		
 		if (group->filelist.HasItem(file)) {
+			DropUnityBatch(file);
 			file->RemoveObjects(fBuildInfo);
 			group->filelist.RemoveItem(file);
+			fDirtyFiles.RemoveItem(file);
+			fChangesTracked = false;
 			STRACE(2, ("%s:Remove File: Removed file %s\n", GetName(),
 				file->GetPath().GetFullPath()));
 		}
@@ -745,6 +797,7 @@ Project::UpdateBuildInfo(void)
 {
 	fBuildInfo.projectFolder = fPath.GetFolder();
 	fBuildInfo.objectFolder = fObjectPath;
+	fBuildInfo.dependencyStore = &fDependencyStore;
 
 	fBuildInfo.includeList.MakeEmpty();
 
@@ -768,17 +821,20 @@ Project::UpdateBuildInfo(void)
 	}
 
 	fBuildInfo.errorList.msglist.MakeEmpty();
+
+	// Headers may be found in different places now
+	fChangesTracked = false;
 }
 
 
 void
-Project::PrecompileFile(SourceFile* file)
+Project::PrecompileFile(SourceFile* file, BuildInfo& info)
 {
 	if (file == NULL)
 		return;
 
 	//DPath projfolder(GetPath().GetFolder());
-	file->Precompile(fBuildInfo,"");
+	file->Precompile(info,"");
 }
 
 void
@@ -791,15 +847,93 @@ Project::UpdateFileDependencies(SourceFile* file)
 }
 
 void
-Project::CompileFile(SourceFile* file)
+Project::FileChanged(const char *path, BObjectList<SourceFile> &dirtied)
+{
+	if (path == NULL)
+		return;
+	
+	// The build writes all kinds of files to the object folder itself. Only
+	// an object which went away means that its source has to be built again.
+	BString objectFolder(fObjectPath.GetFullPath());
+	objectFolder << "/";
+	bool isObject = strncmp(path, objectFolder.String(),
+		objectFolder.Length()) == 0;
+	if (isObject && (gStatCache.Exists(path) || !BString(path).EndsWith(".o")))
+		return;
+	
+	// The files which include a header are looked up in the dependency store
+	// instead of going through every dependency of every file
+	std::set<BString> dependents;
+	if (!isObject) {
+		std::vector<BString> list;
+		fDependencyStore.GetDependents(path, list);
+		dependents.insert(list.begin(), list.end());
+	}
+	
+	for (int32 i = 0; i < CountGroups(); i++) {
+		SourceGroup* group = GroupAt(i);
+		for (int32 j = 0; j < group->filelist.CountItems(); j++) {
+			SourceFile* file = group->filelist.ItemAt(j);
+			BString filePath(file->GetPath().GetFullPath());
+			bool affected;
+			
+			if (isObject) {
+				DPath objectPath(file->GetObjectPath(fBuildInfo));
+				affected = !objectPath.IsEmpty()
+					&& strcmp(objectPath.GetFullPath(), path) == 0;
+			} else {
+				affected = filePath == path
+					|| dependents.find(filePath) != dependents.end();
+			}
+			
+			if (!affected)
+				continue;
+			
+			STRACE(1,("%s needs to be built because %s changed\n",
+				filePath.String(), path));
+			file->SetBuildFlag(BUILD_YES);
+			MakeFileDirty(file);
+			if (!dirtied.HasItem(file))
+				dirtied.AddItem(file);
+		}
+	}
+}
+
+
+void
+Project::CompileFile(SourceFile* file, BuildInfo& info)
 {
 	if (file == NULL)
 		return;
 	
+	BString compileString = GetCompileOptions();
+
+	// The precompiled header only goes ahead of files which start out by
+	// including the same headers anyway
+	if (fAutoPCH && file->GetType() == TYPE_C
+		&& fPCH.Suits(info, file->GetPath().GetFullPath()))
+		compileString << "-include '" << fPCH.GetHeaderPath() << "' ";
+
+	//DPath projfolder(GetPath().GetFolder());
+	
+	CompileCommand cc(
+		std::string(file->GetPath().GetFileName()),
+		std::string(file->GetCompileCommand(info,compileString).String()),
+		std::string(info.objectFolder.GetFullPath())
+	);
+	file->Compile(info,cc);
+}
+
+
+BString
+Project::GetCompileOptions(void)
+{
 	BString compileString;
-	if (Debug())
+	if (Debug()) {
 		compileString << "-g -O0 ";
-	else {
+		if (SplitDebug())
+			compileString << "-gsplit-dwarf ";
+	} else {
 		compileString << "-O" << (int)OpLevel() << " ";
 
 		if (OpForSize())
@@ -831,74 +965,169 @@ Project::CompileFile(SourceFile* file)
 		compileString << "-I '" << item.String() << "' ";
 	}
 
-	//DPath projfolder(GetPath().GetFolder());
+	return compileString;
+}
+
+
+void
+Project::UpdatePrecompiledHeader(void)
+{
+	if (!fAutoPCH) {
+		fPCH.Clear();
+		return;
+	}
+
+	// This runs in a build thread while the files are being examined, so
+	// the project is only locked while the sources are collected
+	std::vector<BString> sources;
+	Lock();
+	for (int32 i = 0; i < CountGroups(); i++) {
+		SourceGroup *group = GroupAt(i);
+		for (int32 j = 0; j < group->filelist.CountItems(); j++) {
+			SourceFile *file = group->filelist.ItemAt(j);
+			if (file->GetType() == TYPE_C && file->UsesBuild())
+				sources.push_back(BString(file->GetPath().GetFullPath()));
+		}
+	}
+	BString options = GetCompileOptions();
+	Unlock();
+
+	fPCH.Update(fBuildInfo,sources,options.String());
+}
+
+
+void
+Project::CheckUnityBatches(void)
+{
+	fUnity.Load(fBuildInfo,this);
+	fUnity.CheckBatches(fBuildInfo);
+}
+
+
+void
+Project::DropUnityBatch(SourceFile *file)
+{
+	// The batch has to be known before it can be dropped
+	fUnity.Load(fBuildInfo,this);
+	fUnity.RemoveFile(fBuildInfo,file);
+}
+
+
+void
+Project::PrepareUnityBuild(void)
+{
+	if (!fUnityPending)
+		return;
 	
-	CompileCommand cc(
-		std::string(file->GetPath().GetFileName()),
-		std::string(file->GetCompileCommand(fBuildInfo,compileString).String()),
-		std::string(fBuildInfo.objectFolder.GetFullPath())
-	);
-	file->Compile(fBuildInfo,cc);
+	fUnityPending = false;
+	for (int32 i = 0; i < CountGroups(); i++) {
+		SourceGroup *group = GroupAt(i);
+		std::vector<SourceFile*> files;
+		for (int32 j = 0; j < group->filelist.CountItems(); j++) {
+			SourceFile *file = group->filelist.ItemAt(j);
+			if (file->GetType() == TYPE_C && file->UsesBuild()
+				&& file->BuildFlag() == BUILD_YES && !IsUnityExcluded(file))
+				files.push_back(file);
+		}
+		fUnity.AddGroup(fBuildInfo,i,files);
+	}
+	fUnity.Save(fBuildInfo);
 }
 
 
 void
-Project::Link(void)
+Project::SetUnityExcluded(SourceFile *file, bool value)
+{
+	if (file == NULL || IsUnityExcluded(file) == value)
+		return;
+	
+	BString path(file->GetPath().GetFullPath());
+	path.RemoveFirst(BString(fPath.GetFolder()) << "/");
+	
+	if (value) {
+		fUnityExcludeList.AddItem(new BString(path));
+		return;
+	}
+	
+	for (int32 i = 0; i < fUnityExcludeList.CountItems(); i++) {
+		if (*fUnityExcludeList.ItemAt(i) == path) {
+			delete fUnityExcludeList.RemoveItemAt(i);
+			return;
+		}
+	}
+}
+
+
+bool
+Project::IsUnityExcluded(SourceFile *file)
+{
+	if (file == NULL)
+		return false;
+	
+	BString path(file->GetPath().GetFullPath());
+	path.RemoveFirst(BString(fPath.GetFolder()) << "/");
+	
+	for (int32 i = 0; i < fUnityExcludeList.CountItems(); i++) {
+		if (*fUnityExcludeList.ItemAt(i) == path)
+			return true;
+	}
+	return false;
+}
+
+
+static BString
+make_response(const std::vector<BString> &files)
+{
+	// The compiler and ar take quotes and backslashes away again the same
+	// way the shell does
+	BString response;
+	for (size_t i = 0; i < files.size(); i++) {
+		BString file(files[i]);
+		file.CharacterEscape("'\\", '\\');
+		response << "'" << file << "'\n";
+	}
+	return response;
+}
+
+
+BString
+Project::GetLinkCommand(void)
 {
 	BString linkString;
-	BString targetPath;
+	BString targetPath = GetLinkTargetPath();
 	
-	if (GetTargetName()[0] != '/')
-		targetPath << GetPath().GetFolder() << "/" << GetTargetName();
-	else
-		targetPath << GetTargetName();
+	// The objects and libraries to link are passed in a file instead, which
+	// keeps the command short however many there are
+	DPath responsePath(fBuildInfo.objectFolder);
+	responsePath.Append("(Link).rsp");
 
 	if (TargetType() == TARGET_STATIC_LIB)
 	{
-		linkString = "ar rcs '";
-		linkString << targetPath << "' ";
-		for (int32 i = 0; i < CountGroups(); i++)
-		{
-			SourceGroup *group = GroupAt(i);
-			
-			for (int32 j = 0; j < group->filelist.CountItems(); j++)
-			{
-				SourceFile *file = group->filelist.ItemAt(j);
-				if (file->GetObjectPath(fBuildInfo).GetFullPath())
-					linkString << "'" << file->GetObjectPath(fBuildInfo).GetFullPath() << "' ";
-			}
-		}
+		// A thin archive only refers to the objects instead of holding them
+		linkString = ThinArchive() ? "ar rcsT '" : "ar rcs '";
+		linkString << targetPath << "' @'" << responsePath.GetFullPath() << "' ";
 	} else {
 		linkString = "g++ -o '";
 		linkString << targetPath << "' ";
 		
 		if (Profiling())
 			linkString << "-p ";
-			
-			
-		for (int32 i = 0; i < CountGroups(); i++)
-		{
-			SourceGroup *group = GroupAt(i);
-			
-			for (int32 j = 0; j < group->filelist.CountItems(); j++)
-			{
-				SourceFile *file = group->filelist.ItemAt(j);
-				if (file->GetObjectPath(fBuildInfo).GetFullPath())
-					linkString << "'" << file->GetObjectPath(fBuildInfo).GetFullPath() << "' ";
-			}
-		}
-
-		for (int32 i = 0; i < CountGroups(); i++) {
-			SourceGroup* group = GroupAt(i);
-			
-			for (int32 j = 0; j < group->filelist.CountItems(); j++) {
-				SourceFile* file = group->filelist.ItemAt(j);
-				if (file->GetLibraryPath(fBuildInfo).GetFullPath()) {
-					linkString << "'" << file->GetLibraryPath(fBuildInfo).GetFullPath()
-						<< "' ";
-				}
-			}
+		
+		if (fLinker.Length() > 0) {
+			if (LinkerInstalled(fLinker.String()))
+				linkString << "-fuse-ld=" << fLinker << " ";
+			else
+				STRACE(1, ("ld.%s isn't installed, using the default linker\n",
+					fLinker.String()));
 		}
+		
+		// With the debugging information in the .dwo files, an index saves
+		// the debugger from reading all of them. The BFD linker can't make one.
+		if (Debug() && SplitDebug() && fLinker.Length() > 0 && fLinker != "bfd"
+			&& LinkerInstalled(fLinker.String()))
+			linkString << "-Wl,--gdb-index ";
+		
+		linkString << "@'" << responsePath.GetFullPath() << "' ";
 
 		for (int32 i = 0; i < CountLibraries(); i++) {
 			SourceFile* file = LibraryAt(i);
@@ -962,90 +1191,417 @@ Project::Link(void)
 		}
 	}
 
-	//linkString << " 2>&1";
+	return linkString;
+}
+
+
+BString
+Project::GetLinkTargetPath(void)
+{
+	BString targetPath;
+	if (GetTargetName()[0] != '/')
+		targetPath << GetPath().GetFolder() << "/" << GetTargetName();
+	else
+		targetPath << GetTargetName();
+	return targetPath;
+}
+
+
+BString
+Project::GetLinkResponse(void)
+{
+	std::vector<BString> files;
+	GetLinkObjects(files);
+	
+	if (TargetType() != TARGET_STATIC_LIB) {
+		for (int32 i = 0; i < CountGroups(); i++) {
+			SourceGroup* group = GroupAt(i);
+			
+			for (int32 j = 0; j < group->filelist.CountItems(); j++) {
+				SourceFile* file = group->filelist.ItemAt(j);
+				if (file->GetLibraryPath(fBuildInfo).GetFullPath())
+					files.push_back(file->GetLibraryPath(fBuildInfo).GetFullPath());
+			}
+		}
+	}
+	
+	return make_response(files);
+}
+
 
-	//BString errorMessage;
-	//PipeCommand(linkString.String(),errorMessage);
+void
+Project::GetLinkObjects(std::vector<BString> &objects)
+{
+	for (int32 i = 0; i < CountGroups(); i++)
+	{
+		SourceGroup *group = GroupAt(i);
+		
+		for (int32 j = 0; j < group->filelist.CountItems(); j++)
+		{
+			SourceFile *file = group->filelist.ItemAt(j);
+			if (fUnity.Covers(file))
+				continue;
+			if (file->GetObjectPath(fBuildInfo).GetFullPath())
+				objects.push_back(file->GetObjectPath(fBuildInfo).GetFullPath());
+		}
+	}
+	
+	for (int32 i = 0; i < fUnity.CountUnits(); i++)
+	{
+		SourceFile *unit = fUnity.UnitAt(i);
+		objects.push_back(unit->GetObjectPath(fBuildInfo).GetFullPath());
+	}
+}
+
+
+bool
+Project::LinkInputsChanged(BString &reason)
+{
+	// What went into the last successful link: a hash of the command and,
+	// for each object and library, a hash of its code along with the time,
+	// size and node it had so that files which weren't touched aren't read
+	// again. The time goes down to the nanosecond, since an object can be
+	// written again within the same second and have the same size.
+	std::map<BString, BString> lastInputs;
+	BString lastCommand;
+	
+	DPath statePath(fBuildInfo.objectFolder);
+	statePath.Append("(Link).state");
+	TextFile file(statePath.GetFullPath(), B_READ_ONLY);
+	if (file.InitCheck() == B_OK) {
+		BString line = file.ReadLine();
+		while (line.CountChars() > 0) {
+			if (line.FindFirst("COMMAND=") == 0)
+				lastCommand = line.String() + 8;
+			else if (line.FindFirst("INPUT=") == 0) {
+				int32 pos = line.FindLast("|");
+				if (pos > 0)
+					lastInputs[BString(line.String() + pos + 1)]
+						= BString(line.String() + 6, pos - 6);
+			}
+			line = file.ReadLine();
+		}
+	}
+	
+	std::vector<BString> inputs;
+	GetLinkObjects(inputs);
+	size_t objectCount = inputs.size();
+	for (int32 i = 0; i < CountGroups(); i++) {
+		SourceGroup *group = GroupAt(i);
+		for (int32 j = 0; j < group->filelist.CountItems(); j++) {
+			DPath libPath = group->filelist.ItemAt(j)->GetLibraryPath(fBuildInfo);
+			if (libPath.GetFullPath())
+				inputs.push_back(libPath.GetFullPath());
+		}
+	}
 	
-	BMessage cmd;
-	cmd.AddString("cmd",linkString);
-	//cmd.AddString("pwd",abspath);
+	// The files to link are only named in the response file, but the order
+	// they are given in matters, too. The members of an archive can be in
+	// any order, so files can be added to one without starting over.
+	BString command = GetLinkCommand();
+	if (TargetType() != TARGET_STATIC_LIB)
+		command << GetLinkResponse();
+	char hashString[32];
+	sprintf(hashString, "%016" B_PRIx64,
+		HashBuffer(command.String(), command.Length()));
+	
+	fLinkState = "";
+	fLinkState << "COMMAND=" << hashString << "\n";
+	
+	reason = "";
+	if (lastCommand.Length() == 0)
+		reason = "there is no record of an earlier link";
+	else if (lastCommand != hashString)
+		reason = "the link command changed";
+	else if (lastInputs.size() != inputs.size())
+		reason = "files were added or removed";
+	
+	// A static library only needs the members replaced which were written
+	// since the last link. It is made from scratch when anything was taken
+	// out of it, since ar would keep those members otherwise.
+	fArchiveMembers.clear();
+	fRebuildArchive = lastCommand != hashString;
+	std::set<BString> current(inputs.begin(), inputs.end());
+	std::map<BString, BString>::iterator input;
+	for (input = lastInputs.begin(); input != lastInputs.end(); input++) {
+		if (current.find(input->first) == current.end())
+			fRebuildArchive = true;
+	}
 	
-	CommandOutputHandler handler(true); // enable redirect
-	BLooper* looper = new BLooper();
-	looper->AddHandler(&handler);
-	BMessenger msgr(&handler,looper);
-	looper->Run();
-	CommandThread thread(&cmd,&msgr);
-	thread.Start();
-	status_t okReturn = B_OK;
-	thread.WaitForThread(&okReturn);
+	for (size_t i = 0; i < inputs.size(); i++) {
+		struct stat s;
+		if (stat(inputs[i].String(), &s) != 0) {
+			if (reason.Length() == 0)
+				reason << inputs[i] << " is missing";
+			if (i < objectCount)
+				fArchiveMembers.push_back(inputs[i]);
+			continue;
+		}
+		
+		BString stamp;
+		stamp << (int64)s.st_mtim.tv_sec << "." << (int64)s.st_mtim.tv_nsec
+			<< "|" << (int64)s.st_size << "|" << (int64)s.st_ino;
+		
+		std::map<BString, BString>::iterator last = lastInputs.find(inputs[i]);
+		BString lastHash;
+		if (last != lastInputs.end()) {
+			lastHash = last->second;
+			int32 pos = lastHash.FindFirst("|");
+			if (pos > 0 && stamp == lastHash.String() + pos + 1) {
+				fLinkState << "INPUT=" << last->second << "|" << inputs[i] << "\n";
+				continue;
+			}
+			lastHash.Truncate(pos > 0 ? pos : 0);
+		}
+		if (i < objectCount)
+			fArchiveMembers.push_back(inputs[i]);
+		
+		// Libraries aren't objects, so they only get a plain hash. The
+		// line numbers in a debug build have to stay right.
+		uint64 hash;
+		if (HashObjectCode(inputs[i].String(), &hash, Debug()) != B_OK
+			&& HashFile(inputs[i].String(), &hash) != B_OK) {
+			if (reason.Length() == 0)
+				reason << inputs[i] << " couldn't be read";
+			continue;
+		}
+		
+		sprintf(hashString, "%016" B_PRIx64, hash);
+		fLinkState << "INPUT=" << hashString << "|" << stamp << "|"
+			<< inputs[i] << "\n";
+		
+		if (reason.Length() == 0 && lastHash != hashString) {
+			if (last == lastInputs.end())
+				reason << inputs[i] << " is new";
+			else
+				reason << "the code in " << inputs[i] << " changed";
+		}
+	}
 	
-	handler.WaitForExit();
+	return reason.Length() > 0;
+}
+
+
+void
+Project::SaveLinkState(void)
+{
+	if (fLinkState.Length() == 0)
+		return;
 	
-	std::string errmsg = handler.GetOut();
+	DPath statePath(fBuildInfo.objectFolder);
+	statePath.Append("(Link).state");
+	BFile file(statePath.GetFullPath(), B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
+	if (file.InitCheck() == B_OK)
+		file.Write(fLinkState.String(), fLinkState.Length());
+}
+
+
+void
+Project::Link(void)
+{
+	BString linkString = GetLinkCommand();
+
+	BString errmsg;
+	BString response;
+	BString targetPath = GetLinkTargetPath();
+	if (TargetType() == TARGET_STATIC_LIB && !fRebuildArchive
+		&& BEntry(targetPath.String()).Exists()) {
+		// ar replaces the members it is given and leaves the rest alone
+		response = make_response(fArchiveMembers);
+		STRACE(1, ("Replacing %ld members of %s\n", (long)fArchiveMembers.size(),
+			targetPath.String()));
+	} else {
+		response = GetLinkResponse();
+		if (TargetType() == TARGET_STATIC_LIB)
+			BEntry(targetPath.String()).Remove();
+	}
+	
+	// Without an up to date record, the next link starts over
+	fRebuildArchive = true;
+	
+	DPath responsePath(fBuildInfo.objectFolder);
+	responsePath.Append("(Link).rsp");
+	BFile file(responsePath.GetFullPath(), B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
+	if (file.InitCheck() != B_OK
+		|| file.Write(response.String(), response.Length()) != response.Length())
+		errmsg = "Unable to write the list of files to link\n";
+	file.Unset();
+
+	if (errmsg.Length() == 0
+		&& gProcessExecutor.Run(linkString.String(), errmsg) != B_OK)
+		errmsg = "Unable to start the linker\n";
 
 	STRACE(1, ("Linking %s:\n%s\nErrors:\n%s\n", GetName(), linkString.String(),
-		errmsg.c_str()));
+		errmsg.String()));
 
-	if (errmsg.length() > 0)
-		ParseLDErrors(errmsg.c_str(),fBuildInfo.errorList);
+	if (errmsg.Length() > 0)
+		ParseLDErrors(errmsg.String(), fBuildInfo.errorList);
 }
 
 
 void
-Project::UpdateResources(void)
+Project::GetResourceFiles(std::vector<BString> &files)
 {
-	DPath targetpath(fPath.GetFolder());
-	targetpath.Append(GetTargetName());
-
-	BString resFileString;
-	int32 resCount = 0;
 	for (int32 i = 0; i < CountGroups(); i++) {
 		SourceGroup* group = GroupAt(i);
 		for (int32 j = 0; j < group->filelist.CountItems(); j++) {
 			SourceFile* file = group->filelist.ItemAt(j);
-			if (file->GetResourcePath(fBuildInfo).GetFullPath()) {
-				resFileString << "'" << file->GetResourcePath(fBuildInfo).GetFullPath()
-					<< "' ";
-				resCount++;
-			}
+			DPath resPath = file->GetResourcePath(fBuildInfo);
+			if (resPath.GetFullPath())
+				files.push_back(resPath.GetFullPath());
 		}
 	}
+}
 
-	if (resCount > 0) {
-		BString resString = "xres -o ";
-		resString << "'" << targetpath.GetFullPath() << "' " << resFileString;		
-		
 
-	BMessage cmd;
-	cmd.AddString("cmd",resString);
-	//cmd.AddString("pwd",abspath);
+bool
+Project::ResourcesChanged(BString &reason)
+{
+	// What the target's resources were made from the last time: a hash of
+	// each resource file and the time and size the target had afterwards.
+	// Linking writes the target anew, which leaves the resources out.
+	BString lastTarget;
+	BString lastInputs;
+	
+	DPath statePath(fBuildInfo.objectFolder);
+	statePath.Append("(Resources).state");
+	TextFile file(statePath.GetFullPath(), B_READ_ONLY);
+	if (file.InitCheck() == B_OK) {
+		BString line = file.ReadLine();
+		while (line.CountChars() > 0) {
+			if (line.FindFirst("TARGET=") == 0)
+				lastTarget = line.String() + 7;
+			else if (line.FindFirst("INPUT=") == 0)
+				lastInputs << line << "\n";
+			line = file.ReadLine();
+		}
+	}
 	
-	CommandOutputHandler handler(true); // enable redirect
-	BLooper* looper = new BLooper();
-	looper->AddHandler(&handler);
-	BMessenger msgr(&handler,looper);
-	looper->Run();
-	CommandThread thread(&cmd,&msgr);
-	thread.Start();
-	status_t okReturn = B_OK;
-	thread.WaitForThread(&okReturn);
+	std::vector<BString> files;
+	GetResourceFiles(files);
 	
-	handler.WaitForExit();
+	fResourceState = "";
+	reason = "";
+	if (files.empty() && lastInputs.Length() == 0)
+		return false;
+	
+	struct stat s;
+	if (stat(GetLinkTargetPath().String(), &s) != 0)
+		return false;
 	
-	std::string errmsg = handler.GetOut();		
+	// Later files win over earlier ones, so the order counts, too
+	for (size_t i = 0; i < files.size(); i++) {
+		uint64 hash;
+		if (HashFile(files[i].String(), &hash) != B_OK) {
+			if (reason.Length() == 0)
+				reason << files[i] << " couldn't be read";
+			continue;
+		}
 		
-		//BString errorMessage;
-		//PipeCommand(resString.String(),errorMessage);
+		char hashString[32];
+		sprintf(hashString, "%016" B_PRIx64, hash);
+		fResourceState << "INPUT=" << hashString << "|" << files[i] << "\n";
+	}
+	
+	BString timeAndSize;
+	timeAndSize << (int64)s.st_mtime << "|" << (int64)s.st_size;
+	
+	if (reason.Length() == 0) {
+		if (lastTarget.Length() == 0)
+			reason = "there is no record of earlier resources";
+		else if (lastTarget != timeAndSize)
+			reason = "the target was written since";
+		else if (lastInputs != fResourceState)
+			reason = "the resource files changed";
+	}
+	
+	return reason.Length() > 0;
+}
 
-		STRACE(1, ("Resources for %s:\n%s\nErrors:%s\n", GetName(), resString.String(),
-			errmsg.c_str()));
 
-		if (errmsg.length() > 0)
-			printf("Resource errors: %s\n",errmsg.c_str());
-	} else
-		STRACE(1, ("Resources for %s: No resource files to add\n", GetName()));
+void
+Project::UpdateResources(void)
+{
+	BString targetPath = GetLinkTargetPath();
+	
+	std::vector<BString> files;
+	GetResourceFiles(files);
+	
+	// The resources are copied over here instead of by xres, which saves
+	// starting it for every build
+	BString errmsg;
+	BFile target(targetPath.String(), B_READ_WRITE);
+	BResources targetRes;
+	if (target.InitCheck() != B_OK || targetRes.SetTo(&target) != B_OK) {
+		errmsg << "Unable to open the resources of " << targetPath << "\n";
+	} else {
+		// A target which wasn't linked again still has the old resources,
+		// and those which are gone from the files shouldn't stay in it
+		type_code type;
+		int32 id;
+		const char* name;
+		size_t length;
+		while (targetRes.GetResourceInfo(0, &type, &id, &name, &length)) {
+			if (targetRes.RemoveResource(type, id) != B_OK)
+				break;
+		}
+		
+		for (size_t i = 0; i < files.size(); i++) {
+			BFile file(files[i].String(), B_READ_ONLY);
+			BResources res;
+			if (file.InitCheck() != B_OK || res.SetTo(&file) != B_OK) {
+				errmsg << "Unable to read the resources in " << files[i] << "\n";
+				continue;
+			}
+			
+			for (int32 j = 0; res.GetResourceInfo(j, &type, &id, &name, &length);
+					j++) {
+				const void* data = res.LoadResource(type, id, &length);
+				if (data == NULL) {
+					errmsg << "Unable to load resource " << id << " of "
+						<< files[i] << "\n";
+					continue;
+				}
+				
+				// Like with xres, a later file wins over an earlier one
+				if (targetRes.HasResource(type, id))
+					targetRes.RemoveResource(type, id);
+				if (targetRes.AddResource(type, id, data, length, name) != B_OK)
+					errmsg << "Unable to add resource " << id << " of "
+						<< files[i] << "\n";
+			}
+		}
+		
+		if (targetRes.Sync() != B_OK)
+			errmsg << "Unable to write the resources of " << targetPath << "\n";
+	}
+	
+	STRACE(1, ("Resources for %s: %ld files\nErrors:%s\n", GetName(),
+		(long)files.size(), errmsg.String()));
+	
+	if (errmsg.Length() > 0)
+		printf("Resource errors: %s\n", errmsg.String());
+}
+
+
+void
+Project::SaveResourceState(void)
+{
+	// The target's time and size are taken once the resources and the
+	// attributes are in it
+	struct stat s;
+	if (stat(GetLinkTargetPath().String(), &s) != 0)
+		return;
+	
+	BString state;
+	state << "TARGET=" << (int64)s.st_mtime << "|" << (int64)s.st_size << "\n"
+		<< fResourceState;
+	
+	DPath statePath(fBuildInfo.objectFolder);
+	statePath.Append("(Resources).state");
+	BFile file(statePath.GetFullPath(), B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
+	if (file.InitCheck() == B_OK)
+		file.Write(state.String(), state.Length());
 }
 
 
@@ -1106,6 +1662,10 @@ Project::ForceRebuild(void)
 		}
 	}
 	
+	// Rebuilding everything is when batching files together pays off
+	fUnity.RemoveObjects(fBuildInfo);
+	fUnityPending = fUnityBuild;
+	fChangesTracked = false;
 }
 
 
@@ -1765,6 +2325,56 @@ Project::FindLibrary(const char *libname)
 }
 
 
+void
+Project::OpenDependencyStore(void)
+{
+	BString projectFolder(fPath.GetFolder());
+	projectFolder << "/";
+
+	BString storePath(fPath.GetFolder());
+	storePath << "/(Dependencies." << GetName() << ")";
+
+	fDependencyStore.Open(storePath.String(), projectFolder.String());
+
+	for (int32 i = 0; i < CountGroups(); i++) {
+		SourceGroup* group = GroupAt(i);
+		for (int32 j = 0; j < group->filelist.CountItems(); j++) {
+			SourceFile* file = group->filelist.ItemAt(j);
+			const char* filePath = file->GetPath().GetFullPath();
+
+			std::vector<BString> deps;
+			if (fDependencyStore.GetDependencies(filePath, deps)) {
+				BString depstr;
+				for (size_t k = 0; k < deps.size(); k++) {
+					if (k > 0)
+						depstr << "|";
+					depstr << deps[k];
+				}
+				file->SetDependencies(depstr.String());
+				continue;
+			}
+
+			// Older projects kept their dependencies in DEPENDENCY entries
+			// in the project file. Move them over on the first load.
+			const std::vector<BString>& oldDeps = file->GetDependencyList();
+			if (oldDeps.empty())
+				continue;
+
+			for (size_t k = 0; k < oldDeps.size(); k++) {
+				BString dep(oldDeps[k]);
+				if (dep[0] != '/')
+					dep.Prepend(projectFolder);
+				deps.push_back(dep);
+			}
+
+			fDependencyStore.SetDependencies(filePath, deps);
+		}
+	}
+
+	fDependencyStore.Flush();
+}
+
+
 int
 PipeCommand(const char *command, BString &data)
 {
@@ -1842,3 +2452,28 @@ DetectPlatform(void)
 	
 	return type;
 }
+
+
+bool
+LinkerInstalled(const char *name)
+{
+	// The compiler runs ld.<name>, which it finds through the PATH
+	BString paths(getenv("PATH"));
+	int32 start = 0;
+	while (start <= paths.Length()) {
+		int32 end = paths.FindFirst(":", start);
+		if (end < 0)
+			end = paths.Length();
+		
+		BString program;
+		paths.CopyInto(program, start, end - start);
+		if (program.Length() == 0)
+			program = ".";
+		program << "/ld." << name;
+		if (access(program.String(), X_OK) == 0)
+			return true;
+		
+		start = end + 1;
+	}
+	return false;
+}
@@ -21,9 +21,12 @@
 #include <Resources.h>
 
 #include "BuildInfo.h"
+#include "DependencyStore.h"
 #include "DPath.h"
 #include "ErrorParser.h"
 #include "ObjectList.h"
+#include "PrecompiledHeader.h"
+#include "UnityBuild.h"
 #include "ProjectPath.h"
 
 
@@ -93,6 +96,7 @@ public:
 			BString		MakeAbsolutePath(const char *path);
 			DPath		GetPath(void) const { return fPath; }
 			DPath		GetObjectPath(void) const { return fObjectPath; }
+			DependencyStore *	GetDependencyStore(void) { return &fDependencyStore; }
 			DPath		GetPathForFile(SourceFile *file);
 			bool		LocateFile(const char *name, BPath& outPath);
 
@@ -113,14 +117,39 @@ public:
 			bool		CheckNeedsBuild(SourceFile *file, bool check_deps = true);
 			void		UpdateBuildInfo(void);
 			BuildInfo *	GetBuildInfo(void) { return &fBuildInfo; }
-			void		PrecompileFile(SourceFile *file);
-			void		CompileFile(SourceFile *file);
+			void		PrecompileFile(SourceFile *file, BuildInfo &info);
+			void		CompileFile(SourceFile *file, BuildInfo &info);
+			BString		GetCompileOptions(void);
+			void		UpdatePrecompiledHeader(void);
+			void		CheckUnityBatches(void);
+			void		DropUnityBatch(SourceFile *file);
+			void		PrepareUnityBuild(void);
+			bool		IsInUnityBatch(SourceFile *file) const { return fUnity.Covers(file); }
+			int32		CountUnityUnits(void) const { return fUnity.CountUnits(); }
+			SourceFile *UnityUnitAt(int32 index) const { return fUnity.UnitAt(index); }
 			void		Link(void);
+			BString		GetLinkCommand(void);
+			BString		GetLinkResponse(void);
+			BString		GetLinkTargetPath(void);
+			void		GetLinkObjects(std::vector<BString> &objects);
+			bool		LinkInputsChanged(BString &reason);
+			void		SaveLinkState(void);
+			void		GetResourceFiles(std::vector<BString> &files);
+			bool		ResourcesChanged(BString &reason);
 			void		UpdateResources(void);
+			void		SaveResourceState(void);
 			int32		UpdateAttributes(void);
 			void		PostBuild(SourceFile *file);
 			void		ForceRebuild(void);
 			void		UpdateFileDependencies(SourceFile* file);
+			void		FileChanged(const char *path,
+									BObjectList<SourceFile> &dirtied);
+			
+			// Set once every file which goes into the build is watched, so
+			// changes mark the files they affect as they happen and a build
+			// doesn't need to examine them first
+			void		SetChangesTracked(bool value) { fChangesTracked = value; }
+			bool		ChangesTracked(void) const { return fChangesTracked; }
 			
 			void		UpdateErrorList(const ErrorList &list);
 			ErrorList *	GetErrorList(void) const;
@@ -168,6 +197,37 @@ public:
 			void		SetOpForSize(bool value) { fOpSize = value; }
 			bool		OpForSize(void) const { return fOpSize; }
 			
+			void		SetAutoPCH(bool value) { fAutoPCH = value; }
+			bool		AutoPCH(void) const { return fAutoPCH; }
+			
+			void		SetUnityBuild(bool value) { fUnityBuild = value; }
+			bool		UsesUnityBuild(void) const { return fUnityBuild; }
+			
+			void		SetUnityBatchSize(int32 size) { fUnity.SetBatchSize(size); }
+			int32		UnityBatchSize(void) const { return fUnity.BatchSize(); }
+			
+			void		SetUnityExcluded(SourceFile *file, bool value);
+			bool		IsUnityExcluded(SourceFile *file);
+			
+			void		SetKeepGoing(bool value) { fKeepGoing = value; }
+			bool		KeepGoing(void) const { return fKeepGoing; }
+			
+			// The linker given to the compiler with -fuse-ld, like gold, lld
+			// or mold. The compiler's own choice is used when it is empty or
+			// the linker isn't installed.
+			void		SetLinker(const char *name) { fLinker = name; }
+			const char *Linker(void) const { return fLinker.String(); }
+			
+			// Debugging information is left in .dwo files next to the
+			// objects instead of being linked into the target
+			void		SetSplitDebug(bool value) { fSplitDebug = value; }
+			bool		SplitDebug(void) const { return fSplitDebug; }
+			
+			// A static library made as a thin archive only refers to the
+			// objects, so it can only be used where they are
+			void		SetThinArchive(bool value) { fThinArchive = value; }
+			bool		ThinArchive(void) const { return fThinArchive; }
+			
 			void		SetOpLevel(uint8 level);
 			uint8		OpLevel(void) const { return fOpLevel; }
 			
@@ -195,6 +255,7 @@ public:
 private:
 			void		ImportLibrary(const char *path, const platform_t &platform);
 			BString		FindLibrary(const char *name);
+			void		OpenDependencyStore(void);
 	
 	BString						fName,
 								fTargetName,
@@ -208,17 +269,32 @@ private:
 	
 	BObjectList<ProjectPath>	fLocalIncludeList;
 	BObjectList<BString>		fSystemIncludeList,
-								fAccessList;
+								fAccessList,
+								fUnityExcludeList;
 	
 	BObjectList<SourceGroup>	fGroupList;
 	ErrorList					*fErrorList;
 	
 	BuildInfo					fBuildInfo;
+	DependencyStore				fDependencyStore;
+	PrecompiledHeader			fPCH;
+	UnityBuild					fUnity;
+	BString						fLinkState;
+	std::vector<BString>		fArchiveMembers;
+	BString						fResourceState;
 	
 	bool		fReadOnly;
 	bool		fDebug;
 	bool		fProfile;
 	bool		fOpSize;
+	bool		fAutoPCH;
+	bool		fUnityBuild;
+	bool		fUnityPending;
+	bool		fKeepGoing;
+	bool		fSplitDebug;
+	bool		fThinArchive;
+	bool		fRebuildArchive;
+	bool		fChangesTracked;
 	uint8		fOpLevel;
 	int32		fTargetType;
 	platform_t	fPlatform;
@@ -226,12 +302,14 @@ private:
 	
 	BString		fExtraCompilerOptions;
 	BString		fExtraLinkerOptions;
+	BString		fLinker;
 };
 
 int			PipeCommand(const char *command, BString &data);
 bool		ResourceToAttribute(BFile &file, BResources &res,type_code code,
 								const char *name);
 platform_t	DetectPlatform(void);
+bool		LinkerInstalled(const char *name);
 
 
 #endif
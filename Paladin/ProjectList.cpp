@@ -322,6 +322,13 @@ ProjectList::ShowContextMenu(BPoint where)
 		menu.AddItem(new BMenuItem(openStr, message));
 		menu.AddItem(new BMenuItem(B_TRANSLATE("Force file rebuild"),
 			new BMessage(M_REBUILD_FILE)));
+		if (fProject->UsesUnityBuild()) {
+			BMenuItem* excludeItem = new BMenuItem(
+				B_TRANSLATE("Leave out of unity builds"),
+				new BMessage(M_TOGGLE_UNITY_EXCLUDE));
+			excludeItem->SetMarked(fProject->IsUnityExcluded(fileItem->GetData()));
+			menu.AddItem(excludeItem);
+		}
 		menu.AddSeparatorItem();
 		menu.AddItem(new BMenuItem(B_TRANSLATE("Remove selected files"),
 			new BMessage(M_REMOVE_FILES)));
@@ -38,6 +38,12 @@ enum {
 	M_TOGGLE_DEBUG			= 'tgdb',
 	M_TOGGLE_PROFILE		= 'tgpf',
 	M_TOGGLE_OPSIZE			= 'tgsi',
+	M_TOGGLE_AUTOPCH		= 'tgph',
+	M_TOGGLE_UNITY			= 'tgun',
+	M_TOGGLE_KEEP_GOING		= 'tgkg',
+	M_TOGGLE_SPLIT_DEBUG	= 'tgsd',
+	M_TOGGLE_THIN_ARCHIVE	= 'tgta',
+	M_SET_LINKER			= 'stlk',
 	M_SET_OP_VALUE			= 'sopv',
 	M_SET_TARGET_TYPE		= 'stgt',
 	M_TARGET_NAME_CHANGED	= 'tgnc',
@@ -134,6 +140,19 @@ ProjectSettingsWindow::ProjectSettingsWindow(BRect frame, Project* project)
 	if (item != NULL)
 		item->SetMarked(true);
 
+	fThinArchiveBox = new BCheckBox("thinarchivebox",
+		B_TRANSLATE("Only refer to the objects from the library"),
+		new BMessage(M_TOGGLE_THIN_ARCHIVE));
+	SetToolTip(fThinArchiveBox,
+		B_TRANSLATE("Check this to have the library point to the objects "
+		   "instead of holding copies of them. It can then only be used "
+		   "where the objects are, like by other projects in the same tree."));
+
+	if (fProject->ThinArchive())
+		fThinArchiveBox->SetValue(B_CONTROL_ON);
+	if (fProject->TargetType() != TARGET_STATIC_LIB)
+		fThinArchiveBox->SetEnabled(false);
+
 	fIncludeList = new IncludeList(fProject->GetPath().GetFolder());
 	SetToolTip(fIncludeList,
 		B_TRANSLATE("The folders you want Paladin to search for header files"));
@@ -177,6 +196,7 @@ ProjectSettingsWindow::ProjectSettingsWindow(BRect frame, Project* project)
 				.Add(fTypeField->CreateMenuBarLayoutItem())
 				.AddGlue()
 				.End()
+			.Add(fThinArchiveBox, 1, 2)
 			.End()
 		.AddStrut(B_USE_DEFAULT_SPACING)
 		.AddGroup(B_VERTICAL, 2.0f)
@@ -232,6 +252,19 @@ ProjectSettingsWindow::ProjectSettingsWindow(BRect frame, Project* project)
 	if (fProject->Debug())
 		fDebugBox->SetValue(B_CONTROL_ON);
 
+	fSplitDebugBox = new BCheckBox("splitdebugbox",
+		B_TRANSLATE("Keep debugging information out of the target"),
+		new BMessage(M_TOGGLE_SPLIT_DEBUG));
+	SetToolTip(fSplitDebugBox,
+		B_TRANSLATE("Check this to have the debugging information left in "
+		   "files next to the objects, which makes linking much faster. "
+		   "The target can only be debugged while they are there."));
+
+	if (fProject->SplitDebug())
+		fSplitDebugBox->SetValue(B_CONTROL_ON);
+	if (!fProject->Debug())
+		fSplitDebugBox->SetEnabled(false);
+
 	fProfileBox = new BCheckBox("profilebox", B_TRANSLATE("Build profiling information"),
 		new BMessage(M_TOGGLE_PROFILE));
 	SetToolTip(fProfileBox,
@@ -241,6 +274,61 @@ ProjectSettingsWindow::ProjectSettingsWindow(BRect frame, Project* project)
 	if (fProject->Profiling())
 		fProfileBox->SetValue(B_CONTROL_ON);
 
+	fAutoPCHBox = new BCheckBox("autopchbox",
+		B_TRANSLATE("Precompile commonly used system headers"),
+		new BMessage(M_TOGGLE_AUTOPCH));
+	SetToolTip(fAutoPCHBox,
+		B_TRANSLATE("Check this to have the system headers most of your "
+		   "source files include compiled only once per build. This speeds "
+		   "up building projects with many source files."));
+
+	if (fProject->AutoPCH())
+		fAutoPCHBox->SetValue(B_CONTROL_ON);
+
+	fUnityBox = new BCheckBox("unitybox",
+		B_TRANSLATE("Compile files in batches when rebuilding everything"),
+		new BMessage(M_TOGGLE_UNITY));
+	SetToolTip(fUnityBox,
+		B_TRANSLATE("Check this to have each group's source files compiled "
+		   "several at a time when the whole project is rebuilt. Files which "
+		   "don't work that way can be left out from the project list's "
+		   "context menu."));
+
+	if (fProject->UsesUnityBuild())
+		fUnityBox->SetValue(B_CONTROL_ON);
+
+	fKeepGoingBox = new BCheckBox("keepgoingbox",
+		B_TRANSLATE("Keep building after errors"),
+		new BMessage(M_TOGGLE_KEEP_GOING));
+	SetToolTip(fKeepGoingBox,
+		B_TRANSLATE("Check this to have the rest of the files compiled when "
+		   "one of them fails, so that all of the errors can be fixed at "
+		   "once. The project isn't linked until they all build."));
+
+	if (fProject->KeepGoing())
+		fKeepGoingBox->SetValue(B_CONTROL_ON);
+
+	// The names are what the compiler's -fuse-ld option takes
+	BPopUpMenu* linkerMenu = new BPopUpMenu(B_TRANSLATE("Linker"));
+	const char* linkers[] = { "", "bfd", "gold", "lld", "mold", NULL };
+	for (int32 i = 0; linkers[i] != NULL; i++) {
+		BMessage* linkerMessage = new BMessage(M_SET_LINKER);
+		linkerMessage->AddString("linker", linkers[i]);
+		BMenuItem* linkerItem = new BMenuItem(i == 0 ? B_TRANSLATE("Default")
+			: linkers[i], linkerMessage);
+		linkerMenu->AddItem(linkerItem);
+
+		if (strcmp(fProject->Linker(), linkers[i]) == 0)
+			linkerItem->SetMarked(true);
+		else if (i > 0 && !LinkerInstalled(linkers[i]))
+			linkerItem->SetEnabled(false);
+	}
+
+	fLinkerField = new BMenuField("linker", B_TRANSLATE("Linker:"), linkerMenu);
+	SetToolTip(fLinkerField, B_TRANSLATE("The linker used for your project. "
+		"The ones other than the default are usually much faster. Those "
+		"which aren't installed can't be chosen."));
+
 	fCompileText = new AutoTextControl("extracc", B_TRANSLATE("Extra compiler options:"),
 		fProject->ExtraCompilerOptions(), new BMessage(M_CCOPTS_CHANGED));
 	SetToolTip(fCompileText,
@@ -268,7 +356,16 @@ ProjectSettingsWindow::ProjectSettingsWindow(BRect frame, Project* project)
 				.Add(fOpSizeBox)
 				.AddStrut(B_USE_SMALL_SPACING)
 				.Add(fDebugBox)
+				.Add(fSplitDebugBox)
 				.Add(fProfileBox)
+				.Add(fAutoPCHBox)
+				.Add(fUnityBox)
+				.Add(fKeepGoingBox)
+				.End()
+			.Add(fLinkerField->CreateLabelLayoutItem(), 0, 3)
+			.AddGroup(B_HORIZONTAL, B_USE_DEFAULT_SPACING, 1, 3)
+				.Add(fLinkerField->CreateMenuBarLayoutItem())
+				.AddGlue()
 				.End()
 			.End()
 		.AddGlue()
@@ -296,6 +393,7 @@ ProjectSettingsWindow::ProjectSettingsWindow(BRect frame, Project* project)
 
 	targetTypeMenu->SetTargetForItems(this);
 	optimizationMenu->SetTargetForItems(this);
+	linkerMenu->SetTargetForItems(this);
 
 	fIncludeList->Select(0);
 	fTargetText->MakeFocus(true);
@@ -375,10 +473,12 @@ ProjectSettingsWindow::MessageReceived(BMessage* message)
 				fProject->SetDebug(true);
 				fOpField->SetEnabled(false);
 				fOpSizeBox->SetEnabled(false);
+				fSplitDebugBox->SetEnabled(true);
 			} else {
 				fProject->SetDebug(false);
 				fOpField->SetEnabled(true);
 				fOpSizeBox->SetEnabled(true);
+				fSplitDebugBox->SetEnabled(false);
 			}
 			fDirty = true;
 			break;
@@ -406,6 +506,71 @@ ProjectSettingsWindow::MessageReceived(BMessage* message)
 			break;
 		}
 
+		case M_TOGGLE_AUTOPCH:
+		{
+			if (fAutoPCHBox->Value() == B_CONTROL_ON)
+				fProject->SetAutoPCH(true);
+			else
+				fProject->SetAutoPCH(false);
+
+			fDirty = true;
+			break;
+		}
+
+		case M_TOGGLE_UNITY:
+		{
+			if (fUnityBox->Value() == B_CONTROL_ON)
+				fProject->SetUnityBuild(true);
+			else
+				fProject->SetUnityBuild(false);
+
+			fDirty = true;
+			break;
+		}
+
+		case M_TOGGLE_KEEP_GOING:
+		{
+			if (fKeepGoingBox->Value() == B_CONTROL_ON)
+				fProject->SetKeepGoing(true);
+			else
+				fProject->SetKeepGoing(false);
+
+			fDirty = true;
+			break;
+		}
+
+		case M_TOGGLE_SPLIT_DEBUG:
+		{
+			if (fSplitDebugBox->Value() == B_CONTROL_ON)
+				fProject->SetSplitDebug(true);
+			else
+				fProject->SetSplitDebug(false);
+
+			fDirty = true;
+			break;
+		}
+
+		case M_TOGGLE_THIN_ARCHIVE:
+		{
+			if (fThinArchiveBox->Value() == B_CONTROL_ON)
+				fProject->SetThinArchive(true);
+			else
+				fProject->SetThinArchive(false);
+
+			fDirty = true;
+			break;
+		}
+
+		case M_SET_LINKER:
+		{
+			BString linker;
+			if (message->FindString("linker", &linker) == B_OK)
+				fProject->SetLinker(linker.String());
+
+			fDirty = true;
+			break;
+		}
+
 		case M_SET_OP_VALUE:
 		{
 			BMenuItem *item = fOpField->Menu()->FindMarked();
@@ -422,6 +587,8 @@ ProjectSettingsWindow::MessageReceived(BMessage* message)
 			if (item)
 				fProject->SetTargetType(fTypeField->Menu()->IndexOf(item));
 
+			fThinArchiveBox->SetEnabled(
+				fProject->TargetType() == TARGET_STATIC_LIB);
 			fDirty = true;
 			break;
 		}
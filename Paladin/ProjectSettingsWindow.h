@@ -67,10 +67,16 @@ private:
 			AutoTextControl*	fTargetText;
 			RefListView*		fIncludeList;
 			BMenuField*			fTypeField;
+			BCheckBox*			fThinArchiveBox;
 
 	// Build Options
 			BCheckBox*			fDebugBox;
 			BCheckBox*			fProfileBox;
+			BCheckBox*			fAutoPCHBox;
+			BCheckBox*			fUnityBox;
+			BCheckBox*			fKeepGoingBox;
+			BCheckBox*			fSplitDebugBox;
+			BMenuField*			fLinkerField;
 
 			BMenuField*			fOpField;
 			BCheckBox*			fOpSizeBox;
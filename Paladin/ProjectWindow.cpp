@@ -28,6 +28,7 @@
 #include <LayoutBuilder.h>
 #include <Locale.h>
 #include <MenuItem.h>
+#include <MessageRunner.h>
 #include <Node.h>
 #include <OS.h>
 #include <Roster.h>
@@ -74,6 +75,7 @@
 #include "SCMOutputWindow.h"
 #include "Settings.h"
 #include "SourceFile.h"
+#include "StatCache.h"
 #include "VRegWindow.h"
 
 #undef B_TRANSLATION_CONTEXT
@@ -100,6 +102,7 @@ enum {
 	M_MAKE_MAKE					= 'mkmk',
 	M_SHOW_CODE_LIBRARY			= 'shcl',
 	M_SYNC_MODULES				= 'synm',
+	M_COMPILE_CHANGES			= 'cmch',
 
 	M_GET_CHECK_IN_MSG			= 'gcim',
 	M_CHECK_IN_PROJECT			= 'prci',
@@ -133,6 +136,9 @@ ProjectWindow::ProjectWindow(BRect frame, Project* project)
 	fShowingLibs(false),
 	fMenusLocked(false),
 	fBuilder(BMessenger(this)),
+	fCompileRunner(NULL),
+	fCompilingChanges(false),
+	fPendingBuild(-1),
 	fPrefsWindow(NULL),
 	fQuickFind(NULL),
 	fMonitorWindow(NULL)
@@ -262,6 +268,10 @@ ProjectWindow::ProjectWindow(BRect frame, Project* project)
 
 	if (gAutoSyncModules)
 		PostMessage(M_SYNC_MODULES);
+
+	// Changes to the project's files are passed on by the stat cache once
+	// their folders have been looked at by a build
+	gStatCache.AddListener(BMessenger(this));
 		
 	SetStatus(B_TRANSLATE("Project opened."));
 }
@@ -269,6 +279,9 @@ ProjectWindow::ProjectWindow(BRect frame, Project* project)
 
 ProjectWindow::~ProjectWindow()
 {
+	gStatCache.RemoveListener(BMessenger(this));
+	delete fCompileRunner;
+
 	if (gAutoSyncModules)
 		ProjectWindow::SyncThread(this);
 
@@ -512,6 +525,7 @@ ProjectWindow::MessageReceived(BMessage* message)
 		}
 
 		case M_REBUILD_FILE:
+		case M_TOGGLE_UNITY_EXCLUDE:
 		case M_ADD_SELECTION_TO_REPO:
 		case M_REMOVE_SELECTION_FROM_REPO:
 		case M_REVERT_SELECTION:
@@ -1238,6 +1252,11 @@ ProjectWindow::MessageReceived(BMessage* message)
 
 		case M_BUILD_FAILURE:
 			SetMenuLock(false);
+
+			// A build which was asked for in the meantime would only fail
+			// the same way
+			fCompilingChanges = false;
+			fPendingBuild = -1;
 			// fall-through
 		case M_BUILD_MESSAGES:
 		case M_BUILD_WARNINGS:
@@ -1266,18 +1285,43 @@ ProjectWindow::MessageReceived(BMessage* message)
 			}
 			SetStatus(B_TRANSLATE("Build had errors or warnings."));
 
-			// Should this be an Unflatten or an Append?
-			ErrorList* errorList = fProject->GetErrorList();
-			errorList->Unflatten(*message);
+			// Each message only holds what is new since the last one
+			ErrorList newErrors;
+			newErrors.Unflatten(*message);
+			fProject->GetErrorList()->Append(newErrors);
 			fErrorWindow->PostMessage(message);
 			break;
 		}
 
 		case M_BUILD_SUCCESS:
 		{
+			if (message->GetBool("compileonly", false)) {
+				fCompilingChanges = false;
+				SetStatus(B_TRANSLATE("Changes compiled."));
+
+				if (fPendingBuild >= 0) {
+					int32 postbuild = fPendingBuild;
+					fPendingBuild = -1;
+					DoBuild(postbuild);
+				}
+				break;
+			}
+
+			// The dependencies of everything which was compiled were
+			// recorded by the compiler, so there is nothing left to scan
 			SetMenuLock(false);
-			UpdateDependencies();
-			SetStatus(B_TRANSLATE("Build successful."));
+
+			int32 hits, misses;
+			if (message->FindInt32("cachehits", &hits) == B_OK
+				&& message->FindInt32("cachemisses", &misses) == B_OK
+				&& hits + misses > 0) {
+				BString status(B_TRANSLATE("Build successful. "
+					"%hits% of %count% files came from the object cache."));
+				status.ReplaceFirst("%hits%", BString() << hits);
+				status.ReplaceFirst("%count%", BString() << (hits + misses));
+				SetStatus(status.String());
+			} else
+				SetStatus(B_TRANSLATE("Build successful."));
 			break;
 		}
 
@@ -1287,6 +1331,20 @@ ProjectWindow::MessageReceived(BMessage* message)
 			break;
 		}
 
+		case M_WATCHED_FILES_CHANGED:
+		{
+			FilesChanged(message);
+			break;
+		}
+
+		case M_COMPILE_CHANGES:
+		{
+			delete fCompileRunner;
+			fCompileRunner = NULL;
+			CompileChanges();
+			break;
+		}
+
 		case M_SYNC_MODULES:
 		{
 #ifdef BUILD_CODE_LIBRARY
@@ -1614,6 +1672,7 @@ ProjectWindow::ActOnSelectedFiles(const int32& command)
 				case M_REBUILD_FILE:
 				{
 					if (file->UsesBuild()) {
+						fProject->DropUnityBatch(file);
 						file->RemoveObjects(*fProject->GetBuildInfo());
 						item->SetDisplayState(SFITEM_NEEDS_BUILD);
 						fProjectList->InvalidateItem(fProjectList->IndexOf(item));
@@ -1621,6 +1680,13 @@ ProjectWindow::ActOnSelectedFiles(const int32& command)
 					break;
 				}
 
+				case M_TOGGLE_UNITY_EXCLUDE:
+				{
+					fProject->SetUnityExcluded(file,
+						!fProject->IsUnityExcluded(file));
+					break;
+				}
+
 				case M_ADD_SELECTION_TO_REPO:
 				{
 					fSourceControl->AddToRepository(relPath.String());
@@ -1653,6 +1719,9 @@ ProjectWindow::ActOnSelectedFiles(const int32& command)
 			}
 		}
 	}
+
+	if (command == M_TOGGLE_UNITY_EXCLUDE)
+		fProject->Save();
 }
 
 
@@ -2054,7 +2123,19 @@ ProjectWindow::DoBuild(int32 postbuild)
 		}
 	}
 
-	SetStatus(B_TRANSLATE("Examining source files"));
+	// A compile of the latest changes is as far as the build would get at
+	// first, so it is left to finish
+	if (fCompilingChanges) {
+		fPendingBuild = postbuild;
+		SetMenuLock(true);
+		SetStatus(B_TRANSLATE("Waiting for changes to be compiled"));
+		return;
+	}
+
+	if (fProject->ChangesTracked())
+		SetStatus(B_TRANSLATE("Building"));
+	else
+		SetStatus(B_TRANSLATE("Examining source files"));
 	UpdateIfNeeded();
 
 	SetMenuLock(true);
@@ -2062,6 +2143,54 @@ ProjectWindow::DoBuild(int32 postbuild)
 }
 
 
+void
+ProjectWindow::FilesChanged(BMessage* message)
+{
+	BObjectList<SourceFile> dirtied(20, false);
+
+	fProject->Lock();
+	if (message->GetBool("lost", false))
+		fProject->SetChangesTracked(false);
+
+	const char* path;
+	for (int32 i = 0; message->FindString("path", i, &path) == B_OK; i++)
+		fProject->FileChanged(path, dirtied);
+	fProject->Unlock();
+
+	for (int32 i = 0; i < dirtied.CountItems(); i++) {
+		SourceFileItem* item = fProjectList->ItemForFile(dirtied.ItemAt(i));
+		if (item != NULL) {
+			item->SetDisplayState(SFITEM_NEEDS_BUILD);
+			fProjectList->InvalidateItem(fProjectList->IndexOf(item));
+		}
+	}
+
+	// Saving a file often shows up as several changes in a row, so the
+	// compile only starts once things have settled down
+	if (gCompileOnSave && dirtied.CountItems() > 0) {
+		delete fCompileRunner;
+		BMessage compile(M_COMPILE_CHANGES);
+		fCompileRunner = new BMessageRunner(BMessenger(this), &compile,
+			500000, 1);
+	}
+}
+
+
+void
+ProjectWindow::CompileChanges(void)
+{
+	// Anything the user started takes care of the changes anyway
+	if (fMenusLocked || fCompilingChanges || fBuilder.IsBuilding()
+		|| fProject->CountDirtyFiles() == 0)
+		return;
+
+	fCompilingChanges = true;
+	fBuildingFile = 0;
+	SetStatus(B_TRANSLATE("Compiling changes"));
+	fBuilder.CompileProject(fProject);
+}
+
+
 void
 ProjectWindow::AddNewFile(BString name, bool createPair)
 {
@@ -25,6 +25,7 @@
 #include "ProjectStatus.h"
 #include "ProjectSettingsWindow.h"
 
+class BMessageRunner;
 class ErrorWindow;
 class ProjectList;
 class Project;
@@ -73,6 +74,8 @@ private:
 			void				ToggleDebugMenu(void);
 
 			void				DoBuild(int32 postbuild);
+			void				FilesChanged(BMessage* message);
+			void				CompileChanges(void);
 			void				EnsureMonitorWindow(void);
 			void				AddNewFile(BString name, bool createPair);
 	static	int32				AddFileThread(void* data);
@@ -108,6 +111,9 @@ private:
 			add_file_struct		fImportStruct;
 			ProjectBuilder		fBuilder;
 			int32				fBuildingFile;
+			BMessageRunner*		fCompileRunner;
+			bool				fCompilingChanges;
+			int32				fPendingBuild;
 			
 			PrefsWindow*		fPrefsWindow;
 			QuickFindWindow*	fQuickFind;
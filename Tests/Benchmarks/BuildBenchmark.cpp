@@ -0,0 +1,504 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+
+// Times the parts of a build which are down to Paladin itself rather than to
+// the compiler: loading a project, scanning dependencies, examining the files
+// and the bookkeeping around building them. It works on made up projects of
+// any size and puts a stub in place of the compiler and linker which does
+// nothing but write the file it was asked for.
+//
+// Each project size gives one line of JSON, so the results of two revisions
+// can be compared with whatever tool is at hand.
+//
+//	BuildBenchmark --files 100,1000,10000 --label $(git rev-parse --short HEAD)
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include <Application.h>
+#include <Directory.h>
+#include <Entry.h>
+#include <File.h>
+#include <Looper.h>
+#include <Node.h>
+#include <OS.h>
+#include <Path.h>
+#include <String.h>
+
+#include "Globals.h"
+#include "Project.h"
+#include "ProjectBuilder.h"
+#include "ProjectGenerator.h"
+#include "SourceFile.h"
+#include "StatCache.h"
+
+typedef struct
+{
+	std::vector<int32>	fileCounts;
+	int32				headers;
+	int32				fanout;
+	int32				depth;
+	int32				groups;
+	int32				repeat;
+	int32				jobs;
+	BString				workFolder;
+	BString				label;
+	BString				outputPath;
+} benchmark_options;
+
+typedef struct
+{
+	bigtime_t	examine;
+	bigtime_t	total;
+	int32		compiled;
+	bool		success;
+} build_result;
+
+
+// Turns the messages a ProjectBuilder sends into something which can be
+// waited for
+class BuildWatcher : public BLooper
+{
+public:
+						BuildWatcher(void);
+						~BuildWatcher(void);
+
+			void		MessageReceived(BMessage *msg);
+
+			void		Reset(void);
+			uint32		Wait(void);
+			int32		CountCompiled(void) const { return fCompiled; }
+
+private:
+	sem_id				fDone;
+	uint32				fResult;
+	int32				fCompiled;
+};
+
+
+BuildWatcher::BuildWatcher(void)
+	:	BLooper("build watcher"),
+		fDone(create_sem(0,"build watcher done")),
+		fResult(0),
+		fCompiled(0)
+{
+}
+
+
+BuildWatcher::~BuildWatcher(void)
+{
+	delete_sem(fDone);
+}
+
+
+void
+BuildWatcher::MessageReceived(BMessage *msg)
+{
+	switch (msg->what)
+	{
+		case M_BUILDING_FILE:
+		{
+			fCompiled++;
+			break;
+		}
+		case M_BUILD_SUCCESS:
+		case M_BUILD_FAILURE:
+		case M_DEPENDENCIES_UPDATED:
+		{
+			fResult = msg->what;
+			release_sem(fDone);
+			break;
+		}
+		default:
+			BLooper::MessageReceived(msg);
+	}
+}
+
+
+void
+BuildWatcher::Reset(void)
+{
+	Lock();
+	fResult = 0;
+	fCompiled = 0;
+	Unlock();
+}
+
+
+uint32
+BuildWatcher::Wait(void)
+{
+	while (acquire_sem(fDone) == B_INTERRUPTED)
+		;
+
+	Lock();
+	uint32 result = fResult;
+	Unlock();
+	return result;
+}
+
+
+static status_t
+write_stub_tools(const char *folder)
+{
+	BString bin(folder);
+	bin << "/bin";
+	if (create_directory(bin.String(),0777) != B_OK)
+		return B_ERROR;
+
+	// Stands in for both the compiler and the linker
+	BString path(bin);
+	path << "/g++";
+	BFile file(path.String(),B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
+	if (file.InitCheck() != B_OK)
+		return file.InitCheck();
+
+	BString script(
+		"#!/bin/sh\n"
+		"out=\n"
+		"while [ $# -gt 0 ]; do\n"
+		"\tif [ \"$1\" = \"-o\" ]; then out=\"$2\"; shift; fi\n"
+		"\tshift\n"
+		"done\n"
+		"if [ -n \"$out\" ]; then echo \"stub $out\" > \"$out\"; fi\n"
+		"exit 0\n");
+	if (file.Write(script.String(),script.Length()) != script.Length())
+		return B_IO_ERROR;
+	file.SetPermissions(0755);
+
+	BString searchPath(bin);
+	const char *oldPath = getenv("PATH");
+	if (oldPath)
+		searchPath << ":" << oldPath;
+	setenv("PATH",searchPath.String(),1);
+	return B_OK;
+}
+
+
+static void
+age_objects(const char *folder, time_t age)
+{
+	// Puts the objects back in time so that a header touched afterwards is
+	// newer than they are
+	BDirectory dir(folder);
+	time_t then = time(NULL) - age;
+	BEntry entry;
+	while (dir.GetNextEntry(&entry) == B_OK)
+	{
+		BNode node(&entry);
+		if (node.InitCheck() == B_OK)
+			node.SetModificationTime(then);
+
+		// The node monitor would tell the stat cache about it, but maybe
+		// not before the next build has started
+		BPath path;
+		if (entry.GetPath(&path) == B_OK)
+			gStatCache.Update(path.Path());
+	}
+}
+
+
+static build_result
+time_build(ProjectBuilder &builder, BuildWatcher &watcher, Project *proj)
+{
+	build_result result;
+	watcher.Reset();
+
+	bigtime_t start = system_time();
+	builder.BuildProject(proj,POSTBUILD_NOTHING);
+	result.examine = system_time() - start;
+
+	result.success = watcher.Wait() == M_BUILD_SUCCESS;
+	result.total = system_time() - start;
+
+	// The messages about each file come before the one which ends the build
+	watcher.Lock();
+	result.compiled = watcher.CountCompiled();
+	watcher.Unlock();
+
+	return result;
+}
+
+
+static void
+write_times(BString &out, const char *name, std::vector<bigtime_t> times)
+{
+	if (times.empty())
+		return;
+
+	std::sort(times.begin(),times.end());
+	out << ", \"" << name << "\": {\"min\": " << times.front()
+		<< ", \"median\": " << times[times.size() / 2]
+		<< ", \"max\": " << times.back() << "}";
+}
+
+
+static status_t
+run_benchmark(const benchmark_options &options, int32 fileCount,
+			BString &out)
+{
+	generator_options generator;
+	generator.files = fileCount;
+	generator.headers = options.headers > 0 ? options.headers
+						: std::max(fileCount / 10,options.depth);
+	generator.fanout = options.fanout;
+	generator.depth = options.depth;
+	generator.groups = std::min(options.groups,fileCount);
+
+	BString folder(options.workFolder);
+	folder << "/files" << fileCount;
+
+	bigtime_t start = system_time();
+	BString projectPath;
+	status_t status = GenerateProject(folder.String(),generator,projectPath);
+	if (status != B_OK)
+	{
+		fprintf(stderr,"Couldn't generate a project in %s: %s\n",
+				folder.String(),strerror(status));
+		return status;
+	}
+	bigtime_t generateTime = system_time() - start;
+
+	std::vector<bigtime_t> loadTimes;
+	Project *proj = NULL;
+	for (int32 i = 0; i < options.repeat; i++)
+	{
+		delete proj;
+		proj = new Project;
+
+		start = system_time();
+		status = proj->Load(projectPath.String());
+		loadTimes.push_back(system_time() - start);
+
+		if (status != B_OK)
+		{
+			fprintf(stderr,"Couldn't load %s: %s\n",projectPath.String(),
+					strerror(status));
+			delete proj;
+			return status;
+		}
+	}
+
+	BuildWatcher *watcher = new BuildWatcher;
+	watcher->Run();
+	ProjectBuilder builder((BMessenger(watcher)));
+
+	std::vector<bigtime_t> dependencyTimes;
+	for (int32 i = 0; i < options.repeat; i++)
+	{
+		watcher->Reset();
+		start = system_time();
+		builder.UpdateDependencies(proj);
+		watcher->Wait();
+		dependencyTimes.push_back(system_time() - start);
+	}
+
+	build_result full = time_build(builder,*watcher,proj);
+
+	std::vector<bigtime_t> noopExamine, noopTotal;
+	build_result noop = full;
+	for (int32 i = 0; i < options.repeat; i++)
+	{
+		noop = time_build(builder,*watcher,proj);
+		noopExamine.push_back(noop.examine);
+		noopTotal.push_back(noop.total);
+	}
+
+	// A header on the bottom level, so that the change goes through as many
+	// levels of includes as there are
+	BString header = HeaderPath(folder.String(),generator.depth - 1,0);
+	std::vector<bigtime_t> touchExamine, touchTotal;
+	build_result touch = full;
+	for (int32 i = 0; i < options.repeat; i++)
+	{
+		age_objects(proj->GetObjectPath().GetFullPath(),60 * 60);
+		TouchFile(header.String(),i);
+		gStatCache.Update(header.String());
+
+		// This is what the project window does when the node monitor reports
+		// the change. Once every file is watched, the build relies on it.
+		BObjectList<SourceFile> dirtied(20,false);
+		proj->Lock();
+		proj->FileChanged(header.String(),dirtied);
+		proj->Unlock();
+
+		touch = time_build(builder,*watcher,proj);
+		touchExamine.push_back(touch.examine);
+		touchTotal.push_back(touch.total);
+	}
+
+	bool tracked = proj->ChangesTracked();
+
+	watcher->Lock();
+	watcher->Quit();
+	delete proj;
+
+	out << "{\"label\": \"" << options.label << "\""
+		<< ", \"files\": " << generator.files
+		<< ", \"headers\": " << generator.headers
+		<< ", \"fanout\": " << generator.fanout
+		<< ", \"depth\": " << generator.depth
+		<< ", \"groups\": " << generator.groups
+		<< ", \"jobs\": " << (int32)gCPUCount
+		<< ", \"repeat\": " << options.repeat
+		<< ", \"tracked\": " << (tracked ? "true" : "false")
+		<< ", \"generate_us\": " << generateTime;
+	write_times(out,"load_us",loadTimes);
+	write_times(out,"dependencies_us",dependencyTimes);
+	out << ", \"full_build\": {\"examine_us\": " << full.examine
+		<< ", \"total_us\": " << full.total
+		<< ", \"compiled\": " << full.compiled
+		<< ", \"success\": " << (full.success ? "true" : "false") << "}";
+	write_times(out,"noop_examine_us",noopExamine);
+	write_times(out,"noop_total_us",noopTotal);
+	out << ", \"noop_compiled\": " << noop.compiled;
+	write_times(out,"touch_examine_us",touchExamine);
+	write_times(out,"touch_total_us",touchTotal);
+	out << ", \"touch_compiled\": " << touch.compiled << "}\n";
+
+	return (full.success && noop.success && touch.success) ? B_OK : B_ERROR;
+}
+
+
+static void
+print_usage(void)
+{
+	printf("Usage: BuildBenchmark [options]\n"
+		"\t--files <n>[,<n>...]\tSource files in each project (default 100,1000)\n"
+		"\t--headers <n>\t\tHeaders in each project (default a tenth of the files)\n"
+		"\t--fanout <n>\t\tHeaders included by each file (default 8)\n"
+		"\t--depth <n>\t\tLevels of headers (default 3)\n"
+		"\t--groups <n>\t\tGroups the files are split into (default 10)\n"
+		"\t--repeat <n>\t\tHow often each step is timed (default 5)\n"
+		"\t--jobs <n>\t\tBuild threads (default one per CPU)\n"
+		"\t--work <folder>\t\tWhere the projects are made (default /tmp)\n"
+		"\t--label <text>\t\tName for this run, such as a revision\n"
+		"\t--output <file>\t\tAppend the results to a file instead of printing them\n");
+}
+
+
+int
+main(int argc, char **argv)
+{
+	benchmark_options options;
+	options.headers = 0;
+	options.fanout = 8;
+	options.depth = 3;
+	options.groups = 10;
+	options.repeat = 5;
+	options.jobs = 0;
+	options.workFolder = "/tmp";
+
+	BString files("100,1000");
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+		{
+			print_usage();
+			return 1;
+		}
+
+		const char *value = argv[i + 1];
+		if (strcmp(argv[i],"--files") == 0)
+			files = value;
+		else if (strcmp(argv[i],"--headers") == 0)
+			options.headers = atoi(value);
+		else if (strcmp(argv[i],"--fanout") == 0)
+			options.fanout = atoi(value);
+		else if (strcmp(argv[i],"--depth") == 0)
+			options.depth = atoi(value);
+		else if (strcmp(argv[i],"--groups") == 0)
+			options.groups = atoi(value);
+		else if (strcmp(argv[i],"--repeat") == 0)
+			options.repeat = atoi(value);
+		else if (strcmp(argv[i],"--jobs") == 0)
+			options.jobs = atoi(value);
+		else if (strcmp(argv[i],"--work") == 0)
+			options.workFolder = value;
+		else if (strcmp(argv[i],"--label") == 0)
+			options.label = value;
+		else if (strcmp(argv[i],"--output") == 0)
+			options.outputPath = value;
+		else
+		{
+			print_usage();
+			return 1;
+		}
+		i++;
+	}
+
+	for (const char *p = files.String(); *p; )
+	{
+		int32 count = atoi(p);
+		if (count > 0)
+			options.fileCounts.push_back(count);
+		p = strchr(p,',');
+		if (!p)
+			break;
+		p++;
+	}
+
+	if (options.fileCounts.empty() || options.repeat < 1 || options.depth < 1
+		|| options.groups < 1)
+	{
+		print_usage();
+		return 1;
+	}
+
+	BApplication app("application/x-vnd.dw-PaladinBenchmark");
+
+	// The benchmark stays clear of the user's settings so that runs on
+	// different machines are measured the same way
+	gBuildMode = true;
+	gPlatform = DetectPlatform();
+
+	system_info sysinfo;
+	get_system_info(&sysinfo);
+	gCPUCount = options.jobs > 0 ? options.jobs : sysinfo.cpu_count;
+	gStatCache.StartWatching();
+
+	options.workFolder << "/PaladinBenchmark-" << (int32)getpid();
+	if (create_directory(options.workFolder.String(),0777) != B_OK
+		|| write_stub_tools(options.workFolder.String()) != B_OK)
+	{
+		fprintf(stderr,"Couldn't set up %s\n",options.workFolder.String());
+		return 1;
+	}
+
+	int result = 0;
+	for (size_t i = 0; i < options.fileCounts.size(); i++)
+	{
+		BString line;
+		if (run_benchmark(options,options.fileCounts[i],line) != B_OK)
+			result = 1;
+
+		if (options.outputPath.Length() == 0)
+		{
+			printf("%s",line.String());
+			fflush(stdout);
+			continue;
+		}
+
+		BFile file(options.outputPath.String(),
+					B_WRITE_ONLY | B_CREATE_FILE | B_OPEN_AT_END);
+		if (file.InitCheck() != B_OK
+			|| file.Write(line.String(),line.Length()) != line.Length())
+		{
+			fprintf(stderr,"Couldn't write to %s\n",options.outputPath.String());
+			result = 1;
+		}
+	}
+
+	BString command("rm -rf '");
+	command << options.workFolder << "'";
+	system(command.String());
+
+	return result;
+}
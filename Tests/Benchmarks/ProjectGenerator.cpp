@@ -0,0 +1,156 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#include "ProjectGenerator.h"
+
+#include <time.h>
+
+#include <Directory.h>
+#include <File.h>
+
+// The files are made a day old, so that anything built from them afterwards
+// is newer than they are even within the same second
+static const time_t kFileAge = 24 * 60 * 60;
+
+
+static status_t
+write_file(const char *path, const BString &data)
+{
+	BFile file(path,B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE);
+	status_t status = file.InitCheck();
+	if (status != B_OK)
+		return status;
+
+	if (file.Write(data.String(),data.Length()) != data.Length())
+		return B_IO_ERROR;
+	return file.SetModificationTime(time(NULL) - kFileAge);
+}
+
+
+static int32
+pick_start(int32 index, int32 level, int32 count)
+{
+	// Knuth's multiplicative hash spreads the includes of neighbouring files
+	// over the whole level without any randomness
+	uint32 hash = (uint32)(index + 1) * 2654435761U + (uint32)level * 40503U;
+	return hash % count;
+}
+
+
+static void
+add_includes(BString &data, int32 index, int32 level,
+			const generator_options &options, int32 perLevel)
+{
+	int32 fanout = options.fanout < perLevel ? options.fanout : perLevel;
+	int32 start = pick_start(index,level,perLevel);
+	for (int32 i = 0; i < fanout; i++)
+		data << "#include \"l" << level << "_" << (start + i) % perLevel
+			<< ".h\"\n";
+}
+
+
+BString
+HeaderPath(const char *folder, int32 level, int32 index)
+{
+	BString path(folder);
+	path << "/include/l" << level << "_" << index << ".h";
+	return path;
+}
+
+
+status_t
+GenerateProject(const char *folder, const generator_options &options,
+				BString &projectPath)
+{
+	if (options.files < 1 || options.depth < 1 || options.groups < 1)
+		return B_BAD_VALUE;
+
+	int32 perLevel = options.headers / options.depth;
+	if (perLevel < 1)
+		perLevel = 1;
+
+	BString path(folder);
+	path << "/include";
+	status_t status = create_directory(path.String(),0777);
+	if (status != B_OK)
+		return status;
+
+	for (int32 level = 0; level < options.depth; level++)
+	{
+		for (int32 i = 0; i < perLevel; i++)
+		{
+			BString guard;
+			guard << "L" << level << "_" << i << "_H";
+
+			BString data;
+			data << "#ifndef " << guard << "\n#define " << guard << "\n\n";
+			if (level + 1 < options.depth)
+				add_includes(data,i,level + 1,options,perLevel);
+			data << "\nint l" << level << "_" << i << "(void);\n\n#endif\n";
+
+			status = write_file(HeaderPath(folder,level,i).String(),data);
+			if (status != B_OK)
+				return status;
+		}
+	}
+
+	BString project;
+	project << "NAME=Synthetic\nTARGETNAME=Synthetic\nPLATFORM=HaikuGCC4\n"
+		<< "SCM=none\n";
+
+	int32 file = 0;
+	for (int32 group = 0; group < options.groups; group++)
+	{
+		BString groupFolder(folder);
+		groupFolder << "/group" << group;
+		status = create_directory(groupFolder.String(),0777);
+		if (status != B_OK)
+			return status;
+
+		project << "GROUP=Group " << group << "\nEXPANDGROUP=no\n";
+
+		int32 last = (int64)options.files * (group + 1) / options.groups;
+		for (; file < last; file++)
+		{
+			BString name;
+			name << "group" << group << "/file" << file << ".cpp";
+
+			BString data;
+			add_includes(data,file,0,options,perLevel);
+			data << "\nint\nfile" << file << "(void)\n{\n\treturn " << file
+				<< ";\n}\n";
+
+			BString sourcePath(folder);
+			sourcePath << "/" << name;
+			status = write_file(sourcePath.String(),data);
+			if (status != B_OK)
+				return status;
+
+			project << "SOURCEFILE=" << name << "\n";
+		}
+	}
+
+	project << "LOCALINCLUDE=.\nLOCALINCLUDE=include\nCCDEBUG=no\n"
+		<< "CCPROFILE=no\nCCOPSIZE=no\nCCOPLEVEL=0\nCCTARGETTYPE=0\n";
+
+	projectPath = folder;
+	projectPath << "/Synthetic.pld";
+	return write_file(projectPath.String(),project);
+}
+
+
+status_t
+TouchFile(const char *path, int32 serial)
+{
+	BFile file(path,B_WRITE_ONLY | B_OPEN_AT_END);
+	status_t status = file.InitCheck();
+	if (status != B_OK)
+		return status;
+
+	BString line;
+	line << "// touched " << serial << "\n";
+	if (file.Write(line.String(),line.Length()) != line.Length())
+		return B_IO_ERROR;
+	return B_OK;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2020 Haiku Inc.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef PROJECT_GENERATOR_H
+#define PROJECT_GENERATOR_H
+
+#include <String.h>
+
+typedef struct
+{
+	int32	files;		// Number of source files
+	int32	headers;	// Number of headers, spread over all include levels
+	int32	fanout;		// Headers included by each source and header
+	int32	depth;		// Number of levels of headers
+	int32	groups;		// Number of groups the sources are spread over
+} generator_options;
+
+// Writes out a made up project: sources which include headers which in turn
+// include headers further down, a .pld file listing all of the sources and
+// the folders to put them in. Which file includes which is picked the same
+// way every time, so the same options always give the same project.
+//
+// All of the files are dated a day back, so anything built from them is
+// clearly newer.
+//
+// Headers are called l<level>_<index>.h and live in the project's include
+// folder. The sources live in one folder per group.
+status_t	GenerateProject(const char *folder, const generator_options &options,
+							BString &projectPath);
+
+// Returns the path of a header on the given level
+BString		HeaderPath(const char *folder, int32 level, int32 index);
+
+// Adds a line to a file, which is a real change as far as the build is
+// concerned, both by the clock and by its contents
+status_t	TouchFile(const char *path, int32 serial);
+
+#endif
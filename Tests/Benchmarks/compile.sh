@@ -0,0 +1,13 @@
+#!/bin/sh
+
+echo "Assembling Paladin as a static library"
+cd ../../Paladin/objects.*-release
+ar rvs paladin.a *.o
+
+echo "Compiling and linking the benchmark against Paladin static library"
+cd ../../Tests/Benchmarks
+g++ BuildBenchmark.cpp \
+	ProjectGenerator.cpp \
+	../../Paladin/objects*/paladin.a -o ./BuildBenchmark -O2 -Wall -I../../Paladin -I../../Paladin/SourceControl -I../../Paladin/BuildSystem -I../../Paladin/ThirdParty -I../../Paladin/PreviewFeatures -lbe -llocalestub
+
+echo "Done. Now execute ./BuildBenchmark"
@@ -0,0 +1,168 @@
+#include <UnitTest++/UnitTest++.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <String.h>
+
+#include "DependencyStore.h"
+#include "Project.h"
+
+static void
+WriteFile(const BString &path, const char *data, size_t length)
+{
+	int fd = open(path.String(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+	write(fd,data,length);
+	close(fd);
+}
+
+static BString
+Join(const char *folder, const char *name)
+{
+	BString path(folder);
+	path << "/" << name;
+	return path;
+}
+
+SUITE(DependencyStore)
+{
+
+	TEST(RoundTrip)
+	{
+		char folder[] = "/tmp/DependencyStoreTests-XXXXXX";
+		CHECK(mkdtemp(folder) != NULL);
+
+		BString storePath = Join(folder,"(Dependencies.Test)");
+		BString source = Join(folder,"a.cpp");
+		BString localHeader = Join(folder,"a.h");
+
+		std::vector<BString> deps;
+		deps.push_back(localHeader);
+		deps.push_back("/boot/system/develop/headers/os/app/Looper.h");
+
+		{
+			DependencyStore store;
+			CHECK_EQUAL(B_OK,store.Open(storePath.String(),folder));
+			CHECK(!store.HasDependencies(source.String()));
+
+			// Pending changes are seen before they are written out
+			store.SetDependencies(source.String(),deps);
+			CHECK(store.HasDependencies(source.String()));
+			CHECK_EQUAL(B_OK,store.Flush());
+		}
+
+		// A new store reads everything back out of the mapping
+		DependencyStore store;
+		CHECK_EQUAL(B_OK,store.Open(storePath.String(),folder));
+
+		std::vector<BString> out;
+		CHECK(store.GetDependencies(source.String(),out));
+		CHECK_EQUAL(2,out.size());
+		CHECK_EQUAL(localHeader.String(),out[0].String());
+		CHECK_EQUAL(deps[1].String(),out[1].String());
+
+		std::vector<BString> dependents;
+		store.GetDependents(localHeader.String(),dependents);
+		CHECK_EQUAL(1,dependents.size());
+		CHECK_EQUAL(source.String(),dependents[0].String());
+
+		// Headers are only known as dependencies, not as having any
+		out.clear();
+		CHECK(!store.HasDependencies(localHeader.String()));
+		CHECK(!store.GetDependencies(localHeader.String(),out));
+
+		store.Close();
+		unlink(storePath.String());
+		rmdir(folder);
+	}
+
+	TEST(CorruptStore)
+	{
+		char folder[] = "/tmp/DependencyStoreTests-XXXXXX";
+		CHECK(mkdtemp(folder) != NULL);
+
+		BString storePath = Join(folder,"(Dependencies.Test)");
+		BString source = Join(folder,"a.cpp");
+
+		std::vector<BString> deps;
+		deps.push_back(Join(folder,"a.h"));
+		{
+			DependencyStore store;
+			store.Open(storePath.String(),folder);
+			store.SetDependencies(source.String(),deps);
+			store.Flush();
+		}
+
+		// A store cut short is ignored instead of being read past its end
+		struct stat s;
+		CHECK_EQUAL(0,stat(storePath.String(),&s));
+		CHECK_EQUAL(0,truncate(storePath.String(),s.st_size / 2));
+		{
+			DependencyStore store;
+			CHECK_EQUAL(B_OK,store.Open(storePath.String(),folder));
+			CHECK(!store.HasDependencies(source.String()));
+		}
+
+		// So is one which isn't a store at all
+		const char garbage[] = "This is not a dependency store, but it is long "
+			"enough to be taken for the header of one";
+		WriteFile(storePath,garbage,sizeof(garbage));
+		{
+			DependencyStore store;
+			CHECK_EQUAL(B_OK,store.Open(storePath.String(),folder));
+			CHECK(!store.HasDependencies(source.String()));
+
+			// and it is replaced on the next write
+			store.SetDependencies(source.String(),deps);
+			CHECK_EQUAL(B_OK,store.Flush());
+		}
+		{
+			DependencyStore store;
+			store.Open(storePath.String(),folder);
+			CHECK(store.HasDependencies(source.String()));
+		}
+
+		unlink(storePath.String());
+		rmdir(folder);
+	}
+
+	TEST(MigratesProjectDependencies)
+	{
+		char folder[] = "/tmp/DependencyStoreTests-XXXXXX";
+		CHECK(mkdtemp(folder) != NULL);
+
+		// Older projects kept the dependencies in the project file
+		BString projectPath = Join(folder,"Old.pld");
+		BString header = Join(folder,"b.h");
+		BString text("NAME=Old\nTARGETNAME=Old\nSOURCEFILE=a.cpp\n"
+			"DEPENDENCY=a.h|");
+		text << header << "\n";
+		WriteFile(projectPath,text.String(),text.Length());
+
+		BString source = Join(folder,"a.cpp");
+		BString storePath;
+		{
+			Project project;
+			CHECK_EQUAL(B_OK,project.Load(projectPath.String()));
+			storePath = project.GetDependencyStore()->GetStorePath();
+		}
+
+		// They end up in the store, with relative ones taken to be in the
+		// project folder
+		DependencyStore store;
+		CHECK_EQUAL(B_OK,store.Open(storePath.String(),folder));
+
+		std::vector<BString> out;
+		CHECK(store.GetDependencies(source.String(),out));
+		CHECK_EQUAL(2,out.size());
+		CHECK_EQUAL(Join(folder,"a.h").String(),out[0].String());
+		CHECK_EQUAL(header.String(),out[1].String());
+		store.Close();
+
+		unlink(storePath.String());
+		unlink(projectPath.String());
+		rmdir(folder);
+	}
+}
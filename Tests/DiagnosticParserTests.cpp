@@ -0,0 +1,105 @@
+#include <UnitTest++/UnitTest++.h>
+
+#include <string.h>
+
+#include "DiagnosticParser.h"
+
+static const char *kGCCOutput =
+	"main.cpp: In function 'int main()':\n"
+	"main.cpp:12:5: error: 'foo' was not declared in this scope\n"
+	"main.cpp:20: warning: unused variable 'x'\n"
+	"main.cpp:21:3: note: declared here\n";
+
+SUITE(DiagnosticParser)
+{
+
+	TEST(GCCText)
+	{
+		ErrorList list;
+		ParseGCCErrors(kGCCOutput,list);
+		CHECK_EQUAL(4,list.msglist.CountItems());
+
+		error_msg *msg = list.msglist.ItemAt(1);
+		CHECK_EQUAL("main.cpp",msg->path.String());
+		CHECK_EQUAL(12,msg->line);
+		CHECK_EQUAL(5,msg->column);
+		CHECK_EQUAL("error: 'foo' was not declared in this scope",
+					msg->error.String());
+		CHECK_EQUAL(ERROR_ERROR,msg->type);
+
+		msg = list.msglist.ItemAt(2);
+		CHECK_EQUAL(20,msg->line);
+		CHECK_EQUAL(-1,msg->column);
+		CHECK_EQUAL(ERROR_WARNING,msg->type);
+
+		CHECK_EQUAL(ERROR_NOTE,list.msglist.ItemAt(0)->type);
+		CHECK_EQUAL(ERROR_WARNING,list.msglist.ItemAt(3)->type);
+	}
+
+	TEST(SplitChunks)
+	{
+		// Feeding the output a byte at a time gives the same records
+		ErrorList list;
+		DiagnosticParser parser(list);
+		for (size_t i = 0; i < strlen(kGCCOutput); i++)
+			parser.Feed(kGCCOutput + i,1);
+		parser.Finish();
+
+		ErrorList expected;
+		ParseGCCErrors(kGCCOutput,expected);
+		CHECK_EQUAL(expected.AsString().String(),list.AsString().String());
+		CHECK_EQUAL(12,list.msglist.ItemAt(1)->line);
+	}
+
+	TEST(LinkerText)
+	{
+		ErrorList list;
+		ParseLDErrors("main.o: In function `main':\n"
+			"main.cpp:(.text+0x5): undefined reference to `foo()'\n",list);
+		CHECK_EQUAL(2,list.msglist.CountItems());
+		CHECK_EQUAL("main.o",list.msglist.ItemAt(0)->path.String());
+		CHECK_EQUAL(ERROR_NOTE,list.msglist.ItemAt(0)->type);
+		CHECK_EQUAL(ERROR_ERROR,list.msglist.ItemAt(1)->type);
+		CHECK_EQUAL(-1,list.msglist.ItemAt(1)->line);
+	}
+
+	TEST(GCCJSON)
+	{
+		const char *json =
+			"[{\"kind\": \"error\", \"message\": \"expected \\u2018;\\u2019\","
+			" \"children\": [{\"kind\": \"note\", \"message\": \"here\","
+			" \"locations\": [{\"caret\": {\"file\": \"a.h\", \"line\": 3,"
+			" \"column\": 1}}]}],"
+			" \"locations\": [{\"caret\": {\"file\": \"main.cpp\", \"line\": 7,"
+			" \"column\": 14}, \"finish\": {\"line\": 7, \"column\": 15}}]},"
+			" {\"kind\": \"warning\", \"message\": \"x\", \"locations\": []}]\n";
+
+		// Split in the middle of a string and of a number
+		ErrorList list;
+		DiagnosticParser parser(list);
+		parser.Feed(json,40);
+		parser.Feed(json + 40,150);
+		parser.Feed(json + 190,strlen(json) - 190);
+		parser.Finish();
+
+		CHECK_EQUAL(3,list.msglist.CountItems());
+		error_msg *msg = list.msglist.ItemAt(0);
+		CHECK_EQUAL(ERROR_ERROR,msg->type);
+		CHECK_EQUAL("main.cpp",msg->path.String());
+		CHECK_EQUAL(7,msg->line);
+		CHECK_EQUAL(14,msg->column);
+		CHECK_EQUAL("main.cpp:7:14: error: expected \xe2\x80\x98;\xe2\x80\x99",
+					msg->rawdata.String());
+
+		msg = list.msglist.ItemAt(1);
+		CHECK_EQUAL(ERROR_NOTE,msg->type);
+		CHECK_EQUAL("a.h",msg->path.String());
+		CHECK_EQUAL(3,msg->line);
+
+		msg = list.msglist.ItemAt(2);
+		CHECK_EQUAL(ERROR_WARNING,msg->type);
+		CHECK_EQUAL(-1,msg->line);
+		CHECK_EQUAL("warning: x",msg->rawdata.String());
+	}
+
+}
@@ -0,0 +1,94 @@
+#include <UnitTest++/UnitTest++.h>
+
+#include <string.h>
+
+#include "IncludeScanner.h"
+
+static include_record
+Parse(const char *text)
+{
+	include_record record;
+	IncludeScanner::ParseIncludes(text,strlen(text),record);
+	return record;
+}
+
+SUITE(IncludeScanner)
+{
+
+	TEST(Directives)
+	{
+		include_record record = Parse(
+			"#include \"local.h\"\n"
+			"  #  include <sys/types.h>\n"
+			"#include_next <next.h>\n"
+			"#include MACRO_HEADER\n");
+		CHECK_EQUAL(3,record.directives.size());
+		CHECK_EQUAL("local.h",record.directives[0].name.String());
+		CHECK(record.directives[0].quoted);
+		CHECK_EQUAL("sys/types.h",record.directives[1].name.String());
+		CHECK(!record.directives[1].quoted);
+		CHECK_EQUAL("next.h",record.directives[2].name.String());
+	}
+
+	TEST(LeadingIncludes)
+	{
+		include_record record = Parse(
+			"// comment\n"
+			"#include <stdio.h>\n"
+			"#pragma mark -\n"
+			"#include <Window.h>\n"
+			"#define B_AVOID_TRANSLATION_MACROS\n"
+			"#include <Catalog.h>\n");
+		CHECK_EQUAL(3,record.directives.size());
+		CHECK(record.directives[0].leading);
+		CHECK(record.directives[1].leading);
+		CHECK(!record.directives[2].leading);
+
+		record = Parse("int x;\n#include <stdio.h>\n");
+		CHECK(!record.directives[0].leading);
+	}
+
+	TEST(CommentsAndStrings)
+	{
+		include_record record = Parse(
+			"// #include \"line.h\"\n"
+			"/* #include \"block.h\"\n"
+			"#include \"block2.h\" */\n"
+			"const char *s = \"#include <string.h>\";\n"
+			"const char *r = R\"x(\n#include \"raw.h\"\n)x\";\n"
+			"#include \\\n\t\"continued.h\"\n");
+		CHECK_EQUAL(1,record.directives.size());
+		CHECK_EQUAL("continued.h",record.directives[0].name.String());
+	}
+
+	TEST(NormalizePath)
+	{
+		CHECK_EQUAL("/a/c/d.h",IncludeScanner::NormalizePath("/a/b/../c/./d.h").String());
+		CHECK_EQUAL("/a/b",IncludeScanner::NormalizePath("/a//b/").String());
+		CHECK_EQUAL("../d.h",IncludeScanner::NormalizePath("../d.h").String());
+	}
+
+	TEST(MakeDependencies)
+	{
+		const char *text =
+			"/p/objects/a.o: /p/a.cpp /p/a.h \\\n"
+			" /p/my\\ folder/b.h /p/c:d.h\n"
+			"/p/a.h:\n";
+		std::vector<BString> deps;
+		IncludeScanner::ParseMakeDependencies(text,strlen(text),deps);
+		CHECK_EQUAL(4,deps.size());
+		CHECK_EQUAL("/p/a.cpp",deps[0].String());
+		CHECK_EQUAL("/p/a.h",deps[1].String());
+		CHECK_EQUAL("/p/my folder/b.h",deps[2].String());
+		CHECK_EQUAL("/p/c:d.h",deps[3].String());
+	}
+
+	TEST(IsHeader)
+	{
+		CHECK(IncludeScanner::IsHeader("/boot/home/project/Window.h"));
+		CHECK(IncludeScanner::IsHeader("vector.HPP"));
+		CHECK(!IncludeScanner::IsHeader("Window.cpp"));
+		CHECK(!IncludeScanner::IsHeader("dir.h/file"));
+	}
+
+}
@@ -0,0 +1,76 @@
+#include <UnitTest++/UnitTest++.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <String.h>
+
+#include "JobServer.h"
+
+SUITE(JobServer)
+{
+
+	TEST(UsesJobServerOfMake)
+	{
+		int fds[2];
+		CHECK(pipe(fds) == 0);
+		CHECK(write(fds[1],"+",1) == 1);
+
+		BString flags;
+		flags << " -j2 --jobserver-auth=" << fds[0] << "," << fds[1];
+		setenv("MAKEFLAGS",flags.String(),1);
+
+		JobServer server;
+		CHECK_EQUAL(B_OK,server.Init(8));
+		CHECK(server.IsClient());
+		CHECK_EQUAL(2,server.CountSlots());
+
+		// One job doesn't need a token, the other one takes the only one
+		int first, second, third;
+		CHECK(server.Acquire(first,0));
+		CHECK(server.Acquire(second,0));
+		CHECK_EQUAL('+',second);
+		CHECK(!server.Acquire(third,0));
+
+		server.Release(second);
+		CHECK(server.Acquire(third,0));
+		server.Release(third);
+		server.Release(first);
+
+		unsetenv("MAKEFLAGS");
+		close(fds[0]);
+		close(fds[1]);
+	}
+
+	TEST(OffersJobServer)
+	{
+		unsetenv("MAKEFLAGS");
+
+		JobServer server;
+		CHECK_EQUAL(B_OK,server.Init(3));
+		CHECK(!server.IsClient());
+		CHECK_EQUAL(3,server.CountSlots());
+		CHECK(getenv("MAKEFLAGS") != NULL
+			&& strstr(getenv("MAKEFLAGS"),"--jobserver-auth=") != NULL);
+
+		int tokens[4];
+		for (int i = 0; i < 3; i++)
+			CHECK(server.Acquire(tokens[i],0));
+		CHECK(!server.Acquire(tokens[3],0));
+		for (int i = 0; i < 3; i++)
+			server.Release(tokens[i]);
+
+		unsetenv("MAKEFLAGS");
+	}
+
+	TEST(CommandsUsingJobServer)
+	{
+		CHECK(JobServer::IsUsedBy("make -C src"));
+		CHECK(JobServer::IsUsedBy("cd build && /bin/make"));
+		CHECK(JobServer::IsUsedBy("g++ -flto=jobserver a.o b.o -o app"));
+		CHECK(!JobServer::IsUsedBy("g++ -c makefile_parser.cpp"));
+		CHECK(!JobServer::IsUsedBy("cmake ."));
+		CHECK(!JobServer::IsUsedBy(NULL));
+	}
+}
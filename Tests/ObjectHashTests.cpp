@@ -0,0 +1,103 @@
+#include <UnitTest++/UnitTest++.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <String.h>
+
+#include "ObjectHash.h"
+
+// Compiles the code in the same source file each time, so that the file
+// name in the objects doesn't differ
+static BString
+Compile(const char *folder, const char *code, const char *objectName)
+{
+	BString source(folder);
+	source << "/code.cpp";
+	int fd = open(source.String(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+	write(fd,code,strlen(code));
+	close(fd);
+
+	BString object(folder);
+	object << "/" << objectName;
+
+	BString command("g++ -c -g -O0 ");
+	command << source << " -o " << object;
+	if (system(command.String()) != 0)
+		return BString();
+	return object;
+}
+
+SUITE(ObjectHash)
+{
+
+	TEST(ChangedCode)
+	{
+		char folder[] = "/tmp/ObjectHashTests-XXXXXX";
+		CHECK(mkdtemp(folder) != NULL);
+
+		BString first = Compile(folder,"int f(int a) { return a + 1; }\n",
+			"first.o");
+		BString second = Compile(folder,"int f(int a) { return a + 2; }\n",
+			"second.o");
+		CHECK(first.Length() > 0 && second.Length() > 0);
+
+		uint64 firstHash, secondHash;
+		CHECK_EQUAL(B_OK,HashObjectCode(first.String(),&firstHash));
+		CHECK_EQUAL(B_OK,HashObjectCode(second.String(),&secondHash));
+		CHECK(firstHash != secondHash);
+
+		unlink(first.String());
+		unlink(second.String());
+		BString source(folder);
+		unlink((source << "/code.cpp").String());
+		rmdir(folder);
+	}
+
+	TEST(UnchangedCode)
+	{
+		char folder[] = "/tmp/ObjectHashTests-XXXXXX";
+		CHECK(mkdtemp(folder) != NULL);
+
+		// The comment moves the function down, which only changes the line
+		// numbers in the debugging information
+		BString first = Compile(folder,"int f(int a) { return a + 1; }\n",
+			"first.o");
+		BString second = Compile(folder,"// A comment\n\n"
+			"int f(int a) { return a + 1; }\n","second.o");
+		CHECK(first.Length() > 0 && second.Length() > 0);
+
+		uint64 firstHash, secondHash;
+		CHECK_EQUAL(B_OK,HashObjectCode(first.String(),&firstHash));
+		CHECK_EQUAL(B_OK,HashObjectCode(second.String(),&secondHash));
+		CHECK(firstHash == secondHash);
+
+		// A debugger would show the wrong lines, though
+		CHECK_EQUAL(B_OK,HashObjectCode(first.String(),&firstHash,true));
+		CHECK_EQUAL(B_OK,HashObjectCode(second.String(),&secondHash,true));
+		CHECK(firstHash != secondHash);
+
+		unlink(first.String());
+		unlink(second.String());
+		BString source(folder);
+		unlink((source << "/code.cpp").String());
+		rmdir(folder);
+	}
+
+	TEST(NotAnObject)
+	{
+		uint64 hash;
+		const char text[] = "This is not an ELF object, just some text which "
+			"is long enough to hold an ELF header";
+		CHECK_EQUAL(B_BAD_DATA,HashObjectCode(text,sizeof(text),&hash));
+
+		// Nor is something which is cut short after the magic
+		const char truncated[] = "\x7f" "ELF";
+		CHECK_EQUAL(B_BAD_DATA,HashObjectCode(truncated,sizeof(truncated),
+			&hash));
+
+		CHECK(HashObjectCode("/tmp/ObjectHashTests-missing.o",&hash) != B_OK);
+	}
+}
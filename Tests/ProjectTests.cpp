@@ -24,4 +24,14 @@ SUITE(Project)
 		CHECK_EQUAL(p.CountGroups(),0);
 		CHECK_EQUAL(p.GetRunArgs(),"");
 	}
+	
+	TEST(ChangesTracked)
+	{
+		Project p("Blank","");
+		CHECK(!p.ChangesTracked());
+		p.SetChangesTracked(true);
+		CHECK(p.ChangesTracked());
+		p.SetChangesTracked(false);
+		CHECK(!p.ChangesTracked());
+	}
 }
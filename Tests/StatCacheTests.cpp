@@ -0,0 +1,64 @@
+#include <UnitTest++/UnitTest++.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <String.h>
+
+#include "StatCache.h"
+
+static BString
+MakeFile(const BString &folder, const char *name)
+{
+	BString path(folder);
+	path << "/" << name;
+	close(open(path.String(),O_WRONLY | O_CREAT | O_TRUNC,0644));
+	return path;
+}
+
+SUITE(StatCache)
+{
+
+	TEST(ReadsWholeFolder)
+	{
+		char folder[] = "/tmp/StatCacheTests-XXXXXX";
+		CHECK(mkdtemp(folder) != NULL);
+
+		BString a = MakeFile(folder,"a.h");
+		StatCache cache;
+
+		struct stat s;
+		CHECK(cache.StatFor(a.String(),&s));
+		CHECK_EQUAL(0,s.st_size);
+		CHECK(!cache.IsWatched(a.String()));
+
+		// The folder was read along with a.h, so b.h is known not to be there
+		// without looking again. Nothing is watching the folder, so it takes
+		// an update to find out about a new file.
+		BString b(folder);
+		b << "/b.h";
+		CHECK(!cache.Exists(b.String()));
+		MakeFile(folder,"b.h");
+		CHECK(!cache.Exists(b.String()));
+		cache.Update(b.String());
+		CHECK(cache.Exists(b.String()));
+
+		// Unwatched folders are forgotten on a refresh
+		unlink(a.String());
+		CHECK(cache.Exists(a.String()));
+		cache.Refresh();
+		CHECK(!cache.Exists(a.String()));
+		CHECK(cache.Exists(b.String()));
+
+		unlink(b.String());
+		rmdir(folder);
+	}
+
+	TEST(MissingFolder)
+	{
+		StatCache cache;
+		CHECK(!cache.Exists("/tmp/StatCacheTests-missing/a.h"));
+		CHECK(cache.Exists("/tmp"));
+	}
+}
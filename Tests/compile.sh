@@ -9,7 +9,13 @@ cd ../../Tests
 g++ Main.cpp \
 	ProjectTests.cpp \
 	CompileCommandsJSONTests.cpp \
+	DependencyStoreTests.cpp \
 	CommandOutputHandlerTests.cpp \
+	DiagnosticParserTests.cpp \
+	IncludeScannerTests.cpp \
+	JobServerTests.cpp \
+	ObjectHashTests.cpp \
+	StatCacheTests.cpp \
 	../Paladin/objects*/paladin.a -o ./tests.o -Wall -lUnitTest++ -I../Paladin -I../Paladin/SourceControl -I../Paladin/BuildSystem -I../Paladin/ThirdParty -I../Paladin/PreviewFeatures -fprofile-arcs -ftest-coverage -lgcov -lbe -llocalestub
 
 echo "Done. Now execute ./tests.o"